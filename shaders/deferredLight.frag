@@ -0,0 +1,154 @@
+#version 430 core
+out vec4 FragColor;
+
+in vec2 TexCoords;
+
+uniform sampler2D gAlbedo;
+uniform sampler2D gNormal;
+uniform sampler2D gDepth;
+
+uniform mat4 inverseViewProjection;
+uniform mat4 view;
+
+struct DirLight {
+    vec3 direction;
+
+    vec3 ambient;
+    vec3 diffuse;
+    vec3 specular;
+    bool enabled;
+};
+uniform DirLight dirLight;
+
+// Cascaded shadow maps for dirLight (see CascadedShadowMaps)
+uniform bool uUseShadows;
+uniform sampler2DArrayShadow uShadowMap;
+uniform mat4 uCascadeMatrices[4];
+uniform vec4 uCascadeSplits;      // view-space far distance of each cascade
+uniform vec4 uCascadeTexelSizes;  // world-space size of one shadow texel
+
+// Same light buffers as the forward path, the cluster grid doubles as the tile light lists
+struct PunctualLight {
+    vec4 positionRange;
+    vec4 colorIntensity;
+    vec4 directionType;
+    vec4 spotCone;
+};
+layout (std430, binding = 4) readonly buffer PunctualLights {
+    PunctualLight punctualLights[];
+};
+layout (std430, binding = 5) readonly buffer ClusterGrid {
+    uvec2 clusterGrid[];
+};
+layout (std430, binding = 6) readonly buffer ClusterLightIndices {
+    uint clusterLightIndices[];
+};
+uniform bool uUseClusteredLights;
+uniform ivec3 uClusterDims;
+uniform float uClusterNear;
+uniform float uClusterFar;
+uniform vec2 uScreenSize;
+uniform int uDirectionalLightCount;
+
+vec3 decodeNormal(vec2 f)
+{
+    f = f * 2.0 - 1.0;
+    vec3 n = vec3(f.x, f.y, 1.0 - abs(f.x) - abs(f.y));
+    float t = clamp(-n.z, 0.0, 1.0);
+    n.x += n.x >= 0.0 ? -t : t;
+    n.y += n.y >= 0.0 ? -t : t;
+    return normalize(n);
+}
+
+float CalcShadow(vec3 fragPos, vec3 normal)
+{
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < 4 && viewDepth > uCascadeSplits[cascade])
+        cascade++;
+    if (cascade == 4)
+        return 1.0;
+
+    // Normal offset by about one texel hides most of the acne the polygon offset leaves
+    vec4 lightClip = uCascadeMatrices[cascade] * vec4(fragPos + normal * uCascadeTexelSizes[cascade] * 1.5, 1.0);
+    vec3 coords = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+    if (coords.z > 1.0)
+        return 1.0;
+
+    vec2 texelSize = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+    float shadow = 0.0;
+    for (int x = -1; x <= 1; x++)
+        for (int y = -1; y <= 1; y++)
+            shadow += texture(uShadowMap, vec4(coords.xy + vec2(x, y) * texelSize, float(cascade), coords.z));
+    return shadow / 9.0;
+}
+
+vec3 CalcPunctualLight(PunctualLight light, vec3 fragPos, vec3 normal, vec3 albedo)
+{
+    int type = int(light.directionType.w);
+    vec3 lightDir;
+    float attenuation = 1.0;
+    if (type == 2)
+    {
+        lightDir = normalize(-light.directionType.xyz);
+    }
+    else
+    {
+        vec3 toLight = light.positionRange.xyz - fragPos;
+        float distanceSq = max(dot(toLight, toLight), 0.0001);
+        lightDir = toLight * inversesqrt(distanceSq);
+        float ratio = distanceSq / (light.positionRange.w * light.positionRange.w);
+        float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+        attenuation = window * window / distanceSq;
+        if (type == 1)
+        {
+            float cd = dot(normalize(light.directionType.xyz), -lightDir);
+            attenuation *= smoothstep(light.spotCone.y, light.spotCone.x, cd);
+        }
+    }
+    float diff = max(dot(normal, lightDir), 0.0);
+    return light.colorIntensity.rgb * light.colorIntensity.w * attenuation * diff * albedo;
+}
+
+void main()
+{
+    float depth = texture(gDepth, TexCoords).r;
+    if (depth >= 1.0)
+    {
+        // background
+        FragColor = vec4(0.1, 0.1, 0.1, 1.0);
+        return;
+    }
+
+    vec4 clip = vec4(TexCoords * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    vec4 world = inverseViewProjection * clip;
+    vec3 fragPos = world.xyz / world.w;
+
+    vec3 albedo = texture(gAlbedo, TexCoords).rgb;
+    vec3 normal = decodeNormal(texture(gNormal, TexCoords).rg);
+
+    vec3 result = vec3(0.0);
+    if (dirLight.enabled)
+    {
+        vec3 lightDir = normalize(-dirLight.direction);
+        float diff = max(dot(normal, lightDir), 0.0);
+        float shadow = uUseShadows ? CalcShadow(fragPos, normal) : 1.0;
+        result = dirLight.ambient * albedo + dirLight.diffuse * diff * shadow * albedo;
+    }
+
+    if (uUseClusteredLights)
+    {
+        for (int i = 0; i < uDirectionalLightCount; i++)
+            result += CalcPunctualLight(punctualLights[i], fragPos, normal, albedo);
+
+        float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+        int slice = int(log(max(viewDepth, uClusterNear) / uClusterNear) / log(uClusterFar / uClusterNear) * float(uClusterDims.z));
+        ivec2 tile = ivec2(gl_FragCoord.xy / uScreenSize * vec2(uClusterDims.xy));
+        ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), uClusterDims - 1);
+        uvec2 range = clusterGrid[cluster.x + cluster.y * uClusterDims.x + cluster.z * uClusterDims.x * uClusterDims.y];
+        for (uint i = 0u; i < range.y; i++)
+            result += CalcPunctualLight(punctualLights[clusterLightIndices[range.x + i]], fragPos, normal, albedo);
+    }
+
+    FragColor = vec4(result, 1.0);
+}
@@ -0,0 +1,54 @@
+#version 430 core
+// G-buffer layout (see DeferredRenderer):
+//   0: RGBA8  albedo.rgb
+//   1: RG16   octahedral normal
+// Position is not stored, it is reconstructed from depth in the lighting pass.
+layout (location = 0) out vec4 gAlbedo;
+layout (location = 1) out vec2 gNormal;
+
+struct Material {
+    vec3 baseColor;
+    bool hasTexture;
+    sampler2D diffuse;
+    sampler2D normal;
+};
+
+in vec3 FragPos;
+in vec3 Normal;
+in vec2 TexCoords;
+
+uniform Material material;
+
+#include "virtualTexture.glsl"
+
+vec2 octWrap(vec2 v)
+{
+    return (1.0 - abs(v.yx)) * vec2(v.x >= 0.0 ? 1.0 : -1.0, v.y >= 0.0 ? 1.0 : -1.0);
+}
+
+vec2 encodeNormal(vec3 n)
+{
+    n /= (abs(n.x) + abs(n.y) + abs(n.z));
+    n.xy = n.z >= 0.0 ? n.xy : octWrap(n.xy);
+    return n.xy * 0.5 + 0.5;
+}
+
+void main()
+{
+    vec4 textureColour;
+    if (material.hasTexture)
+    {
+        textureColour = uVirtualTexture ? sampleVirtualTexture(TexCoords, vec4(material.baseColor, 1.0)) : texture(material.diffuse, TexCoords);
+    }
+    else
+    {
+        textureColour = vec4(material.baseColor, 1.0);
+    }
+    if (textureColour.a < 0.1)
+    {
+        discard;
+    }
+
+    gAlbedo = vec4(textureColour.rgb, 1.0);
+    gNormal = encodeNormal(normalize(Normal));
+}
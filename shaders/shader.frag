@@ -1,16 +1,33 @@
 
 
-#version 330 core
+#version 430 core
+// Variants (see Shader defines): ALPHA_OPAQUE, ALPHA_MASK, ALPHA_BLEND.
+// Without one, the legacy alpha < 0.1 discard is used for every material.
+//
+// ShaderPermutations also defines SHADER_PERMUTATION and sets every HAS_* feature to 0 or 1,
+// so the branches a material and frame don't need are compiled out. Without it this is the
+// uber shader, which decides each feature per draw from uniforms.
+#ifndef SHADER_PERMUTATION
+#define HAS_BASE_COLOR_MAP material.hasTexture
+#define HAS_VIRTUAL_TEXTURE uVirtualTexture
+#define HAS_NORMAL_MAP (useNormalTexture && material.hasNormalTexture)
+#define HAS_DIRECTIONAL_LIGHT dirLight.enabled
+#define HAS_CLUSTERED_LIGHTS uUseClusteredLights
+#define HAS_SHADOWS uUseShadows
+#endif
+#ifdef ALPHA_OPAQUE
+// The opaque variant never discards, so depth can be tested before shading
+layout (early_fragment_tests) in;
+#endif
 out vec4 FragColor;
 
 struct Material {
     vec3 baseColor;
     bool hasTexture;
+    bool hasNormalTexture;
     sampler2D diffuse;
     sampler2D normal;
-    sampler2D specular;    
-    float shininess;
-    sampler2D emission;
+    float alphaCutoff;
 }; 
 
 struct Light {
@@ -39,20 +56,36 @@ struct DirLight {
 };  
 uniform DirLight dirLight;
 
-struct PointLight {    
-    vec3 position;
-    
-    float constant;
-    float linear;
-    float quadratic;  
-
-    vec3 ambient;
-    vec3 diffuse;
-    vec3 specular;
-    bool enabled;
-};  
-#define NR_POINT_LIGHTS 4  
-uniform PointLight pointLights[NR_POINT_LIGHTS];
+// KHR_lights_punctual lights, binned into clusters on the CPU (see ClusteredLighting)
+struct PunctualLight {
+    vec4 positionRange;
+    vec4 colorIntensity;
+    vec4 directionType;
+    vec4 spotCone;
+};
+layout (std430, binding = 4) readonly buffer PunctualLights {
+    PunctualLight punctualLights[];
+};
+layout (std430, binding = 5) readonly buffer ClusterGrid {
+    uvec2 clusterGrid[];
+};
+layout (std430, binding = 6) readonly buffer ClusterLightIndices {
+    uint clusterLightIndices[];
+};
+uniform bool uUseClusteredLights;
+uniform ivec3 uClusterDims;
+uniform float uClusterNear;
+uniform float uClusterFar;
+uniform vec2 uScreenSize;
+uniform int uDirectionalLightCount;
+uniform mat4 view;
+
+// Cascaded shadow maps for dirLight (see CascadedShadowMaps)
+uniform bool uUseShadows;
+uniform sampler2DArrayShadow uShadowMap;
+uniform mat4 uCascadeMatrices[4];
+uniform vec4 uCascadeSplits;      // view-space far distance of each cascade
+uniform vec4 uCascadeTexelSizes;  // world-space size of one shadow texel
 
 struct SpotLight {
     vec3  position;
@@ -85,6 +118,8 @@ uniform Material material;
 uniform Light light;
 uniform bool useNormalTexture;
 
+#include "virtualTexture.glsl"
+
 
 float near = 0.5;
 float far = 100.0;
@@ -92,6 +127,8 @@ float far = 100.0;
 
 
 vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 textureColour);  
+float CalcShadow(vec3 fragPos, vec3 normal);
+vec3 CalcClusteredLights(vec3 normal, vec3 textureColour);
 
 
 
@@ -101,47 +138,50 @@ void main()
     vec3 viewDir = normalize(viewPos - FragPos);
 
     vec4 textureColour;
-    if(material.hasTexture)
+    if (HAS_BASE_COLOR_MAP)
     {
-        textureColour = texture(material.specular, TexCoords);
+        textureColour = HAS_VIRTUAL_TEXTURE ? sampleVirtualTexture(TexCoords, vec4(material.baseColor, 1.0)) : texture(material.diffuse, TexCoords);
     }
     else 
     {
         textureColour = vec4(material.baseColor, 1.0);
     }
-    if (textureColour.a < 0.1)
+#if defined(ALPHA_MASK)
+    if (textureColour.a < material.alphaCutoff)
     {
         discard;
     }
-    /*
-    vec3 normalColor = texture(material.normal, TexCoords).rgb;
-
-    vec3 N = normalize((normalColor * 2.0 - 1.0) * 10.0);
-
-    // Calculate TBN matrix
-    vec3 T = normalize(Tangent);
-    vec3 B = normalize(Bitangent);
-    vec3 N_world = normalize(Normal);
-    mat3 TBN = mat3(T, B, N_world);
-  
-    vec3 normal;
-    if(useNormalTexture)
+#elif !defined(ALPHA_OPAQUE) && !defined(ALPHA_BLEND)
+    if (textureColour.a < 0.1)
     {
-        normal = normalize(TBN * N);
+        discard;
     }
-    else
+#endif
+
+    vec3 norm = normalize(Normal);
+    // Primitives without tangents have none to build the basis from
+    if (HAS_NORMAL_MAP && dot(Tangent, Tangent) > 0.0)
     {
-        normal = normalize(N_world);
+        // z is rebuilt from xy, cooked normal maps are two channel BC5
+        vec2 xy = texture(material.normal, TexCoords).rg * 2.0 - 1.0;
+        vec3 tangentNormal = vec3(xy, sqrt(max(1.0 - dot(xy, xy), 0.0)));
+        mat3 TBN = mat3(normalize(Tangent), normalize(Bitangent), norm);
+        norm = normalize(TBN * tangentNormal);
     }
-    */
-    vec3 norm = normalize(Normal);
     vec3 result = vec3(0.0f);
     // phase 1: Directional lighting
-    if (dirLight.enabled)
+    if (HAS_DIRECTIONAL_LIGHT)
         result = CalcDirLight(dirLight, norm, viewDir, textureColour.rgb);
+    // phase 2: punctual lights of this fragment's cluster
+    if (HAS_CLUSTERED_LIGHTS)
+        result += CalcClusteredLights(norm, textureColour.rgb);
 
 
+#ifdef ALPHA_BLEND
+    FragColor = vec4(result.rgb, textureColour.a);
+#else
     FragColor = vec4(result.rgb, 1.0);
+#endif
 }
 
 
@@ -151,13 +191,77 @@ vec3 CalcDirLight(DirLight light, vec3 normal, vec3 viewDir, vec3 textureColour)
     vec3 lightDir = normalize(-light.direction);
     // diffuse shading
     float diff = max(dot(normal, lightDir), 0.0);
-    // specular shading
-    vec3 reflectDir = reflect(-lightDir, normal);
-    float spec = pow(max(dot(viewDir, reflectDir), 0.0), material.shininess);
     // combine results
     vec3 ambient  = light.ambient  * textureColour;
     vec3 diffuse  = light.diffuse  * diff * textureColour;
-    vec3 specular = light.specular * spec * vec3(texture(material.specular, TexCoords));
-    return (ambient + diffuse);
-}  
+    float shadow = HAS_SHADOWS ? CalcShadow(FragPos, normal) : 1.0;
+    return (ambient + diffuse * shadow);
+}
 
+float CalcShadow(vec3 fragPos, vec3 normal)
+{
+    float viewDepth = -(view * vec4(fragPos, 1.0)).z;
+    int cascade = 0;
+    while (cascade < 4 && viewDepth > uCascadeSplits[cascade])
+        cascade++;
+    if (cascade == 4)
+        return 1.0;
+
+    // Normal offset by about one texel hides most of the acne the polygon offset leaves
+    vec4 lightClip = uCascadeMatrices[cascade] * vec4(fragPos + normal * uCascadeTexelSizes[cascade] * 1.5, 1.0);
+    vec3 coords = lightClip.xyz / lightClip.w * 0.5 + 0.5;
+    if (coords.z > 1.0)
+        return 1.0;
+
+    vec2 texelSize = 1.0 / vec2(textureSize(uShadowMap, 0).xy);
+    float shadow = 0.0;
+    for (int x = -1; x <= 1; x++)
+        for (int y = -1; y <= 1; y++)
+            shadow += texture(uShadowMap, vec4(coords.xy + vec2(x, y) * texelSize, float(cascade), coords.z));
+    return shadow / 9.0;
+}
+
+vec3 CalcPunctualLight(PunctualLight light, vec3 normal, vec3 textureColour)
+{
+    int type = int(light.directionType.w);
+    vec3 lightDir;
+    float attenuation = 1.0;
+    if (type == 2)
+    {
+        lightDir = normalize(-light.directionType.xyz);
+    }
+    else
+    {
+        vec3 toLight = light.positionRange.xyz - FragPos;
+        float distanceSq = max(dot(toLight, toLight), 0.0001);
+        lightDir = toLight * inversesqrt(distanceSq);
+        // glTF recommended windowed inverse square falloff
+        float ratio = distanceSq / (light.positionRange.w * light.positionRange.w);
+        float window = clamp(1.0 - ratio * ratio, 0.0, 1.0);
+        attenuation = window * window / distanceSq;
+        if (type == 1)
+        {
+            float cd = dot(normalize(light.directionType.xyz), -lightDir);
+            attenuation *= smoothstep(light.spotCone.y, light.spotCone.x, cd);
+        }
+    }
+    float diff = max(dot(normal, lightDir), 0.0);
+    return light.colorIntensity.rgb * light.colorIntensity.w * attenuation * diff * textureColour;
+}
+
+vec3 CalcClusteredLights(vec3 normal, vec3 textureColour)
+{
+    vec3 result = vec3(0.0);
+    for (int i = 0; i < uDirectionalLightCount; i++)
+        result += CalcPunctualLight(punctualLights[i], normal, textureColour);
+
+    float viewDepth = -(view * vec4(FragPos, 1.0)).z;
+    int slice = int(log(max(viewDepth, uClusterNear) / uClusterNear) / log(uClusterFar / uClusterNear) * float(uClusterDims.z));
+    ivec2 tile = ivec2(gl_FragCoord.xy / uScreenSize * vec2(uClusterDims.xy));
+    ivec3 cluster = clamp(ivec3(tile, slice), ivec3(0), uClusterDims - 1);
+    uvec2 range = clusterGrid[cluster.x + cluster.y * uClusterDims.x + cluster.z * uClusterDims.x * uClusterDims.y];
+
+    for (uint i = 0u; i < range.y; i++)
+        result += CalcPunctualLight(punctualLights[clusterLightIndices[range.x + i]], normal, textureColour);
+    return result;
+}
@@ -1,6 +1,6 @@
 
 
-#version 330 core
+#version 430 core
 layout (location = 0) in vec3 aPos;
 layout (location = 1) in vec3 aNormal;
 layout (location = 2) in vec3 aTangent;
@@ -13,6 +13,8 @@ out vec3 Bitangent;
 out vec2 TexCoords;
 out vec3 TangentFragPos;
 out vec3 TangentViewPos;
+// must match depthOnly.vert bit for bit so the opaque pass can test GL_LEQUAL against the pre-pass depth
+invariant gl_Position;
 
 uniform mat4 model;
 uniform mat4 view;
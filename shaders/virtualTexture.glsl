@@ -0,0 +1,36 @@
+// Virtual texturing (see VirtualTextureSystem), shared by the passes that draw virtual textures
+uniform bool uVirtualTexture;
+uniform vec4 uVTRegion;     // xy offset, zw size of the texture's region in virtual UV
+uniform float uVTMaxMip;
+uniform vec4 uVTParams;     // virtual pages per side, page size, border, physical tiles per side
+uniform float uVTMipBias;
+uniform usampler2D uVTPageTable;
+uniform sampler2D uVTPhysical;
+
+// Mip level the virtual texel footprint of uv asks for
+float virtualTextureMip(vec2 uv)
+{
+    vec2 texel = uv * uVTRegion.zw * uVTParams.x * uVTParams.y;
+    vec2 dx = dFdx(texel);
+    vec2 dy = dFdy(texel);
+    return clamp(floor(0.5 * log2(max(max(dot(dx, dx), dot(dy, dy)), 1e-8)) + uVTMipBias), 0.0, uVTMaxMip);
+}
+
+// Translates the UV through the page table into the physical page cache. The page table
+// entry is the finest resident page covering the requested one, so a coarser mip is used
+// until the feedback pass has brought in the right one.
+vec4 sampleVirtualTexture(vec2 uv, vec4 fallback)
+{
+    float mip = virtualTextureMip(uv);
+    vec2 virtualUV = uVTRegion.xy + fract(uv) * uVTRegion.zw;
+    ivec2 page = ivec2(virtualUV * (uVTParams.x / exp2(mip)));
+    uvec4 entry = texelFetch(uVTPageTable, page, int(mip));
+    if (entry.a == 0u)
+    {
+        return fallback;
+    }
+    vec2 inPage = fract(virtualUV * (uVTParams.x / exp2(float(entry.b))));
+    float tileSize = uVTParams.y + 2.0 * uVTParams.z;
+    vec2 physicalUV = (vec2(entry.rg) * tileSize + uVTParams.z + inPage * uVTParams.y) / (uVTParams.w * tileSize);
+    return textureLod(uVTPhysical, physicalUV, 0.0);
+}
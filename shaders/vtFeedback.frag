@@ -0,0 +1,22 @@
+#version 430 core
+// Virtual texture feedback (see VirtualTextureSystem): the page each pixel would sample,
+// as level << 24 | y << 12 | x with bit 31 set. 0 where no virtual texture is drawn.
+layout (location = 0) out uint FeedbackPage;
+
+in vec2 TexCoords;
+
+#include "virtualTexture.glsl"
+
+void main()
+{
+    if (!uVirtualTexture)
+    {
+        FeedbackPage = 0u;
+        return;
+    }
+    float mip = virtualTextureMip(TexCoords);
+
+    vec2 virtualUV = uVTRegion.xy + fract(TexCoords) * uVTRegion.zw;
+    uvec2 page = uvec2(virtualUV * (uVTParams.x / exp2(mip)));
+    FeedbackPage = 0x80000000u | (uint(mip) << 24) | (page.y << 12) | page.x;
+}
@@ -1,58 +1,495 @@
 #include "pch.h"
 #include "assetManager.h"
+#include "mappedFile.h"
+#include "xxhash64.h"
+#include "profiler.h"
+#include <cgltf/cgltf.h>
 #include <thread>
 #include <format>
+#include <fstream>
+#include <cstring>
+#include <algorithm>
 
-std::unordered_map<std::string, fs::path> findModelFiles(const char* dir)
+namespace
 {
-	std::unordered_map<std::string, fs::path> gltf_files;
-	fs::path directorypath = dir;
-	try
+	const char INDEX_MAGIC[4] = { 'A', 'C', 'A', 'T' };
+	const uint32_t INDEX_VERSION = 1;
+
+	template<typename T>
+	void writeValue(std::ofstream& file, const T& value)
+	{
+		file.write(reinterpret_cast<const char*>(&value), sizeof(T));
+	}
+
+	void writeString(std::ofstream& file, const std::string& value)
+	{
+		writeValue(file, static_cast<uint32_t>(value.size()));
+		file.write(value.data(), value.size());
+	}
+
+	void writeStrings(std::ofstream& file, const std::vector<std::string>& values)
+	{
+		writeValue(file, static_cast<uint32_t>(values.size()));
+		for (const auto& value : values)
+		{
+			writeString(file, value);
+		}
+	}
+
+	template<typename T>
+	bool readValue(std::ifstream& file, T& value)
+	{
+		return static_cast<bool>(file.read(reinterpret_cast<char*>(&value), sizeof(T)));
+	}
+
+	bool readString(std::ifstream& file, std::string& value)
+	{
+		uint32_t length;
+		if (!readValue(file, length))
+		{
+			return false;
+		}
+		value.resize(length);
+		return static_cast<bool>(file.read(value.data(), length));
+	}
+
+	bool readStrings(std::ifstream& file, std::vector<std::string>& values)
 	{
-		if (exists(directorypath) && fs::is_directory(directorypath))
+		uint32_t count;
+		if (!readValue(file, count))
+		{
+			return false;
+		}
+		values.resize(count);
+		for (auto& value : values)
 		{
-			for (const auto& entry :
-				fs::recursive_directory_iterator(directorypath))
+			if (!readString(file, value))
 			{
-				if (entry.is_regular_file() && entry.path().extension() == ".gltf")
-				{
-					std::string filename = entry.path().filename().string();
-					gltf_files[filename] = entry.path();
-					std::cout << filename << "\n";
-				}
+				return false;
+			}
+		}
+		return true;
+	}
+
+	std::string joinPath(const std::string& directory, const std::string& name)
+	{
+		return directory.empty() ? name : directory + '/' + name;
+	}
+
+	int64_t toTicks(fs::file_time_type time)
+	{
+		return static_cast<int64_t>(time.time_since_epoch().count());
+	}
+
+	bool hasExtension(const std::string& path, const char* extension)
+	{
+		size_t length = std::strlen(extension);
+		if (path.size() < length)
+		{
+			return false;
+		}
+		for (size_t i = 0; i < length; ++i)
+		{
+			if (std::tolower(static_cast<unsigned char>(path[path.size() - length + i])) != extension[i])
+			{
+				return false;
 			}
 		}
-		else
+		return true;
+	}
+}
+
+const char* AssetCatalogue::INDEX_FILE_NAME = ".assetindex";
+
+AssetCatalogue::AssetCatalogue(ThreadPool& threadPool)
+	: m_ThreadPool(threadPool)
+{
+}
+
+bool AssetCatalogue::load(const std::string& indexPath)
+{
+	m_Root.clear();
+	m_Directories.clear();
+	m_Assets.clear();
+	m_ByName.clear();
+
+	std::ifstream file(indexPath, std::ios::binary);
+	if (!file.is_open())
+	{
+		return false;
+	}
+
+	char magic[4];
+	uint32_t version = 0;
+	std::string root;
+	if (!file.read(magic, sizeof(magic)) || std::memcmp(magic, INDEX_MAGIC, sizeof(magic)) != 0 ||
+		!readValue(file, version) || version != INDEX_VERSION || !readString(file, root))
+	{
+		std::cerr << "Ignoring stale asset index: " << indexPath << std::endl;
+		return false;
+	}
+
+	std::unordered_map<std::string, Directory> directories;
+	std::unordered_map<std::string, AssetEntry> assets;
+	bool valid = true;
+	uint32_t directoryCount = 0;
+	valid = readValue(file, directoryCount);
+	for (uint32_t i = 0; valid && i < directoryCount; ++i)
+	{
+		std::string path;
+		Directory directory;
+		valid = readString(file, path) && readValue(file, directory.writeTime) &&
+			readStrings(file, directory.subdirectories) && readStrings(file, directory.files);
+		directories.emplace(std::move(path), std::move(directory));
+	}
+	uint32_t assetCount = 0;
+	valid = valid && readValue(file, assetCount);
+	for (uint32_t i = 0; valid && i < assetCount; ++i)
+	{
+		AssetEntry entry;
+		valid = readString(file, entry.path) && readValue(file, entry.size) && readValue(file, entry.writeTime) &&
+			readValue(file, entry.hash) && readStrings(file, entry.dependencies);
+		std::string path = entry.path;
+		assets.emplace(std::move(path), std::move(entry));
+	}
+	if (!valid)
+	{
+		std::cerr << "Truncated asset index: " << indexPath << std::endl;
+		return false;
+	}
+
+	m_Root = std::move(root);
+	m_Directories = std::move(directories);
+	m_Assets = std::move(assets);
+	rebuildNameIndex();
+	return true;
+}
+
+bool AssetCatalogue::save(const std::string& indexPath) const
+{
+	// Written under a temporary name so a crash never leaves a truncated index behind
+	std::string temporaryPath = indexPath + ".tmp";
+	{
+		std::ofstream file(temporaryPath, std::ios::binary);
+		if (!file.is_open())
+		{
+			std::cerr << "Failed to write asset index: " << temporaryPath << std::endl;
+			return false;
+		}
+		file.write(INDEX_MAGIC, sizeof(INDEX_MAGIC));
+		writeValue(file, INDEX_VERSION);
+		writeString(file, m_Root);
+		writeValue(file, static_cast<uint32_t>(m_Directories.size()));
+		for (const auto& [path, directory] : m_Directories)
+		{
+			writeString(file, path);
+			writeValue(file, directory.writeTime);
+			writeStrings(file, directory.subdirectories);
+			writeStrings(file, directory.files);
+		}
+		writeValue(file, static_cast<uint32_t>(m_Assets.size()));
+		for (const auto& [path, entry] : m_Assets)
+		{
+			writeString(file, entry.path);
+			writeValue(file, entry.size);
+			writeValue(file, entry.writeTime);
+			writeValue(file, entry.hash);
+			writeStrings(file, entry.dependencies);
+		}
+		if (!file)
+		{
+			std::cerr << "Failed to write asset index: " << temporaryPath << std::endl;
+			return false;
+		}
+	}
+	std::error_code error;
+	fs::rename(temporaryPath, indexPath, error);
+	if (error)
+	{
+		std::cerr << "Failed to replace asset index " << indexPath << ": " << error.message() << std::endl;
+		return false;
+	}
+	return true;
+}
+
+AssetScanStats AssetCatalogue::scan(const std::string& root, bool fullRescan)
+{
+	PROFILE_SCOPE("Scan assets");
+	auto start = std::chrono::high_resolution_clock::now();
+	AssetScanStats stats;
+
+	std::string normalizedRoot = fs::path(root).lexically_normal().generic_string();
+	if (normalizedRoot != m_Root)
+	{
+		m_Directories.clear();
+		m_Assets.clear();
+		m_Root = normalizedRoot;
+	}
+	m_ByName.clear();
+
+	fs::path rootPath = m_Root;
+	std::error_code error;
+	if (!fs::is_directory(rootPath, error))
+	{
+		std::cerr << "Asset directory not found: " << root << std::endl;
+		m_Directories.clear();
+		m_Assets.clear();
+		return stats;
+	}
+
+	struct Listing
+	{
+		bool exists = false;
+		bool changed = false;
+		Directory directory;
+		std::vector<AssetEntry> files;
+	};
+
+	// One level of the tree per pass: the workers only read the old index, merging is serial
+	std::unordered_map<std::string, Directory> directories;
+	std::unordered_map<std::string, AssetEntry> assets;
+	std::vector<AssetEntry*> toHash;
+	std::vector<std::string> level = { "" };
+	while (!level.empty())
+	{
+		std::vector<Listing> listings(level.size());
+		m_ThreadPool.parallelFor(level.size(), [&](size_t begin, size_t end)
+			{
+				for (size_t i = begin; i < end; ++i)
+				{
+					const std::string& path = level[i];
+					Listing& listing = listings[i];
+					fs::path absolutePath = rootPath / fs::path(path);
+					std::error_code statError;
+					auto writeTime = fs::last_write_time(absolutePath, statError);
+					if (statError)
+					{
+						continue;
+					}
+					listing.exists = true;
+
+					auto known = m_Directories.find(path);
+					if (!fullRescan && known != m_Directories.end() && known->second.writeTime == toTicks(writeTime))
+					{
+						bool complete = true;
+						for (const auto& file : known->second.files)
+						{
+							complete = complete && m_Assets.count(file) > 0;
+						}
+						if (complete)
+						{
+							listing.directory = known->second;
+							continue;
+						}
+					}
+
+					listing.changed = true;
+					listing.directory.writeTime = toTicks(writeTime);
+					for (const auto& entry : fs::directory_iterator(absolutePath, statError))
+					{
+						std::error_code entryError;
+						std::string name = entry.path().filename().generic_string();
+						std::string entryPath = joinPath(path, name);
+						if (entry.is_symlink(entryError))
+						{
+							continue;
+						}
+						if (entry.is_directory(entryError))
+						{
+							listing.directory.subdirectories.push_back(entryPath);
+						}
+						else if (entry.is_regular_file(entryError) && !(path.empty() && name == INDEX_FILE_NAME))
+						{
+							AssetEntry asset;
+							asset.path = entryPath;
+							asset.size = entry.file_size(entryError);
+							asset.writeTime = toTicks(entry.last_write_time(entryError));
+							listing.directory.files.push_back(entryPath);
+							listing.files.push_back(std::move(asset));
+						}
+					}
+				}
+			});
+
+		std::vector<std::string> nextLevel;
+		for (size_t i = 0; i < level.size(); ++i)
 		{
-			std::cerr << "Directory not found." << std::endl;
+			Listing& listing = listings[i];
+			if (!listing.exists)
+			{
+				continue;
+			}
+			if (listing.changed)
+			{
+				++stats.changedDirectories;
+				for (auto& file : listing.files)
+				{
+					auto known = m_Assets.find(file.path);
+					if (known != m_Assets.end() && known->second.size == file.size && known->second.writeTime == file.writeTime)
+					{
+						assets.emplace(file.path, std::move(known->second));
+					}
+					else
+					{
+						auto inserted = assets.emplace(file.path, std::move(file));
+						toHash.push_back(&inserted.first->second);
+					}
+				}
+			}
+			else
+			{
+				for (const auto& file : listing.directory.files)
+				{
+					assets.emplace(file, std::move(m_Assets.at(file)));
+				}
+			}
+			nextLevel.insert(nextLevel.end(), listing.directory.subdirectories.begin(), listing.directory.subdirectories.end());
+			directories.emplace(level[i], std::move(listing.directory));
 		}
+		level.swap(nextLevel);
 	}
-	catch (const fs::filesystem_error& e)
+
+	for (const auto& [path, entry] : m_Assets)
+	{
+		stats.removedFiles += assets.count(path) == 0 ? 1 : 0;
+	}
+	auto listed = std::chrono::high_resolution_clock::now();
+
+	// Only new or modified files are read; pointers into the map stay valid while it is not modified
+	m_ThreadPool.parallelFor(toHash.size(), [&](size_t begin, size_t end)
+		{
+			for (size_t i = begin; i < end; ++i)
+			{
+				AssetEntry& entry = *toHash[i];
+				fs::path absolutePath = rootPath / fs::path(entry.path);
+				entry.hash = hashFile(absolutePath);
+				entry.dependencies.clear();
+				if (hasExtension(entry.path, ".gltf") || hasExtension(entry.path, ".glb"))
+				{
+					size_t slash = entry.path.find_last_of('/');
+					entry.dependencies = readGltfDependencies(absolutePath, slash == std::string::npos ? std::string() : entry.path.substr(0, slash));
+				}
+			}
+		});
+
+	m_Directories = std::move(directories);
+	m_Assets = std::move(assets);
+	rebuildNameIndex();
+
+	stats.directories = m_Directories.size();
+	stats.files = m_Assets.size();
+	stats.hashedFiles = toHash.size();
+	for (const AssetEntry* entry : toHash)
 	{
-		std::cerr << "Filesystem error: " << e.what() << std::endl;
+		stats.hashedBytes += entry->size;
 	}
-	catch (const std::exception& e)
+	for (const auto& [path, entry] : m_Assets)
 	{
-		std::cerr << "General error: " << e.what() << std::endl;
+		for (const auto& dependency : entry.dependencies)
+		{
+			stats.missingDependencies += m_Assets.count(dependency) == 0 ? 1 : 0;
+		}
 	}
-	return gltf_files;
 
+	auto end = std::chrono::high_resolution_clock::now();
+	stats.scanMs = std::chrono::duration<float, std::milli>(listed - start).count();
+	stats.hashMs = std::chrono::duration<float, std::milli>(end - listed).count();
+	return stats;
 }
 
-void watchFile(const char* path)
+const AssetEntry* AssetCatalogue::find(const std::string& path) const
 {
-	auto lastWriteTime = getWriteTime(path);
+	auto it = m_Assets.find(path);
+	return it != m_Assets.end() ? &it->second : nullptr;
+}
 
+std::vector<const AssetEntry*> AssetCatalogue::findByName(const std::string& fileName) const
+{
+	std::vector<const AssetEntry*> entries;
+	auto range = m_ByName.equal_range(fileName);
+	for (auto it = range.first; it != range.second; ++it)
+	{
+		entries.push_back(it->second);
+	}
+	return entries;
+}
 
-	while (true) 
+std::vector<const AssetEntry*> AssetCatalogue::findByExtension(const std::string& extension) const
+{
+	std::string lowerExtension = extension;
+	std::transform(lowerExtension.begin(), lowerExtension.end(), lowerExtension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+	std::vector<const AssetEntry*> entries;
+	for (const auto& [path, entry] : m_Assets)
 	{
-		auto currentWriteTime = getWriteTime(path);
-		if (lastWriteTime != currentWriteTime)
+		if (hasExtension(path, lowerExtension.c_str()))
 		{
-			lastWriteTime = currentWriteTime;
-			std::cout << "File changed!" << std::endl;
+			entries.push_back(&entry);
 		}
-		std::this_thread::sleep_for(std::chrono::milliseconds(500));
+	}
+	return entries;
+}
+
+fs::path AssetCatalogue::getAbsolutePath(const AssetEntry& entry) const
+{
+	return fs::path(m_Root) / fs::path(entry.path);
+}
+
+uint64_t AssetCatalogue::hashFile(const fs::path& path)
+{
+	MappedFile file(path.string());
+	if (!file.isOpen())
+	{
+		// Empty files cannot be mapped
+		return xxhash64::hash(nullptr, 0);
+	}
+	return xxhash64::hash(file.data(), file.size());
+}
+
+std::vector<std::string> AssetCatalogue::readGltfDependencies(const fs::path& path, const std::string& directory)
+{
+	std::vector<std::string> dependencies;
+	cgltf_options options = {};
+	cgltf_data* data = nullptr;
+	if (cgltf_parse_file(&options, path.string().c_str(), &data) != cgltf_result_success)
+	{
+		std::cerr << "Failed to parse GLTF file for its dependencies: " << path.string() << std::endl;
+		return dependencies;
+	}
+
+	auto addUri = [&dependencies, &directory](const char* uri)
+		{
+			if (uri == nullptr || std::strncmp(uri, "data:", 5) == 0 || std::strstr(uri, "://") != nullptr)
+			{
+				return;
+			}
+			std::string decoded = uri;
+			decoded.resize(cgltf_decode_uri(decoded.data()));
+			std::string dependency = (fs::path(directory) / fs::path(decoded)).lexically_normal().generic_string();
+			if (std::find(dependencies.begin(), dependencies.end(), dependency) == dependencies.end())
+			{
+				dependencies.push_back(std::move(dependency));
+			}
+		};
+	for (cgltf_size i = 0; i < data->buffers_count; ++i)
+	{
+		addUri(data->buffers[i].uri);
+	}
+	for (cgltf_size i = 0; i < data->images_count; ++i)
+	{
+		addUri(data->images[i].uri);
+	}
+	cgltf_free(data);
+	return dependencies;
+}
+
+void AssetCatalogue::rebuildNameIndex()
+{
+	m_ByName.clear();
+	m_ByName.reserve(m_Assets.size());
+	for (const auto& [path, entry] : m_Assets)
+	{
+		size_t slash = path.find_last_of('/');
+		m_ByName.emplace(slash == std::string::npos ? path : path.substr(slash + 1), &entry);
 	}
 }
 
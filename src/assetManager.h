@@ -5,13 +5,86 @@
 #include <filesystem>
 #include <vector>
 #include <format>
+#include <string>
+#include <unordered_map>
+#include "threadPool.h"
 
 
 namespace fs = std::filesystem;
 
 
-std::unordered_map<std::string, fs::path> findModelFiles(const char* dir);
+struct AssetEntry
+{
+	std::string path;		// relative to the catalogue root, '/' separated
+	uint64_t size = 0;
+	int64_t writeTime = 0;
+	uint64_t hash = 0;		// xxhash64 of the contents
+	std::vector<std::string> dependencies;	// .bin buffers and images of a glTF, catalogue paths
+};
 
-void watchFile(const char* path);
+struct AssetScanStats
+{
+	size_t directories = 0;
+	size_t changedDirectories = 0;	// listed again because their write time moved
+	size_t files = 0;
+	size_t hashedFiles = 0;
+	uint64_t hashedBytes = 0;
+	size_t removedFiles = 0;
+	size_t missingDependencies = 0;
+	float scanMs = 0.0f;
+	float hashMs = 0.0f;
+};
+
+// Persistent index of every file below a root directory.
+//
+// A scan walks the tree one directory level at a time on the thread pool. A directory
+// whose write time matches the index is not listed again, its files are taken from the
+// index. Only directories that gained, lost or renamed entries cost a listing. Files with
+// a new size or write time are hashed and, for .gltf/.glb, parsed for their external
+// buffers and images. Editing a file in place does not touch its directory's write time,
+// so scan(root, true) lists everything again to pick such edits up.
+//
+// Lookups by catalogue path are a single hash lookup. findByName returns every file with
+// that name, so duplicates in different directories no longer shadow each other.
+class AssetCatalogue
+{
+public:
+	explicit AssetCatalogue(ThreadPool& threadPool);
+
+	// Returns false and leaves the catalogue empty when the file is missing or stale
+	bool load(const std::string& indexPath);
+	bool save(const std::string& indexPath) const;
+	AssetScanStats scan(const std::string& root, bool fullRescan = false);
+
+	const AssetEntry* find(const std::string& path) const;
+	std::vector<const AssetEntry*> findByName(const std::string& fileName) const;
+	std::vector<const AssetEntry*> findByExtension(const std::string& extension) const;
+	fs::path getAbsolutePath(const AssetEntry& entry) const;
+
+	const std::string& getRoot() const { return m_Root; }
+	size_t size() const { return m_Assets.size(); }
+
+	static const char* INDEX_FILE_NAME;
+
+	// External buffer and image URIs of a .gltf/.glb, joined to directory and normalized
+	static std::vector<std::string> readGltfDependencies(const fs::path& path, const std::string& directory);
+
+private:
+	struct Directory
+	{
+		int64_t writeTime = 0;
+		std::vector<std::string> subdirectories;
+		std::vector<std::string> files;
+	};
+
+	static uint64_t hashFile(const fs::path& path);
+	void rebuildNameIndex();
+
+	ThreadPool& m_ThreadPool;
+	std::string m_Root;
+	std::unordered_map<std::string, Directory> m_Directories;
+	std::unordered_map<std::string, AssetEntry> m_Assets;
+	std::unordered_multimap<std::string, const AssetEntry*> m_ByName;
+};
 
 std::filesystem::file_time_type getWriteTime(const char* path);
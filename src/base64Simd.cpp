@@ -0,0 +1,278 @@
+#include "pch.h"
+#include "base64Simd.h"
+#include <cstdint>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define BASE64_X86 1
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+#endif
+
+// MSVC accepts any intrinsic, GCC and Clang need the instruction set enabled per function
+#if defined(__GNUC__) || defined(__clang__)
+#define BASE64_TARGET(isa) __attribute__((target(isa)))
+#else
+#define BASE64_TARGET(isa)
+#endif
+
+namespace
+{
+    struct DecodeTable
+    {
+        uint8_t values[256];
+
+        DecodeTable()
+        {
+            for (int i = 0; i < 256; ++i)
+            {
+                values[i] = 0xFF;
+            }
+            for (int i = 0; i < 26; ++i)
+            {
+                values['A' + i] = static_cast<uint8_t>(i);
+                values['a' + i] = static_cast<uint8_t>(26 + i);
+            }
+            for (int i = 0; i < 10; ++i)
+            {
+                values['0' + i] = static_cast<uint8_t>(52 + i);
+            }
+            values['+'] = values['-'] = 62;
+            values['/'] = values['_'] = 63;
+        }
+    };
+
+    const DecodeTable DECODE_TABLE;
+
+    size_t getUnpaddedLength(std::string_view encoded)
+    {
+        size_t length = encoded.size();
+        for (int i = 0; i < 2 && length > 0 && (encoded[length - 1] == '=' || encoded[length - 1] == '.'); ++i)
+        {
+            --length;
+        }
+        return length;
+    }
+
+    bool decodeScalar(const unsigned char* source, size_t length, unsigned char* destination)
+    {
+        const uint8_t* table = DECODE_TABLE.values;
+        size_t i = 0;
+        for (; i + 4 <= length; i += 4)
+        {
+            uint32_t a = table[source[i]], b = table[source[i + 1]], c = table[source[i + 2]], d = table[source[i + 3]];
+            if ((a | b | c | d) & 0x80)
+            {
+                return false;
+            }
+            uint32_t value = (a << 18) | (b << 12) | (c << 6) | d;
+            destination[0] = static_cast<unsigned char>(value >> 16);
+            destination[1] = static_cast<unsigned char>(value >> 8);
+            destination[2] = static_cast<unsigned char>(value);
+            destination += 3;
+        }
+
+        size_t remaining = length - i;
+        if (remaining == 1)
+        {
+            return false;
+        }
+        if (remaining >= 2)
+        {
+            uint32_t a = table[source[i]], b = table[source[i + 1]];
+            uint32_t c = remaining == 3 ? table[source[i + 2]] : 0;
+            if ((a | b | c) & 0x80)
+            {
+                return false;
+            }
+            uint32_t value = (a << 18) | (b << 12) | (c << 6);
+            destination[0] = static_cast<unsigned char>(value >> 16);
+            if (remaining == 3)
+            {
+                destination[1] = static_cast<unsigned char>(value >> 8);
+            }
+        }
+        return true;
+    }
+
+#ifdef BASE64_X86
+    // Returns how many characters were decoded, always a multiple of 16. Stops early at the first
+    // block with a character outside the standard alphabet, and leaves room for the 16-byte stores.
+    BASE64_TARGET("ssse3,sse4.1")
+    size_t decodeSse41(const unsigned char* source, size_t length, unsigned char* destination, size_t destinationSize)
+    {
+        const __m128i lutLo = _mm_setr_epi8(0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m128i lutHi = _mm_setr_epi8(0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m128i lutRoll = _mm_setr_epi8(0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m128i mask2F = _mm_set1_epi8(0x2F);
+        const __m128i packShuffle = _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+
+        size_t consumed = 0;
+        size_t written = 0;
+        while (consumed + 16 <= length && written + 16 <= destinationSize)
+        {
+            __m128i input = _mm_loadu_si128(reinterpret_cast<const __m128i*>(source + consumed));
+            __m128i hiNibbles = _mm_and_si128(_mm_srli_epi32(input, 4), mask2F);
+            __m128i loNibbles = _mm_and_si128(input, mask2F);
+            __m128i lo = _mm_shuffle_epi8(lutLo, loNibbles);
+            __m128i hi = _mm_shuffle_epi8(lutHi, hiNibbles);
+            if (!_mm_testz_si128(lo, hi))
+            {
+                break;
+            }
+            __m128i is2F = _mm_cmpeq_epi8(input, mask2F);
+            __m128i roll = _mm_shuffle_epi8(lutRoll, _mm_add_epi8(is2F, hiNibbles));
+            __m128i values = _mm_add_epi8(input, roll);
+
+            // 4 x 6 bits -> 3 bytes per 32-bit lane, then squeeze out the empty byte
+            __m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+            __m128i packed = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+            packed = _mm_shuffle_epi8(packed, packShuffle);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(destination + written), packed);
+
+            consumed += 16;
+            written += 12;
+        }
+        return consumed;
+    }
+
+    BASE64_TARGET("avx2")
+    size_t decodeAvx2(const unsigned char* source, size_t length, unsigned char* destination, size_t destinationSize)
+    {
+        const __m256i lutLo = _mm256_setr_epi8(
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A,
+            0x15, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x11, 0x13, 0x1A, 0x1B, 0x1B, 0x1B, 0x1A);
+        const __m256i lutHi = _mm256_setr_epi8(
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10,
+            0x10, 0x10, 0x01, 0x02, 0x04, 0x08, 0x04, 0x08, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10, 0x10);
+        const __m256i lutRoll = _mm256_setr_epi8(
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0,
+            0, 16, 19, 4, -65, -65, -71, -71, 0, 0, 0, 0, 0, 0, 0, 0);
+        const __m256i mask2F = _mm256_set1_epi8(0x2F);
+        const __m256i packShuffle = _mm256_setr_epi8(
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1,
+            2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1);
+        const __m256i lanePermute = _mm256_setr_epi32(0, 1, 2, 4, 5, 6, 7, 7);
+
+        size_t consumed = 0;
+        size_t written = 0;
+        while (consumed + 32 <= length && written + 32 <= destinationSize)
+        {
+            __m256i input = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(source + consumed));
+            __m256i hiNibbles = _mm256_and_si256(_mm256_srli_epi32(input, 4), mask2F);
+            __m256i loNibbles = _mm256_and_si256(input, mask2F);
+            __m256i lo = _mm256_shuffle_epi8(lutLo, loNibbles);
+            __m256i hi = _mm256_shuffle_epi8(lutHi, hiNibbles);
+            if (!_mm256_testz_si256(lo, hi))
+            {
+                break;
+            }
+            __m256i is2F = _mm256_cmpeq_epi8(input, mask2F);
+            __m256i roll = _mm256_shuffle_epi8(lutRoll, _mm256_add_epi8(is2F, hiNibbles));
+            __m256i values = _mm256_add_epi8(input, roll);
+
+            __m256i merged = _mm256_maddubs_epi16(values, _mm256_set1_epi32(0x01400140));
+            __m256i packed = _mm256_madd_epi16(merged, _mm256_set1_epi32(0x00011000));
+            packed = _mm256_shuffle_epi8(packed, packShuffle);
+            // 12 bytes per 128-bit lane, make them contiguous
+            packed = _mm256_permutevar8x32_epi32(packed, lanePermute);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(destination + written), packed);
+
+            consumed += 32;
+            written += 24;
+        }
+        return consumed;
+    }
+
+    Base64Path detectBestPath()
+    {
+#ifdef _MSC_VER
+        int info[4];
+        __cpuid(info, 0);
+        int maxLeaf = info[0];
+        __cpuid(info, 1);
+        bool sse41 = (info[2] & (1 << 19)) != 0;
+        bool ssse3 = (info[2] & (1 << 9)) != 0;
+        // AVX2 also needs the OS to save the YMM registers
+        bool osAvx = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 0x6) == 0x6;
+        bool avx2 = false;
+        if (maxLeaf >= 7 && osAvx)
+        {
+            __cpuidex(info, 7, 0);
+            avx2 = (info[1] & (1 << 5)) != 0;
+        }
+#else
+        __builtin_cpu_init();
+        bool ssse3 = __builtin_cpu_supports("ssse3");
+        bool sse41 = __builtin_cpu_supports("sse4.1");
+        bool avx2 = __builtin_cpu_supports("avx2");
+#endif
+        if (avx2)
+        {
+            return BASE64_AVX2;
+        }
+        return ssse3 && sse41 ? BASE64_SSE41 : BASE64_SCALAR;
+    }
+#endif
+}
+
+size_t base64DecodedSize(std::string_view encoded)
+{
+    size_t length = getUnpaddedLength(encoded);
+    if (length % 4 == 1)
+    {
+        return 0;
+    }
+    return length / 4 * 3 + (length % 4 == 0 ? 0 : length % 4 - 1);
+}
+
+Base64Path base64BestPath()
+{
+#ifdef BASE64_X86
+    static const Base64Path bestPath = detectBestPath();
+    return bestPath;
+#else
+    return BASE64_SCALAR;
+#endif
+}
+
+const char* base64PathName(Base64Path path)
+{
+    switch (path)
+    {
+    case BASE64_SCALAR: return "scalar";
+    case BASE64_SSE41: return "SSE4.1";
+    case BASE64_AVX2: return "AVX2";
+    default: return base64PathName(base64BestPath());
+    }
+}
+
+bool base64DecodeInto(std::string_view encoded, unsigned char* destination, Base64Path path)
+{
+    size_t length = getUnpaddedLength(encoded);
+    if (length % 4 == 1)
+    {
+        return false;
+    }
+    size_t destinationSize = base64DecodedSize(encoded);
+    const unsigned char* source = reinterpret_cast<const unsigned char*>(encoded.data());
+
+    if (path == BASE64_AUTO || path > base64BestPath())
+    {
+        path = base64BestPath();
+    }
+
+    size_t consumed = 0;
+#ifdef BASE64_X86
+    if (path == BASE64_AVX2)
+    {
+        consumed = decodeAvx2(source, length, destination, destinationSize);
+    }
+    if (path >= BASE64_SSE41)
+    {
+        consumed += decodeSse41(source + consumed, length - consumed, destination + consumed / 4 * 3, destinationSize - consumed / 4 * 3);
+    }
+#endif
+    return decodeScalar(source + consumed, length - consumed, destination + consumed / 4 * 3);
+}
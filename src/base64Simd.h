@@ -0,0 +1,26 @@
+#pragma once
+#include <cstddef>
+#include <string_view>
+
+enum Base64Path
+{
+    BASE64_AUTO = 0,    // best path the CPU supports
+    BASE64_SCALAR,
+    BASE64_SSE41,
+    BASE64_AVX2
+};
+
+// Exact size of the decoded data, trailing '=' / '.' padding excluded. 0 for lengths no
+// base64 string can have.
+size_t base64DecodedSize(std::string_view encoded);
+
+// Decodes standard or URL-safe base64 straight into destination, which must hold
+// base64DecodedSize(encoded) bytes. Returns false on characters outside the alphabet.
+//
+// The SIMD paths translate and pack 16 (SSE4.1) or 32 (AVX2) characters per step with
+// pshufb lookups, as described by Muła and Lemire. Blocks they reject (URL-safe characters,
+// invalid input) are finished by the scalar table decoder, which also does the tail.
+bool base64DecodeInto(std::string_view encoded, unsigned char* destination, Base64Path path = BASE64_AUTO);
+
+Base64Path base64BestPath();
+const char* base64PathName(Base64Path path);
@@ -3,47 +3,35 @@
 #include "texture.h"
 
 
-Material::Material() : baseColor(1.0f, 1.0f, 1.0f, 1.0f) {}
+Material::Material() : Material(glm::vec4(1.0f, 1.0f, 1.0f, 1.0f)) {}
 
-Material::Material(glm::vec4 nBaseColor) : baseColor(nBaseColor){}
+Material::Material(glm::vec4 nBaseColor)
+    : baseColor(nBaseColor), alphaMode(ALPHA_MODE_OPAQUE), alphaCutoff(0.5f), metallicFactor(1.0f), roughnessFactor(1.0f),
+      colorTextureID(0), normalTextureID(0), aoTextureID(0), emissiveTextureID(0),
+      colorSamplerID(0), normalSamplerID(0), aoSamplerID(0), emissiveSamplerID(0), hasColorTexture(false) {}
 
-GLuint Material::createOpenGLTexture(const std::shared_ptr<Texture>& texture)
+GLuint Material::acquireTexture(GpuTextureCache& textureCache, const std::shared_ptr<Texture>& texture, const SamplerDesc& samplerDesc, GLuint& samplerID)
 {
-
-    GLuint textureID;
-    glGenTextures(1, &textureID);
-    glBindTexture(GL_TEXTURE_2D, textureID);
-
-    if (texture->m_isDDS)
+    if (!texture)
     {
-        for (size_t level = 0; level < texture->m_ddsData.size(); ++level)
-        {
-            const auto& mipmap = texture->m_ddsData[level];
-            glCompressedTexImage2D(GL_TEXTURE_2D, level, texture->m_format, mipmap.width, mipmap.height, 0, mipmap.data.size(), mipmap.data.data());
-            GLenum err;
-        }
+        return 0;
     }
-    else
+    samplerID = textureCache.getSampler(samplerDesc);
+    // Streamed and asynchronously uploaded textures have no handle, the primitive reads their m_TextureID
+    std::shared_ptr<GpuTexture> handle = textureCache.acquire(texture);
+    if (!handle)
     {
-
-
-        glTexImage2D(GL_TEXTURE_2D, 0, texture->m_format, texture->m_width, texture->m_height, 0, texture->m_format, GL_UNSIGNED_BYTE, texture->m_data.data());
-         glGenerateMipmap(GL_TEXTURE_2D);
+        return 0;
     }
-
-    // Set texture parameters
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
-    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
-
-
-
-    return textureID;
+    m_TextureHandles.push_back(handle);
+    return handle->id;
 }
 
-void Material::createAllTextures()
+void Material::createAllTextures(GpuTextureCache& textureCache)
 {
-    colorTextureID = createOpenGLTexture(this->colorTexture);
-}
\ No newline at end of file
+    m_TextureHandles.clear();
+    colorTextureID = acquireTexture(textureCache, colorTexture, colorSampler, colorSamplerID);
+    normalTextureID = acquireTexture(textureCache, normalTexture, normalSampler, normalSamplerID);
+    aoTextureID = acquireTexture(textureCache, occlusionTexture, occlusionSampler, aoSamplerID);
+    emissiveTextureID = acquireTexture(textureCache, emissiveTexture, emissiveSampler, emissiveSamplerID);
+}
@@ -2,23 +2,53 @@
 #include <glm/glm.hpp>
 #include <glad/glad.h>
 #include "texture.h"
+#include "gpuTextureCache.h"
 
+// glTF alphaMode, decides which render bucket a primitive goes into
+enum AlphaMode
+{
+    ALPHA_MODE_OPAQUE = 0,
+    ALPHA_MODE_MASK,
+    ALPHA_MODE_BLEND
+};
 
 class Material
 {
 public:
     glm::vec4 baseColor;
+    AlphaMode alphaMode;
+    float alphaCutoff;
+    float metallicFactor;
+    float roughnessFactor;
     GLuint colorTextureID;
     GLuint normalTextureID;
     GLuint aoTextureID;
+    GLuint emissiveTextureID;
     
     std::shared_ptr<Texture> colorTexture;
     std::shared_ptr<Texture> normalTexture;
+    std::shared_ptr<Texture> occlusionTexture;
+    std::shared_ptr<Texture> emissiveTexture;
+
+    // From the glTF samplers of the textures above, turned into shared GL samplers by createAllTextures
+    SamplerDesc colorSampler;
+    SamplerDesc normalSampler;
+    SamplerDesc occlusionSampler;
+    SamplerDesc emissiveSampler;
+    GLuint colorSamplerID;
+    GLuint normalSamplerID;
+    GLuint aoSamplerID;
+    GLuint emissiveSamplerID;
 
     bool hasColorTexture;
 
     Material();
     Material(glm::vec4 nBaseColor);
-    GLuint createOpenGLTexture(const std::shared_ptr<Texture>& texture);
-    void createAllTextures();
+    void createAllTextures(GpuTextureCache& textureCache);
+
+private:
+    GLuint acquireTexture(GpuTextureCache& textureCache, const std::shared_ptr<Texture>& texture, const SamplerDesc& samplerDesc, GLuint& samplerID);
+
+    // Keeps the shared GL textures alive as long as a material uses them
+    std::vector<std::shared_ptr<GpuTexture>> m_TextureHandles;
 };
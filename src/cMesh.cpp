@@ -1,5 +1,6 @@
 #include "pch.h"
 #include "cMesh.h"
+#include "renderStats.h"
 
 cMesh::cMesh(const std::vector<cPrimitive>& primitives)
     : primitives(primitives)
@@ -15,11 +16,11 @@ void cMesh::draw(Shader& shader)
     }
 }
 
-void cMesh::uploadToGpu()
+void cMesh::uploadToGpu(GpuTextureCache& textureCache)
 {
     for (auto& primitive : primitives)
     {
-        primitive.uploadToGPU();
+        primitive.uploadToGPU(textureCache);
 
     }
 }
@@ -94,6 +95,7 @@ void cMesh::renderBatch(Shader& shader)
         m_CombinedIndices.size(), // count: specifies the number of elements to be rendered
         GL_UNSIGNED_INT, // type: specifies the type of the values in indices
         0); // indices: specifies a pointer to the location where the indices are stored (NULL if EBO is bound)
+    RenderStats::get().countDraw();
 
 
     // Unbind VAO to avoid accidentally modifying it
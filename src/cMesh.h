@@ -15,6 +15,7 @@ public:
     std::vector<cPrimitive> primitives;
     glm::mat4 transform;
     bool transformChanged;
+    bool m_Dynamic = false;     // node is animated, so it is not baked into cached shadow maps
     cMesh(const std::vector<cPrimitive>& primitives);
     std::vector<float> m_CombinedInterleavedData;
     std::vector<unsigned int> m_CombinedIndices;
@@ -25,7 +26,7 @@ public:
     
 
     void draw(Shader& shader);
-    void uploadToGpu();
+    void uploadToGpu(GpuTextureCache& textureCache);
     void combinePrimitiveData();
     void renderBatch(Shader& shader);
 };
@@ -1,8 +1,11 @@
 #include "pch.h"
 #include "cModel.h"
 #include "texture.h"
+#include "ktxLoader.h"
+#include "imageCodec.h"
 #include "MipmapData.h"
 #include <algorithm>
+#include <cfloat>
 
 #define CGLTF_IMPLEMENTATION
 #include <cgltf/cgltf.h>
@@ -13,54 +16,41 @@
 #define DRACO_TRANSCODER_SUPPORTED
 #include <draco/compression/decode.h>
 #include <draco/core/decoder_buffer.h>
-#include "base64.h"
-
-int totalPrimitives = 0;
-
-struct Timer
-{
-    std::chrono::time_point<std::chrono::high_resolution_clock> start, end;
-    std::chrono::duration<float> duration;
-    std::string m_title = "Timer";
-    Timer()
-    {
-        startTimer();
-    }
-    void setTitle(const char* title)
-    {
-        m_title = title;
-    }
-    void startTimer()
-    {
-        start = std::chrono::high_resolution_clock::now();
-    }
-    void stopTimer()
-    {
-        end = std::chrono::high_resolution_clock::now();
-        duration = end - start;
-
-        float ms = duration.count() * 1000.0f;
-
-        std::cout << m_title << " took: " << ms << "ms" << "\n";
-    }
-};
-
-
-
-
-
-
-
-cModel::cModel(const char* path)
+#include "base64Simd.h"
+#include "xxhash64.h"
+#include "shaderPermutations.h"
+#include "profiler.h"
+#include "renderStats.h"
+
+cModel::cModel(const char* path, bool streamTextures, bool cookTextures, const cModel* previous, bool useCookedTextures)
+    : m_VAO(0), m_StreamTextures(streamTextures), m_CookTextures(cookTextures), m_UseCookedTextures(useCookedTextures), m_Previous(previous)
 {
+    PROFILE_SCOPE("Parse glTF");
+    m_LoadReport.begin(path);
     std::string directoryPath = path;
     directory = directoryPath.substr(0, directoryPath.find_last_of("/") + 1);
+    if (m_Previous)
+    {
+        for (const auto& mesh : m_Previous->meshes)
+        {
+            for (const auto& primitive : mesh.primitives)
+            {
+                m_PreviousPrimitives.emplace(primitive.m_GeometryHash, &primitive);
+            }
+        }
+    }
     loadModel(path);
+    m_Previous = nullptr;
+    m_PreviousPrimitives.clear();
+    m_ReloadReport.textures = m_TextureCache.size();
 
+    std::cout << "Texture cache: " << m_TextureCacheStats.hits << " hits (" << m_TextureCacheStats.contentHits << " by content) for "
+              << m_TextureCacheStats.lookups << " lookups, " << m_TextureCacheStats.getHitRate() * 100.0f << "% hit rate" << std::endl;
 }
 
 void cModel::Draw(Shader& shader, bool useBatchRendering)
 {
+    PROFILE_SCOPE("Draw model");
     /*
     auto renderFunc = useBatchRendering
         ? [](cMesh& mesh, Shader& shader) { mesh.renderBatch(shader); }
@@ -90,7 +80,183 @@ void cModel::Draw(Shader& shader, bool useBatchRendering)
 
 }
 
+// Position-only pass over the opaque primitives, masked ones need their texture alpha and are left out
+void cModel::drawDepthPrepass(Shader& shader)
+{
+    for (auto& mesh : meshes)
+    {
+        shader.setMat4("model", mesh.transform);
+        for (auto& primitive : mesh.primitives)
+        {
+            if (primitive.m_material.alphaMode == ALPHA_MODE_OPAQUE)
+            {
+                primitive.drawDepth();
+            }
+        }
+    }
+}
+
+void cModel::drawAlphaMode(Shader& shader, AlphaMode alphaMode)
+{
+    PROFILE_SCOPE("Draw alpha mode");
+    for (auto& mesh : meshes)
+    {
+        bool transformSet = false;
+        for (auto& primitive : mesh.primitives)
+        {
+            if (primitive.m_material.alphaMode != alphaMode)
+            {
+                continue;
+            }
+            if (!transformSet)
+            {
+                shader.setMat4("model", mesh.transform);
+                transformSet = true;
+            }
+            primitive.draw(shader);
+        }
+    }
+}
+
+// Same buckets, each primitive drawn with the permutation its material and the frame need.
+// Draws are grouped by variant so every program is made current once per pass.
+void cModel::drawAlphaMode(ShaderPermutations& permutations, uint32_t frameFeatures, AlphaMode alphaMode)
+{
+    PROFILE_SCOPE("Draw alpha mode");
+    std::vector<PrimitiveDraw> draws;
+    for (auto& mesh : meshes)
+    {
+        for (auto& primitive : mesh.primitives)
+        {
+            if (primitive.m_material.alphaMode == alphaMode)
+            {
+                draws.push_back({ &mesh, &primitive, 0.0f, ShaderPermutations::select(primitive.getShaderFeatures(), frameFeatures) });
+            }
+        }
+    }
+    std::stable_sort(draws.begin(), draws.end(), [](const PrimitiveDraw& a, const PrimitiveDraw& b)
+        {
+            return a.shaderFeatures < b.shaderFeatures;
+        });
+
+    uint32_t currentFeatures = UINT32_MAX;
+    Shader* shader = nullptr;
+    const cMesh* currentMesh = nullptr;
+    for (const auto& draw : draws)
+    {
+        if (draw.shaderFeatures != currentFeatures)
+        {
+            shader = &permutations.use(draw.shaderFeatures);
+            currentFeatures = draw.shaderFeatures;
+            currentMesh = nullptr;
+        }
+        if (draw.mesh != currentMesh)
+        {
+            shader->setMat4("model", draw.mesh->transform);
+            currentMesh = draw.mesh;
+        }
+        draw.primitive->draw(*shader);
+    }
+}
+
+// Depth-only draw of the static or dynamic shadow casters that overlap a cascade's frustum.
+// Blended primitives don't cast shadows, masked ones are drawn solid. Returns the number of draws.
+unsigned int cModel::drawShadowCasters(Shader& shader, const Frustum& frustum, bool dynamicCasters)
+{
+    unsigned int drawCount = 0;
+    for (auto& mesh : meshes)
+    {
+        if (mesh.m_Dynamic != dynamicCasters)
+        {
+            continue;
+        }
+        bool transformSet = false;
+        for (auto& primitive : mesh.primitives)
+        {
+            if (primitive.m_material.alphaMode == ALPHA_MODE_BLEND)
+            {
+                continue;
+            }
+            glm::vec3 worldMin, worldMax;
+            transformBounds(primitive.m_BoundsMin, primitive.m_BoundsMax, mesh.transform, worldMin, worldMax);
+            if (!frustum.intersectsAabb(worldMin, worldMax))
+            {
+                continue;
+            }
+            if (!transformSet)
+            {
+                shader.setMat4("model", mesh.transform);
+                transformSet = true;
+            }
+            primitive.drawDepth();
+            ++drawCount;
+        }
+    }
+    return drawCount;
+}
 
+// Blended primitives are drawn back-to-front by the distance of their world-space bounds center
+std::vector<cModel::PrimitiveDraw> cModel::getBlendedDraws(const glm::vec3& cameraPosition)
+{
+    std::vector<PrimitiveDraw> blendedDraws;
+    for (auto& mesh : meshes)
+    {
+        for (auto& primitive : mesh.primitives)
+        {
+            if (primitive.m_material.alphaMode != ALPHA_MODE_BLEND)
+            {
+                continue;
+            }
+            glm::vec3 center = glm::vec3(mesh.transform * glm::vec4((primitive.m_BoundsMin + primitive.m_BoundsMax) * 0.5f, 1.0f));
+            glm::vec3 offset = center - cameraPosition;
+            blendedDraws.push_back({ &mesh, &primitive, glm::dot(offset, offset), 0 });
+        }
+    }
+
+    std::sort(blendedDraws.begin(), blendedDraws.end(), [](const PrimitiveDraw& a, const PrimitiveDraw& b)
+        {
+            return a.distanceSquared > b.distanceSquared;
+        });
+    return blendedDraws;
+}
+
+void cModel::drawBlendedSorted(Shader& shader, const glm::vec3& cameraPosition)
+{
+    for (const auto& blendedDraw : getBlendedDraws(cameraPosition))
+    {
+        shader.setMat4("model", blendedDraw.mesh->transform);
+        blendedDraw.primitive->draw(shader);
+    }
+}
+
+void cModel::drawBlendedSorted(ShaderPermutations& permutations, uint32_t frameFeatures, const glm::vec3& cameraPosition)
+{
+    // Back-to-front order wins over grouping, the variant changes whenever the next one needs another
+    uint32_t currentFeatures = UINT32_MAX;
+    Shader* shader = nullptr;
+    for (const auto& blendedDraw : getBlendedDraws(cameraPosition))
+    {
+        uint32_t features = ShaderPermutations::select(blendedDraw.primitive->getShaderFeatures(), frameFeatures);
+        if (features != currentFeatures)
+        {
+            shader = &permutations.use(features);
+            currentFeatures = features;
+        }
+        shader->setMat4("model", blendedDraw.mesh->transform);
+        blendedDraw.primitive->draw(*shader);
+    }
+}
+
+void cModel::updateShaderFeatures()
+{
+    for (auto& mesh : meshes)
+    {
+        for (auto& primitive : mesh.primitives)
+        {
+            primitive.m_ShaderFeatures = ShaderPermutations::getMaterialFeatures(primitive.m_material);
+        }
+    }
+}
 
 void cModel::checkGLError(const std::string& message)
 {
@@ -115,81 +281,258 @@ bool is_base64_encoded_image(const char* uri)
     return false;
 }
 
+int hexDigitValue(char c)
+{
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// Percent-decoding only. '+' is kept, it is a literal character in URIs (and in base64)
+std::string percentDecode(std::string_view encoded)
+{
+    std::string decoded;
+    decoded.reserve(encoded.size());
+    for (size_t i = 0; i < encoded.size(); ++i)
+    {
+        int hi, lo;
+        if (encoded[i] == '%' && i + 2 < encoded.size() && (hi = hexDigitValue(encoded[i + 1])) >= 0 && (lo = hexDigitValue(encoded[i + 2])) >= 0)
+        {
+            decoded += static_cast<char>(hi * 16 + lo);
+            i += 2;
+        }
+        else
+        {
+            decoded += encoded[i];
+        }
+    }
+    return decoded;
+}
+
 std::string urlDecode(const std::string& encoded)
 {
-    std::ostringstream decoded;
-    for (size_t i = 0; i < encoded.length(); ++i) {
-        if (encoded[i] == '%' && (i + 2) < encoded.length()) {
-            std::istringstream iss(encoded.substr(i + 1, 2));
-            int hexValue;
-            if (iss >> std::hex >> hexValue) {
-                decoded << static_cast<char>(hexValue);
-                i += 2;
-            }
-            else {
-                decoded << encoded[i];
-            }
+    std::string decoded = percentDecode(encoded);
+    std::replace(decoded.begin(), decoded.end(), '+', ' ');
+    return decoded;
+}
+
+// Decodes the payload of a data: URI straight into destination, sized with base64DecodedSize()
+bool decodeDataUri(const char* uri, std::vector<unsigned char>& destination)
+{
+    const char* comma = strchr(uri, ',');
+    if (comma == nullptr)
+    {
+        return false;
+    }
+    std::string_view payload(comma + 1);
+    std::string unescaped;
+    if (payload.find('%') != std::string_view::npos)
+    {
+        unescaped = percentDecode(payload);
+        payload = unescaped;
+    }
+    destination.resize(base64DecodedSize(payload));
+    return base64DecodeInto(payload, destination.data());
+}
+
+// cgltf_load_buffers() skips buffers that already have data, so base64 buffers decoded here
+// never go through its scalar decoder. The memory is released by cgltf_free().
+cgltf_result decodeBase64Buffers(cgltf_data* data)
+{
+    for (cgltf_size i = 0; i < data->buffers_count; ++i)
+    {
+        cgltf_buffer& buffer = data->buffers[i];
+        if (buffer.data || buffer.uri == nullptr || strncmp(buffer.uri, "data:", 5) != 0)
+        {
+            continue;
         }
-        else if (encoded[i] == '+') {
-            decoded << ' ';
+        const char* comma = strchr(buffer.uri, ',');
+        if (comma == nullptr || comma - buffer.uri < 7 || strncmp(comma - 7, ";base64", 7) != 0)
+        {
+            continue;
         }
-        else {
-            decoded << encoded[i];
+
+        std::string_view payload(comma + 1);
+        if (base64DecodedSize(payload) < buffer.size)
+        {
+            return cgltf_result_io_error;
+        }
+        unsigned char* bufferData = static_cast<unsigned char*>(malloc(base64DecodedSize(payload)));
+        if (bufferData == nullptr)
+        {
+            return cgltf_result_out_of_memory;
         }
+        if (!base64DecodeInto(payload, bufferData))
+        {
+            free(bufferData);
+            return cgltf_result_io_error;
+        }
+        buffer.data = bufferData;
+        buffer.data_free_method = cgltf_data_free_method_memory_free;
     }
-    return decoded.str();
+    return cgltf_result_success;
 }
 
-void cModel::loadTexture(cgltf_texture* texture, std::shared_ptr<Texture>& textureObject)
+// CPU memory a texture holds until uploadToGpu clears it
+uint64_t getDecodedBytes(const Texture& texture)
 {
-    cgltf_image* image = texture->image;
+    uint64_t bytes = texture.m_data.size();
+    for (const MipmapData& level : texture.m_ddsData)
+    {
+        bytes += level.data.size();
+    }
+    return bytes;
+}
 
-    if (image->buffer_view)
+void cModel::loadTexture(cgltf_texture* texture, std::shared_ptr<Texture>& textureObject, CookFormat cookFormat, bool srgb, bool streamable)
+{
+    PROFILE_SCOPE("Load texture");
+    cgltf_image* image = texture->image;
+    auto webpImage = m_WebPImages.find(texture);
+    if (webpImage != m_WebPImages.end())
     {
-        textureObject = std::make_shared<Texture>();
-        void* bufferData = image->buffer_view->buffer->data;
-        size_t bufferOffset = image->buffer_view->offset;
-        size_t bufferLength = image->buffer_view->size;
+        image = webpImage->second;
+    }
+    if (image == nullptr)
+    {
+        std::cerr << "Texture has no image in a format that can be decoded" << std::endl;
+        return;
+    }
+    ++m_TextureCacheStats.lookups;
 
-        unsigned char* imageData = static_cast<unsigned char*>(bufferData) + bufferOffset;
-        textureObject->loadStandardTextureFromBuffer(imageData, bufferLength);
-        textureObject->m_isDDS = false;
+    // Embedded images have no file name, their cgltf_image is just as unique
+    bool isEmbedded = image->buffer_view || (image->uri && is_base64_encoded_image(image->uri));
+    std::string cacheKey = isEmbedded ? "#image" + std::to_string(reinterpret_cast<uintptr_t>(image)) : std::string(image->uri ? image->uri : "");
+    auto it = m_TextureCache.find(cacheKey);
+    if (it != m_TextureCache.end())
+    {
+        ++m_TextureCacheStats.hits;
+        textureObject = it->second;
+        return;
     }
-    if (image && image->uri)
+    // A file the live model already uses is kept, HotReloader updates it in place when it
+    // changes. Embedded keys hold pointers of a freed cgltf_data, those only match by content.
+    if (m_Previous && !isEmbedded)
     {
-        std::string path = urlDecode(image->uri);
-        if (is_base64_encoded_image(image->uri))
+        auto previousIt = m_Previous->m_TextureCache.find(cacheKey);
+        // A cooked texture whose source was edited since is loaded again from the source
+        bool staleCook = previousIt != m_Previous->m_TextureCache.end() && !previousIt->second->m_SourcePath.empty() &&
+            !TextureCooker::isUpToDate(previousIt->second->m_SourcePath, previousIt->second->m_path);
+        if (previousIt != m_Previous->m_TextureCache.end() && !staleCook)
         {
-            std::string base64String = path.substr(path.find(',') + 1);
-            std::cout << "Image is base64 encoded" << "\n";
+            ++m_ReloadReport.reusedTextures;
+            textureObject = previousIt->second;
+            m_TextureCache[cacheKey] = textureObject;
+            return;
+        }
+    }
 
-            std::string decodedData = base64_decode(base64String);
-            textureObject = std::make_shared<Texture>();
-            textureObject->loadStandardTextureFromBuffer((unsigned char*)decodedData.data(), decodedData.size());
-            textureObject->m_isDDS = false;
+    if (isEmbedded)
+    {
+        // Different images can embed the same bytes, decode every distinct stream once
+        std::vector<unsigned char> decodedData;
+        const unsigned char* imageData;
+        size_t imageLength;
+        if (image->buffer_view)
+        {
+            imageData = static_cast<const unsigned char*>(image->buffer_view->buffer->data) + image->buffer_view->offset;
+            imageLength = image->buffer_view->size;
         }
         else
         {
-            std::string fullPath = directory + '/' + path;
+            if (!decodeDataUri(image->uri, decodedData))
+            {
+                std::cerr << "Invalid base64 image data" << std::endl;
+                return;
+            }
+            imageData = decodedData.data();
+            imageLength = decodedData.size();
+        }
 
-            auto it = m_TextureCache.find(image->uri);
+        uint64_t contentHash = xxhash64::hash(imageData, imageLength);
+        auto contentIt = m_ImageContentCache.find(contentHash);
+        auto previousIt = m_Previous ? m_Previous->m_ImageContentCache.find(contentHash) : m_ImageContentCache.end();
+        if (contentIt != m_ImageContentCache.end())
+        {
+            ++m_TextureCacheStats.hits;
+            ++m_TextureCacheStats.contentHits;
+            textureObject = contentIt->second;
+        }
+        else if (m_Previous && previousIt != m_Previous->m_ImageContentCache.end())
+        {
+            ++m_ReloadReport.reusedTextures;
+            textureObject = previousIt->second;
+            m_ImageContentCache[contentHash] = textureObject;
+        }
+        else
+        {
+            ++m_TextureCacheStats.misses;
+            LoadPhaseScope decodeScope(m_LoadReport, LOAD_PHASE_IMAGE_DECODE);
+            textureObject = std::make_shared<Texture>();
+            textureObject->loadStandardTextureFromBuffer(const_cast<unsigned char*>(imageData), imageLength);
+            textureObject->m_isDDS = false;
+            decodeScope.setBytes(getDecodedBytes(*textureObject));
+            m_LoadReport.addTexture(image, image->name ? image->name : "", getDecodedBytes(*textureObject), decodeScope.getElapsedNs());
+            m_ImageContentCache[contentHash] = textureObject;
+        }
+        m_TextureCache[cacheKey] = textureObject;
+        return;
+    }
 
-            if (it != m_TextureCache.end())
+    if (image->uri)
+    {
+        ++m_TextureCacheStats.misses;
+        std::string fullPath = directory + '/' + urlDecode(image->uri);
+        std::string sourcePath;
+        std::string fileExtension = fullPath.substr(fullPath.find_last_of(".") + 1);
+        bool isDDS = fileExtension == "dds";
+        bool isKTX = KTXLoader::isKTX(fullPath);
+        if (!isDDS && !isKTX && m_UseCookedTextures)
+        {
+            // Prefer the block compressed copy written by TextureCooker
+            std::string cookedPath = TextureCooker::getCookedPath(fullPath);
+            if (TextureCooker::isUpToDate(fullPath, cookedPath))
             {
-                textureObject = it->second;
+                sourcePath = fullPath;
+                fullPath = cookedPath;
+                isDDS = true;
             }
-            else
+            else if (m_CookTextures)
             {
-                
-                
-                std::string fileExtension = fullPath.substr(fullPath.find_last_of(".") + 1);
-   
-                textureObject = std::make_shared<Texture>(fullPath, fileExtension == "dds");
-                m_TextureCache[image->uri] = textureObject;
+                m_CookJobs.push_back({ fullPath, cookedPath, cookFormat, srgb });
             }
         }
+
+        bool stream = m_StreamTextures && streamable;
+        if (isKTX || (isDDS && !stream))
+        {
+            // Already GPU ready, uploaded from the mapped file when the materials create their textures
+            textureObject = std::make_shared<Texture>();
+            textureObject->m_path = fullPath;
+            textureObject->m_isDDS = isDDS;
+            textureObject->m_isMapped = true;
+        }
+        else if (stream)
+        {
+            // Only remember where it is, nothing is decoded until it is first seen
+            textureObject = std::make_shared<Texture>();
+            textureObject->m_path = fullPath;
+            textureObject->m_isDDS = isDDS;
+            textureObject->m_Streamed = true;
+        }
+        else
+        {
+            LoadPhaseScope decodeScope(m_LoadReport, LOAD_PHASE_IMAGE_DECODE);
+            textureObject = std::make_shared<Texture>(fullPath, isDDS);
+            textureObject->m_path = fullPath;
+            decodeScope.setBytes(getDecodedBytes(*textureObject));
+            m_LoadReport.addTexture(image, image->uri, getDecodedBytes(*textureObject), decodeScope.getElapsedNs());
+        }
+        textureObject->m_SourcePath = sourcePath;
+        textureObject->m_SRGB = srgb;
+        m_TextureCache[cacheKey] = textureObject;
     }
-    checkGLError("Error");
 }
 
 Material cModel::createMaterial(cgltf_primitive* primitive)
@@ -202,24 +545,50 @@ Material cModel::createMaterial(cgltf_primitive* primitive)
         cgltf_material* material = primitive->material;
         cgltf_pbr_metallic_roughness* pbr = &material->pbr_metallic_roughness;
         newMaterial.hasColorTexture = false;
+        switch (material->alpha_mode)
+        {
+        case cgltf_alpha_mode_mask:
+            newMaterial.alphaMode = ALPHA_MODE_MASK;
+            newMaterial.alphaCutoff = material->alpha_cutoff;
+            break;
+        case cgltf_alpha_mode_blend:
+            newMaterial.alphaMode = ALPHA_MODE_BLEND;
+            break;
+        default:
+            newMaterial.alphaMode = ALPHA_MODE_OPAQUE;
+            break;
+        }
         if (primitive->material->normal_texture.texture)
         {
-            loadTexture(material->normal_texture.texture, newMaterial.normalTexture);
+            loadTexture(material->normal_texture.texture, newMaterial.normalTexture, COOK_BC5);
+            newMaterial.normalSampler = GpuTextureCache::getSamplerDesc(material->normal_texture.texture->sampler);
+        }
+        if (material->occlusion_texture.texture)
+        {
+            loadTexture(material->occlusion_texture.texture, newMaterial.occlusionTexture);
+            newMaterial.occlusionSampler = GpuTextureCache::getSamplerDesc(material->occlusion_texture.texture->sampler);
+        }
+        if (material->emissive_texture.texture)
+        {
+            loadTexture(material->emissive_texture.texture, newMaterial.emissiveTexture, COOK_AUTO, true);
+            newMaterial.emissiveSampler = GpuTextureCache::getSamplerDesc(material->emissive_texture.texture->sampler);
         }
         if (pbr)
         {
             color = glm::vec4(pbr->base_color_factor[0], pbr->base_color_factor[1],
                 pbr->base_color_factor[2], pbr->base_color_factor[3]);
             newMaterial.baseColor = color;
+            newMaterial.metallicFactor = pbr->metallic_factor;
+            newMaterial.roughnessFactor = pbr->roughness_factor;
         }
         if (pbr->base_color_texture.texture)
         {
             //std::cout << "Has color texture" << "\n";
             newMaterial.hasColorTexture = true;
-            loadTexture(pbr->base_color_texture.texture, newMaterial.colorTexture);
+            loadTexture(pbr->base_color_texture.texture, newMaterial.colorTexture, COOK_AUTO, true, true);
+            newMaterial.colorSampler = GpuTextureCache::getSamplerDesc(pbr->base_color_texture.texture->sampler);
         }
     }
-    checkGLError("Error");
     return newMaterial;
 }
 
@@ -228,7 +597,11 @@ void cModel::loadModel(const char* path)
     // Parse the GLTF file
     cgltf_options options = {};
     cgltf_data* data = nullptr;
-    cgltf_result result = cgltf_parse_file(&options, path, &data);
+    cgltf_result result;
+    {
+        LoadPhaseScope parseScope(m_LoadReport, LOAD_PHASE_PARSE);
+        result = cgltf_parse_file(&options, path, &data);
+    }
 
     if (result != cgltf_result_success) 
     {
@@ -236,16 +609,69 @@ void cModel::loadModel(const char* path)
         return;
     }
 
+    m_LoadReport.markBoundary("JSON parsed");
+
     // Load buffers
-    result = cgltf_load_buffers(&options, data, path);
+    {
+        LoadPhaseScope bufferScope(m_LoadReport, LOAD_PHASE_BUFFERS);
+        result = decodeBase64Buffers(data);
+        if (result == cgltf_result_success)
+        {
+            result = cgltf_load_buffers(&options, data, path);
+        }
+        uint64_t bufferBytes = 0;
+        for (cgltf_size i = 0; i < data->buffers_count; ++i)
+        {
+            bufferBytes += data->buffers[i].size;
+        }
+        bufferScope.setBytes(bufferBytes);
+    }
     if (result != cgltf_result_success) 
     {
         std::cerr << "Failed to load buffers for GLTF file: " << path << std::endl;
         cgltf_free(data);
         return;
     }
+    m_LoadReport.markBoundary("Buffers loaded");
 
-    std::cout << "Number of nodes: " << data->nodes_count << "\n";
+    // Nodes targeted by an animation channel (and their children) are treated as dynamic
+    for (cgltf_size i = 0; i < data->animations_count; ++i)
+    {
+        const cgltf_animation& animation = data->animations[i];
+        for (cgltf_size j = 0; j < animation.channels_count; ++j)
+        {
+            if (animation.channels[j].target_node)
+            {
+                m_AnimatedNodes.insert(animation.channels[j].target_node);
+            }
+        }
+    }
+
+    // EXT_texture_webp points at a WebP image, texture->image is only the PNG/JPEG fallback.
+    // cgltf keeps the extension as raw JSON: { "source": <image index> }
+    if (ImageCodecs::get().find("WebP"))
+    {
+        for (cgltf_size i = 0; i < data->textures_count; ++i)
+        {
+            const cgltf_texture& texture = data->textures[i];
+            for (cgltf_size j = 0; j < texture.extensions_count; ++j)
+            {
+                const char* source = texture.extensions[j].data ? strstr(texture.extensions[j].data, "\"source\"") : nullptr;
+                const char* colon = source ? strchr(source, ':') : nullptr;
+                if (strcmp(texture.extensions[j].name, "EXT_texture_webp") != 0 || colon == nullptr)
+                {
+                    continue;
+                }
+                long imageIndex = strtol(colon + 1, nullptr, 10);
+                if (imageIndex >= 0 && static_cast<cgltf_size>(imageIndex) < data->images_count)
+                {
+                    m_WebPImages[&texture] = &data->images[imageIndex];
+                }
+            }
+        }
+    }
+
+    m_LoadReport.m_NodeCount = data->nodes_count;
     // Process Nodes
     for (cgltf_size i = 0; i < data->nodes_count; ++i) 
     {
@@ -255,13 +681,15 @@ void cModel::loadModel(const char* path)
         }
     }
 
-    std::cout << "Total amount of primitives: " << totalPrimitives << "\n";
+    m_LoadReport.markBoundary("Nodes processed");
+    std::cout << "Number of punctual lights: " << m_Lights.size() << "\n";
 
     // Free the loaded data
+    m_WebPImages.clear();
     cgltf_free(data);
 }
 
-void cModel::processNode(cgltf_node* node, const glm::mat4& parentTransform)
+void cModel::processNode(cgltf_node* node, const glm::mat4& parentTransform, bool parentAnimated)
 {
     if (!node) {
         std::cerr << "Invalid node pointer" << std::endl;
@@ -282,15 +710,57 @@ void cModel::processNode(cgltf_node* node, const glm::mat4& parentTransform)
         nodeTransform = parentTransform * glm::translate(glm::mat4(1.0f), translation) * glm::toMat4(rotation) * glm::scale(glm::mat4(1.0f), scale);
     }
 
+    bool animated = parentAnimated || m_AnimatedNodes.count(node) > 0;
     if (node->mesh) {
         meshes.push_back(processMesh(node->mesh, nodeTransform));
+        meshes.back().m_Dynamic = animated;
+    }
+
+    if (node->light) {
+        processLight(node->light, nodeTransform);
     }
 
     for (cgltf_size i = 0; i < node->children_count; ++i) {
-        processNode(node->children[i], nodeTransform);
+        processNode(node->children[i], nodeTransform, animated);
     }
 }
 
+void cModel::processLight(cgltf_light* light, const glm::mat4& transform)
+{
+    PunctualLight newLight;
+    glm::vec3 color = glm::make_vec3(light->color);
+    glm::vec3 position = glm::vec3(transform * glm::vec4(0.0f, 0.0f, 0.0f, 1.0f));
+    // KHR_lights_punctual lights point down the node's local -Z axis
+    glm::vec3 direction = glm::normalize(glm::mat3(transform) * glm::vec3(0.0f, 0.0f, -1.0f));
+
+    float range = light->range;
+    if (range <= 0.0f)
+    {
+        // Unbounded in the file: cut off where the inverse square falloff drops below ~1/256
+        float maxComponent = std::max(color.r, std::max(color.g, color.b));
+        range = std::sqrt(light->intensity * maxComponent * 256.0f);
+    }
+
+    PunctualLightType type = LIGHT_POINT;
+    switch (light->type)
+    {
+    case cgltf_light_type_directional:
+        type = LIGHT_DIRECTIONAL;
+        break;
+    case cgltf_light_type_spot:
+        type = LIGHT_SPOT;
+        break;
+    default:
+        type = LIGHT_POINT;
+        break;
+    }
+
+    newLight.positionRange = glm::vec4(position, range);
+    newLight.colorIntensity = glm::vec4(color, light->intensity);
+    newLight.directionType = glm::vec4(direction, static_cast<float>(type));
+    newLight.spotCone = glm::vec4(std::cos(light->spot_inner_cone_angle), std::cos(light->spot_outer_cone_angle), 0.0f, 0.0f);
+    m_Lights.push_back(newLight);
+}
 
 void cModel::extractAttributes(cgltf_primitive* primitive, cgltf_accessor*& positions, cgltf_accessor*& normals, cgltf_accessor*& texCoords0, cgltf_accessor*& texCoords1, cgltf_accessor*& tangents, cgltf_accessor*& colors)
 {
@@ -343,18 +813,50 @@ float* cModel::getBufferData(cgltf_accessor* accessor)
 
 cMesh cModel::processMesh(cgltf_mesh* mesh, glm::mat4 transform)
 {
+    PROFILE_SCOPE("Process mesh");
     std::vector<cPrimitive> primitives;
     GLenum index_type = GL_UNSIGNED_SHORT;
-    
-    totalPrimitives += mesh->primitives_count;
+    // Textures first used by this mesh are decoded inside it, they are reported on their own
+    uint64_t start = Profiler::now();
+    uint64_t imageDecodeNs = m_LoadReport.getPhase(LOAD_PHASE_IMAGE_DECODE).ns;
+
+    m_LoadReport.m_PrimitiveCount += mesh->primitives_count;
     for (cgltf_size p = 0; p < mesh->primitives_count; ++p) 
     {
         try
         {
             cgltf_primitive* primitive = &mesh->primitives[p];
+            uint64_t geometryHash = hashGeometry(primitive, index_type);
+            uint64_t materialHash = hashMaterial(primitive->material);
+            auto previous = m_PreviousPrimitives.find(geometryHash);
+            if (previous != m_PreviousPrimitives.end())
+            {
+                // Vertex data and GL objects are kept. The material is created anyway, so its
+                // textures land in m_TextureCache, but only used when its parameters changed.
+                cPrimitive newPrimitive = *previous->second;
+                Material newMaterial = createMaterial(primitive);
+                if (newPrimitive.m_MaterialHash != materialHash)
+                {
+                    newPrimitive.m_material = newMaterial;
+                    newPrimitive.m_MaterialHash = materialHash;
+                    ++m_ReloadReport.rebuiltMaterials;
+                }
+                else
+                {
+                    ++m_ReloadReport.reusedPrimitives;
+                }
+                index_type = newPrimitive.m_indexType;
+                newPrimitive.m_PrimIndex = p;
+                primitives.push_back(std::move(newPrimitive));
+                continue;
+            }
+
             cPrimitive newPrimitive = processPrimitive(primitive, index_type);
             newPrimitive.m_PrimIndex = p;
+            newPrimitive.m_GeometryHash = geometryHash;
+            newPrimitive.m_MaterialHash = materialHash;
             primitives.push_back(std::move(newPrimitive));
+            ++m_ReloadReport.rebuiltPrimitives;
         }
         catch (const std::exception& e)
         {
@@ -363,13 +865,250 @@ cMesh cModel::processMesh(cgltf_mesh* mesh, glm::mat4 transform)
         } 
     }
 
+    uint64_t meshBytes = 0;
+    for (const cPrimitive& primitive : primitives)
+    {
+        meshBytes += primitive.m_interleavedData.size() * sizeof(float) + primitive.m_indices.size() * sizeof(unsigned int);
+    }
+    uint64_t meshNs = Profiler::now() - start - (m_LoadReport.getPhase(LOAD_PHASE_IMAGE_DECODE).ns - imageDecodeNs);
+    m_LoadReport.addMesh(mesh, mesh->name, meshBytes, meshNs);
 
- 
     cMesh newMesh(std::move(primitives));
     newMesh.transform = transform;
     return newMesh;
 }
 
+uint64_t hashAccessor(const cgltf_accessor* accessor, uint64_t seed)
+{
+    if (accessor == nullptr)
+    {
+        return seed;
+    }
+    uint64_t layout[5] = { accessor->count, static_cast<uint64_t>(accessor->type), static_cast<uint64_t>(accessor->component_type), accessor->normalized ? 1u : 0u, accessor->is_sparse ? accessor->sparse.count : 0 };
+    seed = xxhash64::hash(layout, sizeof(layout), seed);
+
+    const cgltf_buffer_view* views[3] = { accessor->buffer_view, nullptr, nullptr };
+    if (accessor->is_sparse)
+    {
+        views[1] = accessor->sparse.indices_buffer_view;
+        views[2] = accessor->sparse.values_buffer_view;
+    }
+    for (const cgltf_buffer_view* view : views)
+    {
+        if (view == nullptr || view->buffer->data == nullptr)
+        {
+            continue;
+        }
+        const unsigned char* data = static_cast<const unsigned char*>(view->buffer->data) + view->offset;
+        size_t length = view->size;
+        if (view == accessor->buffer_view && accessor->count > 0)
+        {
+            // Only the bytes the accessor reads, views are often shared by many accessors
+            data += accessor->offset;
+            length = (accessor->count - 1) * accessor->stride + cgltf_calc_size(accessor->type, accessor->component_type);
+        }
+        seed = xxhash64::hash(data, length, seed);
+    }
+    return seed;
+}
+
+uint64_t cModel::hashGeometry(const cgltf_primitive* primitive, GLenum index_type) const
+{
+    // index_type carries over from the previous primitive when this one has no indices
+    uint64_t hash = xxhash64::hash(&index_type, sizeof(index_type));
+    for (cgltf_size i = 0; i < primitive->attributes_count; ++i)
+    {
+        const cgltf_attribute& attribute = primitive->attributes[i];
+        uint64_t semantic[2] = { static_cast<uint64_t>(attribute.type), static_cast<uint64_t>(attribute.index) };
+        hash = xxhash64::hash(semantic, sizeof(semantic), hash);
+        hash = hashAccessor(attribute.data, hash);
+    }
+    hash = hashAccessor(primitive->indices, hash);
+    if (primitive->has_draco_mesh_compression && primitive->draco_mesh_compression.buffer_view)
+    {
+        const cgltf_buffer_view* view = primitive->draco_mesh_compression.buffer_view;
+        hash = xxhash64::hash(static_cast<const unsigned char*>(view->buffer->data) + view->offset, view->size, hash);
+    }
+    return hash;
+}
+
+uint64_t cModel::hashTextureView(const cgltf_texture_view& view, uint64_t seed) const
+{
+    if (view.texture == nullptr)
+    {
+        return xxhash64::hash("-", 1, seed);
+    }
+    SamplerDesc sampler = GpuTextureCache::getSamplerDesc(view.texture->sampler);
+    seed = xxhash64::hash(&sampler, sizeof(sampler), seed);
+
+    cgltf_image* image = view.texture->image;
+    auto webpImage = m_WebPImages.find(view.texture);
+    if (webpImage != m_WebPImages.end())
+    {
+        image = webpImage->second;
+    }
+    if (image == nullptr)
+    {
+        return seed;
+    }
+    // Same identity loadTexture uses: the URI, or the bytes of a buffer view
+    if (image->buffer_view && image->buffer_view->buffer->data)
+    {
+        return xxhash64::hash(static_cast<const unsigned char*>(image->buffer_view->buffer->data) + image->buffer_view->offset, image->buffer_view->size, seed);
+    }
+    const char* uri = image->uri ? image->uri : "";
+    return xxhash64::hash(uri, strlen(uri), seed);
+}
+
+uint64_t cModel::hashMaterial(const cgltf_material* material) const
+{
+    if (material == nullptr)
+    {
+        return 0;
+    }
+    const cgltf_pbr_metallic_roughness& pbr = material->pbr_metallic_roughness;
+    float parameters[8] = { pbr.base_color_factor[0], pbr.base_color_factor[1], pbr.base_color_factor[2], pbr.base_color_factor[3],
+                            pbr.metallic_factor, pbr.roughness_factor, material->alpha_cutoff, static_cast<float>(material->alpha_mode) };
+    uint64_t hash = xxhash64::hash(parameters, sizeof(parameters));
+    hash = hashTextureView(pbr.base_color_texture, hash);
+    hash = hashTextureView(material->normal_texture, hash);
+    hash = hashTextureView(material->occlusion_texture, hash);
+    return hashTextureView(material->emissive_texture, hash);
+}
+
+VertexStream getVertexStream(const cgltf_accessor* accessor)
+{
+    VertexStream stream;
+    if (!accessor || !accessor->buffer_view || !accessor->buffer_view->buffer)
+    {
+        return stream;
+    }
+    // cgltf sets the accessor's stride to the view's byteStride, or to the element size when the view has none
+    stream.data = reinterpret_cast<const float*>(static_cast<const char*>(accessor->buffer_view->buffer->data) + accessor->buffer_view->offset + accessor->offset);
+    stream.stride = accessor->stride;
+    return stream;
+}
+
+static const float* getElement(const VertexStream& stream, size_t i)
+{
+    return reinterpret_cast<const float*>(reinterpret_cast<const char*>(stream.data) + i * stream.stride);
+}
+
+void interleaveVertices(const VertexStream& positions, const VertexStream& normals, const VertexStream& tangents, const VertexStream& texCoords, size_t count, std::vector<float>& interleaved)
+{
+    interleaved.resize(count * 11);
+    float* out = interleaved.data();
+    for (size_t i = 0; i < count; ++i, out += 11)
+    {
+        const float* position = getElement(positions, i);
+        const float* normal = getElement(normals, i);
+        out[0] = position[0];
+        out[1] = position[1];
+        out[2] = position[2];
+        out[3] = normal[0];
+        out[4] = normal[1];
+        out[5] = normal[2];
+        if (tangents.data)
+        {
+            const float* tangent = getElement(tangents, i);
+            out[6] = tangent[0];
+            out[7] = tangent[1];
+            out[8] = tangent[2];
+        }
+        else
+        {
+            out[6] = out[7] = out[8] = 0.0f;
+        }
+        if (texCoords.data)
+        {
+            const float* texCoord = getElement(texCoords, i);
+            out[9] = texCoord[0];
+            out[10] = texCoord[1];
+        }
+        else
+        {
+            out[9] = out[10] = 0.0f;
+        }
+    }
+}
+
+bool decodeDracoPrimitive(const char* data, size_t size, std::vector<float>& interleaved, std::vector<unsigned int>& indices)
+{
+    draco::DecoderBuffer buffer;
+    buffer.Init(data, size);
+    draco::Decoder decoder;
+    auto decoded = decoder.DecodeMeshFromBuffer(&buffer);
+    if (!decoded.ok())
+    {
+        std::cerr << "Draco decode failed: " << decoded.status().error_msg() << "\n";
+        return false;
+    }
+    std::unique_ptr<draco::Mesh> mesh = std::move(decoded).value();
+
+    const draco::PointAttribute* positions = mesh->GetNamedAttribute(draco::GeometryAttribute::POSITION);
+    const draco::PointAttribute* normals = mesh->GetNamedAttribute(draco::GeometryAttribute::NORMAL);
+    const draco::PointAttribute* texCoords = mesh->GetNamedAttribute(draco::GeometryAttribute::TEX_COORD);
+    const draco::PointAttribute* tangents = mesh->GetNamedAttribute(draco::GeometryAttribute::TANGENT);
+    if (!positions)
+    {
+        std::cerr << "Draco mesh has no positions" << "\n";
+        return false;
+    }
+
+    // Attribute values are shared between points, GetMappedValue resolves them per point
+    interleaved.assign(static_cast<size_t>(mesh->num_points()) * 11, 0.0f);
+    float* out = interleaved.data();
+    for (draco::PointIndex i(0); i < mesh->num_points(); ++i, out += 11)
+    {
+        positions->GetMappedValue(i, out);
+        if (normals)
+        {
+            normals->GetMappedValue(i, out + 3);
+        }
+        if (tangents)
+        {
+            // glTF tangents are vec4, the w sign is not used
+            float tangent[4] = {};
+            tangents->GetMappedValue(i, tangent);
+            std::copy_n(tangent, 3, out + 6);
+        }
+        if (texCoords)
+        {
+            texCoords->GetMappedValue(i, out + 9);
+        }
+    }
+
+    indices.resize(static_cast<size_t>(mesh->num_faces()) * 3);
+    for (draco::FaceIndex i(0); i < mesh->num_faces(); ++i)
+    {
+        const draco::Mesh::Face& face = mesh->face(i);
+        indices[i.value() * 3] = face[0].value();
+        indices[i.value() * 3 + 1] = face[1].value();
+        indices[i.value() * 3 + 2] = face[2].value();
+    }
+    return true;
+}
+
+void convertIndices(const void* data, size_t count, GLenum indexType, std::vector<unsigned int>& indices)
+{
+    switch (indexType)
+    {
+    case GL_UNSIGNED_INT:
+        indices.resize(count);
+        std::copy_n(static_cast<const unsigned int*>(data), count, indices.begin());
+        break;
+    case GL_UNSIGNED_SHORT:
+        indices.assign(static_cast<const unsigned short*>(data), static_cast<const unsigned short*>(data) + count);
+        break;
+    case GL_UNSIGNED_BYTE:
+        indices.assign(static_cast<const unsigned char*>(data), static_cast<const unsigned char*>(data) + count);
+        break;
+    default:
+        indices.clear();
+        break;
+    }
+}
+
 cPrimitive cModel::processPrimitive(cgltf_primitive* primitive, GLenum& index_type)
 {
     cgltf_accessor* positions = nullptr;
@@ -404,174 +1143,45 @@ cPrimitive cModel::processPrimitive(cgltf_primitive* primitive, GLenum& index_ty
 
 
     std::vector<float> interleavedData;
-    interleavedData.reserve(positions->count * 11);
-
-    // TODO
+    std::vector<unsigned int> indices;
     if (primitive->has_draco_mesh_compression)
     {
-        cgltf_draco_mesh_compression* draco_compression = &primitive->draco_mesh_compression;
-        draco::DecoderBuffer draco_buffer;
-        draco_buffer.Init(
-            static_cast<const char*>(draco_compression->buffer_view->buffer->data) + draco_compression->buffer_view->offset,
-            draco_compression->buffer_view->size
-        );
-        draco::Decoder decoder;
- 
-        std::unique_ptr<draco::Mesh> mesh = decoder.DecodeMeshFromBuffer(&draco_buffer).value();
-
-        const draco::PointAttribute* pos_attr = mesh->GetNamedAttribute(draco::GeometryAttribute::POSITION);
-        const draco::PointAttribute* norm_attr = mesh->GetNamedAttribute(draco::GeometryAttribute::NORMAL);
-        const draco::PointAttribute* tex_attr = mesh->GetNamedAttribute(draco::GeometryAttribute::TEX_COORD);
-        const draco::PointAttribute* tang_attr = mesh->GetNamedAttribute(draco::GeometryAttribute::TANGENT);
-        
-
-        std::vector<float> vertices;
-        std::vector<float> normals;
-        std::vector<float> texCoords;
-        std::vector<float> tangents;
-
-
-        if (pos_attr)
-        {
-            for (draco::AttributeValueIndex i(0); i < pos_attr->size(); ++i)
-            {
-                draco::Vector3f pos;
-                pos_attr->GetValue(i, &pos);
-                vertices.push_back(pos[0]);
-                vertices.push_back(pos[1]);
-                vertices.push_back(pos[2]);
-            }
-        }
-        if (norm_attr)
-        {
-            for (draco::AttributeValueIndex i(0); i < norm_attr->size(); ++i)
-            {
-                draco::Vector3f norm;
-                norm_attr->GetValue(i, &norm);
-                normals.push_back(norm[0]);
-                normals.push_back(norm[1]);
-                normals.push_back(norm[2]);
-            }
-        }
-        if (tex_attr)
-        {
-            for (draco::AttributeValueIndex i(0); i < tex_attr->size(); ++i)
-            {
-                draco::Vector2f tex;
-                tex_attr->GetValue(i, &tex);
-                texCoords.push_back(tex[0]);
-                texCoords.push_back(tex[1]);
-            }
-        }
-        if (tang_attr)
-        {
-            for (draco::AttributeValueIndex i(0); i < tang_attr->size(); ++i)
-            {
-                draco::Vector3f tang;
-                tang_attr->GetValue(i, &tang);
-                tangents.push_back(tang[0]);
-                tangents.push_back(tang[1]);
-                tangents.push_back(tang[2]);
-            }
-        }
-
-
-
-        for (size_t i = 0; i < vertices.size() - 2; ++i)
+        // The indices accessor of a compressed primitive has no buffer view, they come from the Draco faces
+        const cgltf_buffer_view* view = primitive->draco_mesh_compression.buffer_view;
+        LoadPhaseScope dracoScope(m_LoadReport, LOAD_PHASE_DRACO);
+        if (!decodeDracoPrimitive(static_cast<const char*>(view->buffer->data) + view->offset, view->size, interleavedData, indices))
         {
-            interleavedData.insert(interleavedData.end(), {
-                vertices[i], vertices[i + 1], vertices[i + 2],
-                normals[i * 3], normals[i * 3 + 1], normals[i * 3 + 2],
-                tang_attr ? tangents[i * 3] : 0.0f,
-                tang_attr ? tangents[i * 3 + 1] : 0.0f,
-                tang_attr ? tangents[i * 3 + 2] : 0.0f,
-                tex_attr ? texCoords[i * 2] : 0.0f,
-                tex_attr ? texCoords[i * 2 + 1] : 0.0f
-             });
+            throw std::runtime_error("Failed to decode Draco mesh");
         }
+        dracoScope.setBytes(interleavedData.size() * sizeof(float) + indices.size() * sizeof(unsigned int));
+        hasIndices = true;
+        index_type = GL_UNSIGNED_INT;
     }
     else
     {
-        float* vertices = getBufferData(positions);
-        float* normData = getBufferData(v_normals);
-        float* texData = getBufferData(tex_coords0);
-        float* tangData = getBufferData(tangents);
-
+        VertexStream vertices = getVertexStream(positions);
+        VertexStream normData = getVertexStream(v_normals);
 
-
-        if (!vertices || !normData)
+        if (!vertices.data || !normData.data)
         {
             std::cerr << "Error accessing buffer data for positions or normals" << "\n";
             throw std::runtime_error("Error accessing buffer data for positions or normals");
         }
 
-        if (positions->buffer_view->stride == 24)
-        {
-            for (size_t i = 0; i < positions->count; ++i)
-            {
-                interleavedData.insert(interleavedData.end(), {
-                    vertices[i * 6], vertices[i * 6 + 1], vertices[i * 6 + 2],
-                    vertices[(i-1) * 6 + 3], vertices[(i-1) * 6 + 4], vertices[(i-1) * 6 + 5],
-                    tangData ? tangData[i * 3] : 0.0f,
-                    tangData ? tangData[i * 3 + 1] : 0.0f,
-                    tangData ? tangData[i * 3 + 2] : 0.0f,
-                    texData ? texData[i * 2] : 0.0f,
-                    texData ? texData[i * 2 + 1] : 0.0f
-                    });
-            }
-        }
-        else
-        {
-            for (size_t i = 0; i < positions->count; ++i)
-            {
-                interleavedData.insert(interleavedData.end(), {
-                    vertices[i * 3], vertices[i * 3 + 1], vertices[i * 3 + 2],
-                    normData[i * 3], normData[i * 3 + 1], normData[i * 3 + 2],
-                    tangData ? tangData[i * 3] : 0.0f,
-                    tangData ? tangData[i * 3 + 1] : 0.0f,
-                    tangData ? tangData[i * 3 + 2] : 0.0f,
-                    texData ? texData[i * 2] : 0.0f,
-                    texData ? texData[i * 2 + 1] : 0.0f
-                    });
-            }
-        }
-
-
-    }
-    
-
-    void* bufferData = getBufferData(primitive->indices);
+        LoadPhaseScope interleaveScope(m_LoadReport, LOAD_PHASE_INTERLEAVE);
+        interleaveVertices(vertices, normData, getVertexStream(tangents), getVertexStream(tex_coords0), positions->count, interleavedData);
 
- 
-
-    std::vector<unsigned int> indices;
-    if (primitive->indices)
-    {
-        hasIndices = true;
-        indices.resize(primitive->indices->count);
-        void* bufferData = getBufferData(primitive->indices);
-        if (index_type == GL_UNSIGNED_INT)
+        if (primitive->indices)
         {
-            std::copy_n(static_cast<unsigned int*>(bufferData), primitive->indices->count, indices.begin());
+            hasIndices = true;
+            convertIndices(getBufferData(primitive->indices), primitive->indices->count, index_type, indices);
         }
-        else if (index_type == GL_UNSIGNED_SHORT)
-        {
-            std::vector<unsigned short> shortIndices(primitive->indices->count);
-            std::copy_n(static_cast<unsigned short*>(bufferData), primitive->indices->count, shortIndices.begin());
-            indices.assign(shortIndices.begin(), shortIndices.end());
-        }
-        else if (index_type == GL_UNSIGNED_BYTE)
+        else
         {
-            std::vector<unsigned char> byteIndices(primitive->indices->count);
-            std::copy_n(static_cast<unsigned char*>(bufferData), primitive->indices->count, byteIndices.begin());
-            indices.assign(byteIndices.begin(), byteIndices.end());
+            std::cout << "No indices" << "\n";
         }
+        interleaveScope.setBytes(interleavedData.size() * sizeof(float) + indices.size() * sizeof(unsigned int));
     }
-    else
-    {
-        std::cout << "No indices" << "\n";
-    }
-    
 
     Material newMaterial;
     try
@@ -589,21 +1199,188 @@ cPrimitive cModel::processPrimitive(cgltf_primitive* primitive, GLenum& index_ty
 
 
 
-void cModel::uploadToGpu(Shader& shader)
+void cModel::uploadToGpu(Shader& shader, TextureUploader* textureUploader)
 {
- 
+    PROFILE_SCOPE("Upload model");
+    // Textures handed to the uploader go up over the next frames and are not part of the load
+    LoadPhaseScope uploadScope(m_LoadReport, LOAD_PHASE_GPU_UPLOAD);
+    size_t textureBytes = m_GpuTextures.getStats().uniqueBytes;
+    uint64_t uploadedBytes = 0;
+    // Queued before the meshes so their materials leave these textures to the uploader
+    if (textureUploader)
+    {
+        for (const auto& pair : m_TextureCache)
+        {
+            const std::shared_ptr<Texture>& texture = pair.second;
+            if (!texture->m_Streamed && !texture->m_isMapped && !texture->m_AsyncUpload)
+            {
+                textureUploader->queue(texture);
+            }
+        }
+    }
+
     for (auto& mesh : meshes)
     {
         //shader.setMat4("model", mesh.transform);
         mesh.transformChanged = true;
-        mesh.uploadToGpu();
+        mesh.uploadToGpu(m_GpuTextures);
+        for (const auto& primitive : mesh.primitives)
+        {
+            // Interleaved vertices, the depth pre-pass positions and the indices
+            size_t indexSize = primitive.m_indexType == GL_UNSIGNED_BYTE ? 1 : (primitive.m_indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+            uploadedBytes += primitive.m_interleavedData.size() / 11 * 14 * sizeof(float) + primitive.m_indices.size() * indexSize;
+        }
     }
+    // Checked once for the whole model, glGetError per texture or primitive forces a driver sync
+    checkGLError("uploadToGpu");
+    m_GpuTextures.printStats();
     std::cout << "Number of texture" << m_TextureCache.size() << "\n";
     for (const auto& pair : m_TextureCache) {
         // pair is of type std::pair<const std::string, std::shared_ptr<Texture>>
         pair.second->clearData();
     }
-    
+    uploadScope.setBytes(uploadedBytes + m_GpuTextures.getStats().uniqueBytes - textureBytes);
+    m_LoadReport.markBoundary("Uploaded to GPU");
+}
+
+void cModel::destroyGpu()
+{
+    // Vertex arrays don't own their buffers, collect those before the arrays go
+    std::unordered_set<GLuint> buffers;
+    std::vector<GLuint> vertexArrays;
+    auto collect = [&buffers, &vertexArrays](GLuint vertexArray)
+        {
+            if (vertexArray == 0 || !glIsVertexArray(vertexArray))
+            {
+                return;
+            }
+            GLint buffer = 0;
+            glGetVertexArrayiv(vertexArray, GL_ELEMENT_ARRAY_BUFFER_BINDING, &buffer);
+            buffers.insert(static_cast<GLuint>(buffer));
+            glGetVertexArrayIndexediv(vertexArray, 0, GL_VERTEX_BINDING_BUFFER, &buffer);
+            buffers.insert(static_cast<GLuint>(buffer));
+            vertexArrays.push_back(vertexArray);
+        };
+    for (auto& mesh : meshes)
+    {
+        for (auto& primitive : mesh.primitives)
+        {
+            collect(primitive.m_VAO);
+            collect(primitive.m_DepthVAO);
+            primitive.m_VAO = primitive.m_DepthVAO = 0;
+        }
+    }
+    collect(m_VAO);
+    m_VAO = 0;
+    buffers.erase(0);
+
+    std::vector<GLuint> bufferList(buffers.begin(), buffers.end());
+    glDeleteVertexArrays(static_cast<GLsizei>(vertexArrays.size()), vertexArrays.data());
+    glDeleteBuffers(static_cast<GLsizei>(bufferList.size()), bufferList.data());
+
+    for (const auto& pair : m_TextureCache)
+    {
+        const std::shared_ptr<Texture>& texture = pair.second;
+        if (texture->m_AsyncUpload && texture->m_TextureID)
+        {
+            glDeleteTextures(1, &texture->m_TextureID);
+            texture->m_TextureID = 0;
+        }
+    }
+    m_GpuTextures.destroy();
+}
+
+const ModelReloadReport& cModel::adoptFrom(cModel& previous, TextureUploader* textureUploader)
+{
+    PROFILE_SCOPE("Adopt model");
+    auto start = std::chrono::high_resolution_clock::now();
+    // Reused materials hold handles from previous's cache, acquiring them again uploads nothing
+    m_GpuTextures = std::move(previous.m_GpuTextures);
+    previous.m_GpuTextures = GpuTextureCache();
+    size_t textureBytes = m_GpuTextures.getStats().uniqueBytes;
+    size_t queuedBytes = textureUploader ? textureUploader->getStats().pendingBytes : 0;
+
+    if (textureUploader)
+    {
+        for (const auto& pair : m_TextureCache)
+        {
+            const std::shared_ptr<Texture>& texture = pair.second;
+            if (!texture->m_Streamed && !texture->m_isMapped && !texture->m_AsyncUpload)
+            {
+                textureUploader->queue(texture);
+            }
+        }
+    }
+
+    std::unordered_set<GLuint> adoptedVertexArrays;
+    m_ReloadReport.primitives = 0;
+    for (auto& mesh : meshes)
+    {
+        mesh.transformChanged = true;
+        for (auto& primitive : mesh.primitives)
+        {
+            ++m_ReloadReport.primitives;
+            if (primitive.m_VAO != 0)
+            {
+                adoptedVertexArrays.insert(primitive.m_VAO);
+                primitive.m_material.createAllTextures(m_GpuTextures);
+                continue;
+            }
+            primitive.uploadToGPU(m_GpuTextures);
+            // Interleaved vertices, the depth pre-pass positions and the indices
+            size_t vertexCount = primitive.m_interleavedData.size() / 11;
+            size_t indexSize = primitive.m_indexType == GL_UNSIGNED_BYTE ? 1 : (primitive.m_indexType == GL_UNSIGNED_SHORT ? 2 : 4);
+            m_ReloadReport.uploadedBytes += vertexCount * 14 * sizeof(float) + primitive.m_indices.size() * indexSize;
+        }
+    }
+    checkGLError("adoptFrom");
+    for (const auto& pair : m_TextureCache)
+    {
+        pair.second->clearData();
+    }
+    m_ReloadReport.uploadedBytes += m_GpuTextures.getStats().uniqueBytes - textureBytes;
+    if (textureUploader)
+    {
+        m_ReloadReport.uploadedBytes += textureUploader->getStats().pendingBytes - queuedBytes;
+    }
+
+    // previous keeps only what this model does not share with it
+    for (auto& mesh : previous.meshes)
+    {
+        for (auto& primitive : mesh.primitives)
+        {
+            if (adoptedVertexArrays.count(primitive.m_VAO))
+            {
+                primitive.m_VAO = primitive.m_DepthVAO = 0;
+            }
+        }
+    }
+    std::unordered_set<const Texture*> sharedTextures;
+    for (const auto& pair : m_TextureCache)
+    {
+        sharedTextures.insert(pair.second.get());
+    }
+    for (auto it = previous.m_TextureCache.begin(); it != previous.m_TextureCache.end();)
+    {
+        it = sharedTextures.count(it->second.get()) ? previous.m_TextureCache.erase(it) : std::next(it);
+    }
+    previous.destroyGpu();
+
+    std::chrono::duration<float, std::milli> uploadTime = std::chrono::high_resolution_clock::now() - start;
+    m_ReloadReport.uploadMs = uploadTime.count();
+    m_LoadReport.addPhase(LOAD_PHASE_GPU_UPLOAD, static_cast<uint64_t>(uploadTime.count() * 1000000.0), m_ReloadReport.uploadedBytes);
+    m_LoadReport.markBoundary("Uploaded to GPU");
+
+    batchTest();
+    m_ReloadReport.batchBytes = m_CombinedInterleavedData.size() * sizeof(float) + m_CombinedIndices.size() * sizeof(unsigned int);
+
+    const ModelReloadReport& report = m_ReloadReport;
+    std::cout << "Incremental reload: " << report.reusedPrimitives << " of " << report.primitives << " primitives kept, "
+              << report.rebuiltMaterials << " materials and " << report.rebuiltPrimitives << " primitives rebuilt, "
+              << report.reusedTextures << " of " << report.textures << " textures kept\n";
+    std::cout << "  Uploaded " << report.uploadedBytes / (1024.0 * 1024.0) << " MB in " << report.uploadMs << "ms, plus "
+              << report.batchBytes / (1024.0 * 1024.0) << " MB of batch buffers" << std::endl;
+    return m_ReloadReport;
 }
 
 glm::vec3 transformVertex(const glm::vec3& vertex, const glm::mat4& transform)
@@ -611,14 +1388,46 @@ glm::vec3 transformVertex(const glm::vec3& vertex, const glm::mat4& transform)
     return glm::vec3(transform * glm::vec4(vertex, 1.0f));
 }
 
+void transformBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform, glm::vec3& outMin, glm::vec3& outMax)
+{
+    outMin = glm::vec3(FLT_MAX);
+    outMax = glm::vec3(-FLT_MAX);
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? boundsMax.x : boundsMin.x,
+                         (i & 2) ? boundsMax.y : boundsMin.y,
+                         (i & 4) ? boundsMax.z : boundsMin.z);
+        corner = transformVertex(corner, transform);
+        outMin = glm::min(outMin, corner);
+        outMax = glm::max(outMax, corner);
+    }
+}
+
 void cModel::batchTest()
 {
+    PROFILE_SCOPE("Build batches");
     unsigned int vertexOffset = 0;
 
     for (auto& mesh : meshes)
     {
         mesh.combinePrimitiveData();
 
+        // Record each primitive's index range so it can be culled and drawn on its own
+        GLuint firstIndex = static_cast<GLuint>(m_CombinedIndices.size());
+        for (const auto& primitive : mesh.primitives)
+        {
+            GLuint indexCount = static_cast<GLuint>(primitive.m_indices.size());
+            if (indexCount > 0)
+            {
+                BatchDraw draw;
+                draw.firstIndex = firstIndex;
+                draw.indexCount = indexCount;
+                transformBounds(primitive.m_BoundsMin, primitive.m_BoundsMax, mesh.transform, draw.boundsMin, draw.boundsMax);
+                m_BatchDraws.push_back(draw);
+            }
+            firstIndex += indexCount;
+        }
+
         // Apply transformation to each vertex in the mesh
         for (size_t i = 0; i < mesh.m_CombinedInterleavedData.size(); i += 11) {
             glm::vec3 vertex(mesh.m_CombinedInterleavedData[i], mesh.m_CombinedInterleavedData[i + 1], mesh.m_CombinedInterleavedData[i + 2]);
@@ -646,6 +1455,7 @@ void cModel::batchTest()
     {
         std::cerr << "OpenGL error during " << "message" << ": " << err << std::endl;
     }
+    LoadPhaseScope uploadScope(m_LoadReport, LOAD_PHASE_GPU_UPLOAD, m_CombinedInterleavedData.size() * sizeof(float) + m_CombinedIndices.size() * sizeof(unsigned int));
     GLuint EBO, VBO;
     glGenVertexArrays(1, &this->m_VAO);
     glBindVertexArray(this->m_VAO);
@@ -675,6 +1485,28 @@ void cModel::batchTest()
     std::vector<unsigned short> temp_indices(m_CombinedIndices.begin(), m_CombinedIndices.end());
     glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_CombinedIndices.size() * sizeof(unsigned int), m_CombinedIndices.data(), GL_STATIC_DRAW);
     glBindVertexArray(0);
+    m_LoadReport.markBoundary("Batches built");
+}
+
+void cModel::getSceneBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const
+{
+    boundsMin = glm::vec3(FLT_MAX);
+    boundsMax = glm::vec3(-FLT_MAX);
+    for (const auto& mesh : meshes)
+    {
+        for (const auto& primitive : mesh.primitives)
+        {
+            glm::vec3 worldMin, worldMax;
+            transformBounds(primitive.m_BoundsMin, primitive.m_BoundsMax, mesh.transform, worldMin, worldMax);
+            boundsMin = glm::min(boundsMin, worldMin);
+            boundsMax = glm::max(boundsMax, worldMax);
+        }
+    }
+    if (boundsMin.x > boundsMax.x)
+    {
+        boundsMin = glm::vec3(0.0f);
+        boundsMax = glm::vec3(0.0f);
+    }
 }
 
 void cModel::renderModelBatch(Shader& shader)
@@ -685,6 +1517,7 @@ void cModel::renderModelBatch(Shader& shader)
         m_CombinedIndices.size(), // count: specifies the number of elements to be rendered
         GL_UNSIGNED_INT, // type: specifies the type of the values in indices
         0); // indices: specifies a pointer to the location where the indices are stored (NULL if EBO is bound)
+    RenderStats::get().countDraw();
 
 
     // Unbind VAO to avoid accidentally modifying it
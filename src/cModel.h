@@ -19,12 +19,77 @@
 #include <glm/gtc/type_ptr.hpp>
 #include "shader.h"
 #include "cMesh.h"
+#include "light.h"
+#include "frustum.h"
+#include "textureCooker.h"
+#include "textureUploader.h"
+#include "gpuTextureCache.h"
+#include "loadReport.h"
+#include <unordered_set>
 #include <future>
 
 struct DDSHeader;
+class ShaderPermutations;
 struct DDSHeaderDX10;
 struct MipmapData;
 
+// World-space AABB of a transformed object-space AABB
+void transformBounds(const glm::vec3& boundsMin, const glm::vec3& boundsMax, const glm::mat4& transform, glm::vec3& outMin, glm::vec3& outMax);
+
+// CPU stages of loading a primitive, free functions so LoaderBenchmark can time them on their own.
+// Base64 data URIs are decoded before cgltf_load_buffers(), which then skips those buffers.
+cgltf_result decodeBase64Buffers(cgltf_data* data);
+// A float attribute in a buffer: its first element and the bytes from one element to the
+// next, the view's byteStride when several attributes share a view
+struct VertexStream
+{
+    const float* data = nullptr;
+    size_t stride = 0;
+};
+// Empty without a buffer view
+VertexStream getVertexStream(const cgltf_accessor* accessor);
+// Into position, normal, tangent, uv (11 floats per vertex). Tangents are glTF vec4s, the w
+// sign is dropped. Tangents and uvs without data are written as zeros.
+void interleaveVertices(const VertexStream& positions, const VertexStream& normals, const VertexStream& tangents, const VertexStream& texCoords, size_t count, std::vector<float>& interleaved);
+// KHR_draco_mesh_compression buffer view into the same layout, indices from the faces
+bool decodeDracoPrimitive(const char* data, size_t size, std::vector<float>& interleaved, std::vector<unsigned int>& indices);
+// 8, 16 or 32 bit glTF indices widened to unsigned int
+void convertIndices(const void* data, size_t count, GLenum indexType, std::vector<unsigned int>& indices);
+
+// loadTexture lookups: hits come from the URI/image cache or, for embedded images, from
+// identical bytes already decoded for another image
+struct TextureCacheStats
+{
+    size_t lookups = 0;
+    size_t hits = 0;
+    size_t contentHits = 0;
+    size_t misses = 0;
+
+    float getHitRate() const { return lookups > 0 ? static_cast<float>(hits) / lookups : 0.0f; }
+};
+
+// What a model built against the live one kept, and what it sent to the GPU again
+struct ModelReloadReport
+{
+    size_t primitives = 0;
+    size_t reusedPrimitives = 0;     // geometry and material unchanged, nothing uploaded
+    size_t rebuiltMaterials = 0;     // geometry unchanged, material created again
+    size_t rebuiltPrimitives = 0;    // processed and uploaded again
+    size_t textures = 0;
+    size_t reusedTextures = 0;
+    size_t uploadedBytes = 0;        // vertex, index and texture data
+    size_t batchBytes = 0;           // the combined batch buffers are always rebuilt
+    float uploadMs = 0.0f;
+};
+
+// Index range and world-space bounds of one primitive inside the combined batch buffers
+struct BatchDraw
+{
+    GLuint firstIndex;
+    GLuint indexCount;
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+};
 
 class cModel 
 {
@@ -32,30 +97,85 @@ public:
     std::vector<cMesh> meshes;
     std::string directory;
     std::unordered_map<std::string, std::shared_ptr<Texture>> m_TextureCache;
+    GpuTextureCache m_GpuTextures;
+    // Embedded images by XXH64 of their encoded bytes
+    std::unordered_map<uint64_t, std::shared_ptr<Texture>> m_ImageContentCache;
+    TextureCacheStats m_TextureCacheStats;
+    // EXT_texture_webp sources, only filled while loading and only with a WebP codec compiled in
+    std::unordered_map<const cgltf_texture*, cgltf_image*> m_WebPImages;
 
     std::vector<float> m_CombinedInterleavedData;
     std::vector<unsigned int> m_CombinedIndices;
+    std::vector<BatchDraw> m_BatchDraws;
+    std::vector<PunctualLight> m_Lights;
+    std::unordered_set<const cgltf_node*> m_AnimatedNodes;
 
     GLuint m_VAO;
+    bool m_StreamTextures;
+    bool m_CookTextures;
+    bool m_UseCookedTextures;
+    std::vector<CookJob> m_CookJobs;    // PNG/JPG textures without an up-to-date cooked DDS
+    ModelReloadReport m_ReloadReport;
+    // Started by the constructor, uploadToGpu/adoptFrom and batchTest add to it, the caller finishes it
+    LoadReport m_LoadReport;
 
 
-    cModel(const char* path);
+    // With previous, primitives and textures whose glTF data did not change are copied
+    // from it instead of being processed again. previous must stay alive and unmodified
+    // until the constructor returns, adoptFrom() then takes over their GPU objects.
+    // useCookedTextures: load up-to-date .cooked.dds files in place of their PNG/JPG source
+    cModel(const char* path, bool streamTextures = false, bool cookTextures = false, const cModel* previous = nullptr, bool useCookedTextures = true);
     void Draw(Shader& shader, bool useBatchRendering);
+    void drawDepthPrepass(Shader& shader);
+    void drawAlphaMode(Shader& shader, AlphaMode alphaMode);
+    void drawAlphaMode(ShaderPermutations& permutations, uint32_t frameFeatures, AlphaMode alphaMode);
+    void drawBlendedSorted(Shader& shader, const glm::vec3& cameraPosition);
+    void drawBlendedSorted(ShaderPermutations& permutations, uint32_t frameFeatures, const glm::vec3& cameraPosition);
+    // Picks each primitive's ShaderPermutations variant, call after virtual textures are registered
+    void updateShaderFeatures();
+    unsigned int drawShadowCasters(Shader& shader, const Frustum& frustum, bool dynamicCasters);
     std::vector<MipmapData> readDDS(const std::string& filePath, DDSHeader& header, DDSHeaderDX10& headerDX10);
     void checkGLError(const std::string& message);
     GLuint loadDDSTexture(const std::string& path);
     Texture loadStandardTexture(const std::string& path);
-    void loadTexture(cgltf_texture* texture, std::shared_ptr<Texture>& textureObject);
+    // srgb: base color and emissive, their mips are filtered in linear light.
+    // streamable: left to TextureStreamer when streaming, which only drives base color textures
+    void loadTexture(cgltf_texture* texture, std::shared_ptr<Texture>& textureObject, CookFormat cookFormat = COOK_AUTO, bool srgb = false, bool streamable = false);
     Material createMaterial(cgltf_primitive* primitive);
     void loadModel(const char* path);
-    void processNode(cgltf_node* node, const glm::mat4& parentTransform = glm::mat4(1.0f));
+    void processNode(cgltf_node* node, const glm::mat4& parentTransform = glm::mat4(1.0f), bool parentAnimated = false);
+    void processLight(cgltf_light* light, const glm::mat4& transform);
     void extractAttributes(cgltf_primitive* primitive, cgltf_accessor*& positions, cgltf_accessor*& normals, cgltf_accessor*& texCoords0, cgltf_accessor*& texCoords1, cgltf_accessor*& tangents, cgltf_accessor*& colors);
-    float* getBufferData(cgltf_accessor* accessor);
+    static float* getBufferData(cgltf_accessor* accessor);
     cMesh processMesh(cgltf_mesh* mesh, glm::mat4 transform);
     cPrimitive processPrimitive(cgltf_primitive* primitive, GLenum& index_type);
-    void uploadToGpu(Shader& shader);
+    void uploadToGpu(Shader& shader, TextureUploader* textureUploader = nullptr);
+    // Deletes what uploadToGpu and batchTest created, streamed textures belong to TextureStreamer
+    void destroyGpu();
+    // uploadToGpu for a model built against previous: takes over previous's GPU objects
+    // for what was reused, uploads the rest and deletes what previous no longer shares
+    const ModelReloadReport& adoptFrom(cModel& previous, TextureUploader* textureUploader = nullptr);
     void batchTest();
     void renderModelBatch(Shader& shader);
+    void getSceneBounds(glm::vec3& boundsMin, glm::vec3& boundsMax) const;
+
+private:
+    struct PrimitiveDraw
+    {
+        cMesh* mesh;
+        cPrimitive* primitive;
+        float distanceSquared;
+        uint32_t shaderFeatures;
+    };
+    std::vector<PrimitiveDraw> getBlendedDraws(const glm::vec3& cameraPosition);
+
+    uint64_t hashGeometry(const cgltf_primitive* primitive, GLenum index_type) const;
+    uint64_t hashMaterial(const cgltf_material* material) const;
+    uint64_t hashTextureView(const cgltf_texture_view& view, uint64_t seed) const;
+
+    // Only set while the constructor runs
+    const cModel* m_Previous = nullptr;
+    std::unordered_map<uint64_t, const cPrimitive*> m_PreviousPrimitives;   // by geometry hash
 
 };
 
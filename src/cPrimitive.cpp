@@ -1,5 +1,8 @@
 #include "pch.h"
 #include "cPrimitive.h"
+#include "shaderPermutations.h"
+#include "renderStats.h"
+#include <cfloat>
 
 void checkGLError(const std::string& message)
 {
@@ -10,23 +13,84 @@ void checkGLError(const std::string& message)
     }
 }
 cPrimitive::cPrimitive(std::vector<float> interleavedData, std::vector<unsigned int> indices, GLenum nIndex_type, Material nMaterial, bool hasIndices)
-    : m_interleavedData(interleavedData), m_indices(indices), m_indexType(nIndex_type), m_material(nMaterial), m_HasIndices(hasIndices)
+    : m_interleavedData(interleavedData), m_indices(indices), m_indexType(nIndex_type), m_material(nMaterial), m_VAO(0), m_DepthVAO(0), m_HasIndices(hasIndices)
 {
+    computeBounds();
+    computeUVDensity();
+}
+
+void cPrimitive::computeBounds()
+{
+    m_BoundsMin = glm::vec3(FLT_MAX);
+    m_BoundsMax = glm::vec3(-FLT_MAX);
+
+    for (size_t i = 0; i + 2 < m_interleavedData.size(); i += 11)
+    {
+        glm::vec3 position(m_interleavedData[i], m_interleavedData[i + 1], m_interleavedData[i + 2]);
+        m_BoundsMin = glm::min(m_BoundsMin, position);
+        m_BoundsMax = glm::max(m_BoundsMax, position);
+    }
+
+    if (m_interleavedData.empty())
+    {
+        m_BoundsMin = glm::vec3(0.0f);
+        m_BoundsMax = glm::vec3(0.0f);
+    }
+}
+
+void cPrimitive::computeUVDensity()
+{
+    // sqrt of total UV area over total surface area
+    double uvArea = 0.0;
+    double surfaceArea = 0.0;
+    for (size_t i = 0; i + 2 < m_indices.size(); i += 3)
+    {
+        const float* a = &m_interleavedData[m_indices[i] * 11];
+        const float* b = &m_interleavedData[m_indices[i + 1] * 11];
+        const float* c = &m_interleavedData[m_indices[i + 2] * 11];
+
+        glm::vec3 edge1(b[0] - a[0], b[1] - a[1], b[2] - a[2]);
+        glm::vec3 edge2(c[0] - a[0], c[1] - a[1], c[2] - a[2]);
+        surfaceArea += 0.5 * glm::length(glm::cross(edge1, edge2));
+
+        glm::vec2 uv1(b[9] - a[9], b[10] - a[10]);
+        glm::vec2 uv2(c[9] - a[9], c[10] - a[10]);
+        uvArea += 0.5 * std::abs(uv1.x * uv2.y - uv1.y * uv2.x);
+    }
+
+    m_UVDensity = surfaceArea > 0.0 ? static_cast<float>(std::sqrt(uvArea / surfaceArea)) : 0.0f;
 }
 
 void cPrimitive::draw(Shader& shader)
 {
+    GLuint colorTextureID = resolveTextureID(m_material.colorTexture, m_material.colorTextureID);
+    GLuint normalTextureID = resolveTextureID(m_material.normalTexture, m_material.normalTextureID);
+
     glActiveTexture(GL_TEXTURE0);
-    glBindTexture(GL_TEXTURE_2D, m_material.colorTextureID);
+    glBindTexture(GL_TEXTURE_2D, colorTextureID);
+    glBindSampler(0, m_material.colorSamplerID);
 
     glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_2D, m_material.normalTextureID);
+    glBindTexture(GL_TEXTURE_2D, normalTextureID);
+    glBindSampler(1, m_material.normalSamplerID);
 
 
     shader.setInt("material.diffuse", 0);
     shader.setInt("material.normal", 1);
     shader.setVec3("material.baseColor", m_material.baseColor);
-    shader.setBool("material.hasTexture", m_material.hasColorTexture);
+    const std::shared_ptr<Texture>& colorTexture = m_material.colorTexture;
+    bool isVirtual = colorTexture && colorTexture->m_Virtual;
+    shader.setBool("uVirtualTexture", isVirtual);
+    if (isVirtual)
+    {
+        shader.setVec4("uVTRegion", colorTexture->m_VirtualRegion);
+        shader.setFloat("uVTMaxMip", colorTexture->m_VirtualMaxMip);
+    }
+    shader.setBool("material.hasTexture", m_material.hasColorTexture && (colorTextureID != 0 || isVirtual));
+    shader.setBool("material.hasNormalTexture", normalTextureID != 0);
+    shader.setFloat("material.metallic", m_material.metallicFactor);
+    shader.setFloat("material.roughness", m_material.roughnessFactor);
+    shader.setFloat("material.alphaCutoff", m_material.alphaCutoff);
     glBindVertexArray(this->m_VAO);
 
     if (m_HasIndices) 
@@ -35,6 +99,7 @@ void cPrimitive::draw(Shader& shader)
             m_indices.size(), // count: specifies the number of elements to be rendered
             m_indexType, // type: specifies the type of the values in indices
             0); // indices: specifies a pointer to the location where the indices are stored (NULL if EBO is bound)
+        RenderStats::get().countDraw();
     }
     else
     {
@@ -43,20 +108,54 @@ void cPrimitive::draw(Shader& shader)
 
     // Unbind the VAO to prevent accidental modifications
     glBindVertexArray(0);
+    // Other passes sample render targets on these units with the texture's own state
+    glBindSampler(0, 0);
+    glBindSampler(1, 0);
 }
 
-void cPrimitive::uploadToGPU()
+GLuint cPrimitive::resolveTextureID(const std::shared_ptr<Texture>& texture, GLuint textureID)
 {
-    if (m_material.hasColorTexture)
+    // Streamed textures can change their GL name, streamed and asynchronously uploaded ones
+    // may not be resident yet
+    if (texture && (texture->m_Streamed || texture->m_AsyncUpload))
     {
-        m_material.createAllTextures();
+        return texture->m_TextureID;
     }
+    return textureID;
+}
 
-    GLenum err;
-    while ((err = glGetError()) != GL_NO_ERROR)
+uint32_t cPrimitive::getShaderFeatures() const
+{
+    // Same residency test draw() makes for material.hasTexture
+    uint32_t features = m_ShaderFeatures;
+    if ((features & SHADER_BASE_COLOR_MAP) && !(features & SHADER_VIRTUAL_TEXTURE) && resolveTextureID(m_material.colorTexture, m_material.colorTextureID) == 0)
+    {
+        features &= ~SHADER_BASE_COLOR_MAP;
+    }
+    if ((features & SHADER_NORMAL_MAP) && resolveTextureID(m_material.normalTexture, m_material.normalTextureID) == 0)
     {
-        std::cerr << "OpenGL error during " << "message" << ": " << err << "\n";
+        features &= ~SHADER_NORMAL_MAP;
     }
+    return features;
+}
+
+void cPrimitive::drawDepth()
+{
+    if (!m_HasIndices)
+    {
+        return;
+    }
+
+    glBindVertexArray(this->m_DepthVAO);
+    glDrawElements(GL_TRIANGLES, m_indices.size(), m_indexType, 0);
+    RenderStats::get().countDraw();
+    glBindVertexArray(0);
+}
+
+void cPrimitive::uploadToGPU(GpuTextureCache& textureCache)
+{
+    m_material.createAllTextures(textureCache);
+
     GLuint EBO, VBO;
     glGenVertexArrays(1, &this->m_VAO);
     glBindVertexArray(this->m_VAO);
@@ -111,4 +210,26 @@ void cPrimitive::uploadToGPU()
 
     // Unbind VAO to avoid accidentally modifying it
     glBindVertexArray(0);
+
+    // Tightly packed positions for the depth pre-pass, so it only fetches 12 bytes per vertex instead of 44
+    size_t vertexCount = m_interleavedData.size() / 11;
+    std::vector<float> positions;
+    positions.reserve(vertexCount * 3);
+    for (size_t i = 0; i < vertexCount; ++i)
+    {
+        positions.push_back(m_interleavedData[i * 11 + 0]);
+        positions.push_back(m_interleavedData[i * 11 + 1]);
+        positions.push_back(m_interleavedData[i * 11 + 2]);
+    }
+
+    GLuint positionVBO;
+    glGenVertexArrays(1, &this->m_DepthVAO);
+    glBindVertexArray(this->m_DepthVAO);
+    glGenBuffers(1, &positionVBO);
+    glBindBuffer(GL_ARRAY_BUFFER, positionVBO);
+    glBufferData(GL_ARRAY_BUFFER, positions.size() * sizeof(float), positions.data(), GL_STATIC_DRAW);
+    glVertexAttribPointer(0, 3, GL_FLOAT, GL_FALSE, 3 * sizeof(float), (void*)0);
+    glEnableVertexAttribArray(0);
+    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, EBO);
+    glBindVertexArray(0);
 }
@@ -15,12 +15,31 @@ public:
     GLenum m_indexType;
     Material m_material;
     GLuint m_VAO;
+    GLuint m_DepthVAO;      // position-only stream for the depth pre-pass, shares the index buffer
     int m_PrimIndex;
     bool m_HasIndices;
 
+    // Object-space bounds, computed from the interleaved positions
+    glm::vec3 m_BoundsMin;
+    glm::vec3 m_BoundsMax;
+    // Average texture-space distance per object-space unit, used to pick streamed mip levels
+    float m_UVDensity;
+    // XXH64 of the glTF data the primitive was built from, an incremental reload keeps the
+    // GPU copy of primitives whose hashes did not change
+    uint64_t m_GeometryHash = 0;
+    uint64_t m_MaterialHash = 0;
+    // ShaderPermutations material bits, chosen once the model's textures are set up
+    uint32_t m_ShaderFeatures = 0;
+
     cPrimitive(std::vector<float> interleavedData, std::vector<unsigned int> indices, GLenum nIndex_type, Material nMaterial, bool hasIndices);
 
     void draw(Shader& shader);
+    void drawDepth();
+    static GLuint resolveTextureID(const std::shared_ptr<Texture>& texture, GLuint textureID);
+    // m_ShaderFeatures without the maps that are not resident yet
+    uint32_t getShaderFeatures() const;
 
-    void uploadToGPU();
+    void uploadToGPU(GpuTextureCache& textureCache);
+    void computeBounds();
+    void computeUVDensity();
 };
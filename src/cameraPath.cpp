@@ -0,0 +1,163 @@
+#include "pch.h"
+#include "cameraPath.h"
+#include "camera.h"
+#include <glm/gtc/constants.hpp>
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+namespace
+{
+    template<typename T>
+    T catmullRom(const T& p0, const T& p1, const T& p2, const T& p3, float t)
+    {
+        float t2 = t * t;
+        float t3 = t2 * t;
+        return 0.5f * ((2.0f * p1) + (p2 - p0) * t + (2.0f * p0 - 5.0f * p1 + 4.0f * p2 - p3) * t2 + (3.0f * p1 - p0 - 3.0f * p2 + p3) * t3);
+    }
+
+    // Keeps yaw continuous so the spline turns the short way instead of through 360 degrees
+    void unwrapYaw(const std::vector<CameraKey>& keys, CameraKey& key)
+    {
+        if (!keys.empty())
+        {
+            float previous = keys.back().yaw;
+            key.yaw = previous + std::remainder(key.yaw - previous, 360.0f);
+        }
+    }
+}
+
+bool CameraPath::load(const std::string& path)
+{
+    std::ifstream file(path);
+    if (!file.is_open())
+    {
+        std::cerr << "Failed to open camera path " << path << std::endl;
+        return false;
+    }
+
+    std::vector<CameraKey> keys;
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(file, line))
+    {
+        ++lineNumber;
+        if (line.empty() || line[0] == '#')
+        {
+            continue;
+        }
+        std::istringstream fields(line);
+        CameraKey key;
+        key.zoom = ZOOM;
+        if (!(fields >> key.time >> key.position.x >> key.position.y >> key.position.z >> key.yaw >> key.pitch))
+        {
+            std::cerr << path << ":" << lineNumber << ": expected time x y z yaw pitch [zoom]" << std::endl;
+            continue;
+        }
+        fields >> key.zoom;
+        if (!keys.empty() && key.time <= keys.back().time)
+        {
+            std::cerr << path << ":" << lineNumber << ": key time must increase, skipped" << std::endl;
+            continue;
+        }
+        unwrapYaw(keys, key);
+        keys.push_back(key);
+    }
+    if (keys.empty())
+    {
+        std::cerr << "Camera path " << path << " has no keys" << std::endl;
+        return false;
+    }
+    m_Keys = std::move(keys);
+    return true;
+}
+
+bool CameraPath::save(const std::string& path) const
+{
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath);
+        file << "# time x y z yaw pitch zoom\n";
+        for (const CameraKey& key : m_Keys)
+        {
+            file << key.time << ' ' << key.position.x << ' ' << key.position.y << ' ' << key.position.z << ' '
+                 << key.yaw << ' ' << key.pitch << ' ' << key.zoom << '\n';
+        }
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        std::cerr << "Failed to write " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+CameraPath CameraPath::createOrbit(const glm::vec3& sceneMin, const glm::vec3& sceneMax, float seconds, int keyCount)
+{
+    CameraPath path;
+    glm::vec3 center = (sceneMin + sceneMax) * 0.5f;
+    glm::vec3 extent = sceneMax - sceneMin;
+    float radius = std::max(0.6f * glm::length(glm::vec2(extent.x, extent.z)), 1.0f);
+    float height = 0.25f * extent.y;
+
+    // Closed loop: the last key repeats the first
+    keyCount = std::max(keyCount, 4);
+    for (int i = 0; i <= keyCount; ++i)
+    {
+        float angle = glm::two_pi<float>() * i / keyCount;
+        CameraKey key;
+        key.time = seconds * i / keyCount;
+        key.position = center + glm::vec3(radius * std::cos(angle), height, radius * std::sin(angle));
+        glm::vec3 direction = glm::normalize(center - key.position);
+        key.yaw = glm::degrees(std::atan2(direction.z, direction.x));
+        key.pitch = glm::degrees(std::asin(direction.y));
+        key.zoom = ZOOM;
+        unwrapYaw(path.m_Keys, key);
+        path.m_Keys.push_back(key);
+    }
+    return path;
+}
+
+void CameraPath::addKey(float time, const Camera& camera)
+{
+    CameraKey key = { time, camera.Position, camera.Yaw, camera.Pitch, camera.Zoom };
+    if (!m_Keys.empty() && time <= m_Keys.back().time)
+    {
+        return;
+    }
+    unwrapYaw(m_Keys, key);
+    m_Keys.push_back(key);
+}
+
+void CameraPath::apply(float time, Camera& camera) const
+{
+    if (m_Keys.empty())
+    {
+        return;
+    }
+    time = std::clamp(time, m_Keys.front().time, m_Keys.back().time);
+    size_t next = std::upper_bound(m_Keys.begin(), m_Keys.end(), time, [](float t, const CameraKey& key) { return t < key.time; }) - m_Keys.begin();
+    size_t i1 = next == 0 ? 0 : std::min(next - 1, m_Keys.size() - 1);
+    size_t i2 = std::min(i1 + 1, m_Keys.size() - 1);
+    size_t i0 = i1 == 0 ? 0 : i1 - 1;
+    size_t i3 = std::min(i2 + 1, m_Keys.size() - 1);
+
+    const CameraKey& k1 = m_Keys[i1];
+    const CameraKey& k2 = m_Keys[i2];
+    float span = k2.time - k1.time;
+    float t = span > 0.0f ? (time - k1.time) / span : 0.0f;
+
+    glm::vec3 position = catmullRom(m_Keys[i0].position, k1.position, k2.position, m_Keys[i3].position, t);
+    glm::vec3 angles = catmullRom(glm::vec3(m_Keys[i0].yaw, m_Keys[i0].pitch, m_Keys[i0].zoom), glm::vec3(k1.yaw, k1.pitch, k1.zoom),
+        glm::vec3(k2.yaw, k2.pitch, k2.zoom), glm::vec3(m_Keys[i3].yaw, m_Keys[i3].pitch, m_Keys[i3].zoom), t);
+    camera.SetPose(position, angles.x, glm::clamp(angles.y, -89.0f, 89.0f));
+    camera.Zoom = glm::clamp(angles.z, 1.0f, 45.0f);
+}
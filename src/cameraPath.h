@@ -0,0 +1,41 @@
+#pragma once
+#include <glm/glm.hpp>
+#include <string>
+#include <vector>
+
+class Camera;
+
+struct CameraKey
+{
+    float time;         // seconds from the start of the path
+    glm::vec3 position;
+    float yaw;          // degrees, unwrapped so neighbouring keys differ by less than 180
+    float pitch;
+    float zoom;
+};
+
+// Camera keyframes replayed with a Catmull-Rom spline through position and angles.
+//
+// A path is recorded from live input (dense keys, one per frame) or written by hand / generated
+// (sparse keys the spline smooths out). Both are stored as text, one key per line:
+//   time x y z yaw pitch zoom
+// Lines starting with # are comments.
+class CameraPath
+{
+public:
+    // Replaces the keys, false if the file is missing or has no valid key
+    bool load(const std::string& path);
+    bool save(const std::string& path) const;
+
+    // keyCount keys on a circle around the bounds, looking at their centre
+    static CameraPath createOrbit(const glm::vec3& sceneMin, const glm::vec3& sceneMax, float seconds, int keyCount = 16);
+
+    void addKey(float time, const Camera& camera);
+    void apply(float time, Camera& camera) const;
+    void clear() { m_Keys.clear(); }
+
+    bool empty() const { return m_Keys.empty(); }
+    float getDuration() const { return m_Keys.empty() ? 0.0f : m_Keys.back().time; }
+
+    std::vector<CameraKey> m_Keys;
+};
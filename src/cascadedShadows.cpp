@@ -0,0 +1,242 @@
+#include "pch.h"
+#include "cascadedShadows.h"
+#include "cModel.h"
+#include "profiler.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <cfloat>
+#include <chrono>
+
+void CascadedShadowMaps::init()
+{
+    glGenTextures(1, &m_StaticDepth);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_StaticDepth);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, RESOLUTION, RESOLUTION, CASCADE_COUNT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    // Sampled with hardware PCF, outside the cascade counts as lit
+    const float borderDepth[] = { 1.0f, 1.0f, 1.0f, 1.0f };
+    glGenTextures(1, &m_ShadowDepth);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_ShadowDepth);
+    glTexStorage3D(GL_TEXTURE_2D_ARRAY, 1, GL_DEPTH_COMPONENT32F, RESOLUTION, RESOLUTION, CASCADE_COUNT);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_BORDER);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_BORDER);
+    glTexParameterfv(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_BORDER_COLOR, borderDepth);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_MODE, GL_COMPARE_REF_TO_TEXTURE);
+    glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_COMPARE_FUNC, GL_LEQUAL);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, 0);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &m_Fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+    glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_ShadowDepth, 0, 0);
+    glDrawBuffer(GL_NONE);
+    glReadBuffer(GL_NONE);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+    {
+        std::cerr << "ERROR::FRAMEBUFFER:: Shadow map framebuffer is not complete!" << std::endl;
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    m_Timers.assign(CASCADE_COUNT, GpuQuery(GL_TIME_ELAPSED));
+    for (auto& timer : m_Timers)
+    {
+        timer.init();
+    }
+    invalidate();
+}
+
+void CascadedShadowMaps::destroy()
+{
+    for (auto& timer : m_Timers)
+    {
+        timer.destroy();
+    }
+    m_Timers.clear();
+    glDeleteFramebuffers(1, &m_Fbo);
+    glDeleteTextures(1, &m_StaticDepth);
+    glDeleteTextures(1, &m_ShadowDepth);
+    m_Fbo = m_StaticDepth = m_ShadowDepth = 0;
+}
+
+void CascadedShadowMaps::invalidate()
+{
+    for (auto& cascade : m_Cascades)
+    {
+        cascade.valid = false;
+    }
+}
+
+void CascadedShadowMaps::update(const glm::mat4& view, float fovY, float aspect, float zNear, const glm::vec3& lightDirection, const glm::vec3& sceneMin, const glm::vec3& sceneMax)
+{
+    PROFILE_SCOPE("Shadow cascades");
+    glm::vec3 direction = glm::normalize(lightDirection);
+    if (glm::dot(direction, m_LightDirection) < 0.99999f)
+    {
+        // Fixed rotation only, cascades are placed by their light-space center
+        glm::vec3 up = std::abs(direction.y) > 0.99f ? glm::vec3(0.0f, 0.0f, 1.0f) : glm::vec3(0.0f, 1.0f, 0.0f);
+        m_LightView = glm::lookAt(glm::vec3(0.0f), direction, up);
+        m_LightDirection = direction;
+        invalidate();
+    }
+
+    // Depth range has to contain every caster in the scene, not only those inside the cascade
+    float depthMin = FLT_MAX;
+    float depthMax = -FLT_MAX;
+    for (int i = 0; i < 8; ++i)
+    {
+        glm::vec3 corner((i & 1) ? sceneMax.x : sceneMin.x, (i & 2) ? sceneMax.y : sceneMin.y, (i & 4) ? sceneMax.z : sceneMin.z);
+        float depth = -(m_LightView * glm::vec4(corner, 1.0f)).z;
+        depthMin = std::min(depthMin, depth);
+        depthMax = std::max(depthMax, depth);
+    }
+    depthMin -= 1.0f;
+    depthMax += 1.0f;
+
+    glm::mat4 inverseView = glm::inverse(view);
+    glm::vec3 cameraPosition = glm::vec3(inverseView[3]);
+    glm::vec3 cameraForward = -glm::normalize(glm::vec3(inverseView[2]));
+
+    float tanY = std::tan(fovY * 0.5f);
+    float tanX = tanY * aspect;
+    float tanSquared = tanX * tanX + tanY * tanY;
+
+    float sliceNear = zNear;
+    for (int i = 0; i < CASCADE_COUNT; ++i)
+    {
+        float t = float(i + 1) / CASCADE_COUNT;
+        float logSplit = zNear * std::pow(m_ShadowDistance / zNear, t);
+        float uniformSplit = zNear + (m_ShadowDistance - zNear) * t;
+        float sliceFar = m_SplitLambda * logSplit + (1.0f - m_SplitLambda) * uniformSplit;
+        m_SplitFar[i] = sliceFar;
+
+        // Smallest sphere around the frustum slice. It only depends on the projection,
+        // so its radius doesn't change when the camera rotates.
+        float centerDistance = (sliceNear + sliceFar) * (1.0f + tanSquared) * 0.5f;
+        float radius;
+        if (centerDistance >= sliceFar)
+        {
+            centerDistance = sliceFar;
+            radius = sliceFar * std::sqrt(tanSquared);
+        }
+        else
+        {
+            float alongAxis = centerDistance - sliceNear;
+            radius = std::sqrt(alongAxis * alongAxis + sliceNear * sliceNear * tanSquared);
+        }
+        radius = std::ceil(radius * 16.0f) / 16.0f;
+
+        Cascade& cascade = m_Cascades[i];
+        cascade.center = glm::vec3(m_LightView * glm::vec4(cameraPosition + cameraForward * centerDistance, 1.0f));
+        cascade.radius = radius;
+        cascade.stats.splitFar = sliceFar;
+        cascade.stats.radius = radius;
+
+        bool insideCache = cascade.valid
+            && std::abs(cascade.center.x - cascade.cachedCenter.x) + radius <= cascade.cachedHalfSize
+            && std::abs(cascade.center.y - cascade.cachedCenter.y) + radius <= cascade.cachedHalfSize
+            && radius * m_CachePadding > cascade.cachedHalfSize * 0.75f;   // refit after zooming in
+        cascade.stats.refreshed = m_ForceRefresh || !insideCache;
+        if (cascade.stats.refreshed)
+        {
+            refreshCascade(cascade, depthMin, depthMax);
+        }
+
+        sliceNear = sliceFar;
+    }
+}
+
+void CascadedShadowMaps::refreshCascade(Cascade& cascade, float depthMin, float depthMax)
+{
+    float halfSize = cascade.radius * m_CachePadding;
+    float texelSize = 2.0f * halfSize / RESOLUTION;
+
+    // Snap to whole shadow map texels so the rasterization of static edges never shifts
+    glm::vec3 center = cascade.center;
+    center.x = std::floor(center.x / texelSize + 0.5f) * texelSize;
+    center.y = std::floor(center.y / texelSize + 0.5f) * texelSize;
+
+    cascade.cachedCenter = center;
+    cascade.cachedHalfSize = halfSize;
+    cascade.lightProjection = glm::ortho(center.x - halfSize, center.x + halfSize, center.y - halfSize, center.y + halfSize, depthMin, depthMax);
+    cascade.valid = true;
+}
+
+void CascadedShadowMaps::render(cModel& model, Shader& depthShader)
+{
+    PROFILE_SCOPE("Shadow render");
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+    glViewport(0, 0, RESOLUTION, RESOLUTION);
+    glEnable(GL_POLYGON_OFFSET_FILL);
+    glPolygonOffset(1.5f, 4.0f);
+
+    depthShader.use();
+    depthShader.setMat4("view", m_LightView);
+
+    for (int i = 0; i < CASCADE_COUNT; ++i)
+    {
+        Cascade& cascade = m_Cascades[i];
+        auto cpuStart = std::chrono::high_resolution_clock::now();
+        m_Timers[i].begin();
+
+        depthShader.setMat4("projection", cascade.lightProjection);
+        Frustum frustum = Frustum::fromMatrix(cascade.lightProjection * m_LightView);
+
+        if (cascade.stats.refreshed)
+        {
+            glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_StaticDepth, 0, i);
+            glClear(GL_DEPTH_BUFFER_BIT);
+            cascade.stats.staticCasters = model.drawShadowCasters(depthShader, frustum, false);
+            ++cascade.stats.refreshCount;
+        }
+
+        glCopyImageSubData(m_StaticDepth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i,
+                           m_ShadowDepth, GL_TEXTURE_2D_ARRAY, 0, 0, 0, i,
+                           RESOLUTION, RESOLUTION, 1);
+
+        glFramebufferTextureLayer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, m_ShadowDepth, 0, i);
+        cascade.stats.dynamicCasters = model.drawShadowCasters(depthShader, frustum, true);
+
+        m_Timers[i].end();
+        std::chrono::duration<float, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - cpuStart;
+        cascade.stats.cpuMs = cpuTime.count();
+        cascade.stats.gpuMs = m_Timers[i].getResultMs();
+    }
+
+    glDisable(GL_POLYGON_OFFSET_FILL);
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void CascadedShadowMaps::bind(Shader& shader, bool enabled)
+{
+    shader.setBool("uUseShadows", enabled);
+    shader.setInt("uShadowMap", SHADOW_TEXTURE_UNIT);
+    if (!enabled)
+    {
+        return;
+    }
+
+    glActiveTexture(GL_TEXTURE0 + SHADOW_TEXTURE_UNIT);
+    glBindTexture(GL_TEXTURE_2D_ARRAY, m_ShadowDepth);
+    glActiveTexture(GL_TEXTURE0);
+
+    glm::vec4 splits;
+    glm::vec4 texelSizes;
+    for (int i = 0; i < CASCADE_COUNT; ++i)
+    {
+        shader.setMat4("uCascadeMatrices[" + std::to_string(i) + "]", m_Cascades[i].lightProjection * m_LightView);
+        splits[i] = m_SplitFar[i];
+        texelSizes[i] = 2.0f * m_Cascades[i].cachedHalfSize / RESOLUTION;
+    }
+    shader.setVec4("uCascadeSplits", splits);
+    shader.setVec4("uCascadeTexelSizes", texelSizes);
+}
@@ -0,0 +1,81 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include "shader.h"
+#include "frustum.h"
+#include "gpuQuery.h"
+
+class cModel;
+
+struct CascadeStats
+{
+    float splitFar = 0.0f;
+    float radius = 0.0f;
+    bool refreshed = false;         // static casters were re-rendered this frame
+    unsigned int refreshCount = 0;
+    unsigned int staticCasters = 0; // draws issued by the last static refresh
+    unsigned int dynamicCasters = 0;
+    float cpuMs = 0.0f;
+    float gpuMs = 0.0f;
+};
+
+// Cascaded shadow maps for the directional light.
+//
+// Each cascade keeps a cached depth layer with only the static geometry in it. The
+// cached light projection covers a padded square around the cascade's bounding sphere
+// and is snapped to whole texels, so it stays valid while the camera moves inside the
+// padding. The static layer is re-rendered only when the sphere leaves the padded area,
+// the light direction changes or invalidate() is called. Every frame the cached layer is
+// copied into the sampled shadow map and the dynamic casters are drawn on top.
+class CascadedShadowMaps
+{
+public:
+    static const int CASCADE_COUNT = 4;
+    static const int RESOLUTION = 2048;
+    static const GLuint SHADOW_TEXTURE_UNIT = 5;
+
+    void init();
+    void destroy();
+    void invalidate();
+
+    void update(const glm::mat4& view, float fovY, float aspect, float zNear, const glm::vec3& lightDirection, const glm::vec3& sceneMin, const glm::vec3& sceneMax);
+    void render(cModel& model, Shader& depthShader);
+    // Sets the cascade uniforms and binds the shadow map, call for every shader declaring uShadowMap
+    void bind(Shader& shader, bool enabled);
+
+    const CascadeStats& getStats(int cascade) const { return m_Cascades[cascade].stats; }
+    bool isInitialized() const { return m_Fbo != 0; }
+
+    float m_ShadowDistance = 150.0f;
+    float m_SplitLambda = 0.75f;    // blend between logarithmic (1) and uniform (0) splits
+    float m_CachePadding = 1.25f;   // cached ortho half-size relative to the bounding sphere
+    bool m_ForceRefresh = false;    // re-render static casters every frame, for comparison
+
+private:
+    struct Cascade
+    {
+        // Cached static layer
+        glm::vec3 cachedCenter = glm::vec3(0.0f); // light space, texel snapped
+        float cachedHalfSize = 0.0f;
+        glm::mat4 lightProjection = glm::mat4(1.0f);
+        bool valid = false;
+
+        // This frame
+        glm::vec3 center = glm::vec3(0.0f);       // light space
+        float radius = 0.0f;
+        CascadeStats stats;
+    };
+
+    void refreshCascade(Cascade& cascade, float depthMin, float depthMax);
+
+    Cascade m_Cascades[CASCADE_COUNT];
+    std::vector<GpuQuery> m_Timers;
+    glm::mat4 m_LightView = glm::mat4(1.0f);
+    glm::vec3 m_LightDirection = glm::vec3(0.0f);
+    float m_SplitFar[CASCADE_COUNT] = {};
+
+    GLuint m_Fbo = 0;
+    GLuint m_StaticDepth = 0;   // cache, static casters only
+    GLuint m_ShadowDepth = 0;   // sampled, static + dynamic
+};
@@ -0,0 +1,350 @@
+#include "pch.h"
+#include "clusteredLighting.h"
+#include "profiler.h"
+#include <random>
+#include <cfloat>
+
+ClusteredLighting::ClusteredLighting(ThreadPool& threadPool)
+    : m_ThreadPool(threadPool)
+{
+    m_ClusterLists.resize(CLUSTER_COUNT);
+    m_ClusterGrid.resize(CLUSTER_COUNT);
+}
+
+void ClusteredLighting::init()
+{
+    glGenBuffers(1, &m_LightBuffer);
+    glGenBuffers(1, &m_ClusterBuffer);
+    glGenBuffers(1, &m_IndexBuffer);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_ClusterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(glm::uvec2), nullptr, GL_STREAM_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ClusteredLighting::destroy()
+{
+    glDeleteBuffers(1, &m_LightBuffer);
+    glDeleteBuffers(1, &m_ClusterBuffer);
+    glDeleteBuffers(1, &m_IndexBuffer);
+    m_LightBuffer = m_ClusterBuffer = m_IndexBuffer = 0;
+    m_IndexBufferCapacity = 0;
+}
+
+void ClusteredLighting::setLights(const std::vector<PunctualLight>& lights)
+{
+    m_Lights.clear();
+    m_Lights.reserve(lights.size());
+
+    for (const auto& light : lights)
+    {
+        if (static_cast<int>(light.directionType.w) == LIGHT_DIRECTIONAL)
+        {
+            m_Lights.push_back(light);
+        }
+    }
+    m_DirectionalLightCount = static_cast<uint32_t>(m_Lights.size());
+    for (const auto& light : lights)
+    {
+        if (static_cast<int>(light.directionType.w) != LIGHT_DIRECTIONAL)
+        {
+            m_Lights.push_back(light);
+        }
+    }
+    m_LightsDirty = true;
+}
+
+void ClusteredLighting::buildClusterBounds()
+{
+    m_ClusterBounds.resize(CLUSTER_COUNT);
+    m_SliceDepths.resize(CLUSTER_Z + 1);
+
+    // Exponential slicing keeps the froxels roughly cubic along the view direction
+    for (int k = 0; k <= CLUSTER_Z; ++k)
+    {
+        m_SliceDepths[k] = m_Near * std::pow(m_Far / m_Near, static_cast<float>(k) / CLUSTER_Z);
+    }
+
+    float tanHalfFovY = std::tan(m_FovY * 0.5f);
+    float tanHalfFovX = tanHalfFovY * m_Aspect;
+
+    for (int k = 0; k < CLUSTER_Z; ++k)
+    {
+        float depths[2] = { m_SliceDepths[k], m_SliceDepths[k + 1] };
+        for (int j = 0; j < CLUSTER_Y; ++j)
+        {
+            float ndcY0 = -1.0f + 2.0f * j / CLUSTER_Y;
+            float ndcY1 = -1.0f + 2.0f * (j + 1) / CLUSTER_Y;
+            for (int i = 0; i < CLUSTER_X; ++i)
+            {
+                float ndcX0 = -1.0f + 2.0f * i / CLUSTER_X;
+                float ndcX1 = -1.0f + 2.0f * (i + 1) / CLUSTER_X;
+
+                ClusterBounds bounds{ glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+                for (float depth : depths)
+                {
+                    glm::vec3 a(ndcX0 * depth * tanHalfFovX, ndcY0 * depth * tanHalfFovY, -depth);
+                    glm::vec3 b(ndcX1 * depth * tanHalfFovX, ndcY1 * depth * tanHalfFovY, -depth);
+                    bounds.min = glm::min(bounds.min, glm::min(a, b));
+                    bounds.max = glm::max(bounds.max, glm::max(a, b));
+                }
+                m_ClusterBounds[i + j * CLUSTER_X + k * CLUSTER_X * CLUSTER_Y] = bounds;
+            }
+        }
+    }
+}
+
+void ClusteredLighting::binSlice(int slice)
+{
+    const int sliceOffset = slice * CLUSTER_X * CLUSTER_Y;
+    for (int c = 0; c < CLUSTER_X * CLUSTER_Y; ++c)
+    {
+        m_ClusterLists[sliceOffset + c].clear();
+    }
+
+    const float sliceNear = m_SliceDepths[slice];
+    const float sliceFar = m_SliceDepths[slice + 1];
+
+    for (uint32_t lightIndex = m_DirectionalLightCount; lightIndex < m_Lights.size(); ++lightIndex)
+    {
+        const glm::vec4& sphere = m_ViewSpaceLights[lightIndex];
+        const float depth = -sphere.z;
+        const float radius = sphere.w;
+        if (depth + radius < sliceNear || depth - radius > sliceFar)
+        {
+            continue;
+        }
+
+        // Conservative column/row range first, exact sphere-box tests only inside it.
+        // Column extents do not depend on the row (and vice versa), so row 0 / column 0
+        // of this slice stand in for the whole column / row.
+        int columnMin = CLUSTER_X, columnMax = -1;
+        for (int i = 0; i < CLUSTER_X; ++i)
+        {
+            const ClusterBounds& column = m_ClusterBounds[sliceOffset + i];
+            if (sphere.x + radius >= column.min.x && sphere.x - radius <= column.max.x)
+            {
+                columnMin = std::min(columnMin, i);
+                columnMax = i;
+            }
+        }
+        int rowMin = CLUSTER_Y, rowMax = -1;
+        for (int j = 0; j < CLUSTER_Y; ++j)
+        {
+            const ClusterBounds& row = m_ClusterBounds[sliceOffset + j * CLUSTER_X];
+            if (sphere.y + radius >= row.min.y && sphere.y - radius <= row.max.y)
+            {
+                rowMin = std::min(rowMin, j);
+                rowMax = j;
+            }
+        }
+
+        for (int j = rowMin; j <= rowMax; ++j)
+        {
+            for (int i = columnMin; i <= columnMax; ++i)
+            {
+                const int clusterIndex = sliceOffset + i + j * CLUSTER_X;
+                const ClusterBounds& bounds = m_ClusterBounds[clusterIndex];
+                glm::vec3 center(sphere);
+                glm::vec3 closest = glm::clamp(center, bounds.min, bounds.max);
+                glm::vec3 delta = center - closest;
+                if (glm::dot(delta, delta) <= radius * radius)
+                {
+                    m_ClusterLists[clusterIndex].push_back(lightIndex);
+                }
+            }
+        }
+    }
+}
+
+void ClusteredLighting::update(const glm::mat4& view, float fovY, float aspect, float zNear, float zFar)
+{
+    PROFILE_SCOPE("Light binning");
+    auto start = std::chrono::high_resolution_clock::now();
+
+    if (fovY != m_FovY || aspect != m_Aspect || zNear != m_Near || zFar != m_Far)
+    {
+        m_FovY = fovY;
+        m_Aspect = aspect;
+        m_Near = zNear;
+        m_Far = zFar;
+        buildClusterBounds();
+    }
+
+    m_ViewSpaceLights.resize(m_Lights.size());
+    m_ThreadPool.parallelFor(m_Lights.size(), [&](size_t begin, size_t end)
+    {
+        for (size_t i = begin; i < end; ++i)
+        {
+            glm::vec4 center = view * glm::vec4(glm::vec3(m_Lights[i].positionRange), 1.0f);
+            m_ViewSpaceLights[i] = glm::vec4(glm::vec3(center), m_Lights[i].positionRange.w);
+        }
+    }, 256);
+
+    m_ThreadPool.parallelFor(CLUSTER_Z, [&](size_t begin, size_t end)
+    {
+        for (size_t slice = begin; slice < end; ++slice)
+        {
+            binSlice(static_cast<int>(slice));
+        }
+    });
+
+    // Compact the per-cluster lists into one index buffer
+    uint32_t offset = 0;
+    for (int c = 0; c < CLUSTER_COUNT; ++c)
+    {
+        uint32_t count = static_cast<uint32_t>(m_ClusterLists[c].size());
+        m_ClusterGrid[c] = glm::uvec2(offset, count);
+        offset += count;
+    }
+    m_LightIndices.resize(offset);
+    m_ThreadPool.parallelFor(CLUSTER_COUNT, [&](size_t begin, size_t end)
+    {
+        for (size_t c = begin; c < end; ++c)
+        {
+            std::copy(m_ClusterLists[c].begin(), m_ClusterLists[c].end(), m_LightIndices.begin() + m_ClusterGrid[c].x);
+        }
+    }, 256);
+
+    std::chrono::duration<float, std::milli> binningTime = std::chrono::high_resolution_clock::now() - start;
+    m_BinningMs = binningTime.count();
+
+    // Upload
+    if (m_LightsDirty)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_LightBuffer);
+        // Never bind an empty buffer: keep at least one (unused) element
+        glBufferData(GL_SHADER_STORAGE_BUFFER, std::max<size_t>(1, m_Lights.size()) * sizeof(PunctualLight), nullptr, GL_STATIC_DRAW);
+        if (!m_Lights.empty())
+        {
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_Lights.size() * sizeof(PunctualLight), m_Lights.data());
+        }
+        m_LightsDirty = false;
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_ClusterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, CLUSTER_COUNT * sizeof(glm::uvec2), m_ClusterGrid.data(), GL_STREAM_DRAW);
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_IndexBuffer);
+    size_t indexBytes = std::max<size_t>(1, m_LightIndices.size()) * sizeof(uint32_t);
+    if (indexBytes > m_IndexBufferCapacity)
+    {
+        m_IndexBufferCapacity = indexBytes + indexBytes / 2;
+    }
+    // Orphan the previous frame's storage
+    glBufferData(GL_SHADER_STORAGE_BUFFER, m_IndexBufferCapacity, nullptr, GL_STREAM_DRAW);
+    if (!m_LightIndices.empty())
+    {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, m_LightIndices.size() * sizeof(uint32_t), m_LightIndices.data());
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
+
+void ClusteredLighting::bind(Shader& shader, int screenWidth, int screenHeight)
+{
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, LIGHT_BUFFER_BINDING, m_LightBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, CLUSTER_BUFFER_BINDING, m_ClusterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INDEX_BUFFER_BINDING, m_IndexBuffer);
+
+    glUniform3i(shader.getUniformlocation("uClusterDims"), CLUSTER_X, CLUSTER_Y, CLUSTER_Z);
+    shader.setFloat("uClusterNear", m_Near);
+    shader.setFloat("uClusterFar", m_Far);
+    shader.setVec2("uScreenSize", static_cast<float>(screenWidth), static_cast<float>(screenHeight));
+    shader.setInt("uDirectionalLightCount", static_cast<int>(m_DirectionalLightCount));
+}
+
+std::vector<PunctualLight> ClusteredLighting::generateSyntheticLights(size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, unsigned int seed)
+{
+    std::mt19937 rng(seed);
+    std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+    float diagonal = glm::length(boundsMax - boundsMin);
+    float range = std::max(1.0f, diagonal * 0.04f);
+
+    std::vector<PunctualLight> lights(count);
+    for (auto& light : lights)
+    {
+        glm::vec3 position = boundsMin + (boundsMax - boundsMin) * glm::vec3(unit(rng), unit(rng), unit(rng));
+        glm::vec3 color(0.25f + 0.75f * unit(rng), 0.25f + 0.75f * unit(rng), 0.25f + 0.75f * unit(rng));
+        light.positionRange = glm::vec4(position, range);
+        light.colorIntensity = glm::vec4(color, range * range * 0.25f);
+        light.directionType = glm::vec4(0.0f, 0.0f, -1.0f, static_cast<float>(LIGHT_POINT));
+        light.spotCone = glm::vec4(1.0f, 0.0f, 0.0f, 0.0f);
+    }
+    return lights;
+}
+
+static const size_t BENCHMARK_LIGHT_COUNTS[] = { 4, 16, 64, 256, 1024, 4096, 10000 };
+static const size_t BENCHMARK_STEP_COUNT = sizeof(BENCHMARK_LIGHT_COUNTS) / sizeof(BENCHMARK_LIGHT_COUNTS[0]);
+
+void LightCountBenchmark::start()
+{
+    m_Running = true;
+    m_LightsPending = true;
+    m_Results.clear();
+    m_Step = 0;
+    m_Frame = 0;
+    m_FrameAccumulator = 0.0;
+    m_BinningAccumulator = 0.0;
+    m_IndexAccumulator = 0;
+}
+
+size_t LightCountBenchmark::getCurrentLightCount() const
+{
+    return BENCHMARK_LIGHT_COUNTS[std::min(m_Step, BENCHMARK_STEP_COUNT - 1)];
+}
+
+bool LightCountBenchmark::advance(float frameMs, float binningMs, size_t lightIndices)
+{
+    if (!m_Running)
+    {
+        return false;
+    }
+    if (m_LightsPending)
+    {
+        // First step's light set is installed on the frame after start()
+        m_LightsPending = false;
+        return true;
+    }
+
+    ++m_Frame;
+    if (m_Frame <= WARMUP_FRAMES)
+    {
+        return false;
+    }
+
+    m_FrameAccumulator += frameMs;
+    m_BinningAccumulator += binningMs;
+    m_IndexAccumulator += lightIndices;
+    if (m_Frame < WARMUP_FRAMES + MEASURE_FRAMES)
+    {
+        return false;
+    }
+
+    m_Results.push_back({ getCurrentLightCount(),
+        static_cast<float>(m_FrameAccumulator / MEASURE_FRAMES),
+        static_cast<float>(m_BinningAccumulator / MEASURE_FRAMES),
+        m_IndexAccumulator / MEASURE_FRAMES });
+
+    m_Frame = 0;
+    m_FrameAccumulator = 0.0;
+    m_BinningAccumulator = 0.0;
+    m_IndexAccumulator = 0;
+
+    if (++m_Step >= BENCHMARK_STEP_COUNT)
+    {
+        m_Running = false;
+        printResults();
+    }
+    return true;
+}
+
+void LightCountBenchmark::printResults() const
+{
+    std::cout << "Clustered lighting benchmark\n";
+    std::cout << "lights, frame ms, binning ms, light indices\n";
+    for (const auto& result : m_Results)
+    {
+        std::cout << result.lightCount << ", " << result.frameMs << ", " << result.binningMs << ", " << result.lightIndices << "\n";
+    }
+}
@@ -0,0 +1,114 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <vector>
+#include <cstdint>
+#include "light.h"
+#include "shader.h"
+#include "threadPool.h"
+
+// Clustered forward lighting.
+//
+// The view frustum is split into a CLUSTER_X * CLUSTER_Y * CLUSTER_Z froxel grid
+// (exponential depth slices). Every frame the point and spot lights are binned into
+// the froxels on the worker threads, one depth slice per task, and the per-cluster
+// light index lists are uploaded as SSBOs. Directional lights affect every fragment
+// and are kept at the front of the light buffer instead of being binned.
+class ClusteredLighting
+{
+public:
+    static const int CLUSTER_X = 16;
+    static const int CLUSTER_Y = 9;
+    static const int CLUSTER_Z = 24;
+    static const int CLUSTER_COUNT = CLUSTER_X * CLUSTER_Y * CLUSTER_Z;
+
+    // SSBO binding points used by shaders/shader.frag
+    static const GLuint LIGHT_BUFFER_BINDING = 4;
+    static const GLuint CLUSTER_BUFFER_BINDING = 5;
+    static const GLuint INDEX_BUFFER_BINDING = 6;
+
+    explicit ClusteredLighting(ThreadPool& threadPool);
+
+    void init();
+    void destroy();
+    void setLights(const std::vector<PunctualLight>& lights);
+    void update(const glm::mat4& view, float fovY, float aspect, float zNear, float zFar);
+    void bind(Shader& shader, int screenWidth, int screenHeight);
+
+    size_t getLightCount() const { return m_Lights.size(); }
+    size_t getLightIndexCount() const { return m_LightIndices.size(); }
+    float getBinningMs() const { return m_BinningMs; }
+
+    // Random point lights inside the given box, used by the light count benchmark
+    static std::vector<PunctualLight> generateSyntheticLights(size_t count, const glm::vec3& boundsMin, const glm::vec3& boundsMax, unsigned int seed = 1337);
+
+private:
+    struct ClusterBounds
+    {
+        glm::vec3 min;
+        glm::vec3 max;
+    };
+
+    void buildClusterBounds();
+    void binSlice(int slice);
+
+    ThreadPool& m_ThreadPool;
+
+    std::vector<PunctualLight> m_Lights;     // directional lights first, then point/spot
+    uint32_t m_DirectionalLightCount = 0;
+    bool m_LightsDirty = true;
+
+    // Projection the cluster bounds were built for
+    float m_FovY = 0.0f;
+    float m_Aspect = 0.0f;
+    float m_Near = 0.0f;
+    float m_Far = 0.0f;
+    std::vector<ClusterBounds> m_ClusterBounds;
+    std::vector<float> m_SliceDepths;         // CLUSTER_Z + 1 view-space distances
+
+    // Per-frame binning data
+    std::vector<glm::vec4> m_ViewSpaceLights; // xyz: view-space center, w: range
+    std::vector<std::vector<uint32_t>> m_ClusterLists;
+    std::vector<glm::uvec2> m_ClusterGrid;    // offset, count into m_LightIndices
+    std::vector<uint32_t> m_LightIndices;
+    float m_BinningMs = 0.0f;
+
+    GLuint m_LightBuffer = 0;
+    GLuint m_ClusterBuffer = 0;
+    GLuint m_IndexBuffer = 0;
+    size_t m_IndexBufferCapacity = 0;
+};
+
+// Steps the renderer through increasing light counts and records the average
+// frame time for each, so clustered shading cost can be plotted against light count.
+class LightCountBenchmark
+{
+public:
+    struct Result
+    {
+        size_t lightCount;
+        float frameMs;
+        float binningMs;
+        size_t lightIndices;
+    };
+
+    bool m_Running = false;
+    std::vector<Result> m_Results;
+
+    void start();
+    // Returns true when the light set has to be replaced with getCurrentLightCount() lights
+    bool advance(float frameMs, float binningMs, size_t lightIndices);
+    size_t getCurrentLightCount() const;
+    void printResults() const;
+
+private:
+    static const int WARMUP_FRAMES = 30;
+    static const int MEASURE_FRAMES = 120;
+
+    bool m_LightsPending = false;
+    size_t m_Step = 0;
+    int m_Frame = 0;
+    double m_FrameAccumulator = 0.0;
+    double m_BinningAccumulator = 0.0;
+    size_t m_IndexAccumulator = 0;
+};
@@ -7,10 +7,98 @@
 #include "camera.h"
 #include "cModel.h"
 #include "assetManager.h"
+#include "gpuCulling.h"
+#include "clusteredLighting.h"
+#include "threadPool.h"
+#include "deferredRenderer.h"
+#include "gpuQuery.h"
+#include "cascadedShadows.h"
+#include "textureStreamer.h"
+#include "virtualTexture.h"
+#include "textureCooker.h"
+#include "ktxLoader.h"
+#include "ddsLoader.h"
+#include "base64.h"
+#include "base64Simd.h"
+#include "imageCodec.h"
+#include "mappedFile.h"
+#include "hotReload.h"
+#include "shaderPermutations.h"
+#include "profiler.h"
+#include "headlessContext.h"
+#include "frameBenchmark.h"
+#include "cameraPath.h"
+#include "loaderBenchmark.h"
+#include "sceneGenerator.h"
 
 
 
 bool useBatchRendering = false;
+bool useGpuCulling = false;
+GpuCuller gpuCuller;
+
+ThreadPool threadPool;
+bool useClusteredLighting = true;
+ClusteredLighting clusteredLighting(threadPool);
+LightCountBenchmark lightBenchmark;
+
+bool useDeferredShading = false;
+DeferredRenderer deferredRenderer;
+
+// Forward path split into opaque/mask/blend buckets with an optional depth pre-pass
+bool useAlphaModePipeline = true;
+bool useDepthPrepass = true;
+GpuQuery fragmentQuery(GL_FRAGMENT_SHADER_INVOCATIONS);
+GLuint64 uberShaderInvocations = 0;
+GLuint64 splitPipelineInvocations = 0;
+// The split passes draw each primitive with a shader.frag variant specialized for its material
+// instead of the opaque/mask/blend uber shaders. GPU time of the forward draws of each path:
+bool useShaderPermutations = true;
+ShaderPermutations forwardPermutations("shaders/shader.vert", "shaders/shader.frag");
+GpuQuery forwardTimeQuery(GL_TIME_ELAPSED);
+float uberShaderMs = 0.0f;
+float splitPipelineMs = 0.0f;
+float permutationMs = 0.0f;
+
+bool useShadows = true;
+CascadedShadowMaps cascadedShadows;
+
+// Decided at load time, streamed textures are never decoded up front.
+// Streaming has its own workers so slow decodes can't hold up the per-frame light binning.
+bool useTextureStreaming = true;
+ThreadPool streamingThreadPool(2);
+TextureStreamer textureStreamer(streamingThreadPool);
+
+// Streamed PNG/JPG color textures are paged through a fixed-size physical cache instead,
+// also decided at load time. Page reads share the streaming workers.
+bool useVirtualTexturing = false;
+VirtualTextureSystem virtualTextures(streamingThreadPool);
+
+// PNG/JPG textures are cooked to BC1/BC3/BC5 DDS files that later runs load instead. Off
+// unless asked for with --cook, cooking writes next to the source assets
+bool cookTextures = false;
+// Cooked DDS files are loaded in place of their source, a benchmark with --textures decoded turns this off
+bool useCookedTextures = true;
+// --bench-cook: also upload every cooked texture both ways and compare the times
+bool benchmarkCookedUploads = false;
+TextureCooker textureCooker(threadPool);
+CookReport cookReport;
+ModelReloadReport modelReloadReport;
+// The live model's, finished after every load or reload
+const LoadReport* loadReport = nullptr;
+// --load-report <file.json>: written there after every load or reload. The panel's export
+// button uses it too, or <model>.load_report.json when it is empty.
+std::string loadReportPath;
+
+// Decoded PNG/JPG textures go through a persistently mapped PBO ring a few MB per frame
+// instead of a synchronous glTexImage2D each at load time
+bool useAsyncTextureUpload = true;
+TextureUploader textureUploader;
+
+// Shaders, textures and the model are reloaded when their files change, decodes and model
+// loads share the streaming workers
+bool useHotReload = true;
+HotReloader hotReloader(streamingThreadPool, textureUploader, textureStreamer);
 
 
 glm::vec3 objectColor = glm::vec3(1.0f);
@@ -40,35 +128,14 @@ bool showUI = false;
 float deltaTime = 0.0f;
 float lastFrame = 0.0f;
 
-GLuint VAO, VBO, EBO;
+// P records the camera into a path that --benchmark --path can replay
+CameraPath recordedCameraPath;
+bool recordingCameraPath = false;
+float cameraPathStart = 0.0f;
+const char* cameraPathFile = "camera_path.campath";
 
-struct Timer
-{
-    std::chrono::time_point<std::chrono::high_resolution_clock> start, end;
-    std::chrono::duration<float> duration;
-    std::string m_title = "Timer";
-    Timer()
-    {
-        startTimer();
-    }
-    void setTitle(const char* title)
-    {
-        m_title = title;
-    }
-    void startTimer()
-    {
-        start = std::chrono::high_resolution_clock::now();
-    }
-    void stopTimer()
-    {
-        end = std::chrono::high_resolution_clock::now();
-        duration = end - start;
-
-        float ms = duration.count() * 1000.0f;
+GLuint VAO, VBO, EBO;
 
-        std::cout << m_title << " took: " << ms << "ms" << std::endl;
-    }
-};
 
 void processInput(float deltaTime)
 {
@@ -90,6 +157,20 @@ void processInput(float deltaTime)
         {
             flashlight = !flashlight;
         }
+        if (event.type == SDL_KEYUP && event.key.keysym.sym == SDLK_p)
+        {
+            recordingCameraPath = !recordingCameraPath;
+            if (recordingCameraPath)
+            {
+                recordedCameraPath.clear();
+                cameraPathStart = lastFrame;
+                std::cout << "Recording camera path" << std::endl;
+            }
+            else if (recordedCameraPath.save(cameraPathFile))
+            {
+                std::cout << "Camera path saved to " << cameraPathFile << " (" << recordedCameraPath.getDuration() << "s)" << std::endl;
+            }
+        }
         if (event.type == SDL_KEYDOWN && event.key.keysym.sym == SDLK_1)
         {
             glPolygonMode(GL_FRONT_AND_BACK, GL_POINT);
@@ -167,9 +248,163 @@ void gui()
 
     ImGui::Begin("Hello, world!");                          // Create a window called "Hello, world!" and append into it
     ImGui::Text("Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    if (ImGui::CollapsingHeader("Profiler"))
+    {
+        Profiler& profiler = Profiler::get();
+        const ProfilerStats& stats = profiler.getStats();
+        bool enabled = profiler.isEnabled();
+        if (ImGui::Checkbox("Record scopes", &enabled))
+        {
+            profiler.setEnabled(enabled);
+        }
+        ImGui::SameLine();
+        if (ImGui::Button("Export Chrome trace"))
+        {
+            profiler.exportChromeTrace("profile_trace.json");
+        }
+        ImGui::Text("Frame %.3f ms  p50 %.3f  p95 %.3f  p99 %.3f  max %.3f (last %zu frames)",
+            stats.frameMs, stats.p50Ms, stats.p95Ms, stats.p99Ms, stats.maxMs, profiler.m_HistoryFrames);
+        ImGui::Text("Profiler overhead %.3f ms (%.2f%%), %zu events/frame, dropped %zu events, %zu GPU scopes",
+            stats.overheadMs, stats.frameMs > 0.0f ? 100.0f * stats.overheadMs / stats.frameMs : 0.0f,
+            stats.eventsPerFrame, stats.droppedEvents, stats.droppedGpuScopes);
+        profiler.drawTimeline(ImGui::GetContentRegionAvail().x, ImGui::GetTextLineHeight() + 2.0f);
+    }
     ImGui::Text("Camera Position: X: %.3f  Y: %.3f  Z: %.3f", camera.Position.x, camera.Position.y, camera.Position.z);
     ImGui::Checkbox("Use normal texture: ", &useNormalTexture);
     ImGui::Checkbox("Use batch rendering", &useBatchRendering);
+    ImGui::Checkbox("Use GPU culling (two-phase Hi-Z)", &useGpuCulling);
+    if (useGpuCulling && gpuCuller.isInitialized())
+    {
+        const GpuCullingStats& stats = gpuCuller.getStats();
+        ImGui::Text("Objects: %u  Phase 1 drawn: %u  Occluded: %u  Phase 2 drawn: %u",
+            stats.objectCount, stats.phase1Drawn, stats.phase1Occluded, stats.phase2Drawn);
+    }
+
+    ImGui::Checkbox("Use clustered lighting", &useClusteredLighting);
+    ImGui::Text("Punctual lights: %zu  Light indices: %zu  Binning: %.3f ms",
+        clusteredLighting.getLightCount(), clusteredLighting.getLightIndexCount(), clusteredLighting.getBinningMs());
+    if (!lightBenchmark.m_Running && ImGui::Button("Run light count benchmark"))
+    {
+        lightBenchmark.start();
+    }
+    if (lightBenchmark.m_Running)
+    {
+        ImGui::Text("Benchmarking %zu lights...", lightBenchmark.getCurrentLightCount());
+    }
+    for (const auto& result : lightBenchmark.m_Results)
+    {
+        ImGui::Text("%6zu lights: %.3f ms/frame (binning %.3f ms, %zu indices)", result.lightCount, result.frameMs, result.binningMs, result.lightIndices);
+    }
+
+    ImGui::Checkbox("Split opaque/mask/blend passes", &useAlphaModePipeline);
+    ImGui::Checkbox("Depth pre-pass", &useDepthPrepass);
+    if (fragmentQuery.isSupported())
+    {
+        ImGui::Text("Fragment shader invocations  uber shader: %llu  split pipeline: %llu",
+            (unsigned long long)uberShaderInvocations, (unsigned long long)splitPipelineInvocations);
+    }
+    ImGui::Checkbox("Shader permutations", &useShaderPermutations);
+    ImGui::Text("Forward GPU time  uber shader: %.3f ms  split: %.3f ms  permutations: %.3f ms (%zu variants)",
+        uberShaderMs, splitPipelineMs, permutationMs, forwardPermutations.getVariantCount());
+
+    ImGui::Checkbox("Cascaded shadows", &useShadows);
+    if (useShadows && ImGui::CollapsingHeader("Shadow cascades"))
+    {
+        ImGui::Checkbox("Re-render static casters every frame", &cascadedShadows.m_ForceRefresh);
+        ImGui::SliderFloat("Shadow distance", &cascadedShadows.m_ShadowDistance, 20.0f, 500.0f);
+        for (int i = 0; i < CascadedShadowMaps::CASCADE_COUNT; ++i)
+        {
+            const CascadeStats& stats = cascadedShadows.getStats(i);
+            ImGui::Text("Cascade %d (%6.1f m): %s static %4u draws, dynamic %3u draws, %.3f ms GPU, %.3f ms CPU, %u refreshes",
+                i, stats.splitFar, stats.refreshed ? "REFRESH" : "cached ", stats.staticCasters, stats.dynamicCasters,
+                stats.gpuMs, stats.cpuMs, stats.refreshCount);
+        }
+    }
+
+    if (useVirtualTexturing && ImGui::CollapsingHeader("Virtual texturing"))
+    {
+        const VirtualTextureStats& stats = virtualTextures.getStats();
+        ImGui::SliderFloat("VT mip bias", &virtualTextures.m_MipBias, -2.0f, 4.0f);
+        ImGui::Text("Textures: %zu (%zu tiled)  Virtual space: %ux%u pages", stats.textureCount, stats.readyTextures, stats.virtualPages, stats.virtualPages);
+        ImGui::Text("Resident pages: %zu / %zu  Requested: %zu  Pending: %zu", stats.residentPages, stats.capacityPages, stats.requestedPages, stats.pendingLoads);
+        ImGui::Text("Uploaded pages: %zu  Evictions: %zu", stats.uploadedPages, stats.evictions);
+    }
+
+    if (useTextureStreaming && ImGui::CollapsingHeader("Texture streaming"))
+    {
+        const TextureStreamingStats& stats = textureStreamer.getStats();
+        int budgetMB = static_cast<int>(textureStreamer.m_BudgetBytes / (1024 * 1024));
+        if (ImGui::SliderInt("Budget (MB)", &budgetMB, 16, 4096))
+        {
+            textureStreamer.m_BudgetBytes = static_cast<size_t>(budgetMB) * 1024 * 1024;
+        }
+        ImGui::SliderFloat("Mip bias", &textureStreamer.m_MipBias, -2.0f, 4.0f);
+        ImGui::Text("Textures: %zu  Resident: %zu  Pending: %zu", stats.textureCount, stats.residentTextures, stats.pendingLoads);
+        ImGui::Text("Resident: %.1f MB  Uploaded: %.1f MB  Evictions: %zu",
+            stats.residentBytes / (1024.0 * 1024.0), stats.uploadedBytes / (1024.0 * 1024.0), stats.evictions);
+    }
+
+    if (useAsyncTextureUpload && ImGui::CollapsingHeader("Texture upload"))
+    {
+        const TextureUploadStats& stats = textureUploader.getStats();
+        int budgetMB = static_cast<int>(textureUploader.m_UploadBytesPerFrame / (1024 * 1024));
+        if (ImGui::SliderInt("Per frame (MB)", &budgetMB, 1, 64))
+        {
+            textureUploader.m_UploadBytesPerFrame = static_cast<size_t>(budgetMB) * 1024 * 1024;
+        }
+        ImGui::Text("Textures: %zu / %zu  Pending: %.1f MB", stats.completedTextures, stats.queuedTextures, stats.pendingBytes / (1024.0 * 1024.0));
+        ImGui::Text("Uploaded: %.1f MB at %.1f MB/s  CPU: %.2f ms/frame",
+            stats.uploadedBytes / (1024.0 * 1024.0), stats.throughputMBs, stats.lastFrameCpuMs);
+    }
+
+    if (useHotReload && ImGui::CollapsingHeader("Hot reload"))
+    {
+        const HotReloadStats& stats = hotReloader.getStats();
+        ImGui::Text("Shaders: %zu  Textures: %zu  Models: %zu  Failed: %zu", stats.shaderReloads, stats.textureReloads, stats.modelReloads, stats.failedReloads);
+        if (stats.modelReloads > 0)
+        {
+            const ModelReloadReport& report = modelReloadReport;
+            ImGui::Text("Last model reload: %zu/%zu primitives kept, %zu materials and %zu primitives rebuilt", report.reusedPrimitives, report.primitives, report.rebuiltMaterials, report.rebuiltPrimitives);
+            ImGui::Text("  %zu/%zu textures kept, %.2f MB uploaded in %.2f ms (+%.2f MB batch)", report.reusedTextures, report.textures, report.uploadedBytes / (1024.0 * 1024.0), report.uploadMs, report.batchBytes / (1024.0 * 1024.0));
+        }
+    }
+
+    if (loadReport && ImGui::CollapsingHeader("Load report"))
+    {
+        loadReport->drawGui();
+        if (ImGui::Button("Export JSON"))
+        {
+            std::string path = loadReportPath.empty() ? fs::path(loadReport->getSource()).stem().string() + ".load_report.json" : loadReportPath;
+            if (loadReport->writeJson(path))
+            {
+                std::cout << "Load report written to " << path << std::endl;
+            }
+        }
+    }
+
+    if (cookReport.textureCount > 0 && ImGui::CollapsingHeader("Texture cooking"))
+    {
+        ImGui::Text("Cooked %zu textures, used from the next run on", cookReport.textureCount);
+        ImGui::Text("VRAM: %.1f MB -> %.1f MB", cookReport.uncompressedBytes / (1024.0 * 1024.0), cookReport.compressedBytes / (1024.0 * 1024.0));
+        if (cookReport.uploadsMeasured)
+        {
+            ImGui::Text("Upload: %.2f ms -> %.2f ms", cookReport.uncompressedUploadMs, cookReport.compressedUploadMs);
+        }
+    }
+
+    ImGui::Checkbox("Use deferred shading", &useDeferredShading);
+    if (ImGui::CollapsingHeader("G-buffer memory"))
+    {
+        ImGui::Text("%zu bytes/pixel (RGBA8 albedo, RG16 oct normal, D32F)", DeferredRenderer::getBytesPerPixel());
+        const int resolutions[][2] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+        for (const auto& resolution : resolutions)
+        {
+            double trafficMB = DeferredRenderer::getFrameTrafficBytes(resolution[0], resolution[1]) / (1024.0 * 1024.0);
+            ImGui::Text("%4dx%4d: %6.1f MB, %6.1f MB/frame, %5.2f GB/s at current FPS", resolution[0], resolution[1],
+                DeferredRenderer::getMemoryBytes(resolution[0], resolution[1]) / (1024.0 * 1024.0),
+                trafficMB, trafficMB * ImGui::GetIO().Framerate / 1024.0);
+        }
+    }
 
     if (ImGui::ColorEdit3("Edit lightColor", (float*)&lightColor));
 
@@ -180,13 +415,251 @@ void gui()
 
 }
 
-int run()
+struct LoadTiming
+{
+    double totalMs = 0.0;
+    double minMs = DBL_MAX;
+};
+
+// Times a texture load including the file read, with a glFinish so the GPU copy is counted
+template<typename LoadFunction>
+void timeTextureLoad(LoadTiming& timing, LoadFunction load)
+{
+    glFinish();
+    auto start = std::chrono::high_resolution_clock::now();
+    GLuint texture = load();
+    glFinish();
+    std::chrono::duration<double, std::milli> loadTime = std::chrono::high_resolution_clock::now() - start;
+    glDeleteTextures(1, &texture);
+    timing.totalMs += loadTime.count();
+    timing.minMs = std::min(timing.minMs, loadTime.count());
+}
+
+void printLoadTiming(const char* label, const LoadTiming& timing, int iterations, size_t bytes)
+{
+    std::cout << "  " << label << ": avg " << timing.totalMs / iterations << "ms, min " << timing.minMs << "ms, "
+              << (bytes / (1024.0 * 1024.0)) / (timing.minMs / 1000.0) << " MB/s\n";
+}
+
+// Loads the same texture as KTX and as DDS and prints the timings
+void compareTextureLoaders(const std::string& ktxPath, const std::string& ddsPath, int iterations)
+{
+    LoadTiming ktxTiming, ddsTiming;
+    TextureUploadInfo info;
+    try
+    {
+        for (int i = 0; i < iterations; ++i)
+        {
+            timeTextureLoad(ktxTiming, [&]() { return KTXLoader::load(ktxPath, &info); });
+            timeTextureLoad(ddsTiming, [&]() { return DDSLoader::load(ddsPath); });
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Texture loader comparison failed: " << e.what() << std::endl;
+        return;
+    }
+
+    std::cout << "KTX: " << info.width << "x" << info.height << ", " << info.levels << " levels, "
+              << info.bytes / 1024 << " KB of image data\n";
+    printLoadTiming("KTXLoader", ktxTiming, iterations, info.bytes);
+    printLoadTiming("DDSLoader", ddsTiming, iterations, info.bytes);
+    std::cout << std::flush;
+}
+
+// Mapped DDSLoader against the ifstream reader in Texture, which copies every level into its own vector
+void benchmarkDDSLoad(const std::string& ddsPath, int iterations)
+{
+    LoadTiming mappedTiming, streamTiming;
+    TextureUploadInfo info;
+    size_t bytes;
+    try
+    {
+        for (int i = 0; i < iterations; ++i)
+        {
+            timeTextureLoad(mappedTiming, [&]() { return DDSLoader::load(ddsPath, &info); });
+            timeTextureLoad(streamTiming, [&]() { return GpuTextureCache::createTexture(Texture(ddsPath, true), bytes); });
+        }
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "DDS benchmark failed: " << e.what() << std::endl;
+        return;
+    }
+
+    std::cout << "DDS: " << info.width << "x" << info.height << "x" << info.depth << ", " << info.levels << " levels, "
+              << info.bytes / 1024 << " KB of image data\n";
+    printLoadTiming("DDSLoader (mapped)", mappedTiming, iterations, info.bytes);
+    printLoadTiming("Texture (ifstream)", streamTiming, iterations, info.bytes);
+    std::cout << std::flush;
+}
+
+// base64_decode (std::string result, one character at a time) against every base64DecodeInto path
+void benchmarkBase64(size_t megabytes, int iterations)
+{
+    std::string raw(megabytes * 1024 * 1024, '\0');
+    uint32_t seed = 12345;
+    for (char& c : raw)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        c = static_cast<char>(seed >> 24);
+    }
+    std::string encoded = base64_encode(raw);
+    std::vector<unsigned char> decoded(base64DecodedSize(encoded));
+
+    auto printRate = [&](const char* label, double minMs)
+    {
+        std::cout << "  " << label << ": min " << minMs << "ms, " << (encoded.size() / (1024.0 * 1024.0)) / (minMs / 1000.0) << " MB/s of base64\n";
+    };
+
+    double minMs = DBL_MAX;
+    for (int i = 0; i < iterations; ++i)
+    {
+        auto start = std::chrono::high_resolution_clock::now();
+        std::string result = base64_decode(encoded);
+        std::chrono::duration<double, std::milli> decodeTime = std::chrono::high_resolution_clock::now() - start;
+        minMs = std::min(minMs, decodeTime.count());
+    }
+    std::cout << "base64: " << megabytes << " MB decoded, best path " << base64PathName(base64BestPath()) << "\n";
+    printRate("base64_decode", minMs);
+
+    for (Base64Path path : { BASE64_SCALAR, BASE64_SSE41, BASE64_AVX2 })
+    {
+        if (path > base64BestPath())
+        {
+            break;
+        }
+        minMs = DBL_MAX;
+        bool valid = true;
+        for (int i = 0; i < iterations; ++i)
+        {
+            auto start = std::chrono::high_resolution_clock::now();
+            valid &= base64DecodeInto(encoded, decoded.data(), path);
+            std::chrono::duration<double, std::milli> decodeTime = std::chrono::high_resolution_clock::now() - start;
+            minMs = std::min(minMs, decodeTime.count());
+        }
+        if (!valid || std::memcmp(decoded.data(), raw.data(), raw.size()) != 0)
+        {
+            std::cerr << "base64DecodeInto (" << base64PathName(path) << ") produced wrong output" << std::endl;
+        }
+        printRate((std::string("base64DecodeInto, ") + base64PathName(path)).c_str(), minMs);
+    }
+    std::cout << std::flush;
+}
+
+// Decodes one image with every registered codec that accepts it, into the same preallocated buffer
+void benchmarkImageCodecs(const std::string& path, int iterations)
+{
+    MappedFile file(path);
+    ImageInfo info;
+    if (!file.isOpen() || !ImageCodecs::get().readInfo(file.data(), file.size(), info))
+    {
+        std::cerr << "Failed to read image: " << path << std::endl;
+        return;
+    }
+    std::cout << "Image: " << info.width << "x" << info.height << ", " << info.channels << " channels, "
+              << file.size() / 1024 << " KB\n";
+
+    std::vector<unsigned char> pixels(static_cast<size_t>(info.width) * info.height * 4);
+    double megapixels = static_cast<double>(info.width) * info.height / 1e6;
+    for (const auto& codec : ImageCodecs::get().getCodecs())
+    {
+        if (!codec->canDecode(file.data(), file.size()))
+        {
+            continue;
+        }
+        for (int channels : { info.channels, 4 })
+        {
+            double minMs = DBL_MAX;
+            bool decoded = true;
+            for (int i = 0; i < iterations && decoded; ++i)
+            {
+                auto start = std::chrono::high_resolution_clock::now();
+                decoded = codec->decodeInto(file.data(), file.size(), channels, pixels.data());
+                std::chrono::duration<double, std::milli> decodeTime = std::chrono::high_resolution_clock::now() - start;
+                minMs = std::min(minMs, decodeTime.count());
+            }
+            std::cout << "  " << codec->getName() << " (" << channels << " channels): ";
+            if (decoded)
+            {
+                std::cout << "min " << minMs << "ms, " << megapixels / (minMs / 1000.0) << " MP/s\n";
+            }
+            else
+            {
+                std::cout << "not supported\n";
+            }
+            if (channels == 4)
+            {
+                break;
+            }
+        }
+    }
+    std::cout << std::flush;
+}
+
+// Brings the index under root up to date and returns the first model called name, or an
+// empty string when there is none
+std::string findModel(const std::string& root, const std::string& name)
+{
+    AssetCatalogue catalogue(threadPool);
+    std::string indexPath = (fs::path(root) / AssetCatalogue::INDEX_FILE_NAME).string();
+    catalogue.load(indexPath);
+    catalogue.scan(root);
+    catalogue.save(indexPath);
+
+    std::vector<const AssetEntry*> matches = catalogue.findByName(name);
+    if (matches.empty())
+    {
+        std::cerr << "No model called " << name << " under " << root << std::endl;
+        return std::string();
+    }
+    if (matches.size() > 1)
+    {
+        std::cout << matches.size() << " models called " << name << ", using " << matches[0]->path << std::endl;
+    }
+    return catalogue.getAbsolutePath(*matches[0]).generic_string();
+}
+
+void scanAssets(const std::string& root, bool fullRescan)
+{
+    AssetCatalogue catalogue(threadPool);
+    std::string indexPath = (fs::path(root) / AssetCatalogue::INDEX_FILE_NAME).string();
+
+    auto start = std::chrono::high_resolution_clock::now();
+    bool loaded = catalogue.load(indexPath);
+    std::chrono::duration<float, std::milli> loadTime = std::chrono::high_resolution_clock::now() - start;
+    AssetScanStats stats = catalogue.scan(root, fullRescan);
+    catalogue.save(indexPath);
+
+    std::cout << "Asset index " << indexPath << (loaded ? " loaded in " : " not found, built from scratch, ") << loadTime.count() << "ms\n";
+    std::cout << "  " << stats.files << " files in " << stats.directories << " directories, "
+              << stats.changedDirectories << " listed again, " << stats.removedFiles << " removed\n";
+    std::cout << "  Scan: " << stats.scanMs << "ms, hashing " << stats.hashedFiles << " files ("
+              << stats.hashedBytes / (1024.0 * 1024.0) << " MB): " << stats.hashMs << "ms\n";
+    std::vector<const AssetEntry*> models = catalogue.findByExtension(".gltf");
+    std::vector<const AssetEntry*> binaryModels = catalogue.findByExtension(".glb");
+    models.insert(models.end(), binaryModels.begin(), binaryModels.end());
+    std::cout << "  " << models.size() << " glTF models, " << stats.missingDependencies << " missing dependencies" << std::endl;
+    for (const AssetEntry* model : models)
+    {
+        for (const auto& dependency : model->dependencies)
+        {
+            if (catalogue.find(dependency) == nullptr)
+            {
+                std::cerr << "  " << model->path << " references missing " << dependency << "\n";
+            }
+        }
+    }
+}
+
+// Creates the visible window with a GL 4.6 context and loads GL through it
+bool createWindow(SDL_Window*& window, SDL_GLContext& maincontext)
 {
     //windowContext windowC = initializer::init_window_SDL("CosmicManor", SCR_WIDTH, SCR_HEIGHT);
     if (SDL_Init(SDL_INIT_VIDEO) < 0)
     {
         fprintf(stderr, "%s: %s\n", "Couldn't initialize SDL", SDL_GetError());
-        return -1;
+        return false;
     }
 
     // Windows DPI awareness
@@ -207,29 +680,167 @@ int run()
     SDL_GL_SetAttribute(SDL_GL_DEPTH_SIZE, 24);
 
     // Create the window
-    SDL_Window* window = SDL_CreateWindow("Cosmic Manor", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
+    window = SDL_CreateWindow("Cosmic Manor", SDL_WINDOWPOS_CENTERED, SDL_WINDOWPOS_CENTERED,
         SCR_WIDTH, SCR_HEIGHT, SDL_WINDOW_OPENGL | SDL_WINDOW_SHOWN | SDL_WINDOW_ALLOW_HIGHDPI);
 
     if (window == nullptr)
     {
         fprintf(stderr, "%s: %s\n", "Couldn't set video mode", SDL_GetError());
-        return -1;
+        return false;
     }
 
-    static SDL_GLContext maincontext = SDL_GL_CreateContext(window);
+    maincontext = SDL_GL_CreateContext(window);
     if (maincontext == nullptr)
     {
         fprintf(stderr, "%s: %s\n", "Failed to create OpenGL context", SDL_GetError());
-        return -1;
+        return false;
     }
 
     // Initialize GLAD
     if (!gladLoadGLLoader((GLADloadproc)SDL_GL_GetProcAddress))
     {
         std::cout << "Failed to initialize GLAD" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+int run(int argc, char* argv[])
+{
+    // --bench-base64 [megabytes] [iterations] needs no window, neither do --bench-codecs and --scan-assets
+    if (argc >= 2 && std::string(argv[1]) == "--bench-base64")
+    {
+        size_t megabytes = argc > 2 ? std::max(1, std::atoi(argv[2])) : 64;
+        int iterations = argc > 3 ? std::max(1, std::atoi(argv[3])) : 10;
+        benchmarkBase64(megabytes, iterations);
+        return 0;
+    }
+    // --bench-codecs <image> [iterations] times every image codec that can decode the file
+    if (argc >= 3 && std::string(argv[1]) == "--bench-codecs")
+    {
+        benchmarkImageCodecs(argv[2], argc > 3 ? std::max(1, std::atoi(argv[3])) : 20);
+        return 0;
+    }
+
+    // --bench-loader [inputs...] [options] times every load stage at several thread counts and
+    // writes the throughput as JSON, see LoaderBenchmarkOptions::parse
+    if (argc >= 2 && std::string(argv[1]) == "--bench-loader")
+    {
+        LoaderBenchmarkOptions loaderOptions;
+        if (!LoaderBenchmarkOptions::parse(argc, argv, loaderOptions))
+        {
+            return -1;
+        }
+        return LoaderBenchmark(loaderOptions).run() ? 0 : 1;
+    }
+
+    // --generate-scene <out.glb|out.gltf> [options] writes a synthetic stress scene, see SceneGeneratorOptions::parse
+    if (argc >= 2 && std::string(argv[1]) == "--generate-scene")
+    {
+        SceneGeneratorOptions sceneOptions;
+        if (!SceneGeneratorOptions::parse(argc, argv, sceneOptions))
+        {
+            return -1;
+        }
+        SceneGenerator generator(sceneOptions);
+        if (!generator.write())
+        {
+            return 1;
+        }
+        generator.printStats();
+        return 0;
+    }
+
+    // --scan-assets <directory> [--full] updates the directory's asset index and reports the cost
+    if (argc >= 3 && std::string(argv[1]) == "--scan-assets")
+    {
+        scanAssets(argv[2], argc > 3 && std::string(argv[3]) == "--full");
+        return 0;
+    }
+
+    // --benchmark <model.gltf> [options] renders a camera path offscreen and writes per-frame
+    // timings as JSON, see BenchmarkOptions::parse
+    bool benchmark = argc >= 2 && std::string(argv[1]) == "--benchmark";
+    BenchmarkOptions benchmarkOptions;
+    if (benchmark && !BenchmarkOptions::parse(argc, argv, benchmarkOptions))
+    {
+        return -1;
+    }
+
+    // --find-model <directory> <name.gltf> looks the model up in the directory's asset index.
+    // --load-report <file.json> writes the load report after every load.
+    // --cook cooks the model's PNG/JPG textures for later runs, --bench-cook also times
+    // their uploads against the uncompressed path
+    std::string assetRoot;
+    std::string assetName;
+    for (int i = 1; i < argc && !benchmark; ++i)
+    {
+        std::string argument = argv[i];
+        if (argument == "--find-model" && i + 2 < argc)
+        {
+            assetRoot = argv[++i];
+            assetName = argv[++i];
+        }
+        else if (argument == "--load-report" && i + 1 < argc)
+        {
+            loadReportPath = argv[++i];
+        }
+        else if (argument == "--cook" || argument == "--bench-cook")
+        {
+            cookTextures = true;
+            benchmarkCookedUploads = benchmarkCookedUploads || argument == "--bench-cook";
+        }
+    }
+
+    SDL_Window* window = nullptr;
+    SDL_GLContext maincontext = nullptr;
+    HeadlessContext headlessContext;
+    if (benchmark)
+    {
+        if (!headlessContext.create() || !gladLoadGLLoader(reinterpret_cast<GLADloadproc>(headlessContext.getLoader())))
+        {
+            std::cerr << "Failed to create a headless GL context" << std::endl;
+            headlessContext.destroy();
+            return -1;
+        }
+        ShaderCache::get().m_GetProcAddress = headlessContext.getLoader();
+        std::cout << "Benchmark context: " << headlessContext.getBackend() << ", " << glGetString(GL_RENDERER) << ", GL " << glGetString(GL_VERSION) << std::endl;
+        // Hot reload would make runs depend on what happens to the files meanwhile. Streaming
+        // and the upload ring make texture residency depend on worker timing, and cooking
+        // would change which textures the next run loads, so every texture is loaded up front.
+        useHotReload = false;
+        useTextureStreaming = false;
+        useAsyncTextureUpload = false;
+        cookTextures = false;
+        useCookedTextures = benchmarkOptions.textureMode == "cooked";
+    }
+    else if (!createWindow(window, maincontext))
+    {
         return -1;
     }
 
+    // --compare-ktx <texture.ktx> <texture.dds> [iterations] times both loaders and exits,
+    // --bench-dds <texture.dds> [iterations] times the mapped and ifstream DDS readers
+    bool compareKTX = argc >= 4 && std::string(argv[1]) == "--compare-ktx";
+    bool benchDDS = argc >= 3 && std::string(argv[1]) == "--bench-dds";
+    if (compareKTX || benchDDS)
+    {
+        int iterationsArg = compareKTX ? 4 : 3;
+        int iterations = argc > iterationsArg ? std::max(1, std::atoi(argv[iterationsArg])) : 20;
+        if (compareKTX)
+        {
+            compareTextureLoaders(argv[2], argv[3], iterations);
+        }
+        else
+        {
+            benchmarkDDSLoad(argv[2], iterations);
+        }
+        SDL_GL_DeleteContext(maincontext);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+        return 0;
+    }
+
 
     // MSAA ENABLE
     glEnable(GL_MULTISAMPLE);
@@ -270,96 +881,421 @@ int run()
     // Setup Dear ImGui style
     ImGui::StyleColorsDark();
 
-    // Setup Platform/Renderer backends
-    ImGui_ImplSDL2_InitForOpenGL(window, maincontext);
-    ImGui_ImplOpenGL3_Init("#version 330");
+    // Setup Platform/Renderer backends, the benchmark renders no UI
+    if (!benchmark)
+    {
+        ImGui_ImplSDL2_InitForOpenGL(window, maincontext);
+        ImGui_ImplOpenGL3_Init("#version 330");
+    }
+
+    Profiler::get().setThreadName("Main");
 
-    // Create a shader
+    // Create a shader. The constructors only start compiling, or link a cached binary
+    ProfileTimer shaderTimer("Shader setup");
     Shader shader("shaders/shader.vert", "shaders/shader.frag");
     Shader postShader("shaders/postShader.vert", "shaders/postShader.frag");
     Shader simpleShader("shaders/simpleShader.vert", "shaders/simpleShader.frag");
+    Shader gbufferShader("shaders/shader.vert", "shaders/gbuffer.frag");
+    Shader deferredShader("shaders/postShader.vert", "shaders/deferredLight.frag");
+    Shader depthShader("shaders/depthOnly.vert", "shaders/depthOnly.frag");
+    Shader opaqueShader("shaders/shader.vert", "shaders/shader.frag", std::vector<std::string>{ "ALPHA_OPAQUE" });
+    Shader maskShader("shaders/shader.vert", "shaders/shader.frag", std::vector<std::string>{ "ALPHA_MASK" });
+    Shader blendShader("shaders/shader.vert", "shaders/shader.frag", std::vector<std::string>{ "ALPHA_BLEND" });
+    Shader* forwardShaders[] = { &shader, &opaqueShader, &maskShader, &blendShader };
+    Shader feedbackShader("shaders/shader.vert", "shaders/vtFeedback.frag");
+    for (Shader* builtShader : { &shader, &postShader, &simpleShader, &gbufferShader, &deferredShader, &depthShader, &opaqueShader, &maskShader, &blendShader, &feedbackShader })
+    {
+        builtShader->finishBuild();
+    }
+    ShaderCache::get().printStats(shaderTimer.stop());
 
     if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
         std::cout << "ERROR::FRAMEBUFFER:: Framebuffer is not complete!" << std::endl;
     glBindFramebuffer(GL_FRAMEBUFFER, 0);
 
-    /*
-    std::unordered_map<std::string, fs::path> files;
-    {
-        Timer timer;
-        timer.setTitle("Look up all files");
-        timer.startTimer();
-        files = findModelFiles("../spaceStationProjectDirectory/TODO");
-    }
-    fs::path file;
-    auto it = files.find("SponzaDDS.gltf");
-    if (it != files.end()) 
-    {
-        file = it->second;  // Access the value using iterator
-    }
-    else 
-    {
-        std::cout << "Key not found" << std::endl;
-    }
-    std::string filePath = file.generic_string();
-    */
     std::string filePath = "../spaceStationProjectDirectory/TODO/";
     std::string file = filePath + "MultiUVTest/glTF/MultiUVTest.gltf";
     //file = "C:/spaceStationProjectDirectory/completed/BoxTextured/glTF/BoxTextured.gltf";
     //file = "C:/SponzaDDS/glTF/SponzaDDS.gltf";
     file = "C:/bistro/bistroExterior.gltf";
+    if (benchmark)
+    {
+        file = benchmarkOptions.modelPath;
+    }
+    else if (!assetRoot.empty())
+    {
+        std::string found = findModel(assetRoot, assetName);
+        if (!found.empty())
+        {
+            file = found;
+        }
+    }
 
 
-    Timer timer;
-    
-    timer.setTitle("Load GLTF file");
-    timer.startTimer();
-    cModel myModel(file.c_str());
-    timer.stopTimer();
-
-    timer.setTitle("Upload data to gpu");
-    timer.startTimer();
-    myModel.uploadToGpu(shader);
-    timer.stopTimer();
+    ProfileTimer loadTimer("Load GLTF file");
+    std::unique_ptr<cModel> model = std::make_unique<cModel>(file.c_str(), useTextureStreaming || useVirtualTexturing, cookTextures, nullptr, useCookedTextures);
+    loadTimer.stop();
 
-    myModel.batchTest();
+    if (useAsyncTextureUpload && !textureUploader.init())
+    {
+        useAsyncTextureUpload = false;
+    }
+    clusteredLighting.init();
 
+    // Everything built from the model, done again when a hot reload swaps in a new one
+    glm::vec3 sceneMin, sceneMax;
+    auto registerModel = [&](cModel& myModel)
+        {
+            if (useVirtualTexturing)
+            {
+                virtualTextures.registerModel(myModel);
+            }
+            myModel.updateShaderFeatures();
+            textureStreamer.registerModel(myModel);
+            myModel.getSceneBounds(sceneMin, sceneMax);
+            clusteredLighting.setLights(myModel.m_Lights);
+        };
+    auto finishLoadReport = [](cModel& myModel)
+        {
+            myModel.m_LoadReport.finish();
+            myModel.m_LoadReport.print();
+            if (!loadReportPath.empty())
+            {
+                myModel.m_LoadReport.writeJson(loadReportPath);
+            }
+            loadReport = &myModel.m_LoadReport;
+        };
+    ProfileTimer uploadTimer("Upload data to gpu");
+    model->uploadToGpu(shader, useAsyncTextureUpload ? &textureUploader : nullptr);
+    uploadTimer.stop();
+    model->batchTest();
+    registerModel(*model);
+
+    if (!model->m_CookJobs.empty())
+    {
+        ProfileTimer cookTimer("Cook textures");
+        std::vector<CookResult> cookResults = textureCooker.cookAll(model->m_CookJobs);
+        cookTimer.stop();
+        cookReport = TextureCooker::summarize(cookResults);
+        if (benchmarkCookedUploads)
+        {
+            TextureCooker::measureUploads(cookResults, cookReport);
+        }
+        TextureCooker::printReport(cookReport);
+        model->m_LoadReport.markBoundary("Textures cooked");
+    }
+    finishLoadReport(*model);
 
-    SDL_SetRelativeMouseMode(SDL_TRUE);
+    FrameBenchmark frameBenchmark;
+    bool benchmarkReady = false;
+    if (benchmark)
+    {
+        // A path that fails to load stays empty and init() refuses it
+        CameraPath cameraPath;
+        if (benchmarkOptions.cameraPathFile.empty())
+        {
+            cameraPath = CameraPath::createOrbit(sceneMin, sceneMax, benchmarkOptions.orbitSeconds);
+        }
+        else
+        {
+            cameraPath.load(benchmarkOptions.cameraPathFile);
+        }
+        // Nothing to measure, skip the loop but still tear everything down
+        benchmarkReady = frameBenchmark.init(benchmarkOptions, cameraPath);
+        stopRendering = !benchmarkReady;
+    }
+    else
+    {
+        SDL_SetRelativeMouseMode(SDL_TRUE);
+    }
     glEnable(GL_DEPTH_TEST);
 
-    shader.use();
     // directional Light
     static glm::vec3 lightDir(-2.0f, -1.0f, 3.0f);
     static glm::vec3 lightColor(0.5f, 0.5f, 0.5f);
-    shader.setVec3("dirLight.direction", lightDir);
-    shader.setVec3("dirLight.ambient", lightColor);
-    shader.setVec3("dirLight.diffuse", lightColor);
-    shader.setVec3("dirLight.specular", lightColor);
-    shader.setBool("dirLight.enabled", true);
+    auto setDirectionalLight = [](Shader& lightShader)
+        {
+            lightShader.use();
+            lightShader.setVec3("dirLight.direction", lightDir);
+            lightShader.setVec3("dirLight.ambient", lightColor);
+            lightShader.setVec3("dirLight.diffuse", lightColor);
+            lightShader.setVec3("dirLight.specular", lightColor);
+            lightShader.setBool("dirLight.enabled", true);
+        };
+    for (Shader* forwardShader : forwardShaders)
+    {
+        setDirectionalLight(*forwardShader);
+    }
+    setDirectionalLight(deferredShader);
+
+    fragmentQuery.init();
+    forwardTimeQuery.init();
+    cascadedShadows.init();
+
+    if (useHotReload)
+    {
+        for (Shader* watchedShader : { &shader, &postShader, &simpleShader, &gbufferShader, &deferredShader, &depthShader, &opaqueShader, &maskShader, &blendShader, &feedbackShader })
+        {
+            hotReloader.addShader(*watchedShader);
+        }
+        hotReloader.m_OnShaderReloaded = [&](Shader& reloadedShader)
+            {
+                if (&reloadedShader == &deferredShader || std::find(std::begin(forwardShaders), std::end(forwardShaders), &reloadedShader) != std::end(forwardShaders))
+                {
+                    setDirectionalLight(reloadedShader);
+                }
+            };
+        forwardPermutations.m_OnVariantCreated = [](Shader& variant)
+            {
+                hotReloader.addShader(variant);
+            };
+        hotReloader.setModel(*model, file);
+        hotReloader.watch("shaders");
+        hotReloader.watch(model->directory);
+    }
 
     while (!stopRendering)
     {
+        auto frameStart = std::chrono::high_resolution_clock::now();
+        Profiler::get().beginFrame();
+        PROFILE_SCOPE("Frame");
+        if (benchmark && !frameBenchmark.beginFrame(camera))
+        {
+            break;
+        }
+        if (useHotReload)
+        {
+            hotReloader.update();
+            if (std::unique_ptr<cModel> reloadedModel = hotReloader.takeReloadedModel())
+            {
+                // Only what changed is uploaded, the rest moves over from the live model
+                virtualTextures.destroy();
+                gpuCuller.destroy();
+                std::unique_ptr<cModel> previousModel = std::move(model);
+                model = std::move(reloadedModel);
+                modelReloadReport = model->adoptFrom(*previousModel, useAsyncTextureUpload ? &textureUploader : nullptr);
+                previousModel.reset();
+                registerModel(*model);
+                finishLoadReport(*model);
+                textureStreamer.releaseUnused();
+                cascadedShadows.invalidate();
+                hotReloader.setModel(*model, file);
+            }
+        }
+        cModel& myModel = *model;
         float currentFrame = SDL_GetTicks64() / 1000.0f;
         deltaTime = currentFrame - lastFrame;
         lastFrame = currentFrame;
         //Input
-        processInput(deltaTime);
+        if (benchmark)
+        {
+            deltaTime = frameBenchmark.getDeltaTime();
+        }
+        else
+        {
+            processInput(deltaTime);
+        }
+        if (recordingCameraPath)
+        {
+            recordedCameraPath.addKey(currentFrame - cameraPathStart, camera);
+        }
 
+        PROFILE_GPU_SCOPE("Frame");
         glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
         // view/projection transformations
-        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), (float)SCR_WIDTH / (float)SCR_HEIGHT, 1.0f, 1000.0f);
+        float aspect = benchmark ? (float)frameBenchmark.getWidth() / (float)frameBenchmark.getHeight() : (float)SCR_WIDTH / (float)SCR_HEIGHT;
+        glm::mat4 projection = glm::perspective(glm::radians(camera.Zoom), aspect, 1.0f, 1000.0f);
         glm::mat4 view = camera.GetViewMatrix();
-        shader.setMat4("projection", projection);
-        shader.setMat4("view", view);
- 
-        myModel.Draw(shader, useBatchRendering);
+
+        int drawableWidth, drawableHeight;
+        if (benchmark)
+        {
+            drawableWidth = frameBenchmark.getWidth();
+            drawableHeight = frameBenchmark.getHeight();
+        }
+        else
+        {
+            SDL_GL_GetDrawableSize(window, &drawableWidth, &drawableHeight);
+        }
+
+        bool clusteredLights = useClusteredLighting || lightBenchmark.m_Running;
+        if (clusteredLights)
+        {
+            clusteredLighting.update(view, glm::radians(camera.Zoom), aspect, 1.0f, 1000.0f);
+        }
+        if (useTextureStreaming)
+        {
+            textureStreamer.update(myModel, view, projection, drawableHeight);
+        }
+        if (useAsyncTextureUpload)
+        {
+            textureUploader.update();
+        }
+        if (useVirtualTexturing)
+        {
+            virtualTextures.update();
+            PROFILE_GPU_SCOPE("VT feedback");
+            virtualTextures.renderFeedback(myModel, feedbackShader, view, projection, drawableWidth, drawableHeight);
+        }
+        if (useShadows)
+        {
+            cascadedShadows.update(view, glm::radians(camera.Zoom), aspect, 1.0f, lightDir, sceneMin, sceneMax);
+            PROFILE_GPU_SCOPE("Shadows");
+            cascadedShadows.render(myModel, depthShader);
+        }
+        auto setupForwardShader = [&](Shader& forwardShader)
+            {
+                forwardShader.setMat4("projection", projection);
+                forwardShader.setMat4("view", view);
+                forwardShader.setBool("uUseClusteredLights", clusteredLights);
+                forwardShader.setBool("useNormalTexture", useNormalTexture);
+                if (clusteredLights)
+                {
+                    clusteredLighting.bind(forwardShader, drawableWidth, drawableHeight);
+                }
+                cascadedShadows.bind(forwardShader, useShadows);
+                virtualTextures.bind(forwardShader, useVirtualTexturing);
+            };
+        for (Shader* forwardShader : forwardShaders)
+        {
+            forwardShader->use();
+            setupForwardShader(*forwardShader);
+        }
+        forwardPermutations.beginFrame([&](Shader& variant)
+            {
+                setDirectionalLight(variant);
+                setupForwardShader(variant);
+            });
+        uint32_t frameFeatures = uint32_t(SHADER_DIRECTIONAL_LIGHT) | (clusteredLights ? uint32_t(SHADER_CLUSTERED_LIGHTS) : 0u) |
+            (useShadows ? uint32_t(SHADER_SHADOWS) : 0u) | (useNormalTexture ? uint32_t(SHADER_NORMAL_MAP) : 0u);
+        shader.use();
+
+        if (useDeferredShading)
+        {
+            PROFILE_GPU_SCOPE("Deferred");
+            if (!deferredRenderer.isInitialized())
+            {
+                deferredRenderer.init(drawableWidth, drawableHeight);
+            }
+            deferredRenderer.resize(drawableWidth, drawableHeight);
+
+            deferredRenderer.beginGeometryPass();
+            gbufferShader.use();
+            gbufferShader.setMat4("projection", projection);
+            gbufferShader.setMat4("view", view);
+            virtualTextures.bind(gbufferShader, useVirtualTexturing);
+            myModel.Draw(gbufferShader, useBatchRendering);
+            deferredRenderer.endGeometryPass();
+
+            glViewport(0, 0, drawableWidth, drawableHeight);
+            deferredShader.use();
+            deferredShader.setBool("uUseClusteredLights", clusteredLights);
+            if (clusteredLights)
+            {
+                clusteredLighting.bind(deferredShader, drawableWidth, drawableHeight);
+            }
+            cascadedShadows.bind(deferredShader, useShadows);
+            deferredRenderer.lightingPass(deferredShader, view, projection);
+        }
+        else if (useGpuCulling)
+        {
+            PROFILE_GPU_SCOPE("GPU culling");
+            if (!gpuCuller.isInitialized())
+            {
+                std::vector<CullObject> cullObjects;
+                cullObjects.reserve(myModel.m_BatchDraws.size());
+                for (const auto& draw : myModel.m_BatchDraws)
+                {
+                    cullObjects.push_back({ glm::vec4(draw.boundsMin, 1.0f), glm::vec4(draw.boundsMax, 1.0f), draw.indexCount, draw.firstIndex, 0, 0 });
+                }
+                gpuCuller.init(cullObjects, drawableWidth, drawableHeight);
+            }
+            gpuCuller.resize(drawableWidth, drawableHeight);
+            gpuCuller.m_ReadbackStats = showUI;
+
+            // Batch geometry has no per-draw material
+            shader.setBool("material.hasTexture", false);
+            shader.setVec3("material.baseColor", glm::vec3(1.0f));
+            gpuCuller.render(shader, postShader, myModel.m_VAO, view, projection);
+        }
+        else if (useAlphaModePipeline && !useBatchRendering)
+        {
+            PROFILE_GPU_SCOPE("Forward split");
+            fragmentQuery.begin();
+            forwardTimeQuery.begin();
+            if (useDepthPrepass)
+            {
+                // Lay down opaque depth with positions only, then shade each visible pixel once
+                depthShader.use();
+                depthShader.setMat4("projection", projection);
+                depthShader.setMat4("view", view);
+                glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+                myModel.drawDepthPrepass(depthShader);
+                glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+                glDepthFunc(GL_LEQUAL);
+                glDepthMask(GL_FALSE);
+            }
+            if (useShaderPermutations)
+            {
+                myModel.drawAlphaMode(forwardPermutations, frameFeatures, ALPHA_MODE_OPAQUE);
+            }
+            else
+            {
+                opaqueShader.use();
+                myModel.drawAlphaMode(opaqueShader, ALPHA_MODE_OPAQUE);
+            }
+            glDepthMask(GL_TRUE);
+
+            if (useShaderPermutations)
+            {
+                myModel.drawAlphaMode(forwardPermutations, frameFeatures, ALPHA_MODE_MASK);
+            }
+            else
+            {
+                maskShader.use();
+                myModel.drawAlphaMode(maskShader, ALPHA_MODE_MASK);
+            }
+
+            glEnable(GL_BLEND);
+            glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
+            glDepthMask(GL_FALSE);
+            if (useShaderPermutations)
+            {
+                myModel.drawBlendedSorted(forwardPermutations, frameFeatures, camera.Position);
+            }
+            else
+            {
+                blendShader.use();
+                myModel.drawBlendedSorted(blendShader, camera.Position);
+            }
+            glDepthMask(GL_TRUE);
+            glDisable(GL_BLEND);
+            glDepthFunc(GL_LESS);
+            forwardTimeQuery.end();
+            fragmentQuery.end();
+            splitPipelineInvocations = fragmentQuery.getResult();
+            // The result is from two frames ago, right after a toggle it still belongs to the other path
+            (useShaderPermutations ? permutationMs : splitPipelineMs) = forwardTimeQuery.getResultMs();
+        }
+        else
+        {
+            PROFILE_GPU_SCOPE("Forward");
+            fragmentQuery.begin();
+            forwardTimeQuery.begin();
+            myModel.Draw(shader, useBatchRendering);
+            forwardTimeQuery.end();
+            fragmentQuery.end();
+            uberShaderInvocations = fragmentQuery.getResult();
+            uberShaderMs = forwardTimeQuery.getResultMs();
+        }
 
 
         if (showUI)
         {
+            PROFILE_SCOPE("UI");
+            PROFILE_GPU_SCOPE("UI");
             // Start the Dear ImGui frame
             ImGui_ImplOpenGL3_NewFrame();
             ImGui_ImplSDL2_NewFrame();
@@ -370,25 +1306,84 @@ int run()
             ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
 
         }
-        else
+        else if (!benchmark)
             SDL_SetRelativeMouseMode(SDL_TRUE);
 
 
         
-        glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
-        // Swap buffers
-        SDL_GL_SwapWindow(window);
+        if (benchmark)
+        {
+            frameBenchmark.endFrame();
+        }
+        else
+        {
+            glViewport(0, 0, (int)io.DisplaySize.x, (int)io.DisplaySize.y);
+            // Swap buffers
+            PROFILE_SCOPE("Swap");
+            SDL_GL_SwapWindow(window);
+        }
+
+        std::chrono::duration<float, std::milli> frameTime = std::chrono::high_resolution_clock::now() - frameStart;
+        if (lightBenchmark.advance(frameTime.count(), clusteredLighting.getBinningMs(), clusteredLighting.getLightIndexCount()))
+        {
+            if (lightBenchmark.m_Running)
+                clusteredLighting.setLights(ClusteredLighting::generateSyntheticLights(lightBenchmark.getCurrentLightCount(), sceneMin, sceneMax));
+            else
+                clusteredLighting.setLights(myModel.m_Lights);
+        }
     }
 
+    int exitCode = 0;
+    if (benchmark)
+    {
+        bool passed = benchmarkReady && frameBenchmark.finish(headlessContext.getBackend(), {
+            { "batchRendering", useBatchRendering },
+            { "gpuCulling", useGpuCulling },
+            { "clusteredLighting", useClusteredLighting },
+            { "deferredShading", useDeferredShading },
+            { "alphaModePipeline", useAlphaModePipeline },
+            { "depthPrepass", useDepthPrepass },
+            { "shaderPermutations", useShaderPermutations },
+            { "shadows", useShadows },
+            { "textureStreaming", useTextureStreaming },
+            { "asyncTextureUpload", useAsyncTextureUpload },
+            { "virtualTexturing", useVirtualTexturing } });
+        exitCode = passed ? 0 : 1;
+        frameBenchmark.destroy();
+    }
+
+    gpuCuller.destroy();
+    clusteredLighting.destroy();
+    deferredRenderer.destroy();
+    fragmentQuery.destroy();
+    forwardTimeQuery.destroy();
+    cascadedShadows.destroy();
+    hotReloader.destroy();
+    forwardPermutations.destroy();
+    Profiler::get().destroy();
+    textureStreamer.destroy();
+    virtualTextures.destroy();
+    textureUploader.destroy();
+    model->destroyGpu();
 
     // Cleanup imgui
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplSDL2_Shutdown();
+    if (!benchmark)
+    {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplSDL2_Shutdown();
+    }
     ImGui::DestroyContext();
 
     //Cleanup sdl
-    SDL_GL_DeleteContext(maincontext);
-    SDL_DestroyWindow(window);
-    SDL_Quit();
-    return 0;
+    if (benchmark)
+    {
+        headlessContext.destroy();
+    }
+    else
+    {
+        SDL_GL_DeleteContext(maincontext);
+        SDL_DestroyWindow(window);
+        SDL_Quit();
+    }
+    return exitCode;
 }
\ No newline at end of file
@@ -0,0 +1,193 @@
+#include "pch.h"
+#include "ddsLoader.h"
+#include "mappedFile.h"
+#include "texture.h"
+#include <gli/format.hpp>
+#include <gli/dx.hpp>
+#include <gli/gl.hpp>
+#include <cstring>
+#include <algorithm>
+
+namespace
+{
+    const uint32_t DDSD_MIPMAPCOUNT = 0x20000;
+    const uint32_t DDSD_DEPTH = 0x800000;
+    const uint32_t DDSCAPS2_CUBEMAP = 0x200;
+    const uint32_t DDSCAPS2_CUBEMAP_ALLFACES = 0xFC00;
+    const uint32_t DDSCAPS2_VOLUME = 0x200000;
+    const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE1D = 2;
+    const uint32_t D3D10_RESOURCE_DIMENSION_TEXTURE3D = 4;
+    const uint32_t D3D10_RESOURCE_MISC_TEXTURECUBE = 0x4;
+
+    // Bit-mask layouts, in the order gli's own DDS loader tries them
+    const gli::format MASK_FORMATS[] =
+    {
+        gli::FORMAT_RG4_UNORM_PACK8, gli::FORMAT_L8_UNORM_PACK8, gli::FORMAT_A8_UNORM_PACK8, gli::FORMAT_R8_UNORM_PACK8,
+        gli::FORMAT_RG3B2_UNORM_PACK8, gli::FORMAT_RGBA4_UNORM_PACK16, gli::FORMAT_BGRA4_UNORM_PACK16,
+        gli::FORMAT_R5G6B5_UNORM_PACK16, gli::FORMAT_B5G6R5_UNORM_PACK16, gli::FORMAT_RGB5A1_UNORM_PACK16,
+        gli::FORMAT_BGR5A1_UNORM_PACK16, gli::FORMAT_LA8_UNORM_PACK8, gli::FORMAT_RG8_UNORM_PACK8,
+        gli::FORMAT_L16_UNORM_PACK16, gli::FORMAT_A16_UNORM_PACK16, gli::FORMAT_R16_UNORM_PACK16,
+        gli::FORMAT_RGB8_UNORM_PACK8, gli::FORMAT_BGR8_UNORM_PACK8, gli::FORMAT_BGR8_UNORM_PACK32,
+        gli::FORMAT_BGRA8_UNORM_PACK8, gli::FORMAT_RGBA8_UNORM_PACK8, gli::FORMAT_RGB10A2_UNORM_PACK32,
+        gli::FORMAT_LA16_UNORM_PACK16, gli::FORMAT_RG16_UNORM_PACK16, gli::FORMAT_R32_SFLOAT_PACK32
+    };
+
+    gli::format findFormat(const gli::dx& DX, const DDSHeader& header, const DDSHeaderDX10& headerDX10)
+    {
+        const uint32_t DDPF_FOURCC = 0x4;
+        if (header.pixelFormat.flags & DDPF_FOURCC)
+        {
+            gli::dx::d3dfmt fourCC = static_cast<gli::dx::d3dfmt>(header.pixelFormat.fourCC);
+            if (fourCC == gli::dx::D3DFMT_DX10 || fourCC == gli::dx::D3DFMT_GLI1)
+            {
+                return DX.find(fourCC, gli::dx::dxgiFormat(static_cast<gli::dx::dxgi_format_dds>(headerDX10.dxgiFormat)));
+            }
+            // Some formats have more than one FourCC, gli only knows the canonical one
+            switch (fourCC)
+            {
+            case gli::dx::D3DFMT_BC4U: fourCC = gli::dx::D3DFMT_ATI1; break;
+            case gli::dx::D3DFMT_BC4S: fourCC = gli::dx::D3DFMT_AT1N; break;
+            case gli::dx::D3DFMT_BC5U: fourCC = gli::dx::D3DFMT_ATI2; break;
+            case gli::dx::D3DFMT_BC5S: fourCC = gli::dx::D3DFMT_AT2N; break;
+            default: break;
+            }
+            return DX.find(fourCC);
+        }
+
+        glm::u32vec4 mask(header.pixelFormat.RBitMask, header.pixelFormat.GBitMask, header.pixelFormat.BBitMask, header.pixelFormat.ABitMask);
+        for (gli::format format : MASK_FORMATS)
+        {
+            if (gli::block_size(format) * 8 == header.pixelFormat.RGBBitCount && DX.translate(format).Mask == mask)
+            {
+                return format;
+            }
+        }
+        return gli::FORMAT_UNDEFINED;
+    }
+
+    size_t getImageSize(gli::format format, GLsizei width, GLsizei height, GLsizei depth)
+    {
+        gli::extent3d blockExtent = gli::block_extent(format);
+        size_t blocksX = (width + blockExtent.x - 1) / blockExtent.x;
+        size_t blocksY = (height + blockExtent.y - 1) / blockExtent.y;
+        return blocksX * blocksY * depth * gli::block_size(format);
+    }
+}
+
+GLuint DDSLoader::load(const std::string& path, TextureUploadInfo* info)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        throw std::runtime_error("Failed to open DDS file: " + path);
+    }
+    const unsigned char* data = file.data();
+    size_t size = file.size();
+
+    size_t offset = 4 + sizeof(DDSHeader);
+    if (size < offset || std::memcmp(data, "DDS ", 4) != 0)
+    {
+        throw std::runtime_error("Not a valid DDS file: " + path);
+    }
+    DDSHeader header;
+    std::memcpy(&header, data + 4, sizeof(DDSHeader));
+
+    DDSHeaderDX10 headerDX10 = {};
+    if (header.pixelFormat.fourCC == gli::dx::D3DFMT_DX10 || header.pixelFormat.fourCC == gli::dx::D3DFMT_GLI1)
+    {
+        if (size < offset + sizeof(DDSHeaderDX10))
+        {
+            throw std::runtime_error("Truncated DX10 header: " + path);
+        }
+        std::memcpy(&headerDX10, data + offset, sizeof(DDSHeaderDX10));
+        offset += sizeof(DDSHeaderDX10);
+    }
+
+    gli::dx DX;
+    gli::format format = findFormat(DX, header, headerDX10);
+    if (format == gli::FORMAT_UNDEFINED)
+    {
+        throw std::runtime_error("Unsupported DDS format: " + path);
+    }
+    gli::gl GL(gli::gl::PROFILE_GL33);
+    gli::gl::format glFormat = GL.translate(format, gli::swizzles(gli::SWIZZLE_RED, gli::SWIZZLE_GREEN, gli::SWIZZLE_BLUE, gli::SWIZZLE_ALPHA));
+
+    bool isCube = (header.caps.caps2 & DDSCAPS2_CUBEMAP) || (headerDX10.miscFlag & D3D10_RESOURCE_MISC_TEXTURECUBE);
+    if ((header.caps.caps2 & DDSCAPS2_CUBEMAP) && (header.caps.caps2 & DDSCAPS2_CUBEMAP_ALLFACES) != DDSCAPS2_CUBEMAP_ALLFACES)
+    {
+        throw std::runtime_error("Partial cubemaps are not supported: " + path);
+    }
+    if (headerDX10.resourceDimension == D3D10_RESOURCE_DIMENSION_TEXTURE1D)
+    {
+        throw std::runtime_error("1D textures are not supported: " + path);
+    }
+    bool isVolume = headerDX10.resourceDimension == D3D10_RESOURCE_DIMENSION_TEXTURE3D || (header.flags & DDSD_DEPTH) || (header.caps.caps2 & DDSCAPS2_VOLUME);
+    GLsizei arraySize = std::max(1u, headerDX10.arraySize);
+    GLsizei faces = isCube ? 6 : 1;
+
+    TextureUploadInfo uploadInfo;
+    uploadInfo.internalFormat = glFormat.Internal;
+    uploadInfo.compressed = gli::is_compressed(format);
+    uploadInfo.width = header.width;
+    uploadInfo.height = std::max(1u, header.height);
+    uploadInfo.depth = 1;
+    uploadInfo.levels = (header.flags & DDSD_MIPMAPCOUNT) ? std::max(1u, header.mipMapCount) : 1;
+    if (isCube)
+    {
+        uploadInfo.target = arraySize > 1 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+        uploadInfo.depth = arraySize > 1 ? arraySize * 6 : 1;
+    }
+    else if (arraySize > 1)
+    {
+        uploadInfo.target = GL_TEXTURE_2D_ARRAY;
+        uploadInfo.depth = arraySize;
+    }
+    else if (isVolume)
+    {
+        uploadInfo.target = GL_TEXTURE_3D;
+        uploadInfo.depth = std::max(1u, header.depth);
+    }
+    else
+    {
+        uploadInfo.target = GL_TEXTURE_2D;
+    }
+
+    GLuint texture = TextureUpload::createStorage(uploadInfo);
+    if (glFormat.Swizzles != gli::gl::swizzles(GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA))
+    {
+        GLint swizzle[4] = { glFormat.Swizzles[0], glFormat.Swizzles[1], glFormat.Swizzles[2], glFormat.Swizzles[3] };
+        glTexParameteriv(uploadInfo.target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // DDS rows are tightly packed
+
+    // DDS stores every layer and face with its whole mip chain before the next one
+    for (GLsizei layer = 0; layer < arraySize; ++layer)
+    {
+        for (GLsizei face = 0; face < faces; ++face)
+        {
+            for (GLint level = 0; level < uploadInfo.levels; ++level)
+            {
+                GLsizei levelDepth = uploadInfo.target == GL_TEXTURE_3D ? std::max(1, uploadInfo.depth >> level) : 1;
+                size_t imageSize = getImageSize(format, std::max(1, uploadInfo.width >> level), std::max(1, uploadInfo.height >> level), levelDepth);
+                if (offset + imageSize > size)
+                {
+                    glDeleteTextures(1, &texture);
+                    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+                    throw std::runtime_error("Truncated DDS image data: " + path);
+                }
+
+                GLint layerIndex = uploadInfo.target == GL_TEXTURE_CUBE_MAP ? face : layer * faces + face;
+                TextureUpload::uploadImage(uploadInfo, glFormat.External, glFormat.Type, level, layerIndex, 1, data + offset, imageSize);
+                uploadInfo.bytes += imageSize;
+                offset += imageSize;
+            }
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (info)
+    {
+        *info = uploadInfo;
+    }
+    return texture;
+}
@@ -0,0 +1,18 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include "textureUpload.h"
+
+// Loads DDS files (2D, 3D, arrays, cubemaps and cube arrays, full mip chains) into
+// immutable GL textures.
+//
+// The format table is gli's: legacy FourCC codes (DXT1-5, ATI1/ATI2, BC4/BC5, D3DFMT
+// float formats), DX10 DXGI formats (BC1-BC7, sRGB variants, uncompressed) and the
+// RGB/luminance/alpha bit-mask layouts. Like KTXLoader, every image is uploaded straight
+// from the memory-mapped file.
+class DDSLoader
+{
+public:
+    // Throws std::runtime_error on malformed or unsupported files
+    static GLuint load(const std::string& path, TextureUploadInfo* info = nullptr);
+};
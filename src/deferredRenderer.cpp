@@ -0,0 +1,161 @@
+#include "pch.h"
+#include "deferredRenderer.h"
+#include "profiler.h"
+
+const DeferredRenderer::TargetFormat DeferredRenderer::COLOR_FORMATS[GBUFFER_COLOR_COUNT] = {
+    { "gAlbedo", GL_RGBA8, 4 },
+    { "gNormal", GL_RG16, 4 },
+};
+const DeferredRenderer::TargetFormat DeferredRenderer::DEPTH_FORMAT = { "gDepth", GL_DEPTH_COMPONENT32F, 4 };
+
+void DeferredRenderer::init(int width, int height)
+{
+    m_Quad.create();
+    createTargets(width, height);
+    printMemoryReport();
+}
+
+void DeferredRenderer::resize(int width, int height)
+{
+    if (width == m_Width && height == m_Height)
+    {
+        return;
+    }
+    destroyTargets();
+    createTargets(width, height);
+}
+
+void DeferredRenderer::destroy()
+{
+    destroyTargets();
+    m_Quad.destroy();
+}
+
+void DeferredRenderer::createTargets(int width, int height)
+{
+    m_Width = width;
+    m_Height = height;
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &m_Fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+
+    glGenTextures(GBUFFER_COLOR_COUNT, m_ColorTextures);
+    GLenum drawBuffers[GBUFFER_COLOR_COUNT];
+    for (int i = 0; i < GBUFFER_COLOR_COUNT; ++i)
+    {
+        glBindTexture(GL_TEXTURE_2D, m_ColorTextures[i]);
+        glTexStorage2D(GL_TEXTURE_2D, 1, COLOR_FORMATS[i].internalFormat, width, height);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0 + i, GL_TEXTURE_2D, m_ColorTextures[i], 0);
+        drawBuffers[i] = GL_COLOR_ATTACHMENT0 + i;
+    }
+    glDrawBuffers(GBUFFER_COLOR_COUNT, drawBuffers);
+
+    glGenTextures(1, &m_DepthTexture);
+    glBindTexture(GL_TEXTURE_2D, m_DepthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, DEPTH_FORMAT.internalFormat, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_DepthTexture, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: G-buffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void DeferredRenderer::destroyTargets()
+{
+    glDeleteFramebuffers(1, &m_Fbo);
+    glDeleteTextures(GBUFFER_COLOR_COUNT, m_ColorTextures);
+    glDeleteTextures(1, &m_DepthTexture);
+    m_Fbo = 0;
+    m_DepthTexture = 0;
+    for (auto& texture : m_ColorTextures)
+    {
+        texture = 0;
+    }
+}
+
+void DeferredRenderer::beginGeometryPass()
+{
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &m_TargetFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+    glViewport(0, 0, m_Width, m_Height);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+void DeferredRenderer::endGeometryPass()
+{
+    glBindFramebuffer(GL_FRAMEBUFFER, m_TargetFramebuffer);
+}
+
+void DeferredRenderer::lightingPass(Shader& lightingShader, const glm::mat4& view, const glm::mat4& projection)
+{
+    PROFILE_SCOPE("Deferred lighting");
+    glDisable(GL_DEPTH_TEST);
+    lightingShader.use();
+    lightingShader.setMat4("inverseViewProjection", glm::inverse(projection * view));
+    lightingShader.setMat4("view", view);
+
+    for (int i = 0; i < GBUFFER_COLOR_COUNT; ++i)
+    {
+        glActiveTexture(GL_TEXTURE0 + i);
+        glBindTexture(GL_TEXTURE_2D, m_ColorTextures[i]);
+        lightingShader.setInt(COLOR_FORMATS[i].name, i);
+    }
+    glActiveTexture(GL_TEXTURE0 + GBUFFER_COLOR_COUNT);
+    glBindTexture(GL_TEXTURE_2D, m_DepthTexture);
+    lightingShader.setInt(DEPTH_FORMAT.name, GBUFFER_COLOR_COUNT);
+
+    m_Quad.draw();
+
+    glActiveTexture(GL_TEXTURE0);
+    glEnable(GL_DEPTH_TEST);
+}
+
+size_t DeferredRenderer::getBytesPerPixel()
+{
+    size_t bytes = DEPTH_FORMAT.bytesPerPixel;
+    for (const auto& format : COLOR_FORMATS)
+    {
+        bytes += format.bytesPerPixel;
+    }
+    return bytes;
+}
+
+size_t DeferredRenderer::getMemoryBytes(int width, int height)
+{
+    return static_cast<size_t>(width) * height * getBytesPerPixel();
+}
+
+size_t DeferredRenderer::getFrameTrafficBytes(int width, int height)
+{
+    return 2 * getMemoryBytes(width, height);
+}
+
+void DeferredRenderer::printMemoryReport()
+{
+    const int resolutions[][2] = { { 1280, 720 }, { 1920, 1080 }, { 2560, 1440 }, { 3840, 2160 } };
+
+    std::cout << "G-buffer: " << getBytesPerPixel() << " bytes/pixel (";
+    for (const auto& format : COLOR_FORMATS)
+    {
+        std::cout << format.name << " " << format.bytesPerPixel << ", ";
+    }
+    std::cout << DEPTH_FORMAT.name << " " << DEPTH_FORMAT.bytesPerPixel << ")\n";
+
+    for (const auto& resolution : resolutions)
+    {
+        double memoryMB = getMemoryBytes(resolution[0], resolution[1]) / (1024.0 * 1024.0);
+        double trafficMB = getFrameTrafficBytes(resolution[0], resolution[1]) / (1024.0 * 1024.0);
+        std::cout << resolution[0] << "x" << resolution[1] << ": " << memoryMB << " MB, "
+            << trafficMB << " MB/frame, " << trafficMB * 60.0 / 1024.0 << " GB/s at 60 fps\n";
+    }
+}
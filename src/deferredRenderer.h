@@ -0,0 +1,63 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <cstddef>
+#include "shader.h"
+#include "screenQuad.h"
+
+// Deferred shading path with a compact G-buffer.
+//
+// The geometry pass writes albedo (RGBA8) and an octahedral normal (RG16). Position is
+// reconstructed from the depth buffer, so the whole G-buffer is 12 bytes per pixel
+// including depth. The lighting is Lambert, so nothing would read occlusion, roughness
+// or metallic, and they are not stored. The lighting pass runs once per
+// pixel with postShader.vert on a fullscreen quad and loops over the clustered light
+// lists of that pixel, so only the lights touching its tile/depth slice are evaluated.
+class DeferredRenderer
+{
+public:
+    enum Attachment
+    {
+        GBUFFER_ALBEDO = 0,
+        GBUFFER_NORMAL,
+        GBUFFER_COLOR_COUNT
+    };
+
+    struct TargetFormat
+    {
+        const char* name;
+        GLenum internalFormat;
+        size_t bytesPerPixel;
+    };
+
+    static const TargetFormat COLOR_FORMATS[GBUFFER_COLOR_COUNT];
+    static const TargetFormat DEPTH_FORMAT;
+
+    void init(int width, int height);
+    void resize(int width, int height);
+    void destroy();
+
+    void beginGeometryPass();
+    void endGeometryPass();
+    void lightingPass(Shader& lightingShader, const glm::mat4& view, const glm::mat4& projection);
+
+    bool isInitialized() const { return m_Fbo != 0; }
+
+    static size_t getBytesPerPixel();
+    static size_t getMemoryBytes(int width, int height);
+    // Bytes moved per frame: every target written once by the geometry pass and read once by the lighting pass
+    static size_t getFrameTrafficBytes(int width, int height);
+    static void printMemoryReport();
+
+private:
+    void createTargets(int width, int height);
+    void destroyTargets();
+
+    ScreenQuad m_Quad;
+    GLuint m_Fbo = 0;
+    GLint m_TargetFramebuffer = 0;  // bound when the geometry pass began, restored at its end
+    GLuint m_ColorTextures[GBUFFER_COLOR_COUNT] = {};
+    GLuint m_DepthTexture = 0;
+    int m_Width = 0;
+    int m_Height = 0;
+};
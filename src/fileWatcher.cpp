@@ -0,0 +1,285 @@
+#include "pch.h"
+#include "fileWatcher.h"
+#include <filesystem>
+#include <algorithm>
+#include <cctype>
+#ifndef _WIN32
+#include <sys/inotify.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+FileWatcher::~FileWatcher()
+{
+    stop();
+}
+
+std::string FileWatcher::normalizePath(const std::string& path)
+{
+    std::error_code error;
+    fs::path absolutePath = fs::absolute(fs::path(path), error);
+    std::string normalized = (error ? fs::path(path) : absolutePath).lexically_normal().generic_string();
+#ifdef _WIN32
+    std::transform(normalized.begin(), normalized.end(), normalized.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+#endif
+    return normalized;
+}
+
+std::vector<std::string> FileWatcher::poll()
+{
+    std::vector<std::string> changed;
+    auto now = std::chrono::steady_clock::now();
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (auto it = m_Changes.begin(); it != m_Changes.end();)
+    {
+        if (now - it->second >= m_SettleTime)
+        {
+            changed.push_back(it->first);
+            it = m_Changes.erase(it);
+        }
+        else
+        {
+            ++it;
+        }
+    }
+    return changed;
+}
+
+void FileWatcher::addChange(const std::string& path)
+{
+    // Directories report their own write time changing whenever an entry does
+    std::error_code error;
+    if (fs::is_directory(path, error))
+    {
+        return;
+    }
+    std::string normalized = normalizePath(path);
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Changes[normalized] = std::chrono::steady_clock::now();
+}
+
+#ifdef _WIN32
+
+bool FileWatcher::watch(const std::string& directory)
+{
+    HANDLE handle = CreateFileA(directory.c_str(), FILE_LIST_DIRECTORY, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+        nullptr, OPEN_EXISTING, FILE_FLAG_BACKUP_SEMANTICS | FILE_FLAG_OVERLAPPED, nullptr);
+    if (handle == INVALID_HANDLE_VALUE)
+    {
+        std::cerr << "Failed to watch directory: " << directory << std::endl;
+        return false;
+    }
+    if (m_StopEvent == nullptr)
+    {
+        m_StopEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    }
+    m_Stopping = false;
+    m_Threads.emplace_back([this, handle, directory] { watchLoop(handle, directory); });
+    return true;
+}
+
+void FileWatcher::stop()
+{
+    if (m_StopEvent == nullptr)
+    {
+        return;
+    }
+    m_Stopping = true;
+    SetEvent(m_StopEvent);
+    for (auto& thread : m_Threads)
+    {
+        thread.join();
+    }
+    m_Threads.clear();
+    CloseHandle(m_StopEvent);
+    m_StopEvent = nullptr;
+}
+
+void FileWatcher::watchLoop(HANDLE directory, std::string root)
+{
+    // FILE_NOTIFY_INFORMATION records are DWORD aligned
+    std::vector<DWORD> buffer(16 * 1024);
+    OVERLAPPED overlapped = {};
+    overlapped.hEvent = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+    HANDLE events[2] = { overlapped.hEvent, m_StopEvent };
+    const DWORD filter = FILE_NOTIFY_CHANGE_FILE_NAME | FILE_NOTIFY_CHANGE_LAST_WRITE | FILE_NOTIFY_CHANGE_SIZE;
+
+    while (!m_Stopping)
+    {
+        ResetEvent(overlapped.hEvent);
+        if (!ReadDirectoryChangesW(directory, buffer.data(), static_cast<DWORD>(buffer.size() * sizeof(DWORD)), TRUE, filter, nullptr, &overlapped, nullptr))
+        {
+            std::cerr << "ReadDirectoryChangesW failed for " << root << ": " << GetLastError() << std::endl;
+            break;
+        }
+
+        DWORD bytes = 0;
+        if (WaitForMultipleObjects(2, events, FALSE, INFINITE) != WAIT_OBJECT_0)
+        {
+            CancelIoEx(directory, &overlapped);
+            GetOverlappedResult(directory, &overlapped, &bytes, TRUE);
+            break;
+        }
+        if (!GetOverlappedResult(directory, &overlapped, &bytes, FALSE))
+        {
+            break;
+        }
+        if (bytes == 0)
+        {
+            std::cerr << "File watcher buffer overflowed, changes in " << root << " were missed" << std::endl;
+            continue;
+        }
+
+        const unsigned char* record = reinterpret_cast<const unsigned char*>(buffer.data());
+        while (true)
+        {
+            const FILE_NOTIFY_INFORMATION* info = reinterpret_cast<const FILE_NOTIFY_INFORMATION*>(record);
+            if (info->Action != FILE_ACTION_REMOVED && info->Action != FILE_ACTION_RENAMED_OLD_NAME)
+            {
+                std::wstring name(info->FileName, info->FileNameLength / sizeof(WCHAR));
+                addChange((fs::path(root) / fs::path(name)).string());
+            }
+            if (info->NextEntryOffset == 0)
+            {
+                break;
+            }
+            record += info->NextEntryOffset;
+        }
+    }
+    CloseHandle(overlapped.hEvent);
+    CloseHandle(directory);
+}
+
+#else
+
+bool FileWatcher::watch(const std::string& directory)
+{
+    std::error_code error;
+    if (!fs::is_directory(directory, error))
+    {
+        std::cerr << "Failed to watch directory: " << directory << std::endl;
+        return false;
+    }
+    if (m_Inotify < 0)
+    {
+        m_Inotify = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (m_Inotify < 0)
+        {
+            std::cerr << "inotify_init1 failed" << std::endl;
+            return false;
+        }
+    }
+    addWatches(directory);
+    if (!m_Thread.joinable())
+    {
+        m_Stopping = false;
+        m_Thread = std::thread([this] { watchLoop(); });
+    }
+    return true;
+}
+
+void FileWatcher::stop()
+{
+    m_Stopping = true;
+    if (m_Thread.joinable())
+    {
+        m_Thread.join();
+    }
+    if (m_Inotify >= 0)
+    {
+        close(m_Inotify);
+        m_Inotify = -1;
+    }
+    m_WatchedDirectories.clear();
+}
+
+void FileWatcher::addWatches(const std::string& directory)
+{
+    // Written files report IN_CLOSE_WRITE, files moved into place (atomic saves) IN_MOVED_TO
+    const uint32_t mask = IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE;
+    std::vector<std::string> directories = { directory };
+    std::error_code error;
+    for (fs::recursive_directory_iterator it(directory, error), end; !error && it != end; it.increment(error))
+    {
+        if (it->is_directory(error) && !it->is_symlink(error))
+        {
+            directories.push_back(it->path().string());
+        }
+    }
+
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    for (const auto& path : directories)
+    {
+        int watch = inotify_add_watch(m_Inotify, path.c_str(), mask);
+        if (watch >= 0)
+        {
+            m_WatchedDirectories[watch] = path;
+        }
+    }
+}
+
+void FileWatcher::watchLoop()
+{
+    alignas(inotify_event) char buffer[16 * 1024];
+    while (!m_Stopping)
+    {
+        pollfd descriptor = { m_Inotify, POLLIN, 0 };
+        if (::poll(&descriptor, 1, 100) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t length;
+        while ((length = read(m_Inotify, buffer, sizeof(buffer))) > 0)
+        {
+            for (char* record = buffer; record < buffer + length;)
+            {
+                const inotify_event* event = reinterpret_cast<const inotify_event*>(record);
+                record += sizeof(inotify_event) + event->len;
+
+                std::string directory;
+                {
+                    std::lock_guard<std::mutex> lock(m_Mutex);
+                    auto it = m_WatchedDirectories.find(event->wd);
+                    if (it == m_WatchedDirectories.end())
+                    {
+                        continue;
+                    }
+                    if (event->mask & IN_IGNORED)
+                    {
+                        m_WatchedDirectories.erase(it);
+                        continue;
+                    }
+                    directory = it->second;
+                }
+                if (event->len == 0)
+                {
+                    continue;
+                }
+
+                std::string path = (fs::path(directory) / event->name).string();
+                if (event->mask & IN_ISDIR)
+                {
+                    // New subtrees are watched from now on, files already inside count as changed
+                    if (event->mask & (IN_CREATE | IN_MOVED_TO))
+                    {
+                        addWatches(path);
+                        std::error_code error;
+                        for (fs::recursive_directory_iterator it(path, error), end; !error && it != end; it.increment(error))
+                        {
+                            addChange(it->path().string());
+                        }
+                    }
+                }
+                else if (event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO))
+                {
+                    addChange(path);
+                }
+            }
+        }
+    }
+}
+
+#endif
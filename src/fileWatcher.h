@@ -0,0 +1,60 @@
+#pragma once
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#ifdef _WIN32
+#include <Windows.h>
+#endif
+
+// Reports the files that changed below watched directory trees, without polling.
+//
+// A background thread blocks in ReadDirectoryChangesW on Windows or on an inotify
+// descriptor elsewhere. One request covers a whole tree on Windows; inotify needs a watch per
+// directory, including ones created later. Events go into a map keyed by path, so the
+// burst of writes an editor or exporter makes while saving collapses into one entry.
+// poll() hands out the entries that have been quiet for m_SettleTime. It only takes the
+// lock for that, so it never waits on the file system.
+class FileWatcher
+{
+public:
+    FileWatcher() = default;
+    ~FileWatcher();
+
+    FileWatcher(const FileWatcher&) = delete;
+    FileWatcher& operator=(const FileWatcher&) = delete;
+
+    // Watches the directory and everything below it
+    bool watch(const std::string& directory);
+    void stop();
+    // Normalized paths of the files that changed and settled since the last call
+    std::vector<std::string> poll();
+
+    // Absolute, lexically normal and '/' separated; lower case on Windows, where names are case insensitive
+    static std::string normalizePath(const std::string& path);
+
+    std::chrono::milliseconds m_SettleTime{ 150 };
+
+private:
+    void addChange(const std::string& path);
+#ifdef _WIN32
+    void watchLoop(HANDLE directory, std::string root);
+
+    HANDLE m_StopEvent = nullptr;
+    std::vector<std::thread> m_Threads;
+#else
+    void watchLoop();
+    void addWatches(const std::string& directory);
+
+    int m_Inotify = -1;
+    std::unordered_map<int, std::string> m_WatchedDirectories;   // watch descriptor -> directory
+    std::thread m_Thread;
+#endif
+
+    std::atomic<bool> m_Stopping{ false };
+    std::mutex m_Mutex;
+    std::unordered_map<std::string, std::chrono::steady_clock::time_point> m_Changes;   // path -> last event
+};
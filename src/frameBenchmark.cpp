@@ -0,0 +1,471 @@
+#include "pch.h"
+#include "frameBenchmark.h"
+#include "camera.h"
+#include "profiler.h"
+#include "renderStats.h"
+#include "pngWriter.h"
+#include "jsonWriter.h"
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    struct Distribution
+    {
+        double mean = 0.0;
+        double p50 = 0.0;
+        double p95 = 0.0;
+        double p99 = 0.0;
+        double max = 0.0;
+    };
+
+    Distribution getDistribution(std::vector<double> values)
+    {
+        Distribution distribution;
+        if (values.empty())
+        {
+            return distribution;
+        }
+        std::sort(values.begin(), values.end());
+        auto percentile = [&values](double fraction)
+            {
+                return values[std::min(values.size() - 1, static_cast<size_t>(fraction * values.size()))];
+            };
+        for (double value : values)
+        {
+            distribution.mean += value;
+        }
+        distribution.mean /= values.size();
+        distribution.p50 = percentile(0.50);
+        distribution.p95 = percentile(0.95);
+        distribution.p99 = percentile(0.99);
+        distribution.max = values.back();
+        return distribution;
+    }
+
+    void writeDistribution(JsonWriter& json, const char* name, const Distribution& distribution)
+    {
+        json.key(name);
+        json.beginObject();
+        json.field("mean", distribution.mean);
+        json.field("p50", distribution.p50);
+        json.field("p95", distribution.p95);
+        json.field("p99", distribution.p99);
+        json.field("max", distribution.max);
+        json.endObject();
+    }
+}
+
+bool BenchmarkOptions::parse(int argc, char* argv[], BenchmarkOptions& options)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: --benchmark <model.gltf> [--path file.campath | --orbit seconds] [--frames n] [--warmup n] "
+                     "[--size WxH] [--out file.json] [--golden dir] [--compare dir] [--golden-interval n] [--tolerance n] "
+                     "[--textures decoded|cooked]" << std::endl;
+        return false;
+    }
+    options.modelPath = argv[2];
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (i + 1 >= argc)
+        {
+            std::cerr << option << " needs a value" << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+        if (option == "--path")
+        {
+            options.cameraPathFile = value;
+        }
+        else if (option == "--orbit")
+        {
+            options.orbitSeconds = std::max(0.1f, static_cast<float>(std::atof(value)));
+        }
+        else if (option == "--frames")
+        {
+            options.frames = std::max(1, std::atoi(value));
+        }
+        else if (option == "--warmup")
+        {
+            options.warmupFrames = std::max(0, std::atoi(value));
+        }
+        else if (option == "--size")
+        {
+            if (std::sscanf(value, "%dx%d", &options.width, &options.height) != 2 || options.width <= 0 || options.height <= 0)
+            {
+                std::cerr << "--size expects WIDTHxHEIGHT, got " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--out")
+        {
+            options.outputPath = value;
+        }
+        else if (option == "--golden")
+        {
+            options.goldenDirectory = value;
+        }
+        else if (option == "--compare")
+        {
+            options.compareDirectory = value;
+        }
+        else if (option == "--golden-interval")
+        {
+            options.goldenInterval = std::max(1, std::atoi(value));
+        }
+        else if (option == "--tolerance")
+        {
+            options.tolerance = std::max(0, std::atoi(value));
+        }
+        else if (option == "--textures")
+        {
+            options.textureMode = value;
+            if (options.textureMode != "decoded" && options.textureMode != "cooked")
+            {
+                std::cerr << "--textures expects decoded or cooked, got " << value << std::endl;
+                return false;
+            }
+        }
+        else
+        {
+            std::cerr << "Unknown benchmark option " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FrameBenchmark::init(const BenchmarkOptions& options, const CameraPath& path)
+{
+    m_Options = options;
+    m_Path = path;
+    if (m_Path.empty())
+    {
+        std::cerr << "Benchmark camera path has no keys" << std::endl;
+        return false;
+    }
+    m_TimeStep = m_Options.frames > 1 && m_Path.getDuration() > 0.0f ? m_Path.getDuration() / (m_Options.frames - 1) : 1.0f / 60.0f;
+    m_Frame = -m_Options.warmupFrames;
+    m_Frames.assign(m_Options.frames, BenchmarkFrame());
+
+    glGenRenderbuffers(1, &m_ColorBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_ColorBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, m_Options.width, m_Options.height);
+    glGenRenderbuffers(1, &m_DepthBuffer);
+    glBindRenderbuffer(GL_RENDERBUFFER, m_DepthBuffer);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, m_Options.width, m_Options.height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glGenFramebuffers(1, &m_Framebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, m_ColorBuffer);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_DepthBuffer);
+    bool complete = glCheckFramebufferStatus(GL_FRAMEBUFFER) == GL_FRAMEBUFFER_COMPLETE;
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    if (!complete)
+    {
+        std::cerr << "ERROR::FRAMEBUFFER:: Benchmark framebuffer is not complete!" << std::endl;
+        return false;
+    }
+
+    m_TimestampQueries.resize(2 * m_Options.frames);
+    m_PrimitiveQueries.resize(m_Options.frames);
+    glGenQueries(static_cast<GLsizei>(m_TimestampQueries.size()), m_TimestampQueries.data());
+    glGenQueries(static_cast<GLsizei>(m_PrimitiveQueries.size()), m_PrimitiveQueries.data());
+
+    if (!m_Options.goldenDirectory.empty())
+    {
+        std::error_code error;
+        fs::create_directories(m_Options.goldenDirectory, error);
+        if (error)
+        {
+            std::cerr << "Failed to create " << m_Options.goldenDirectory << ": " << error.message() << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+bool FrameBenchmark::beginFrame(Camera& camera)
+{
+    if (m_Frame >= m_Options.frames)
+    {
+        return false;
+    }
+    m_FrameStart = Profiler::now();
+    float time = m_Frame < 0 ? 0.0f : m_Frame * m_TimeStep;
+    m_Path.apply(time, camera);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+    glViewport(0, 0, m_Options.width, m_Options.height);
+    RenderStats::get().reset();
+    if (m_Frame >= 0)
+    {
+        m_Frames[m_Frame].time = time;
+        glQueryCounter(m_TimestampQueries[2 * m_Frame], GL_TIMESTAMP);
+        glBeginQuery(GL_PRIMITIVES_GENERATED, m_PrimitiveQueries[m_Frame]);
+    }
+    return true;
+}
+
+void FrameBenchmark::endFrame()
+{
+    if (m_Frame >= 0)
+    {
+        BenchmarkFrame& frame = m_Frames[m_Frame];
+        glEndQuery(GL_PRIMITIVES_GENERATED);
+        glQueryCounter(m_TimestampQueries[2 * m_Frame + 1], GL_TIMESTAMP);
+        frame.cpuMs = (Profiler::now() - m_FrameStart) / 1000000.0;
+        frame.drawCalls = RenderStats::get().getDrawCalls();
+
+        bool golden = !m_Options.goldenDirectory.empty() || !m_Options.compareDirectory.empty();
+        if (golden && m_Frame % m_Options.goldenInterval == 0)
+        {
+            frame.captured = true;
+            captureFrame(m_Frame);
+        }
+    }
+
+    // Stand-in for the swap chain, the sync object of the frame FRAMES_IN_FLIGHT back must be done
+    GLsync& fence = m_Fences[(m_Frame + m_Options.warmupFrames) % FRAMES_IN_FLIGHT];
+    if (fence)
+    {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+
+    if (m_Frame >= 0)
+    {
+        m_Frames[m_Frame].frameMs = (Profiler::now() - m_FrameStart) / 1000000.0;
+    }
+    ++m_Frame;
+}
+
+std::string FrameBenchmark::getGoldenName(int frame) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "frame_%05d.png", frame);
+    return name;
+}
+
+void FrameBenchmark::captureFrame(int frame)
+{
+    int width = m_Options.width;
+    int height = m_Options.height;
+    size_t rowBytes = static_cast<size_t>(width) * 3;
+    std::vector<unsigned char> pixels(rowBytes * height);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, m_Framebuffer);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, width, height, GL_RGB, GL_UNSIGNED_BYTE, pixels.data());
+    glPixelStorei(GL_PACK_ALIGNMENT, 4);
+
+    // GL rows start at the bottom, PNG rows at the top
+    std::vector<unsigned char> flipped(pixels.size());
+    for (int y = 0; y < height; ++y)
+    {
+        std::memcpy(&flipped[y * rowBytes], &pixels[(height - 1 - y) * rowBytes], rowBytes);
+    }
+
+    GoldenResult result;
+    result.frame = frame;
+    result.file = getGoldenName(frame);
+    if (!m_Options.goldenDirectory.empty())
+    {
+        PngWriter::write((fs::path(m_Options.goldenDirectory) / result.file).string(), width, height, 3, flipped.data());
+    }
+    if (!m_Options.compareDirectory.empty())
+    {
+        std::string referencePath = (fs::path(m_Options.compareDirectory) / result.file).string();
+        int referenceWidth = 0;
+        int referenceHeight = 0;
+        int channels = 0;
+        unsigned char* reference = stbi_load(referencePath.c_str(), &referenceWidth, &referenceHeight, &channels, 3);
+        result.compared = true;
+        if (!reference || referenceWidth != width || referenceHeight != height)
+        {
+            std::cerr << "Golden frame " << referencePath << " is missing or has a different size" << std::endl;
+            result.matched = false;
+            result.maxDifference = 255;
+            result.differingPixels = static_cast<size_t>(width) * height;
+        }
+        else
+        {
+            for (size_t pixel = 0; pixel < static_cast<size_t>(width) * height; ++pixel)
+            {
+                int difference = 0;
+                for (int channel = 0; channel < 3; ++channel)
+                {
+                    difference = std::max(difference, std::abs(flipped[pixel * 3 + channel] - reference[pixel * 3 + channel]));
+                }
+                result.maxDifference = std::max(result.maxDifference, difference);
+                if (difference > m_Options.tolerance)
+                {
+                    ++result.differingPixels;
+                }
+            }
+            result.matched = result.differingPixels == 0;
+        }
+        stbi_image_free(reference);
+    }
+    m_Golden.push_back(result);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Framebuffer);
+}
+
+bool FrameBenchmark::finish(const std::string& backend, const std::vector<std::pair<std::string, bool>>& settings)
+{
+    // Every query was issued by now, reading them back can only wait for the last frame
+    std::vector<double> cpuMs;
+    std::vector<double> frameMs;
+    std::vector<double> gpuMs;
+    std::vector<double> drawCalls;
+    std::vector<double> primitives;
+    for (size_t i = 0; i < m_Frames.size(); ++i)
+    {
+        BenchmarkFrame& frame = m_Frames[i];
+        GLuint64 begin = 0;
+        GLuint64 end = 0;
+        GLuint64 primitiveCount = 0;
+        glGetQueryObjectui64v(m_TimestampQueries[2 * i], GL_QUERY_RESULT, &begin);
+        glGetQueryObjectui64v(m_TimestampQueries[2 * i + 1], GL_QUERY_RESULT, &end);
+        glGetQueryObjectui64v(m_PrimitiveQueries[i], GL_QUERY_RESULT, &primitiveCount);
+        frame.gpuMs = (end - begin) / 1000000.0;
+        frame.primitives = primitiveCount;
+        if (!frame.captured)
+        {
+            cpuMs.push_back(frame.cpuMs);
+            frameMs.push_back(frame.frameMs);
+            gpuMs.push_back(frame.gpuMs);
+        }
+        drawCalls.push_back(frame.drawCalls);
+        primitives.push_back(static_cast<double>(frame.primitives));
+    }
+
+    bool passed = std::all_of(m_Golden.begin(), m_Golden.end(), [](const GoldenResult& result) { return result.matched; });
+    Distribution cpu = getDistribution(cpuMs);
+    Distribution frame = getDistribution(frameMs);
+    Distribution gpu = getDistribution(gpuMs);
+
+    std::string temporaryPath = m_Options.outputPath + ".tmp";
+    {
+        std::ofstream file(temporaryPath);
+        JsonWriter json(file);
+        json.beginObject();
+        json.field("model", m_Options.modelPath);
+        json.field("cameraPath", m_Options.cameraPathFile.empty() ? std::string("orbit") : m_Options.cameraPathFile);
+        json.field("backend", backend);
+        json.field("renderer", reinterpret_cast<const char*>(glGetString(GL_RENDERER)));
+        json.field("version", reinterpret_cast<const char*>(glGetString(GL_VERSION)));
+        json.field("width", m_Options.width);
+        json.field("height", m_Options.height);
+        json.field("frames", m_Options.frames);
+        json.field("warmupFrames", m_Options.warmupFrames);
+        json.field("timeStep", m_TimeStep);
+        json.field("textureMode", m_Options.textureMode);
+        json.key("settings");
+        json.beginObject();
+        for (const auto& setting : settings)
+        {
+            json.field(setting.first, setting.second);
+        }
+        json.endObject();
+
+        json.key("summary");
+        json.beginObject();
+        writeDistribution(json, "cpuMs", cpu);
+        writeDistribution(json, "frameMs", frame);
+        writeDistribution(json, "gpuMs", gpu);
+        writeDistribution(json, "drawCalls", getDistribution(drawCalls));
+        writeDistribution(json, "primitives", getDistribution(primitives));
+        json.endObject();
+
+        json.key("frameData");
+        json.beginArray();
+        for (const BenchmarkFrame& data : m_Frames)
+        {
+            json.beginObject();
+            json.field("time", data.time);
+            json.field("cpuMs", data.cpuMs);
+            json.field("frameMs", data.frameMs);
+            json.field("gpuMs", data.gpuMs);
+            json.field("drawCalls", data.drawCalls);
+            json.field("primitives", data.primitives);
+            json.field("captured", data.captured);
+            json.endObject();
+        }
+        json.endArray();
+
+        json.key("golden");
+        json.beginArray();
+        for (const GoldenResult& result : m_Golden)
+        {
+            json.beginObject();
+            json.field("frame", result.frame);
+            json.field("file", result.file);
+            if (result.compared)
+            {
+                json.field("maxDifference", result.maxDifference);
+                json.field("differingPixels", static_cast<uint64_t>(result.differingPixels));
+                json.field("matched", result.matched);
+            }
+            json.endObject();
+        }
+        json.endArray();
+        json.field("goldenPassed", passed);
+        json.endObject();
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporaryPath, m_Options.outputPath, error);
+    if (error)
+    {
+        std::cerr << "Failed to write " << m_Options.outputPath << ": " << error.message() << std::endl;
+        return false;
+    }
+
+    std::cout << "Benchmark (" << backend << ", " << m_Options.width << "x" << m_Options.height << ", " << m_Options.frames << " frames): "
+              << "CPU p50 " << cpu.p50 << "ms p99 " << cpu.p99 << "ms, GPU p50 " << gpu.p50 << "ms p99 " << gpu.p99 << "ms, "
+              << "frame p50 " << frame.p50 << "ms -> " << m_Options.outputPath << std::endl;
+    if (!m_Options.compareDirectory.empty())
+    {
+        std::cout << "Golden frames: " << (passed ? "all match" : "DIFFERENT") << " (" << m_Golden.size() << " compared, tolerance " << m_Options.tolerance << ")" << std::endl;
+    }
+    return passed;
+}
+
+void FrameBenchmark::destroy()
+{
+    for (GLsync& fence : m_Fences)
+    {
+        if (fence)
+        {
+            glDeleteSync(fence);
+        }
+        fence = nullptr;
+    }
+    if (!m_TimestampQueries.empty())
+    {
+        glDeleteQueries(static_cast<GLsizei>(m_TimestampQueries.size()), m_TimestampQueries.data());
+        glDeleteQueries(static_cast<GLsizei>(m_PrimitiveQueries.size()), m_PrimitiveQueries.data());
+    }
+    m_TimestampQueries.clear();
+    m_PrimitiveQueries.clear();
+    glDeleteFramebuffers(1, &m_Framebuffer);
+    glDeleteRenderbuffers(1, &m_ColorBuffer);
+    glDeleteRenderbuffers(1, &m_DepthBuffer);
+    m_Framebuffer = 0;
+    m_ColorBuffer = 0;
+    m_DepthBuffer = 0;
+}
@@ -0,0 +1,101 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+#include "cameraPath.h"
+
+class Camera;
+
+struct BenchmarkOptions
+{
+    std::string modelPath;
+    std::string cameraPathFile;     // empty: orbit around the scene bounds
+    float orbitSeconds = 20.0f;
+    int frames = 600;
+    int warmupFrames = 60;          // rendered at the first key and not measured, lets streaming settle
+    int width = 1280;
+    int height = 720;
+    std::string outputPath = "benchmark.json";
+    std::string goldenDirectory;    // golden frames are written here
+    std::string compareDirectory;   // and compared against the ones found here
+    int goldenInterval = 60;        // every Nth measured frame
+    int tolerance = 2;              // largest per channel difference that still counts as equal
+    // "decoded" loads PNG/JPG sources even where a cooked DDS exists, "cooked" prefers up-to-date
+    // .cooked.dds files. Fixed per run so golden images don't depend on an earlier --cook.
+    std::string textureMode = "decoded";
+
+    // --benchmark <model.gltf> [--path file.campath | --orbit seconds] [--frames n] [--warmup n]
+    //   [--size WxH] [--out file.json] [--golden dir] [--compare dir] [--golden-interval n] [--tolerance n]
+    //   [--textures decoded|cooked]
+    static bool parse(int argc, char* argv[], BenchmarkOptions& options);
+};
+
+struct BenchmarkFrame
+{
+    float time = 0.0f;              // position on the camera path in seconds
+    double cpuMs = 0.0;             // from beginFrame() to endFrame(), what the CPU spent submitting
+    double frameMs = 0.0;           // including the wait for the GPU, like a frame with v-sync off
+    double gpuMs = 0.0;
+    uint32_t drawCalls = 0;
+    uint64_t primitives = 0;        // GL_PRIMITIVES_GENERATED, every pass included
+    bool captured = false;          // read back for a golden image and left out of the statistics
+};
+
+struct GoldenResult
+{
+    int frame = 0;
+    std::string file;
+    int maxDifference = 0;
+    size_t differingPixels = 0;     // pixels with a channel beyond the tolerance
+    bool compared = false;
+    bool matched = true;
+};
+
+// Replays a camera path into an offscreen framebuffer with a fixed time step and measures
+// every frame. GPU time comes from GL_TIMESTAMP queries around the frame, which leaves
+// GL_TIME_ELAPSED free for the passes that time themselves. All queries are resolved after
+// the run, so measuring never stalls. A fence FRAMES_IN_FLIGHT frames back stands in for the
+// swap chain and keeps the CPU from queuing unbounded work ahead of the GPU.
+//
+// Golden frames are read back and stored as PNG. A later run compares against them to
+// show an optimization left the image unchanged.
+class FrameBenchmark
+{
+public:
+    static const int FRAMES_IN_FLIGHT = 2;
+
+    bool init(const BenchmarkOptions& options, const CameraPath& path);
+    // Places the camera and binds the offscreen target, false once the path is done
+    bool beginFrame(Camera& camera);
+    // Call where the windowed loop swaps buffers
+    void endFrame();
+    // Writes the JSON report, false if a golden frame differs or the report can't be written
+    bool finish(const std::string& backend, const std::vector<std::pair<std::string, bool>>& settings);
+    void destroy();
+
+    float getDeltaTime() const { return m_TimeStep; }
+    int getWidth() const { return m_Options.width; }
+    int getHeight() const { return m_Options.height; }
+
+private:
+    void captureFrame(int frame);
+    std::string getGoldenName(int frame) const;
+
+    BenchmarkOptions m_Options;
+    CameraPath m_Path;
+    float m_TimeStep = 1.0f / 60.0f;
+
+    GLuint m_Framebuffer = 0;
+    GLuint m_ColorBuffer = 0;
+    GLuint m_DepthBuffer = 0;
+    std::vector<GLuint> m_TimestampQueries;     // begin and end per measured frame
+    std::vector<GLuint> m_PrimitiveQueries;
+    GLsync m_Fences[FRAMES_IN_FLIGHT] = {};
+
+    int m_Frame = 0;                // negative while warming up
+    uint64_t m_FrameStart = 0;
+    std::vector<BenchmarkFrame> m_Frames;
+    std::vector<GoldenResult> m_Golden;
+};
@@ -0,0 +1,38 @@
+#pragma once
+#include <glm/glm.hpp>
+
+// Six clip planes extracted from a view-projection matrix (Gribb/Hartmann),
+// normals pointing inwards.
+struct Frustum
+{
+    glm::vec4 planes[6];
+
+    static Frustum fromMatrix(const glm::mat4& viewProjection)
+    {
+        Frustum frustum;
+        glm::mat4 m = glm::transpose(viewProjection);
+        frustum.planes[0] = m[3] + m[0]; // left
+        frustum.planes[1] = m[3] - m[0]; // right
+        frustum.planes[2] = m[3] + m[1]; // bottom
+        frustum.planes[3] = m[3] - m[1]; // top
+        frustum.planes[4] = m[3] + m[2]; // near
+        frustum.planes[5] = m[3] - m[2]; // far
+        return frustum;
+    }
+
+    // Conservative: only rejects boxes that are fully outside one plane
+    bool intersectsAabb(const glm::vec3& boundsMin, const glm::vec3& boundsMax) const
+    {
+        for (const glm::vec4& plane : planes)
+        {
+            glm::vec3 positive(plane.x >= 0.0f ? boundsMax.x : boundsMin.x,
+                               plane.y >= 0.0f ? boundsMax.y : boundsMin.y,
+                               plane.z >= 0.0f ? boundsMax.z : boundsMin.z);
+            if (glm::dot(glm::vec3(plane), positive) + plane.w < 0.0f)
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+};
@@ -0,0 +1,306 @@
+#include "pch.h"
+#include "gpuCulling.h"
+#include "profiler.h"
+#include "renderStats.h"
+
+// Must match local_size_x in shaders/cull.comp and local_size_x/y in shaders/hiz.comp
+static const GLuint CULL_GROUP_SIZE = 64;
+static const GLuint HIZ_GROUP_SIZE = 8;
+
+// Counter buffer layout: drawCount[0], drawCount[1], occludedCount, padding
+static const GLuint COUNTER_BUFFER_SIZE = 4 * sizeof(GLuint);
+
+static void extractFrustumPlanes(const glm::mat4& m, glm::vec4 planes[6])
+{
+    glm::vec4 row0(m[0][0], m[1][0], m[2][0], m[3][0]);
+    glm::vec4 row1(m[0][1], m[1][1], m[2][1], m[3][1]);
+    glm::vec4 row2(m[0][2], m[1][2], m[2][2], m[3][2]);
+    glm::vec4 row3(m[0][3], m[1][3], m[2][3], m[3][3]);
+
+    planes[0] = row3 + row0; // left
+    planes[1] = row3 - row0; // right
+    planes[2] = row3 + row1; // bottom
+    planes[3] = row3 - row1; // top
+    planes[4] = row3 + row2; // near
+    planes[5] = row3 - row2; // far
+
+    for (int i = 0; i < 6; ++i)
+    {
+        planes[i] /= glm::length(glm::vec3(planes[i]));
+    }
+}
+
+GpuCuller::~GpuCuller()
+{
+    // GL objects are released explicitly through destroy() while the context is alive
+}
+
+void GpuCuller::init(const std::vector<CullObject>& objects, int width, int height)
+{
+    m_CullShader = std::make_unique<Shader>("shaders/cull.comp");
+    m_HiZShader = std::make_unique<Shader>("shaders/hiz.comp");
+    m_Quad.create();
+
+    // glMultiDrawElementsIndirectCount is core in 4.6. Older contexts (e.g. Mesa llvmpipe
+    // exposing 4.5) draw the whole command buffer instead; the unused tail is cleared to
+    // zero every frame, so those commands are empty draws.
+    m_UseIndirectCount = GLAD_GL_VERSION_4_6 != 0;
+
+    m_ObjectCount = static_cast<GLuint>(objects.size());
+    m_Stats.objectCount = m_ObjectCount;
+
+    glGenBuffers(1, &m_ObjectBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_ObjectBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(CullObject), objects.data(), GL_STATIC_DRAW);
+
+    // One command list per phase
+    glGenBuffers(1, &m_CommandBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CommandBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, 2 * objects.size() * sizeof(DrawElementsIndirectCommand), nullptr, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &m_OccludedBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_OccludedBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, objects.size() * sizeof(GLuint), nullptr, GL_DYNAMIC_DRAW);
+
+    glGenBuffers(1, &m_CounterBuffer);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CounterBuffer);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, COUNTER_BUFFER_SIZE, nullptr, GL_DYNAMIC_DRAW);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+
+    createTargets(width, height);
+
+    std::cout << "GPU culling: " << m_ObjectCount << " objects, "
+        << (m_UseIndirectCount ? "glMultiDrawElementsIndirectCount" : "glMultiDrawElementsIndirect fallback") << "\n";
+}
+
+void GpuCuller::resize(int width, int height)
+{
+    if (width == m_Width && height == m_Height)
+    {
+        return;
+    }
+    destroyTargets();
+    createTargets(width, height);
+}
+
+void GpuCuller::createTargets(int width, int height)
+{
+    m_Width = width;
+    m_Height = height;
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glGenFramebuffers(1, &m_Fbo);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+
+    glGenTextures(1, &m_ColorTexture);
+    glBindTexture(GL_TEXTURE_2D, m_ColorTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_ColorTexture, 0);
+
+    glGenTextures(1, &m_DepthTexture);
+    glBindTexture(GL_TEXTURE_2D, m_DepthTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_DEPTH_COMPONENT32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_COMPARE_MODE, GL_NONE);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_TEXTURE_2D, m_DepthTexture, 0);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        std::cout << "ERROR::FRAMEBUFFER:: GPU culling framebuffer is not complete!" << std::endl;
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+
+    // Hi-Z pyramid: R32F, each texel stores the farthest depth of the region it covers
+    m_HiZLevels = 1 + static_cast<int>(std::floor(std::log2(static_cast<float>(std::max(width, height)))));
+    glGenTextures(1, &m_HiZTexture);
+    glBindTexture(GL_TEXTURE_2D, m_HiZTexture);
+    glTexStorage2D(GL_TEXTURE_2D, m_HiZLevels, GL_R32F, width, height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_HiZValid = false;
+}
+
+void GpuCuller::destroyTargets()
+{
+    glDeleteFramebuffers(1, &m_Fbo);
+    glDeleteTextures(1, &m_ColorTexture);
+    glDeleteTextures(1, &m_DepthTexture);
+    glDeleteTextures(1, &m_HiZTexture);
+    m_Fbo = m_ColorTexture = m_DepthTexture = m_HiZTexture = 0;
+}
+
+void GpuCuller::destroy()
+{
+    if (!isInitialized())
+    {
+        return;
+    }
+    destroyTargets();
+    glDeleteBuffers(1, &m_ObjectBuffer);
+    glDeleteBuffers(1, &m_CommandBuffer);
+    glDeleteBuffers(1, &m_OccludedBuffer);
+    glDeleteBuffers(1, &m_CounterBuffer);
+    m_Quad.destroy();
+    m_CullShader->deleteShader();
+    m_HiZShader->deleteShader();
+    m_CullShader.reset();
+    m_HiZShader.reset();
+}
+
+void GpuCuller::cull(int phase, const glm::mat4& viewProjection, const glm::mat4& hiZViewProjection)
+{
+    glm::vec4 planes[6];
+    extractFrustumPlanes(viewProjection, planes);
+
+    m_CullShader->use();
+    m_CullShader->setInt("uPhase", phase);
+    m_CullShader->setInt("uObjectCount", static_cast<int>(m_ObjectCount));
+    m_CullShader->setBool("uHiZValid", m_HiZValid);
+    m_CullShader->setMat4("uHiZViewProjection", hiZViewProjection);
+    m_CullShader->setVec2("uHiZSize", glm::vec2(static_cast<float>(m_Width), static_cast<float>(m_Height)));
+    m_CullShader->setInt("uHiZLevels", m_HiZLevels);
+    glUniform4fv(m_CullShader->getUniformlocation("uFrustumPlanes"), 6, &planes[0][0]);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_HiZTexture);
+    m_CullShader->setInt("uHiZ", 0);
+
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, m_ObjectBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, m_CommandBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, m_CounterBuffer);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 3, m_OccludedBuffer);
+
+    glDispatchCompute((m_ObjectCount + CULL_GROUP_SIZE - 1) / CULL_GROUP_SIZE, 1, 1);
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+void GpuCuller::drawPhase(int phase)
+{
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, m_CommandBuffer);
+    const void* commandOffset = (const void*)(phase * m_ObjectCount * sizeof(DrawElementsIndirectCommand));
+
+    if (m_UseIndirectCount)
+    {
+        glBindBuffer(GL_PARAMETER_BUFFER, m_CounterBuffer);
+        glMultiDrawElementsIndirectCount(GL_TRIANGLES, GL_UNSIGNED_INT, commandOffset, phase * sizeof(GLuint), m_ObjectCount, 0);
+        glBindBuffer(GL_PARAMETER_BUFFER, 0);
+    }
+    else
+    {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, commandOffset, m_ObjectCount, 0);
+    }
+    RenderStats::get().countDraw();
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, 0);
+}
+
+void GpuCuller::buildHiZ()
+{
+    m_HiZShader->use();
+    glActiveTexture(GL_TEXTURE0);
+    m_HiZShader->setInt("uSource", 0);
+
+    int width = m_Width;
+    int height = m_Height;
+    for (int level = 0; level < m_HiZLevels; ++level)
+    {
+        // Level 0 copies the depth buffer, every other level reduces the previous one
+        if (level == 0)
+        {
+            glBindTexture(GL_TEXTURE_2D, m_DepthTexture);
+            m_HiZShader->setInt("uSourceLevel", 0);
+            m_HiZShader->setBool("uCopy", true);
+        }
+        else
+        {
+            glBindTexture(GL_TEXTURE_2D, m_HiZTexture);
+            m_HiZShader->setInt("uSourceLevel", level - 1);
+            m_HiZShader->setBool("uCopy", false);
+        }
+        m_HiZShader->setVec2("uSourceSize", glm::vec2(static_cast<float>(width), static_cast<float>(height)));
+
+        int destWidth = level == 0 ? width : std::max(1, width / 2);
+        int destHeight = level == 0 ? height : std::max(1, height / 2);
+        m_HiZShader->setVec2("uDestSize", glm::vec2(static_cast<float>(destWidth), static_cast<float>(destHeight)));
+
+        glBindImageTexture(0, m_HiZTexture, level, GL_FALSE, 0, GL_WRITE_ONLY, GL_R32F);
+        glDispatchCompute((destWidth + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, (destHeight + HIZ_GROUP_SIZE - 1) / HIZ_GROUP_SIZE, 1);
+        glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+
+        width = destWidth;
+        height = destHeight;
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    m_HiZValid = true;
+}
+
+void GpuCuller::render(Shader& drawShader, Shader& compositeShader, GLuint vao, const glm::mat4& view, const glm::mat4& projection)
+{
+    PROFILE_SCOPE("GPU culling");
+    glm::mat4 viewProjection = projection * view;
+
+    // Reset counters, and the command lists when the count cannot come from the GPU
+    GLuint zero = 0;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CounterBuffer);
+    glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    if (!m_UseIndirectCount)
+    {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CommandBuffer);
+        glClearBufferData(GL_SHADER_STORAGE_BUFFER, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_Fbo);
+    glViewport(0, 0, m_Width, m_Height);
+    glEnable(GL_DEPTH_TEST);
+    glClearColor(0.1f, 0.1f, 0.1f, 1.0f);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // Phase 1: frustum + last frame's Hi-Z (tested with the matrix it was built with)
+    cull(0, viewProjection, m_PrevViewProjection);
+    drawShader.use();
+    drawShader.setMat4("model", glm::mat4(1.0f));
+    glBindVertexArray(vao);
+    drawPhase(0);
+    glBindVertexArray(0);
+
+    // Phase 2: rebuild Hi-Z from what phase 1 drew and re-test the occluded objects
+    buildHiZ();
+    cull(1, viewProjection, viewProjection);
+    drawShader.use();
+    glBindVertexArray(vao);
+    drawPhase(1);
+    glBindVertexArray(0);
+
+    // Pyramid of the final depth, used by phase 1 of the next frame
+    buildHiZ();
+    m_PrevViewProjection = viewProjection;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glDisable(GL_DEPTH_TEST);
+    compositeShader.use();
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_2D, m_ColorTexture);
+    compositeShader.setInt("screenTexture", 0);
+    m_Quad.draw();
+    glEnable(GL_DEPTH_TEST);
+
+    if (m_ReadbackStats)
+    {
+        GLuint counters[4] = {};
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, m_CounterBuffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, sizeof(counters), counters);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        m_Stats.phase1Drawn = counters[0];
+        m_Stats.phase2Drawn = counters[1];
+        m_Stats.phase1Occluded = counters[2];
+    }
+}
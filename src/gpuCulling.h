@@ -0,0 +1,92 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <memory>
+#include <vector>
+#include "shader.h"
+#include "screenQuad.h"
+
+// Layout of one entry in GL_DRAW_INDIRECT_BUFFER for glMultiDrawElementsIndirect
+struct DrawElementsIndirectCommand
+{
+    GLuint count;
+    GLuint instanceCount;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint baseInstance;
+};
+
+// One cullable draw: world-space bounds plus its index range in the batch buffers.
+// Matches the std430 layout of CullObject in shaders/cull.comp.
+struct CullObject
+{
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    GLuint count;
+    GLuint firstIndex;
+    GLint baseVertex;
+    GLuint padding;
+};
+
+struct GpuCullingStats
+{
+    GLuint objectCount = 0;
+    GLuint phase1Drawn = 0;
+    GLuint phase1Occluded = 0;
+    GLuint phase2Drawn = 0;
+};
+
+// GPU-driven renderer for the combined batch geometry.
+//
+// Phase 1 tests every object against the frustum and the previous frame's Hi-Z
+// pyramid and draws the survivors. The Hi-Z pyramid is rebuilt from that depth,
+// and phase 2 re-tests only the objects phase 1 rejected by occlusion, drawing
+// the ones that turned out to be visible. Both phases write compacted indirect
+// commands, so the CPU issues a fixed number of calls regardless of object count.
+class GpuCuller
+{
+public:
+    GpuCuller() = default;
+    ~GpuCuller();
+
+    void init(const std::vector<CullObject>& objects, int width, int height);
+    void resize(int width, int height);
+    void render(Shader& drawShader, Shader& compositeShader, GLuint vao, const glm::mat4& view, const glm::mat4& projection);
+    void destroy();
+
+    const GpuCullingStats& getStats() const { return m_Stats; }
+    bool isInitialized() const { return m_CullShader != nullptr; }
+
+    bool m_ReadbackStats = false;
+
+private:
+    void createTargets(int width, int height);
+    void destroyTargets();
+    void cull(int phase, const glm::mat4& viewProjection, const glm::mat4& hiZViewProjection);
+    void drawPhase(int phase);
+    void buildHiZ();
+
+    std::unique_ptr<Shader> m_CullShader;
+    std::unique_ptr<Shader> m_HiZShader;
+    ScreenQuad m_Quad;
+
+    GLuint m_ObjectCount = 0;
+    GLuint m_ObjectBuffer = 0;
+    GLuint m_CommandBuffer = 0;
+    GLuint m_CounterBuffer = 0;
+    GLuint m_OccludedBuffer = 0;
+
+    GLuint m_Fbo = 0;
+    GLuint m_ColorTexture = 0;
+    GLuint m_DepthTexture = 0;
+    GLuint m_HiZTexture = 0;
+    int m_Width = 0;
+    int m_Height = 0;
+    int m_HiZLevels = 0;
+
+    glm::mat4 m_PrevViewProjection = glm::mat4(1.0f);
+    bool m_HiZValid = false;
+    bool m_UseIndirectCount = false;
+
+    GpuCullingStats m_Stats;
+};
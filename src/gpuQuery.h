@@ -0,0 +1,75 @@
+#pragma once
+#include <glad/glad.h>
+
+// Double-buffered GL query for the draws between begin() and end().
+// Two query objects are used round-robin so the result issued the frame before
+// last is read back without stalling on the one that is still in flight.
+//   GL_FRAGMENT_SHADER_INVOCATIONS: shaded fragment count (core since 4.6)
+//   GL_TIME_ELAPSED: GPU time in nanoseconds
+class GpuQuery
+{
+public:
+    explicit GpuQuery(GLenum target) : m_Target(target) {}
+
+    void init()
+    {
+        m_Supported = m_Target != GL_FRAGMENT_SHADER_INVOCATIONS || GLAD_GL_VERSION_4_6 != 0;
+        if (m_Supported)
+        {
+            glGenQueries(2, m_Queries);
+        }
+    }
+
+    void destroy()
+    {
+        if (m_Supported)
+        {
+            glDeleteQueries(2, m_Queries);
+        }
+        m_Supported = false;
+        m_Issued[0] = m_Issued[1] = false;
+    }
+
+    void begin()
+    {
+        if (!m_Supported)
+        {
+            return;
+        }
+
+        // Pick up the old result before its query object is reused
+        if (m_Issued[m_Current])
+        {
+            GLuint available = 0;
+            glGetQueryObjectuiv(m_Queries[m_Current], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (available)
+            {
+                glGetQueryObjectui64v(m_Queries[m_Current], GL_QUERY_RESULT, &m_Result);
+            }
+        }
+        glBeginQuery(m_Target, m_Queries[m_Current]);
+    }
+
+    void end()
+    {
+        if (!m_Supported)
+        {
+            return;
+        }
+        glEndQuery(m_Target);
+        m_Issued[m_Current] = true;
+        m_Current ^= 1;
+    }
+
+    bool isSupported() const { return m_Supported; }
+    GLuint64 getResult() const { return m_Result; }
+    float getResultMs() const { return m_Result / 1000000.0f; }
+
+private:
+    GLenum m_Target;
+    GLuint m_Queries[2] = { 0, 0 };
+    bool m_Issued[2] = { false, false };
+    int m_Current = 0;
+    bool m_Supported = false;
+    GLuint64 m_Result = 0;
+};
@@ -0,0 +1,170 @@
+#include "pch.h"
+#include "gpuTextureCache.h"
+#include "ktxLoader.h"
+#include "ddsLoader.h"
+
+std::shared_ptr<GpuTexture> GpuTextureCache::acquire(const std::shared_ptr<Texture>& texture)
+{
+    ++m_Stats.requestedTextures;
+    if (texture->m_Streamed || texture->m_AsyncUpload)
+    {
+        if (m_ExternalTextures.insert(texture.get()).second)
+        {
+            ++m_Stats.uniqueTextures;
+        }
+        return nullptr;
+    }
+
+    auto it = m_Textures.find(texture.get());
+    if (it != m_Textures.end())
+    {
+        if (std::shared_ptr<GpuTexture> handle = it->second.lock())
+        {
+            m_Stats.savedBytes += handle->bytes;
+            return handle;
+        }
+    }
+
+    auto handle = std::make_shared<GpuTexture>();
+    handle->id = createTexture(*texture, handle->bytes);
+    if (handle->id == 0)
+    {
+        return nullptr;
+    }
+    m_Textures[texture.get()] = handle;
+    ++m_Stats.uniqueTextures;
+    m_Stats.uniqueBytes += handle->bytes;
+    return handle;
+}
+
+GLuint GpuTextureCache::getSampler(const SamplerDesc& desc)
+{
+    ++m_Stats.requestedSamplers;
+    auto it = m_Samplers.find(desc);
+    if (it != m_Samplers.end())
+    {
+        return it->second;
+    }
+
+    GLuint sampler;
+    glGenSamplers(1, &sampler);
+    glSamplerParameteri(sampler, GL_TEXTURE_MIN_FILTER, desc.minFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_MAG_FILTER, desc.magFilter);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_S, desc.wrapS);
+    glSamplerParameteri(sampler, GL_TEXTURE_WRAP_T, desc.wrapT);
+    glSamplerParameterf(sampler, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
+    m_Samplers[desc] = sampler;
+    ++m_Stats.uniqueSamplers;
+    return sampler;
+}
+
+void GpuTextureCache::destroy()
+{
+    for (auto& pair : m_Textures)
+    {
+        if (std::shared_ptr<GpuTexture> handle = pair.second.lock())
+        {
+            glDeleteTextures(1, &handle->id);
+            handle->id = 0;
+        }
+    }
+    for (auto& pair : m_Samplers)
+    {
+        glDeleteSamplers(1, &pair.second);
+    }
+    m_Textures.clear();
+    m_ExternalTextures.clear();
+    m_Samplers.clear();
+}
+
+void GpuTextureCache::printStats() const
+{
+    std::cout << "Textures: " << m_Stats.uniqueTextures << " unique uploads for " << m_Stats.requestedTextures << " requests, "
+              << m_Stats.uniqueBytes / (1024.0 * 1024.0) << " MB resident, " << m_Stats.savedBytes / (1024.0 * 1024.0) << " MB saved\n";
+    std::cout << "Samplers: " << m_Stats.uniqueSamplers << " unique for " << m_Stats.requestedSamplers << " requests" << std::endl;
+}
+
+std::shared_ptr<GpuTexture> GpuTextureCache::find(const Texture* texture) const
+{
+    auto it = m_Textures.find(texture);
+    return it != m_Textures.end() ? it->second.lock() : nullptr;
+}
+
+GLuint GpuTextureCache::createTexture(const Texture& texture, size_t& bytes)
+{
+    bytes = 0;
+    if (texture.m_isMapped)
+    {
+        try
+        {
+            TextureUploadInfo info;
+            GLuint textureID = texture.m_isDDS ? DDSLoader::load(texture.m_path, &info) : KTXLoader::load(texture.m_path, &info);
+            bytes = info.bytes;
+            return textureID;
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error loading texture " << texture.m_path << ": " << e.what() << std::endl;
+            return 0;
+        }
+    }
+    if (texture.m_isDDS ? texture.m_ddsData.empty() : texture.m_data.empty())
+    {
+        return 0;
+    }
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+
+    if (texture.m_isDDS)
+    {
+        for (size_t level = 0; level < texture.m_ddsData.size(); ++level)
+        {
+            const auto& mipmap = texture.m_ddsData[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, level, texture.m_format, mipmap.width, mipmap.height, 0, mipmap.data.size(), mipmap.data.data());
+            bytes += mipmap.data.size();
+        }
+    }
+    else
+    {
+        glTexImage2D(GL_TEXTURE_2D, 0, texture.m_format, texture.m_width, texture.m_height, 0, texture.m_format, GL_UNSIGNED_BYTE, texture.m_data.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        bytes = texture.m_data.size() * 4 / 3;
+    }
+
+    // Sampler objects override these where a material binds one
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
+    return textureID;
+}
+
+SamplerDesc GpuTextureCache::getSamplerDesc(const cgltf_sampler* sampler)
+{
+    SamplerDesc desc;
+    if (sampler == nullptr)
+    {
+        return desc;
+    }
+    // glTF uses the GL enums, 0 means unset
+    if (sampler->min_filter != 0)
+    {
+        desc.minFilter = sampler->min_filter;
+    }
+    if (sampler->mag_filter != 0)
+    {
+        desc.magFilter = sampler->mag_filter;
+    }
+    if (sampler->wrap_s != 0)
+    {
+        desc.wrapS = sampler->wrap_s;
+    }
+    if (sampler->wrap_t != 0)
+    {
+        desc.wrapT = sampler->wrap_t;
+    }
+    return desc;
+}
@@ -0,0 +1,92 @@
+#pragma once
+#include <glad/glad.h>
+#include <cgltf/cgltf.h>
+#include <memory>
+#include <unordered_map>
+#include <unordered_set>
+#include "texture.h"
+
+// GL sampler state of a glTF sampler, the defaults are what textures used before samplers
+struct SamplerDesc
+{
+    GLint minFilter = GL_LINEAR_MIPMAP_LINEAR;
+    GLint magFilter = GL_LINEAR;
+    GLint wrapS = GL_REPEAT;
+    GLint wrapT = GL_REPEAT;
+
+    bool operator==(const SamplerDesc& other) const
+    {
+        return minFilter == other.minFilter && magFilter == other.magFilter && wrapS == other.wrapS && wrapT == other.wrapT;
+    }
+};
+
+struct SamplerDescHash
+{
+    size_t operator()(const SamplerDesc& desc) const
+    {
+        size_t hash = std::hash<GLint>()(desc.minFilter);
+        hash = hash * 31 + std::hash<GLint>()(desc.magFilter);
+        hash = hash * 31 + std::hash<GLint>()(desc.wrapS);
+        return hash * 31 + std::hash<GLint>()(desc.wrapT);
+    }
+};
+
+// Owns one GL texture, deleted with the last handle
+struct GpuTexture
+{
+    GLuint id = 0;
+    size_t bytes = 0;
+
+    GpuTexture() = default;
+    GpuTexture(const GpuTexture&) = delete;
+    GpuTexture& operator=(const GpuTexture&) = delete;
+    ~GpuTexture()
+    {
+        if (id)
+        {
+            glDeleteTextures(1, &id);
+        }
+    }
+};
+
+struct GpuTextureCacheStats
+{
+    size_t requestedTextures = 0;
+    size_t uniqueTextures = 0;
+    size_t uniqueBytes = 0;
+    size_t savedBytes = 0;           // what one texture object per request would have uploaded on top
+    size_t requestedSamplers = 0;
+    size_t uniqueSamplers = 0;
+};
+
+// GPU residency of the textures of a model, keyed by Texture identity.
+//
+// Materials sharing a Texture from cModel::m_TextureCache get the same refcounted
+// GpuTexture, so every image is uploaded once however many primitives use it. Sampler
+// objects are shared the same way per distinct glTF sampler state. Streamed and
+// asynchronously uploaded textures are only counted: TextureStreamer and TextureUploader
+// own those, and the primitives read Texture::m_TextureID directly.
+class GpuTextureCache
+{
+public:
+    // nullptr for textures owned elsewhere or without data left to upload
+    std::shared_ptr<GpuTexture> acquire(const std::shared_ptr<Texture>& texture);
+    GLuint getSampler(const SamplerDesc& desc);
+    // The live handle of a texture uploaded by acquire, nullptr if there is none
+    std::shared_ptr<GpuTexture> find(const Texture* texture) const;
+    // Deletes every texture and sampler, outstanding handles are left with id 0
+    void destroy();
+
+    const GpuTextureCacheStats& getStats() const { return m_Stats; }
+    void printStats() const;
+
+    // Uploads texture synchronously on the current context, bytes receives its VRAM size
+    static GLuint createTexture(const Texture& texture, size_t& bytes);
+    static SamplerDesc getSamplerDesc(const cgltf_sampler* sampler);
+
+private:
+    std::unordered_map<const Texture*, std::weak_ptr<GpuTexture>> m_Textures;
+    std::unordered_set<const Texture*> m_ExternalTextures;
+    std::unordered_map<SamplerDesc, GLuint, SamplerDescHash> m_Samplers;
+    GpuTextureCacheStats m_Stats;
+};
@@ -0,0 +1,212 @@
+#include "pch.h"
+#include "headlessContext.h"
+#include <SDL_egl.h>
+#include <cstring>
+
+namespace
+{
+#ifdef _WIN32
+    const char* EGL_LIBRARY = "libEGL.dll";
+#else
+    const char* EGL_LIBRARY = "libEGL.so.1";
+#endif
+    const int GL_VERSIONS[][2] = { { 4, 6 }, { 4, 5 }, { 4, 3 } };
+
+    // Set once EGL is up, eglGetProcAddress returns core functions too under EGL 1.5 / Mesa
+    PFNEGLGETPROCADDRESSPROC eglGetProcAddressFunction = nullptr;
+
+    void* getEglProcAddress(const char* name)
+    {
+        return reinterpret_cast<void*>(eglGetProcAddressFunction(name));
+    }
+
+    void* getSdlProcAddress(const char* name)
+    {
+        return SDL_GL_GetProcAddress(name);
+    }
+
+    bool hasExtension(const char* extensions, const char* name)
+    {
+        if (!extensions)
+        {
+            return false;
+        }
+        size_t length = std::strlen(name);
+        for (const char* found = std::strstr(extensions, name); found; found = std::strstr(found + length, name))
+        {
+            bool startsWord = found == extensions || found[-1] == ' ';
+            bool endsWord = found[length] == ' ' || found[length] == '\0';
+            if (startsWord && endsWord)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+bool HeadlessContext::create()
+{
+    if (createEgl())
+    {
+        m_Backend = "egl-surfaceless";
+        return true;
+    }
+    if (createHiddenWindow())
+    {
+        m_Backend = "sdl-hidden-window";
+        return true;
+    }
+    return false;
+}
+
+bool HeadlessContext::createEgl()
+{
+    m_EglLibrary = SDL_LoadObject(EGL_LIBRARY);
+    if (!m_EglLibrary)
+    {
+        return false;
+    }
+    eglGetProcAddressFunction = reinterpret_cast<PFNEGLGETPROCADDRESSPROC>(SDL_LoadFunction(m_EglLibrary, "eglGetProcAddress"));
+    if (!eglGetProcAddressFunction)
+    {
+        destroy();
+        return false;
+    }
+    auto queryString = reinterpret_cast<PFNEGLQUERYSTRINGPROC>(getEglProcAddress("eglQueryString"));
+    auto getPlatformDisplay = reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(getEglProcAddress("eglGetPlatformDisplayEXT"));
+    auto initialize = reinterpret_cast<PFNEGLINITIALIZEPROC>(getEglProcAddress("eglInitialize"));
+    auto bindApi = reinterpret_cast<PFNEGLBINDAPIPROC>(getEglProcAddress("eglBindAPI"));
+    auto chooseConfig = reinterpret_cast<PFNEGLCHOOSECONFIGPROC>(getEglProcAddress("eglChooseConfig"));
+    auto createContext = reinterpret_cast<PFNEGLCREATECONTEXTPROC>(getEglProcAddress("eglCreateContext"));
+    auto makeCurrent = reinterpret_cast<PFNEGLMAKECURRENTPROC>(getEglProcAddress("eglMakeCurrent"));
+    if (!queryString || !getPlatformDisplay || !initialize || !bindApi || !chooseConfig || !createContext || !makeCurrent)
+    {
+        destroy();
+        return false;
+    }
+
+    // Client extensions come from EGL_NO_DISPLAY, display extensions after eglInitialize
+    if (!hasExtension(queryString(EGL_NO_DISPLAY, EGL_EXTENSIONS), "EGL_MESA_platform_surfaceless"))
+    {
+        std::cerr << "EGL has no EGL_MESA_platform_surfaceless" << std::endl;
+        destroy();
+        return false;
+    }
+    m_Display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+    EGLint major = 0;
+    EGLint minor = 0;
+    if (m_Display == EGL_NO_DISPLAY || !initialize(m_Display, &major, &minor))
+    {
+        std::cerr << "Failed to initialize the EGL surfaceless display" << std::endl;
+        m_Display = nullptr;
+        destroy();
+        return false;
+    }
+    if (!hasExtension(queryString(m_Display, EGL_EXTENSIONS), "EGL_KHR_surfaceless_context") || !bindApi(EGL_OPENGL_API))
+    {
+        std::cerr << "EGL display can't make a desktop GL context current without a surface" << std::endl;
+        destroy();
+        return false;
+    }
+
+    const EGLint configAttributes[] = { EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+    EGLConfig config = nullptr;
+    EGLint configCount = 0;
+    if (!chooseConfig(m_Display, configAttributes, &config, 1, &configCount) || configCount == 0)
+    {
+        std::cerr << "No EGL config renders desktop GL" << std::endl;
+        destroy();
+        return false;
+    }
+    for (const auto& version : GL_VERSIONS)
+    {
+        const EGLint contextAttributes[] = {
+            EGL_CONTEXT_MAJOR_VERSION, version[0],
+            EGL_CONTEXT_MINOR_VERSION, version[1],
+            EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+            EGL_NONE };
+        m_Context = createContext(m_Display, config, EGL_NO_CONTEXT, contextAttributes);
+        if (m_Context != EGL_NO_CONTEXT)
+        {
+            break;
+        }
+    }
+    if (!m_Context || !makeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, m_Context))
+    {
+        std::cerr << "Failed to create a GL 4.3+ core context on EGL" << std::endl;
+        destroy();
+        return false;
+    }
+    return true;
+}
+
+bool HeadlessContext::createHiddenWindow()
+{
+    if (SDL_InitSubSystem(SDL_INIT_VIDEO) < 0)
+    {
+        std::cerr << "Couldn't initialize SDL: " << SDL_GetError() << std::endl;
+        return false;
+    }
+    SDL_GL_SetAttribute(SDL_GL_CONTEXT_PROFILE_MASK, SDL_GL_CONTEXT_PROFILE_CORE);
+    for (const auto& version : GL_VERSIONS)
+    {
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MAJOR_VERSION, version[0]);
+        SDL_GL_SetAttribute(SDL_GL_CONTEXT_MINOR_VERSION, version[1]);
+        m_Window = SDL_CreateWindow("Cosmic Manor benchmark", SDL_WINDOWPOS_UNDEFINED, SDL_WINDOWPOS_UNDEFINED, 64, 64, SDL_WINDOW_OPENGL | SDL_WINDOW_HIDDEN);
+        if (!m_Window)
+        {
+            break;
+        }
+        m_GLContext = SDL_GL_CreateContext(m_Window);
+        if (m_GLContext)
+        {
+            SDL_GL_SetSwapInterval(0);
+            return true;
+        }
+        SDL_DestroyWindow(m_Window);
+        m_Window = nullptr;
+    }
+    std::cerr << "Failed to create a hidden GL window: " << SDL_GetError() << std::endl;
+    SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    return false;
+}
+
+HeadlessContext::ProcLoader HeadlessContext::getLoader() const
+{
+    return m_Context ? getEglProcAddress : getSdlProcAddress;
+}
+
+void HeadlessContext::destroy()
+{
+    if (m_EglLibrary)
+    {
+        if (m_Display && eglGetProcAddressFunction)
+        {
+            auto makeCurrent = reinterpret_cast<PFNEGLMAKECURRENTPROC>(getEglProcAddress("eglMakeCurrent"));
+            auto destroyContext = reinterpret_cast<PFNEGLDESTROYCONTEXTPROC>(getEglProcAddress("eglDestroyContext"));
+            auto terminate = reinterpret_cast<PFNEGLTERMINATEPROC>(getEglProcAddress("eglTerminate"));
+            if (m_Context)
+            {
+                makeCurrent(m_Display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+                destroyContext(m_Display, m_Context);
+            }
+            terminate(m_Display);
+        }
+        SDL_UnloadObject(m_EglLibrary);
+        eglGetProcAddressFunction = nullptr;
+    }
+    m_EglLibrary = nullptr;
+    m_Display = nullptr;
+    m_Context = nullptr;
+
+    if (m_Window)
+    {
+        SDL_GL_DeleteContext(m_GLContext);
+        SDL_DestroyWindow(m_Window);
+        SDL_QuitSubSystem(SDL_INIT_VIDEO);
+    }
+    m_Window = nullptr;
+    m_GLContext = nullptr;
+    m_Backend = "none";
+}
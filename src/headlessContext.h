@@ -0,0 +1,33 @@
+#pragma once
+#include <SDL.h>
+
+// A GL context without a visible window, for the offscreen benchmark. Everything is drawn into
+// framebuffer objects, so no default framebuffer is needed.
+//
+// EGL surfaceless (EGL_MESA_platform_surfaceless + EGL_KHR_surfaceless_context) is tried first.
+// Mesa provides it with every driver, llvmpipe included, so the benchmark runs on a machine
+// without a display or GPU. libEGL is loaded at runtime and is not a link dependency. Where it
+// is missing, as on most Windows installs, a hidden SDL window holds the context instead.
+class HeadlessContext
+{
+public:
+    // Tries GL 4.6 down to 4.3 core
+    bool create();
+    void destroy();
+
+    // For gladLoadGLLoader and ShaderCache
+    typedef void* (*ProcLoader)(const char* name);
+    ProcLoader getLoader() const;
+    const char* getBackend() const { return m_Backend; }
+
+private:
+    bool createEgl();
+    bool createHiddenWindow();
+
+    const char* m_Backend = "none";
+    void* m_EglLibrary = nullptr;
+    void* m_Display = nullptr;
+    void* m_Context = nullptr;
+    SDL_Window* m_Window = nullptr;
+    SDL_GLContext m_GLContext = nullptr;
+};
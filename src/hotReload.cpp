@@ -0,0 +1,341 @@
+#include "pch.h"
+#include "hotReload.h"
+#include "cModel.h"
+#include "textureUploader.h"
+#include "textureStreamer.h"
+#include "textureCooker.h"
+#include "assetManager.h"
+#include "profiler.h"
+#include <algorithm>
+
+HotReloader::HotReloader(ThreadPool& threadPool, TextureUploader& textureUploader, TextureStreamer& textureStreamer)
+    : m_ThreadPool(threadPool), m_TextureUploader(textureUploader), m_TextureStreamer(textureStreamer)
+{
+}
+
+void HotReloader::addShader(Shader& shader)
+{
+    for (const auto& path : shader.getSourcePaths())
+    {
+        m_Shaders[FileWatcher::normalizePath(path)].push_back(&shader);
+    }
+}
+
+void HotReloader::setModel(cModel& model, const std::string& path)
+{
+    m_Model = &model;
+    m_ModelPath = path;
+    m_Textures.clear();
+    m_ModelFiles.clear();
+
+    for (const auto& pair : model.m_TextureCache)
+    {
+        // Cooked textures are watched through their source, the .cooked.dds only changes when
+        // --cook writes it
+        const std::shared_ptr<Texture>& texture = pair.second;
+        const std::string& watchedPath = texture->m_SourcePath.empty() ? texture->m_path : texture->m_SourcePath;
+        if (!watchedPath.empty())
+        {
+            m_Textures[FileWatcher::normalizePath(watchedPath)] = texture;
+        }
+    }
+
+    // Images are reloaded on their own, everything else the model reads reloads the model
+    m_ModelFiles.insert(FileWatcher::normalizePath(path));
+    std::string directory = fs::path(path).parent_path().string();
+    for (const auto& dependency : AssetCatalogue::readGltfDependencies(path, directory))
+    {
+        std::string normalized = FileWatcher::normalizePath(dependency);
+        if (!m_Textures.count(normalized))
+        {
+            m_ModelFiles.insert(normalized);
+        }
+    }
+
+    // A change that came in while the previous reload waited to be swapped in
+    if (m_ModelChangedDuringLoad && !m_ModelLoad.valid())
+    {
+        m_ModelChangedDuringLoad = false;
+        reloadModel();
+    }
+}
+
+void HotReloader::update()
+{
+    PROFILE_SCOPE("Hot reload");
+    std::vector<std::shared_ptr<Texture>> deferred;
+    deferred.swap(m_Deferred);
+    for (const auto& texture : deferred)
+    {
+        reloadTexture(texture);
+    }
+
+    for (const std::string& path : m_Watcher.poll())
+    {
+        auto shaders = m_Shaders.find(path);
+        if (shaders != m_Shaders.end())
+        {
+            reloadShaders(shaders->second);
+        }
+        auto texture = m_Textures.find(path);
+        if (texture != m_Textures.end())
+        {
+            reloadTexture(texture->second);
+        }
+        if (m_ModelFiles.count(path))
+        {
+            reloadModel();
+        }
+    }
+
+    collectTextureReloads();
+
+    // Uploads are published by TextureUploader::update, the texture they replace can go then
+    auto published = std::partition(m_PendingPublishes.begin(), m_PendingPublishes.end(),
+        [](const PendingPublish& pending) { return pending.texture->m_TextureID == pending.previousID; });
+    for (auto it = published; it != m_PendingPublishes.end(); ++it)
+    {
+        if (it->ownsPrevious && it->previousID)
+        {
+            glDeleteTextures(1, &it->previousID);
+        }
+    }
+    m_PendingPublishes.erase(published, m_PendingPublishes.end());
+
+    if (m_ModelLoad.valid() && m_ModelLoad.wait_for(std::chrono::seconds(0)) == std::future_status::ready)
+    {
+        std::unique_ptr<cModel> model = m_ModelLoad.get();
+        if (model && !model->meshes.empty())
+        {
+            m_ReloadedModel = std::move(model);
+            ++m_Stats.modelReloads;
+        }
+        else
+        {
+            std::cerr << "Reloading " << m_ModelPath << " failed, keeping the current model" << std::endl;
+            ++m_Stats.failedReloads;
+        }
+        // The next load is built against the live model, so it waits until this one is swapped in
+        if (m_ModelChangedDuringLoad && !m_ReloadedModel)
+        {
+            m_ModelChangedDuringLoad = false;
+            reloadModel();
+        }
+    }
+}
+
+std::unique_ptr<cModel> HotReloader::takeReloadedModel()
+{
+    return std::move(m_ReloadedModel);
+}
+
+void HotReloader::destroy()
+{
+    m_Watcher.stop();
+    for (auto& reload : m_TextureReloads)
+    {
+        reload.decode.wait();
+    }
+    m_TextureReloads.clear();
+    m_PendingPublishes.clear();
+    m_Deferred.clear();
+    if (m_ModelLoad.valid())
+    {
+        m_ModelLoad.wait();
+    }
+    m_ModelLoad = {};
+    m_ReloadedModel.reset();
+}
+
+void HotReloader::reloadShaders(const std::vector<Shader*>& shaders)
+{
+    PROFILE_SCOPE("Reload shaders");
+    for (Shader* shader : shaders)
+    {
+        if (shader->reload())
+        {
+            ++m_Stats.shaderReloads;
+            if (m_OnShaderReloaded)
+            {
+                m_OnShaderReloaded(*shader);
+            }
+        }
+        else
+        {
+            ++m_Stats.failedReloads;
+        }
+    }
+    std::cout << "Reloaded " << shaders.size() << " shader program(s)" << std::endl;
+}
+
+bool HotReloader::isBusy(const Texture* texture) const
+{
+    for (const auto& reload : m_TextureReloads)
+    {
+        if (reload.texture.get() == texture)
+        {
+            return true;
+        }
+    }
+    for (const auto& pending : m_PendingPublishes)
+    {
+        if (pending.texture.get() == texture)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+void HotReloader::reloadTexture(const std::shared_ptr<Texture>& texture)
+{
+    if (texture->m_Virtual)
+    {
+        std::cout << texture->m_path << " is virtual, reloading the model to rebuild its pages" << std::endl;
+        reloadModel();
+        return;
+    }
+    // A model load in flight reads the live textures' paths on a worker, they change once it is done
+    if (isBusy(texture.get()) || m_ModelLoad.valid())
+    {
+        if (std::find(m_Deferred.begin(), m_Deferred.end(), texture) == m_Deferred.end())
+        {
+            m_Deferred.push_back(texture);
+        }
+        return;
+    }
+    // The cooked copy is out of date now, decode the edited source instead. The next --cook
+    // run or model reload with cooking on writes a new one.
+    if (!texture->m_SourcePath.empty())
+    {
+        texture->m_path = texture->m_SourcePath;
+        texture->m_SourcePath.clear();
+        texture->m_isDDS = false;
+        texture->m_isMapped = false;
+    }
+    if (texture->m_Streamed)
+    {
+        m_TextureStreamer.invalidate(texture.get());
+        ++m_Stats.textureReloads;
+        return;
+    }
+    if (texture->m_isMapped)
+    {
+        publishTexture(texture);
+        return;
+    }
+
+    std::string path = texture->m_path;
+    TextureReload reload;
+    reload.texture = texture;
+    reload.decode = m_ThreadPool.submit([path]
+        {
+            DecodedImage image;
+            image.success = ImageCodecs::get().decodeFile(path, 0, image.pixels, image.info);
+            return image;
+        });
+    m_TextureReloads.push_back(std::move(reload));
+}
+
+void HotReloader::collectTextureReloads()
+{
+    for (auto it = m_TextureReloads.begin(); it != m_TextureReloads.end();)
+    {
+        if (it->decode.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+        std::shared_ptr<Texture> texture = it->texture;
+        DecodedImage image = it->decode.get();
+        it = m_TextureReloads.erase(it);
+        if (!image.success)
+        {
+            // Usually caught halfway through a save, the next write reports the file again
+            std::cerr << "Failed to decode changed texture: " << texture->m_path << std::endl;
+            ++m_Stats.failedReloads;
+            continue;
+        }
+        texture->m_data = std::move(image.pixels);
+        texture->setStandardFormat(image.info);
+        publishTexture(texture);
+    }
+}
+
+void HotReloader::publishTexture(const std::shared_ptr<Texture>& texture)
+{
+    // What the primitives draw with now: textures loaded synchronously belong to the model's
+    // GpuTextureCache, later ones to the uploader or to an earlier reload
+    bool ownsPrevious = texture->m_AsyncUpload;
+    GLuint previousID = texture->m_TextureID;
+    if (!ownsPrevious && m_Model)
+    {
+        std::shared_ptr<GpuTexture> handle = m_Model->m_GpuTextures.find(texture.get());
+        previousID = handle ? handle->id : 0;
+    }
+    texture->m_TextureID = previousID;
+
+    if (!texture->m_isMapped && m_TextureUploader.queue(texture))
+    {
+        m_PendingPublishes.push_back({ texture, previousID, ownsPrevious });
+        ++m_Stats.textureReloads;
+        return;
+    }
+
+    // Block compressed files and textures without the upload ring are uploaded right here
+    size_t bytes;
+    GLuint textureID = GpuTextureCache::createTexture(*texture, bytes);
+    texture->clearData();
+    if (textureID == 0)
+    {
+        ++m_Stats.failedReloads;
+        return;
+    }
+    if (ownsPrevious && previousID)
+    {
+        glDeleteTextures(1, &previousID);
+    }
+    // From now on the primitives read m_TextureID instead of their material's handle
+    texture->m_TextureID = textureID;
+    texture->m_AsyncUpload = true;
+    ++m_Stats.textureReloads;
+}
+
+void HotReloader::reloadModel()
+{
+    if (m_ModelPath.empty())
+    {
+        return;
+    }
+    if (m_ModelLoad.valid() || m_ReloadedModel)
+    {
+        m_ModelChangedDuringLoad = true;
+        return;
+    }
+    std::cout << "Reloading " << m_ModelPath << std::endl;
+    // cModel's constructor only parses and decodes, the GL work happens when it is swapped in.
+    // Primitives and textures whose glTF data did not change are copied from the live model,
+    // which stays untouched until the new one is swapped in with cModel::adoptFrom.
+    std::string path = m_ModelPath;
+    const cModel* previous = m_Model;
+    bool streamTextures = m_Model ? m_Model->m_StreamTextures : false;
+    bool cookTextures = m_Model ? m_Model->m_CookTextures : false;
+    bool useCookedTextures = m_Model ? m_Model->m_UseCookedTextures : true;
+    m_ModelLoad = m_ThreadPool.submit([path, previous, streamTextures, cookTextures, useCookedTextures]
+        {
+            std::unique_ptr<cModel> model = std::make_unique<cModel>(path.c_str(), streamTextures, cookTextures, previous, useCookedTextures);
+            // Edited sources are decoded for this session and cooked for the next one. This
+            // already runs on a pool worker, so the jobs go one after another instead of
+            // through TextureCooker::cookAll.
+            for (const CookJob& job : model->m_CookJobs)
+            {
+                TextureCooker::cook(job);
+            }
+            if (!model->m_CookJobs.empty())
+            {
+                std::cout << "Cooked " << model->m_CookJobs.size() << " changed texture(s)" << std::endl;
+            }
+            model->m_CookJobs.clear();
+            return model;
+        });
+}
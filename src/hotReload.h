@@ -0,0 +1,108 @@
+#pragma once
+#include <functional>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "fileWatcher.h"
+#include "threadPool.h"
+#include "shader.h"
+#include "texture.h"
+#include "imageCodec.h"
+
+class cModel;
+class TextureUploader;
+class TextureStreamer;
+
+struct HotReloadStats
+{
+    size_t shaderReloads = 0;
+    size_t textureReloads = 0;
+    size_t modelReloads = 0;
+    size_t failedReloads = 0;
+};
+
+// Reloads shaders, textures and the model when FileWatcher reports their files changed.
+//
+// update() runs once per frame on the GL thread and hands each file to whoever owns it:
+// - Shader sources recompile every program built from them. A program that fails to
+//   build is dropped and the old one keeps running.
+// - PNG/JPG textures are decoded on the thread pool and uploaded through TextureUploader.
+//   Primitives keep drawing the old texture until the new one has landed.
+// - DDS/KTX textures are uploaded from the mapped file, as at load time. Cooked textures
+//   are watched through their PNG/JPG source and decoded from it once it changes.
+// - Streamed textures go back to TextureStreamer, which streams them again from the tail.
+// - The .gltf/.glb and its buffers load a new cModel on the thread pool, built against the
+//   live one so unchanged primitives and textures are kept. The caller swaps it in with
+//   cModel::adoptFrom() after takeReloadedModel(). Virtual textures take this path as well,
+//   because their page file has to be rebuilt.
+class HotReloader
+{
+public:
+    HotReloader(ThreadPool& threadPool, TextureUploader& textureUploader, TextureStreamer& textureStreamer);
+
+    bool watch(const std::string& directory) { return m_Watcher.watch(directory); }
+    void addShader(Shader& shader);
+    // Indexes the files of the model, call again after swapping in a reloaded one
+    void setModel(cModel& model, const std::string& path);
+    void update();
+    // The model that finished loading in the background, nullptr until there is one
+    std::unique_ptr<cModel> takeReloadedModel();
+    // Stops watching and waits for background work
+    void destroy();
+
+    const HotReloadStats& getStats() const { return m_Stats; }
+
+    // Restores uniforms that are only set once, programs come back with defaults after a rebuild
+    std::function<void(Shader&)> m_OnShaderReloaded;
+
+private:
+    struct DecodedImage
+    {
+        bool success = false;
+        std::vector<unsigned char> pixels;
+        ImageInfo info;
+    };
+
+    struct TextureReload
+    {
+        std::shared_ptr<Texture> texture;
+        std::future<DecodedImage> decode;
+    };
+
+    // Queued in TextureUploader, the old GL texture goes once the new one is published
+    struct PendingPublish
+    {
+        std::shared_ptr<Texture> texture;
+        GLuint previousID = 0;
+        bool ownsPrevious = false;
+    };
+
+    void reloadShaders(const std::vector<Shader*>& shaders);
+    void reloadTexture(const std::shared_ptr<Texture>& texture);
+    void reloadModel();
+    void collectTextureReloads();
+    void publishTexture(const std::shared_ptr<Texture>& texture);
+    bool isBusy(const Texture* texture) const;
+
+    ThreadPool& m_ThreadPool;
+    TextureUploader& m_TextureUploader;
+    TextureStreamer& m_TextureStreamer;
+    FileWatcher m_Watcher;
+
+    std::unordered_map<std::string, std::vector<Shader*>> m_Shaders;    // normalized source path -> programs
+    cModel* m_Model = nullptr;
+    std::string m_ModelPath;
+    std::unordered_map<std::string, std::shared_ptr<Texture>> m_Textures;
+    std::unordered_set<std::string> m_ModelFiles;
+
+    std::vector<TextureReload> m_TextureReloads;
+    std::vector<PendingPublish> m_PendingPublishes;
+    std::vector<std::shared_ptr<Texture>> m_Deferred;    // changed again while a reload was in flight
+    std::future<std::unique_ptr<cModel>> m_ModelLoad;
+    bool m_ModelChangedDuringLoad = false;
+    std::unique_ptr<cModel> m_ReloadedModel;
+    HotReloadStats m_Stats;
+};
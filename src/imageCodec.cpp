@@ -0,0 +1,327 @@
+#include "pch.h"
+#include "imageCodec.h"
+#include "mappedFile.h"
+#include <cstring>
+
+#ifdef COSMIC_USE_TURBOJPEG
+#include <turbojpeg.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "turbojpeg.lib")
+#endif
+#endif
+
+#ifdef COSMIC_USE_SPNG
+#include <spng.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "spng.lib")
+#endif
+#endif
+
+#ifdef COSMIC_USE_WEBP
+#include <webp/decode.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "libwebp.lib")
+#endif
+#endif
+
+namespace
+{
+#ifdef COSMIC_USE_TURBOJPEG
+    class TurboJpegCodec : public ImageCodec
+    {
+    public:
+        const char* getName() const override { return "libjpeg-turbo"; }
+
+        bool canDecode(const unsigned char* data, size_t size) const override
+        {
+            return size >= 3 && data[0] == 0xFF && data[1] == 0xD8 && data[2] == 0xFF;
+        }
+
+        bool readInfo(const unsigned char* data, size_t size, ImageInfo& info) const override
+        {
+            int subsampling, colorspace;
+            if (tjDecompressHeader3(getHandle(), data, static_cast<unsigned long>(size), &info.width, &info.height, &subsampling, &colorspace) != 0)
+            {
+                return false;
+            }
+            info.channels = colorspace == TJCS_GRAY ? 1 : 3;
+            return true;
+        }
+
+        bool decodeInto(const unsigned char* data, size_t size, int channels, unsigned char* destination) const override
+        {
+            int pixelFormat = channels == 1 ? TJPF_GRAY : (channels == 3 ? TJPF_RGB : (channels == 4 ? TJPF_RGBA : -1));
+            ImageInfo info;
+            if (pixelFormat < 0 || !readInfo(data, size, info))
+            {
+                return false;
+            }
+            return tjDecompress2(getHandle(), data, static_cast<unsigned long>(size), destination, info.width, 0, info.height, pixelFormat, 0) == 0;
+        }
+
+    private:
+        // Decompressors aren't thread safe, texture streaming decodes on the worker threads
+        static tjhandle getHandle()
+        {
+            struct Handle
+            {
+                tjhandle handle = tjInitDecompress();
+                ~Handle() { tjDestroy(handle); }
+            };
+            thread_local Handle handle;
+            return handle.handle;
+        }
+    };
+#endif
+
+#ifdef COSMIC_USE_SPNG
+    class SpngCodec : public ImageCodec
+    {
+    public:
+        const char* getName() const override { return "libspng"; }
+
+        bool canDecode(const unsigned char* data, size_t size) const override
+        {
+            const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+            return size >= sizeof(signature) && std::memcmp(data, signature, sizeof(signature)) == 0;
+        }
+
+        bool readInfo(const unsigned char* data, size_t size, ImageInfo& info) const override
+        {
+            Context context(data, size);
+            spng_ihdr header;
+            if (context.ctx == nullptr || spng_get_ihdr(context.ctx, &header) != 0)
+            {
+                return false;
+            }
+            info.width = static_cast<int>(header.width);
+            info.height = static_cast<int>(header.height);
+            info.channels = getChannels(context.ctx, header);
+            return true;
+        }
+
+        bool decodeInto(const unsigned char* data, size_t size, int channels, unsigned char* destination) const override
+        {
+            Context context(data, size);
+            spng_ihdr header;
+            if (context.ctx == nullptr || spng_get_ihdr(context.ctx, &header) != 0)
+            {
+                return false;
+            }
+
+            // Same channel layouts stb_image produces, anything else goes to stb
+            bool isGray = header.color_type == SPNG_COLOR_TYPE_GRAYSCALE || header.color_type == SPNG_COLOR_TYPE_GRAYSCALE_ALPHA;
+            int format;
+            int flags = 0;
+            switch (channels)
+            {
+            case 4: format = SPNG_FMT_RGBA8; flags = SPNG_DECODE_TRNS; break;
+            case 3: format = SPNG_FMT_RGB8; break;
+            case 2: format = SPNG_FMT_GA8; flags = SPNG_DECODE_TRNS; break;
+            case 1: format = SPNG_FMT_G8; break;
+            default: return false;
+            }
+            if (channels <= 2 && (!isGray || header.bit_depth > 8))
+            {
+                return false;
+            }
+
+            size_t imageSize;
+            if (spng_decoded_image_size(context.ctx, format, &imageSize) != 0 || imageSize != static_cast<size_t>(header.width) * header.height * channels)
+            {
+                return false;
+            }
+            return spng_decode_image(context.ctx, destination, imageSize, format, flags) == 0;
+        }
+
+    private:
+        struct Context
+        {
+            spng_ctx* ctx;
+
+            Context(const unsigned char* data, size_t size)
+                : ctx(spng_ctx_new(0))
+            {
+                if (ctx && spng_set_png_buffer(ctx, data, size) != 0)
+                {
+                    spng_ctx_free(ctx);
+                    ctx = nullptr;
+                }
+            }
+            ~Context()
+            {
+                spng_ctx_free(ctx);
+            }
+        };
+
+        static int getChannels(spng_ctx* ctx, const spng_ihdr& header)
+        {
+            spng_trns transparency;
+            bool hasTransparency = spng_get_trns(ctx, &transparency) == 0;
+            switch (header.color_type)
+            {
+            case SPNG_COLOR_TYPE_GRAYSCALE: return hasTransparency ? 2 : 1;
+            case SPNG_COLOR_TYPE_GRAYSCALE_ALPHA: return 2;
+            case SPNG_COLOR_TYPE_TRUECOLOR_ALPHA: return 4;
+            default: return hasTransparency ? 4 : 3;
+            }
+        }
+    };
+#endif
+
+#ifdef COSMIC_USE_WEBP
+    class WebPCodec : public ImageCodec
+    {
+    public:
+        const char* getName() const override { return "WebP"; }
+
+        bool canDecode(const unsigned char* data, size_t size) const override
+        {
+            return size >= 12 && std::memcmp(data, "RIFF", 4) == 0 && std::memcmp(data + 8, "WEBP", 4) == 0;
+        }
+
+        bool readInfo(const unsigned char* data, size_t size, ImageInfo& info) const override
+        {
+            WebPBitstreamFeatures features;
+            if (WebPGetFeatures(data, size, &features) != VP8_STATUS_OK)
+            {
+                return false;
+            }
+            info.width = features.width;
+            info.height = features.height;
+            info.channels = features.has_alpha ? 4 : 3;
+            return true;
+        }
+
+        bool decodeInto(const unsigned char* data, size_t size, int channels, unsigned char* destination) const override
+        {
+            ImageInfo info;
+            if ((channels != 3 && channels != 4) || !readInfo(data, size, info))
+            {
+                return false;
+            }
+            size_t stride = static_cast<size_t>(info.width) * channels;
+            size_t imageSize = stride * info.height;
+            if (channels == 4)
+            {
+                return WebPDecodeRGBAInto(data, size, destination, imageSize, static_cast<int>(stride)) != nullptr;
+            }
+            return WebPDecodeRGBInto(data, size, destination, imageSize, static_cast<int>(stride)) != nullptr;
+        }
+    };
+#endif
+
+    class StbCodec : public ImageCodec
+    {
+    public:
+        const char* getName() const override { return "stb_image"; }
+
+        bool canDecode(const unsigned char* data, size_t size) const override
+        {
+            int width, height, channels;
+            return stbi_info_from_memory(data, static_cast<int>(size), &width, &height, &channels) != 0;
+        }
+
+        bool readInfo(const unsigned char* data, size_t size, ImageInfo& info) const override
+        {
+            return stbi_info_from_memory(data, static_cast<int>(size), &info.width, &info.height, &info.channels) != 0;
+        }
+
+        bool decodeInto(const unsigned char* data, size_t size, int channels, unsigned char* destination) const override
+        {
+            int width, height, fileChannels;
+            unsigned char* pixels = stbi_load_from_memory(data, static_cast<int>(size), &width, &height, &fileChannels, channels);
+            if (pixels == nullptr)
+            {
+                return false;
+            }
+            std::memcpy(destination, pixels, static_cast<size_t>(width) * height * channels);
+            stbi_image_free(pixels);
+            return true;
+        }
+    };
+}
+
+ImageCodecs::ImageCodecs()
+{
+#ifdef COSMIC_USE_TURBOJPEG
+    m_Codecs.push_back(std::make_unique<TurboJpegCodec>());
+#endif
+#ifdef COSMIC_USE_SPNG
+    m_Codecs.push_back(std::make_unique<SpngCodec>());
+#endif
+#ifdef COSMIC_USE_WEBP
+    m_Codecs.push_back(std::make_unique<WebPCodec>());
+#endif
+    m_Codecs.push_back(std::make_unique<StbCodec>());
+}
+
+ImageCodecs& ImageCodecs::get()
+{
+    static ImageCodecs codecs;
+    return codecs;
+}
+
+void ImageCodecs::add(std::unique_ptr<ImageCodec> codec)
+{
+    m_Codecs.insert(m_Codecs.end() - 1, std::move(codec));
+}
+
+const ImageCodec* ImageCodecs::find(const char* name) const
+{
+    for (const auto& codec : m_Codecs)
+    {
+        if (std::strcmp(codec->getName(), name) == 0)
+        {
+            return codec.get();
+        }
+    }
+    return nullptr;
+}
+
+const ImageCodec* ImageCodecs::decode(const unsigned char* data, size_t size, int desiredChannels, std::vector<unsigned char>& pixels, ImageInfo& info) const
+{
+    for (const auto& codec : m_Codecs)
+    {
+        if (!codec->canDecode(data, size) || !codec->readInfo(data, size, info))
+        {
+            continue;
+        }
+        int channels = desiredChannels > 0 ? desiredChannels : info.channels;
+        pixels.resize(static_cast<size_t>(info.width) * info.height * channels);
+        if (codec->decodeInto(data, size, channels, pixels.data()))
+        {
+            return codec.get();
+        }
+    }
+    pixels.clear();
+    return nullptr;
+}
+
+const ImageCodec* ImageCodecs::decodeFile(const std::string& path, int desiredChannels, std::vector<unsigned char>& pixels, ImageInfo& info) const
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        return nullptr;
+    }
+    return decode(file.data(), file.size(), desiredChannels, pixels, info);
+}
+
+bool ImageCodecs::readInfo(const unsigned char* data, size_t size, ImageInfo& info) const
+{
+    for (const auto& codec : m_Codecs)
+    {
+        if (codec->canDecode(data, size) && codec->readInfo(data, size, info))
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool ImageCodecs::readFileInfo(const std::string& path, ImageInfo& info) const
+{
+    MappedFile file(path);
+    return file.isOpen() && readInfo(file.data(), file.size(), info);
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+struct ImageInfo
+{
+    int width = 0;
+    int height = 0;
+    int channels = 0;   // as stored in the file, what a decode with 0 desired channels produces
+};
+
+// One image format decoder. Decoders write tightly packed 8-bit pixels straight into memory
+// the caller sized from readInfo(), so the result can be uploaded without another copy.
+class ImageCodec
+{
+public:
+    virtual ~ImageCodec() = default;
+
+    virtual const char* getName() const = 0;
+    // Checks the file signature only
+    virtual bool canDecode(const unsigned char* data, size_t size) const = 0;
+    virtual bool readInfo(const unsigned char* data, size_t size, ImageInfo& info) const = 0;
+    // destination holds width * height * channels bytes. Returns false if the codec can't
+    // produce that channel count, the registry then tries the next codec.
+    virtual bool decodeInto(const unsigned char* data, size_t size, int channels, unsigned char* destination) const = 0;
+};
+
+// Dispatches PNG/JPEG/WebP data to the fastest decoder compiled in, by file signature.
+//
+// libjpeg-turbo, libspng and libwebp are optional: define COSMIC_USE_TURBOJPEG,
+// COSMIC_USE_SPNG and COSMIC_USE_WEBP and put the libraries on the include and link paths.
+// stb_image is always registered last and takes whatever the others refuse. It is the only
+// codec that decodes into its own allocation and needs a copy.
+class ImageCodecs
+{
+public:
+    static ImageCodecs& get();
+
+    // Registered ahead of the stb fallback
+    void add(std::unique_ptr<ImageCodec> codec);
+    const ImageCodec* find(const char* name) const;
+    const std::vector<std::unique_ptr<ImageCodec>>& getCodecs() const { return m_Codecs; }
+
+    // pixels get desiredChannels per pixel, or info.channels if it is 0. info always describes
+    // the file. Returns the codec that decoded the image, nullptr if none could.
+    const ImageCodec* decode(const unsigned char* data, size_t size, int desiredChannels, std::vector<unsigned char>& pixels, ImageInfo& info) const;
+    const ImageCodec* decodeFile(const std::string& path, int desiredChannels, std::vector<unsigned char>& pixels, ImageInfo& info) const;
+    bool readInfo(const unsigned char* data, size_t size, ImageInfo& info) const;
+    bool readFileInfo(const std::string& path, ImageInfo& info) const;
+
+private:
+    ImageCodecs();
+
+    std::vector<std::unique_ptr<ImageCodec>> m_Codecs;
+};
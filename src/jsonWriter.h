@@ -0,0 +1,140 @@
+#pragma once
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <ostream>
+#include <string>
+#include <vector>
+
+// Streams indented JSON, tracking the commas. Keys are only valid directly inside an object.
+//   JsonWriter json(file);
+//   json.beginObject();
+//   json.field("frames", 600);
+//   json.key("cpuMs"); json.beginArray(); json.value(1.5); json.endArray();
+//   json.endObject();
+class JsonWriter
+{
+public:
+    explicit JsonWriter(std::ostream& out) : m_Out(out) {}
+
+    void beginObject() { open('{'); }
+    void endObject() { close('}'); }
+    void beginArray() { open('['); }
+    void endArray() { close(']'); }
+
+    void key(const std::string& name)
+    {
+        separate();
+        writeString(name);
+        m_Out << ": ";
+        m_AfterKey = true;
+    }
+
+    void value(const std::string& text) { separate(); writeString(text); }
+    void value(const char* text) { separate(); writeString(text); }
+    void value(bool flag) { separate(); m_Out << (flag ? "true" : "false"); }
+    void value(int number) { separate(); m_Out << number; }
+    void value(uint32_t number) { separate(); m_Out << number; }
+    void value(int64_t number) { separate(); m_Out << number; }
+    void value(uint64_t number) { separate(); m_Out << number; }
+    void value(double number)
+    {
+        separate();
+        if (!std::isfinite(number))
+        {
+            m_Out << "null";
+            return;
+        }
+        char text[32];
+        snprintf(text, sizeof(text), "%.6g", number);
+        m_Out << text;
+    }
+    void value(float number) { value(static_cast<double>(number)); }
+
+    template<typename T>
+    void field(const std::string& name, const T& fieldValue)
+    {
+        key(name);
+        value(fieldValue);
+    }
+
+private:
+    void open(char bracket)
+    {
+        separate();
+        m_Out << bracket;
+        m_First.push_back(true);
+    }
+
+    void close(char bracket)
+    {
+        bool empty = m_First.back();
+        m_First.pop_back();
+        if (!empty)
+        {
+            newLine();
+        }
+        m_Out << bracket;
+        if (m_First.empty())
+        {
+            m_Out << '\n';
+        }
+    }
+
+    // Comma and indentation before a value, nothing between a key and its value
+    void separate()
+    {
+        if (m_AfterKey)
+        {
+            m_AfterKey = false;
+            return;
+        }
+        if (m_First.empty())
+        {
+            return;
+        }
+        if (!m_First.back())
+        {
+            m_Out << ',';
+        }
+        m_First.back() = false;
+        newLine();
+    }
+
+    void newLine()
+    {
+        m_Out << '\n' << std::string(m_First.size() * 2, ' ');
+    }
+
+    void writeString(const std::string& text)
+    {
+        m_Out << '"';
+        for (char c : text)
+        {
+            switch (c)
+            {
+            case '"': m_Out << "\\\""; break;
+            case '\\': m_Out << "\\\\"; break;
+            case '\n': m_Out << "\\n"; break;
+            case '\r': m_Out << "\\r"; break;
+            case '\t': m_Out << "\\t"; break;
+            default:
+                if (static_cast<unsigned char>(c) < 0x20)
+                {
+                    char escaped[8];
+                    snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                    m_Out << escaped;
+                }
+                else
+                {
+                    m_Out << c;
+                }
+            }
+        }
+        m_Out << '"';
+    }
+
+    std::ostream& m_Out;
+    std::vector<bool> m_First;  // per open container, nothing written into it yet
+    bool m_AfterKey = false;
+};
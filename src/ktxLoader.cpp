@@ -0,0 +1,281 @@
+#include "pch.h"
+#include "ktxLoader.h"
+#include "mappedFile.h"
+#include <gli/format.hpp>
+#include <gli/gl.hpp>
+#include <cstring>
+#include <cctype>
+#include <cmath>
+#include <algorithm>
+
+namespace
+{
+    const unsigned char KTX1_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+    const unsigned char KTX2_IDENTIFIER[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x32, 0x30, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+
+    // Highest VkFormat that shares its value with gli::format (VK_FORMAT_ASTC_12x12_SRGB_BLOCK)
+    const uint32_t MAX_VK_FORMAT = 184;
+
+    struct KTX1Header
+    {
+        uint32_t endianness;
+        uint32_t glType;
+        uint32_t glTypeSize;
+        uint32_t glFormat;
+        uint32_t glInternalFormat;
+        uint32_t glBaseInternalFormat;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t numberOfArrayElements;
+        uint32_t numberOfFaces;
+        uint32_t numberOfMipmapLevels;
+        uint32_t bytesOfKeyValueData;
+    };
+
+#pragma pack(push, 1)
+    struct KTX2Header
+    {
+        uint32_t vkFormat;
+        uint32_t typeSize;
+        uint32_t pixelWidth;
+        uint32_t pixelHeight;
+        uint32_t pixelDepth;
+        uint32_t layerCount;
+        uint32_t faceCount;
+        uint32_t levelCount;
+        uint32_t supercompressionScheme;
+        uint32_t dfdByteOffset;
+        uint32_t dfdByteLength;
+        uint32_t kvdByteOffset;
+        uint32_t kvdByteLength;
+        uint64_t sgdByteOffset;
+        uint64_t sgdByteLength;
+    };
+
+    struct KTX2LevelIndex
+    {
+        uint64_t byteOffset;
+        uint64_t byteLength;
+        uint64_t uncompressedByteLength;
+    };
+#pragma pack(pop)
+
+    size_t alignTo4(size_t value)
+    {
+        return (value + 3) & ~size_t(3);
+    }
+
+    void setupTarget(TextureUploadInfo& info, uint32_t width, uint32_t height, uint32_t depth, uint32_t layers, uint32_t faces, uint32_t levels)
+    {
+        if (height == 0)
+        {
+            throw std::runtime_error("1D textures are not supported");
+        }
+        if (faces != 1 && faces != 6)
+        {
+            throw std::runtime_error("Invalid face count");
+        }
+
+        info.width = width;
+        info.height = height;
+        info.depth = 1;
+        if (faces == 6)
+        {
+            info.target = layers > 0 ? GL_TEXTURE_CUBE_MAP_ARRAY : GL_TEXTURE_CUBE_MAP;
+            info.depth = layers > 0 ? layers * 6 : 1;
+        }
+        else if (layers > 0)
+        {
+            info.target = GL_TEXTURE_2D_ARRAY;
+            info.depth = layers;
+        }
+        else if (depth > 0)
+        {
+            info.target = GL_TEXTURE_3D;
+            info.depth = depth;
+        }
+        else
+        {
+            info.target = GL_TEXTURE_2D;
+        }
+
+        // A level count of 0 asks the loader to generate the chain
+        info.levels = levels > 0 ? levels : static_cast<GLsizei>(std::floor(std::log2(std::max({ width, height, info.target == GL_TEXTURE_3D ? depth : 1u })))) + 1;
+    }
+}
+
+bool KTXLoader::isKTX(const std::string& path)
+{
+    size_t dot = path.find_last_of('.');
+    if (dot == std::string::npos)
+    {
+        return false;
+    }
+    std::string extension = path.substr(dot + 1);
+    std::transform(extension.begin(), extension.end(), extension.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+    return extension == "ktx" || extension == "ktx2";
+}
+
+GLuint KTXLoader::load(const std::string& path, TextureUploadInfo* info)
+{
+    MappedFile file(path);
+    if (!file.isOpen())
+    {
+        throw std::runtime_error("Failed to open KTX file: " + path);
+    }
+
+    TextureUploadInfo uploadInfo;
+    GLuint texture = 0;
+    if (file.size() >= sizeof(KTX1_IDENTIFIER) && std::memcmp(file.data(), KTX1_IDENTIFIER, sizeof(KTX1_IDENTIFIER)) == 0)
+    {
+        texture = loadKTX1(file.data(), file.size(), uploadInfo);
+    }
+    else if (file.size() >= sizeof(KTX2_IDENTIFIER) && std::memcmp(file.data(), KTX2_IDENTIFIER, sizeof(KTX2_IDENTIFIER)) == 0)
+    {
+        texture = loadKTX2(file.data(), file.size(), uploadInfo);
+    }
+    else
+    {
+        throw std::runtime_error("Not a KTX file: " + path);
+    }
+
+    if (info)
+    {
+        *info = uploadInfo;
+    }
+    return texture;
+}
+
+GLuint KTXLoader::loadKTX1(const unsigned char* data, size_t size, TextureUploadInfo& info)
+{
+    if (size < sizeof(KTX1_IDENTIFIER) + sizeof(KTX1Header))
+    {
+        throw std::runtime_error("Truncated KTX header");
+    }
+    KTX1Header header;
+    std::memcpy(&header, data + sizeof(KTX1_IDENTIFIER), sizeof(KTX1Header));
+    if (header.endianness != 0x04030201)
+    {
+        throw std::runtime_error("Big-endian KTX files are not supported");
+    }
+
+    gli::gl GL(gli::gl::PROFILE_KTX);
+    gli::format format = GL.find(static_cast<gli::gl::internal_format>(header.glInternalFormat),
+                                 static_cast<gli::gl::external_format>(header.glFormat),
+                                 static_cast<gli::gl::type_format>(header.glType));
+    if (format == gli::FORMAT_UNDEFINED)
+    {
+        throw std::runtime_error("Unsupported KTX internal format " + std::to_string(header.glInternalFormat));
+    }
+
+    info.internalFormat = header.glInternalFormat;
+    info.compressed = gli::is_compressed(format);
+    setupTarget(info, header.pixelWidth, header.pixelHeight, header.pixelDepth, header.numberOfArrayElements, header.numberOfFaces, header.numberOfMipmapLevels);
+    uint32_t storedLevels = std::max(1u, header.numberOfMipmapLevels);
+
+    GLuint texture = TextureUpload::createStorage(info);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4); // KTX1 rows are padded to 4 bytes
+
+    size_t offset = sizeof(KTX1_IDENTIFIER) + sizeof(KTX1Header) + header.bytesOfKeyValueData;
+    for (uint32_t level = 0; level < storedLevels; ++level)
+    {
+        if (offset + sizeof(uint32_t) > size)
+        {
+            glDeleteTextures(1, &texture);
+            throw std::runtime_error("Truncated KTX level");
+        }
+        uint32_t imageSize;
+        std::memcpy(&imageSize, data + offset, sizeof(uint32_t));
+        offset += sizeof(uint32_t);
+
+        // imageSize is per face for non-array cubemaps, for the whole level otherwise
+        int images = info.target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+        for (int image = 0; image < images; ++image)
+        {
+            if (offset + imageSize > size)
+            {
+                glDeleteTextures(1, &texture);
+                throw std::runtime_error("Truncated KTX image data");
+            }
+            TextureUpload::uploadImage(info, header.glFormat, header.glType, level, image, info.depth, data + offset, imageSize);
+            info.bytes += imageSize;
+            offset += alignTo4(imageSize);
+        }
+    }
+
+    if (header.numberOfMipmapLevels == 0 && !info.compressed)
+    {
+        glGenerateMipmap(info.target);
+    }
+    return texture;
+}
+
+GLuint KTXLoader::loadKTX2(const unsigned char* data, size_t size, TextureUploadInfo& info)
+{
+    if (size < sizeof(KTX2_IDENTIFIER) + sizeof(KTX2Header))
+    {
+        throw std::runtime_error("Truncated KTX2 header");
+    }
+    KTX2Header header;
+    std::memcpy(&header, data + sizeof(KTX2_IDENTIFIER), sizeof(KTX2Header));
+    if (header.supercompressionScheme != 0)
+    {
+        throw std::runtime_error("Supercompressed KTX2 files are not supported");
+    }
+    if (header.vkFormat == 0 || header.vkFormat > MAX_VK_FORMAT)
+    {
+        throw std::runtime_error("Unsupported KTX2 VkFormat " + std::to_string(header.vkFormat));
+    }
+
+    gli::format format = static_cast<gli::format>(header.vkFormat);
+    gli::gl GL(gli::gl::PROFILE_GL33);
+    gli::gl::format glFormat = GL.translate(format, gli::swizzles(gli::SWIZZLE_RED, gli::SWIZZLE_GREEN, gli::SWIZZLE_BLUE, gli::SWIZZLE_ALPHA));
+
+    info.internalFormat = glFormat.Internal;
+    info.compressed = gli::is_compressed(format);
+    setupTarget(info, header.pixelWidth, header.pixelHeight, header.pixelDepth, header.layerCount, header.faceCount, header.levelCount);
+    uint32_t storedLevels = std::max(1u, header.levelCount);
+
+    size_t indexOffset = sizeof(KTX2_IDENTIFIER) + sizeof(KTX2Header);
+    if (indexOffset + storedLevels * sizeof(KTX2LevelIndex) > size)
+    {
+        throw std::runtime_error("Truncated KTX2 level index");
+    }
+
+    GLuint texture = TextureUpload::createStorage(info);
+    if (glFormat.Swizzles != gli::gl::swizzles(GL_RED, GL_GREEN, GL_BLUE, GL_ALPHA))
+    {
+        GLint swizzle[4] = { glFormat.Swizzles[0], glFormat.Swizzles[1], glFormat.Swizzles[2], glFormat.Swizzles[3] };
+        glTexParameteriv(info.target, GL_TEXTURE_SWIZZLE_RGBA, swizzle);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1); // KTX2 rows are tightly packed
+
+    for (uint32_t level = 0; level < storedLevels; ++level)
+    {
+        KTX2LevelIndex levelIndex;
+        std::memcpy(&levelIndex, data + indexOffset + level * sizeof(KTX2LevelIndex), sizeof(KTX2LevelIndex));
+        if (levelIndex.byteOffset + levelIndex.byteLength > size)
+        {
+            glDeleteTextures(1, &texture);
+            glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+            throw std::runtime_error("Truncated KTX2 image data");
+        }
+
+        // Faces of a non-array cubemap are stored back to back within the level
+        int images = info.target == GL_TEXTURE_CUBE_MAP ? 6 : 1;
+        size_t imageSize = static_cast<size_t>(levelIndex.byteLength / images);
+        for (int image = 0; image < images; ++image)
+        {
+            TextureUpload::uploadImage(info, glFormat.External, glFormat.Type, level, image, info.depth, data + levelIndex.byteOffset + image * imageSize, imageSize);
+        }
+        info.bytes += static_cast<size_t>(levelIndex.byteLength);
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+
+    if (header.levelCount == 0 && !info.compressed)
+    {
+        glGenerateMipmap(info.target);
+    }
+    return texture;
+}
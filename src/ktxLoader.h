@@ -0,0 +1,25 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <cstdint>
+#include "textureUpload.h"
+
+// Loads KTX 1.1 and KTX 2.0 containers (2D, 3D, arrays, cubemaps and cube arrays,
+// full mip chains) into immutable GL textures.
+//
+// The file is memory-mapped and every image is handed to glCompressedTexSubImage*D /
+// glTexSubImage*D straight from the mapping, without copying it first. gli translates the
+// format: KTX1 stores GL enums, which gli maps to its format for the block sizes.
+// KTX2 stores a VkFormat, whose values match gli::format. Supercompressed KTX2
+// (Basis Universal, zstd) is not supported.
+class KTXLoader
+{
+public:
+    static bool isKTX(const std::string& path);
+    // Throws std::runtime_error on malformed or unsupported files
+    static GLuint load(const std::string& path, TextureUploadInfo* info = nullptr);
+
+private:
+    static GLuint loadKTX1(const unsigned char* data, size_t size, TextureUploadInfo& info);
+    static GLuint loadKTX2(const unsigned char* data, size_t size, TextureUploadInfo& info);
+};
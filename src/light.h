@@ -0,0 +1,19 @@
+#pragma once
+#include <glm/glm.hpp>
+
+enum PunctualLightType
+{
+    LIGHT_POINT = 0,
+    LIGHT_SPOT = 1,
+    LIGHT_DIRECTIONAL = 2
+};
+
+// KHR_lights_punctual light in world space.
+// Matches the std430 layout of PunctualLight in shaders/shader.frag.
+struct PunctualLight
+{
+    glm::vec4 positionRange;   // xyz: position, w: range (cutoff distance)
+    glm::vec4 colorIntensity;  // rgb: color, w: intensity (candela, or lux for directional)
+    glm::vec4 directionType;   // xyz: direction the light points in, w: PunctualLightType
+    glm::vec4 spotCone;        // x: cos(innerConeAngle), y: cos(outerConeAngle)
+};
@@ -0,0 +1,396 @@
+#include "pch.h"
+#include "loadReport.h"
+#include "profiler.h"
+#include "jsonWriter.h"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#ifdef _WIN32
+#include <Windows.h>
+#include <psapi.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    const char* PHASE_NAMES[LOAD_PHASE_COUNT] = { "JSON parse", "Buffer IO", "Draco", "Interleave", "Image decode", "GPU upload" };
+
+    double toMegabytes(uint64_t bytes)
+    {
+        return bytes / (1024.0 * 1024.0);
+    }
+
+    void writeItems(JsonWriter& json, const char* name, const std::vector<LoadItem>& items)
+    {
+        json.key(name);
+        json.beginArray();
+        for (const LoadItem& item : items)
+        {
+            json.beginObject();
+            json.field("name", item.name);
+            json.field("bytes", item.bytes);
+            json.field("ms", item.ns / 1000000.0);
+            json.field("count", item.count);
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    void drawItems(const char* id, const std::vector<LoadItem>& items)
+    {
+        if (!ImGui::BeginTable(id, 4, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+        {
+            return;
+        }
+        ImGui::TableSetupColumn("Name");
+        ImGui::TableSetupColumn("MB");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("Count");
+        ImGui::TableHeadersRow();
+        for (const LoadItem& item : items)
+        {
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(item.name.c_str());
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", toMegabytes(item.bytes));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", item.ns / 1000000.0);
+            ImGui::TableNextColumn();
+            ImGui::Text("%u", item.count);
+        }
+        ImGui::EndTable();
+    }
+}
+
+MemoryUsage MemoryUsage::query()
+{
+    MemoryUsage usage;
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters = {};
+    if (GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+    {
+        usage.currentBytes = counters.WorkingSetSize;
+        usage.peakBytes = counters.PeakWorkingSetSize;
+    }
+#else
+    // VmRSS and VmHWM, in kB
+    std::ifstream status("/proc/self/status");
+    std::string line;
+    while (std::getline(status, line))
+    {
+        if (line.compare(0, 6, "VmRSS:") == 0)
+        {
+            usage.currentBytes = std::stoull(line.substr(6)) * 1024;
+        }
+        else if (line.compare(0, 6, "VmHWM:") == 0)
+        {
+            usage.peakBytes = std::stoull(line.substr(6)) * 1024;
+        }
+    }
+#endif
+    return usage;
+}
+
+const char* LoadReport::getPhaseName(LoadPhase phase)
+{
+    return PHASE_NAMES[phase];
+}
+
+void LoadReport::begin(const std::string& source)
+{
+    m_Source = source;
+    m_LoaderThread = std::this_thread::get_id();
+    m_Start = m_End = Profiler::now();
+    markBoundary("Start");
+}
+
+void LoadReport::markBoundary(const char* name)
+{
+    LoadBoundary boundary;
+    boundary.name = name;
+    boundary.elapsedMs = (Profiler::now() - m_Start) / 1000000.0;
+    boundary.memory = MemoryUsage::query();
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Boundaries.push_back(std::move(boundary));
+}
+
+LoadThreadStats& LoadReport::getThread()
+{
+    std::thread::id id = std::this_thread::get_id();
+    for (auto& thread : m_Threads)
+    {
+        if (thread.first == id)
+        {
+            return thread.second;
+        }
+    }
+    LoadThreadStats stats;
+    stats.name = id == m_LoaderThread ? "Loader" : "Thread " + std::to_string(m_Threads.size());
+    m_Threads.emplace_back(id, stats);
+    return m_Threads.back().second;
+}
+
+void LoadReport::addPhase(LoadPhase phase, uint64_t ns, uint64_t bytes)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    m_Phases[phase].ns += ns;
+    m_Phases[phase].bytes += bytes;
+    ++m_Phases[phase].calls;
+    LoadThreadStats& thread = getThread();
+    thread.busyNs += ns;
+    thread.phaseNs[phase] += ns;
+}
+
+void LoadReport::addMesh(const void* key, const char* name, uint64_t bytes, uint64_t ns)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    LoadItem& item = m_Meshes[key];
+    if (item.count == 0)
+    {
+        item.name = name && name[0] ? name : "Unnamed mesh";
+    }
+    item.bytes += bytes;
+    item.ns += ns;
+    ++item.count;
+}
+
+void LoadReport::addTexture(const void* key, const std::string& name, uint64_t bytes, uint64_t ns)
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    LoadItem& item = m_Textures[key];
+    if (item.count == 0)
+    {
+        item.name = name.empty() ? "Embedded image" : name;
+    }
+    item.bytes += bytes;
+    item.ns += ns;
+    ++item.count;
+}
+
+void LoadReport::finish()
+{
+    markBoundary("Done");
+    m_End = Profiler::now();
+}
+
+std::vector<LoadItem> LoadReport::getTop(const std::unordered_map<const void*, LoadItem>& items, bool byTime, size_t count)
+{
+    std::vector<LoadItem> top;
+    top.reserve(items.size());
+    for (const auto& pair : items)
+    {
+        top.push_back(pair.second);
+    }
+    std::sort(top.begin(), top.end(), [byTime](const LoadItem& a, const LoadItem& b)
+        {
+            return byTime ? a.ns > b.ns : a.bytes > b.bytes;
+        });
+    if (top.size() > count)
+    {
+        top.resize(count);
+    }
+    return top;
+}
+
+std::vector<LoadItem> LoadReport::getTopMeshes(bool byTime) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return getTop(m_Meshes, byTime, m_TopCount);
+}
+
+std::vector<LoadItem> LoadReport::getTopTextures(bool byTime) const
+{
+    std::lock_guard<std::mutex> lock(m_Mutex);
+    return getTop(m_Textures, byTime, m_TopCount);
+}
+
+void LoadReport::print() const
+{
+    double totalMs = getTotalMs();
+    std::cout << "Load report for " << m_Source << ": " << totalMs << "ms, " << m_NodeCount << " nodes, "
+              << m_PrimitiveCount << " primitives, " << m_Textures.size() << " textures decoded\n";
+    for (int i = 0; i < LOAD_PHASE_COUNT; ++i)
+    {
+        const LoadPhaseStats& phase = m_Phases[i];
+        double ms = phase.ns / 1000000.0;
+        std::cout << "  " << PHASE_NAMES[i] << ": " << ms << "ms (" << (totalMs > 0.0 ? 100.0 * ms / totalMs : 0.0) << "%), "
+                  << phase.calls << " calls, " << toMegabytes(phase.bytes) << " MB\n";
+    }
+    for (const LoadBoundary& boundary : m_Boundaries)
+    {
+        std::cout << "  " << boundary.name << " at " << boundary.elapsedMs << "ms: RSS " << toMegabytes(boundary.memory.currentBytes)
+                  << " MB, peak " << toMegabytes(boundary.memory.peakBytes) << " MB\n";
+    }
+    for (const auto& thread : m_Threads)
+    {
+        double busyMs = thread.second.busyNs / 1000000.0;
+        std::cout << "  " << thread.second.name << ": " << busyMs << "ms in phases, "
+                  << (totalMs > 0.0 ? 100.0 * busyMs / totalMs : 0.0) << "% utilization\n";
+    }
+    std::cout << std::flush;
+}
+
+void LoadReport::drawGui() const
+{
+    double totalMs = getTotalMs();
+    ImGui::Text("%s: %.1f ms, %zu nodes, %zu primitives", m_Source.c_str(), totalMs, m_NodeCount, m_PrimitiveCount);
+
+    if (ImGui::BeginTable("Load phases", 5, ImGuiTableFlags_Borders | ImGuiTableFlags_RowBg | ImGuiTableFlags_SizingStretchProp))
+    {
+        ImGui::TableSetupColumn("Phase");
+        ImGui::TableSetupColumn("ms");
+        ImGui::TableSetupColumn("Share");
+        ImGui::TableSetupColumn("Calls");
+        ImGui::TableSetupColumn("MB");
+        ImGui::TableHeadersRow();
+        for (int i = 0; i < LOAD_PHASE_COUNT; ++i)
+        {
+            const LoadPhaseStats& phase = m_Phases[i];
+            double ms = phase.ns / 1000000.0;
+            ImGui::TableNextRow();
+            ImGui::TableNextColumn();
+            ImGui::TextUnformatted(PHASE_NAMES[i]);
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", ms);
+            ImGui::TableNextColumn();
+            ImGui::ProgressBar(totalMs > 0.0 ? static_cast<float>(ms / totalMs) : 0.0f, ImVec2(-1.0f, 0.0f));
+            ImGui::TableNextColumn();
+            ImGui::Text("%llu", static_cast<unsigned long long>(phase.calls));
+            ImGui::TableNextColumn();
+            ImGui::Text("%.2f", toMegabytes(phase.bytes));
+        }
+        ImGui::EndTable();
+    }
+
+    if (ImGui::TreeNode("Memory at phase boundaries"))
+    {
+        for (const LoadBoundary& boundary : m_Boundaries)
+        {
+            ImGui::Text("%-20s %9.2f ms  RSS %8.1f MB  peak %8.1f MB", boundary.name.c_str(), boundary.elapsedMs,
+                toMegabytes(boundary.memory.currentBytes), toMegabytes(boundary.memory.peakBytes));
+        }
+        ImGui::TreePop();
+    }
+
+    if (ImGui::TreeNode("Threads"))
+    {
+        for (const auto& thread : m_Threads)
+        {
+            float utilization = totalMs > 0.0 ? static_cast<float>(thread.second.busyNs / 1000000.0 / totalMs) : 0.0f;
+            char label[64];
+            snprintf(label, sizeof(label), "%s %.1f%%", thread.second.name.c_str(), utilization * 100.0f);
+            ImGui::ProgressBar(utilization, ImVec2(-1.0f, 0.0f), label);
+        }
+        ImGui::TreePop();
+    }
+
+    static bool byTime = false;
+    ImGui::Checkbox("Sort meshes and textures by time", &byTime);
+    if (ImGui::TreeNode("Heaviest meshes"))
+    {
+        drawItems("Meshes", getTopMeshes(byTime));
+        ImGui::TreePop();
+    }
+    if (ImGui::TreeNode("Heaviest textures"))
+    {
+        drawItems("Textures", getTopTextures(byTime));
+        ImGui::TreePop();
+    }
+}
+
+bool LoadReport::writeJson(const std::string& path) const
+{
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath);
+        JsonWriter json(file);
+        double totalMs = getTotalMs();
+        json.beginObject();
+        json.field("source", m_Source);
+        json.field("totalMs", totalMs);
+        json.field("nodes", static_cast<uint64_t>(m_NodeCount));
+        json.field("primitives", static_cast<uint64_t>(m_PrimitiveCount));
+
+        json.key("phases");
+        json.beginArray();
+        for (int i = 0; i < LOAD_PHASE_COUNT; ++i)
+        {
+            json.beginObject();
+            json.field("name", PHASE_NAMES[i]);
+            json.field("ms", m_Phases[i].ns / 1000000.0);
+            json.field("calls", m_Phases[i].calls);
+            json.field("bytes", m_Phases[i].bytes);
+            json.endObject();
+        }
+        json.endArray();
+
+        json.key("boundaries");
+        json.beginArray();
+        for (const LoadBoundary& boundary : m_Boundaries)
+        {
+            json.beginObject();
+            json.field("name", boundary.name);
+            json.field("elapsedMs", boundary.elapsedMs);
+            json.field("rssBytes", boundary.memory.currentBytes);
+            json.field("peakRssBytes", boundary.memory.peakBytes);
+            json.endObject();
+        }
+        json.endArray();
+
+        json.key("threads");
+        json.beginArray();
+        for (const auto& thread : m_Threads)
+        {
+            json.beginObject();
+            json.field("name", thread.second.name);
+            json.field("busyMs", thread.second.busyNs / 1000000.0);
+            json.field("utilization", totalMs > 0.0 ? thread.second.busyNs / 1000000.0 / totalMs : 0.0);
+            json.key("phaseMs");
+            json.beginObject();
+            for (int i = 0; i < LOAD_PHASE_COUNT; ++i)
+            {
+                json.field(PHASE_NAMES[i], thread.second.phaseNs[i] / 1000000.0);
+            }
+            json.endObject();
+            json.endObject();
+        }
+        json.endArray();
+
+        writeItems(json, "meshesByBytes", getTopMeshes(false));
+        writeItems(json, "meshesByTime", getTopMeshes(true));
+        writeItems(json, "texturesByBytes", getTopTextures(false));
+        writeItems(json, "texturesByTime", getTopTextures(true));
+        json.endObject();
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporaryPath, path, error);
+    if (error)
+    {
+        std::cerr << "Failed to write " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
+
+LoadPhaseScope::LoadPhaseScope(LoadReport& report, LoadPhase phase, uint64_t bytes)
+    : m_Report(report), m_Phase(phase), m_Bytes(bytes), m_Start(Profiler::now())
+{
+}
+
+LoadPhaseScope::~LoadPhaseScope()
+{
+    m_Report.addPhase(m_Phase, getElapsedNs(), m_Bytes);
+}
+
+uint64_t LoadPhaseScope::getElapsedNs() const
+{
+    return Profiler::now() - m_Start;
+}
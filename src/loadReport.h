@@ -0,0 +1,133 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+// Work a model load spends its time on. Phases are summed over every call, Draco, interleaving
+// and image decoding happen once per primitive or texture while the nodes are walked.
+enum LoadPhase
+{
+    LOAD_PHASE_PARSE,           // cgltf_parse_file, the JSON
+    LOAD_PHASE_BUFFERS,         // base64 and .bin buffers
+    LOAD_PHASE_DRACO,
+    LOAD_PHASE_INTERLEAVE,      // vertex interleaving and index widening
+    LOAD_PHASE_IMAGE_DECODE,    // PNG/JPG decoding and DDS reads
+    LOAD_PHASE_GPU_UPLOAD,      // vertex, index and texture uploads, batch buffers
+
+    LOAD_PHASE_COUNT
+};
+
+// Resident set size of the process, the peak is the high water mark since it started
+struct MemoryUsage
+{
+    uint64_t currentBytes = 0;
+    uint64_t peakBytes = 0;
+
+    // Zeros where the platform has no way to ask
+    static MemoryUsage query();
+};
+
+struct LoadPhaseStats
+{
+    uint64_t ns = 0;
+    uint64_t calls = 0;
+    uint64_t bytes = 0;         // produced, e.g. decoded pixels or uploaded data
+};
+
+// A point between two sequential steps of the load
+struct LoadBoundary
+{
+    std::string name;
+    double elapsedMs = 0.0;     // since begin()
+    MemoryUsage memory;
+};
+
+// A mesh or texture. Meshes instanced by several nodes are processed, and counted, once per node.
+struct LoadItem
+{
+    std::string name;
+    uint64_t bytes = 0;
+    uint64_t ns = 0;
+    uint32_t count = 0;
+};
+
+struct LoadThreadStats
+{
+    std::string name;
+    uint64_t busyNs = 0;        // inside a phase
+    uint64_t phaseNs[LOAD_PHASE_COUNT] = {};
+};
+
+// Structured report of one model load: time per phase, memory at the phase boundaries, the
+// heaviest meshes and textures, and how busy each thread that did load work was.
+//
+// Phases and items can be recorded from any thread. Boundaries, begin() and finish() belong
+// to the thread driving the load.
+class LoadReport
+{
+public:
+    static const char* getPhaseName(LoadPhase phase);
+
+    void begin(const std::string& source);
+    void markBoundary(const char* name);
+    void addPhase(LoadPhase phase, uint64_t ns, uint64_t bytes = 0);
+    // key tells instances of the same mesh or image apart from others with the same name
+    void addMesh(const void* key, const char* name, uint64_t bytes, uint64_t ns);
+    void addTexture(const void* key, const std::string& name, uint64_t bytes, uint64_t ns);
+    // Marks the last boundary and stops the clock
+    void finish();
+
+    const LoadPhaseStats& getPhase(LoadPhase phase) const { return m_Phases[phase]; }
+    const std::vector<LoadBoundary>& getBoundaries() const { return m_Boundaries; }
+    double getTotalMs() const { return (m_End - m_Start) / 1000000.0; }
+    const std::string& getSource() const { return m_Source; }
+    // Heaviest first, by bytes or by time
+    std::vector<LoadItem> getTopMeshes(bool byTime) const;
+    std::vector<LoadItem> getTopTextures(bool byTime) const;
+
+    void print() const;
+    void drawGui() const;
+    bool writeJson(const std::string& path) const;
+
+    size_t m_TopCount = 10;
+    size_t m_NodeCount = 0;
+    size_t m_PrimitiveCount = 0;
+
+private:
+    static std::vector<LoadItem> getTop(const std::unordered_map<const void*, LoadItem>& items, bool byTime, size_t count);
+    LoadThreadStats& getThread();
+
+    std::string m_Source;
+    uint64_t m_Start = 0;
+    uint64_t m_End = 0;
+    std::thread::id m_LoaderThread;
+    LoadPhaseStats m_Phases[LOAD_PHASE_COUNT];
+    std::vector<LoadBoundary> m_Boundaries;
+    std::unordered_map<const void*, LoadItem> m_Meshes;
+    std::unordered_map<const void*, LoadItem> m_Textures;
+    std::vector<std::pair<std::thread::id, LoadThreadStats>> m_Threads;
+    mutable std::mutex m_Mutex;
+};
+
+// Adds the enclosing block's duration to a phase of the report
+class LoadPhaseScope
+{
+public:
+    LoadPhaseScope(LoadReport& report, LoadPhase phase, uint64_t bytes = 0);
+    ~LoadPhaseScope();
+    LoadPhaseScope(const LoadPhaseScope&) = delete;
+    LoadPhaseScope& operator=(const LoadPhaseScope&) = delete;
+
+    // For what is only known once the work is done
+    void setBytes(uint64_t bytes) { m_Bytes = bytes; }
+    uint64_t getElapsedNs() const;
+
+private:
+    LoadReport& m_Report;
+    LoadPhase m_Phase;
+    uint64_t m_Bytes;
+    uint64_t m_Start;
+};
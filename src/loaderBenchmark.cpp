@@ -0,0 +1,919 @@
+#include "pch.h"
+#include "loaderBenchmark.h"
+#include "cModel.h"
+#include "texture.h"
+#include "textureCooker.h"
+#include "base64.h"
+#include "base64Simd.h"
+#include "pngWriter.h"
+#include "jsonWriter.h"
+#include "syntheticMesh.h"
+#include "sceneGenerator.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <memory>
+#include <thread>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    using Clock = std::chrono::high_resolution_clock;
+
+    const int SYNTHETIC_GRID_SIZE = 512;        // vertices per side
+    const int SYNTHETIC_NODES = 4096;           // instances of the grid, gives the JSON parser some work
+    const uint32_t SYNTHETIC_ATTRIBUTES = SYNTHETIC_NORMAL | SYNTHETIC_TANGENT | SYNTHETIC_TEXCOORD0;
+    const int SYNTHETIC_TEXTURE_SIZE = 1024;
+    const size_t SYNTHETIC_BASE64_BYTES = 8 * 1024 * 1024;
+    const size_t MAX_MODEL_IMAGES = 16;         // per image kind, keeps runs on large scenes short
+
+    uint64_t elapsedNs(Clock::time_point start)
+    {
+        return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now() - start).count());
+    }
+
+    bool readFile(const std::string& path, std::vector<unsigned char>& bytes)
+    {
+        std::ifstream file(path, std::ios::binary | std::ios::ate);
+        if (!file.is_open())
+        {
+            return false;
+        }
+        bytes.resize(static_cast<size_t>(file.tellg()));
+        file.seekg(0);
+        file.read(reinterpret_cast<char*>(bytes.data()), bytes.size());
+        return static_cast<bool>(file);
+    }
+
+    std::string toLower(std::string text)
+    {
+        std::transform(text.begin(), text.end(), text.begin(), [](unsigned char c) { return static_cast<char>(std::tolower(c)); });
+        return text;
+    }
+
+    // Payload of a base64 data URI, empty for anything else
+    std::string getBase64Payload(const char* uri)
+    {
+        if (uri == nullptr || strncmp(uri, "data:", 5) != 0)
+        {
+            return std::string();
+        }
+        const char* comma = strchr(uri, ',');
+        if (comma == nullptr || comma - uri < 7 || strncmp(comma - 7, ";base64", 7) != 0)
+        {
+            return std::string();
+        }
+        return std::string(comma + 1);
+    }
+
+    // The vertex and index data processPrimitive reads, resolved once up front
+    struct PrimitiveInput
+    {
+        VertexStream positions;
+        VertexStream normals;
+        VertexStream tangents;
+        VertexStream texCoords;
+        size_t count = 0;
+        const void* indices = nullptr;
+        size_t indexCount = 0;
+        GLenum indexType = GL_UNSIGNED_INT;
+        const char* draco = nullptr;
+        size_t dracoSize = 0;
+    };
+
+    GLenum getIndexType(cgltf_component_type type)
+    {
+        switch (type)
+        {
+        case cgltf_component_type_r_8u:
+            return GL_UNSIGNED_BYTE;
+        case cgltf_component_type_r_16u:
+            return GL_UNSIGNED_SHORT;
+        case cgltf_component_type_r_32u:
+            return GL_UNSIGNED_INT;
+        default:
+            return GL_NONE;
+        }
+    }
+
+    size_t getIndexSize(GLenum type)
+    {
+        return type == GL_UNSIGNED_BYTE ? 1 : (type == GL_UNSIGNED_SHORT ? 2 : 4);
+    }
+
+    struct CgltfDeleter
+    {
+        void operator()(cgltf_data* data) const { cgltf_free(data); }
+    };
+}
+
+bool LoaderBenchmarkOptions::parse(int argc, char* argv[], LoaderBenchmarkOptions& options)
+{
+    for (int i = 2; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--no-synthetic")
+        {
+            options.synthetic = false;
+            continue;
+        }
+        if (option.rfind("--", 0) != 0)
+        {
+            options.inputs.push_back(option);
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << option << " needs a value" << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+        if (option == "--threads")
+        {
+            options.threadCounts.clear();
+            for (const char* number = value; *number; )
+            {
+                char* end = nullptr;
+                long threads = std::strtol(number, &end, 10);
+                if (end == number || threads < 1)
+                {
+                    std::cerr << "--threads expects a list like 1,2,8, got " << value << std::endl;
+                    return false;
+                }
+                options.threadCounts.push_back(static_cast<int>(threads));
+                number = *end == ',' ? end + 1 : end;
+            }
+        }
+        else if (option == "--iterations")
+        {
+            options.iterations = std::max(1, std::atoi(value));
+        }
+        else if (option == "--out")
+        {
+            options.outputPath = value;
+        }
+        else
+        {
+            std::cerr << "Unknown loader benchmark option " << option << std::endl;
+            return false;
+        }
+    }
+    if (!options.synthetic && options.inputs.empty())
+    {
+        std::cerr << "Usage: --bench-loader [inputs...] [--threads 1,2,8] [--iterations n] [--no-synthetic] [--out file.json]" << std::endl;
+        return false;
+    }
+    if (options.threadCounts.empty())
+    {
+        int hardwareThreads = static_cast<int>(std::max(1u, std::thread::hardware_concurrency()));
+        for (int threads = 1; threads < hardwareThreads; threads *= 2)
+        {
+            options.threadCounts.push_back(threads);
+        }
+        options.threadCounts.push_back(hardwareThreads);
+    }
+    return true;
+}
+
+LoaderBenchmark::LoaderBenchmark(const LoaderBenchmarkOptions& options)
+    : m_Options(options)
+{
+}
+
+bool LoaderBenchmark::addSyntheticStages()
+{
+    std::cout << "Generating synthetic inputs" << std::endl;
+    fs::path directory = fs::temp_directory_path() / "cosmic_loader_benchmark";
+    std::error_code error;
+    fs::create_directories(directory, error);
+
+    auto grid = std::make_shared<SyntheticGrid>(createSyntheticGrid(SYNTHETIC_GRID_SIZE, SYNTHETIC_ATTRIBUTES));
+    uint64_t attributeBytes = static_cast<uint64_t>(grid->vertexCount) * sizeof(float) * (3 + 3 + 4 + 2);
+
+    // One mesh instanced by every node, its buffer a .bin next to the file or a base64 data URI
+    // like exporters write for single-file glTF
+    for (bool embedded : { false, true })
+    {
+        fs::path path = directory / (embedded ? "synthetic_embedded.gltf" : "synthetic.gltf");
+        SceneGeneratorOptions sceneOptions;
+        sceneOptions.outputPath = path.string();
+        sceneOptions.nodes = SYNTHETIC_NODES;
+        sceneOptions.depth = 1;
+        sceneOptions.meshReuse = 1.0f;
+        sceneOptions.gridSize = SYNTHETIC_GRID_SIZE;
+        sceneOptions.materials = 1;
+        sceneOptions.textures = 0;
+        sceneOptions.indexBits = 32;
+        sceneOptions.attributes = SYNTHETIC_ATTRIBUTES;
+        sceneOptions.embedBuffers = embedded;
+        if (!SceneGenerator(sceneOptions).write() || !addModelStages(path.string()))
+        {
+            std::cerr << "Failed to create " << path.string() << std::endl;
+            return false;
+        }
+        // Labelled by kind rather than the temporary path
+        for (Stage& stage : m_Stages)
+        {
+            if (stage.input == path.string())
+            {
+                stage.input = embedded ? "synthetic (base64 buffer)" : "synthetic";
+            }
+        }
+    }
+
+    Stage interleave;
+    interleave.name = "interleaveVertices";
+    interleave.input = "synthetic";
+    interleave.bytes = attributeBytes;
+    interleave.vertices = grid->vertexCount;
+    interleave.run = [grid]()
+        {
+            std::vector<float> interleaved;
+            Clock::time_point start = Clock::now();
+            interleaveVertices({ grid->positions.data(), 3 * sizeof(float) }, { grid->normals.data(), 3 * sizeof(float) },
+                { grid->tangents.data(), 4 * sizeof(float) }, { grid->texCoords0.data(), 2 * sizeof(float) }, grid->vertexCount, interleaved);
+            return elapsedNs(start);
+        };
+    m_Stages.push_back(interleave);
+
+    // Positions and normals sharing one view with a byteStride of 24
+    auto packed = std::make_shared<std::vector<float>>();
+    packed->reserve(grid->vertexCount * 6);
+    for (uint32_t i = 0; i < grid->vertexCount; ++i)
+    {
+        packed->insert(packed->end(), grid->positions.begin() + i * 3, grid->positions.begin() + i * 3 + 3);
+        packed->insert(packed->end(), grid->normals.begin() + i * 3, grid->normals.begin() + i * 3 + 3);
+    }
+    interleave.input = "synthetic (interleaved view)";
+    interleave.run = [grid, packed]()
+        {
+            std::vector<float> interleaved;
+            Clock::time_point start = Clock::now();
+            interleaveVertices({ packed->data(), 6 * sizeof(float) }, { packed->data() + 3, 6 * sizeof(float) },
+                { grid->tangents.data(), 4 * sizeof(float) }, { grid->texCoords0.data(), 2 * sizeof(float) }, grid->vertexCount, interleaved);
+            return elapsedNs(start);
+        };
+    m_Stages.push_back(interleave);
+
+    DracoPrimitive dracoPrimitive;
+    std::vector<float> decoded;
+    std::vector<unsigned int> decodedIndices;
+    if (!encodeDracoGrid(*grid, dracoPrimitive) || !decodeDracoPrimitive(dracoPrimitive.data.data(), dracoPrimitive.data.size(), decoded, decodedIndices))
+    {
+        std::cerr << "Failed to encode the synthetic Draco mesh" << std::endl;
+        return false;
+    }
+    auto compressed = std::make_shared<std::vector<char>>(std::move(dracoPrimitive.data));
+    Stage dracoStage;
+    dracoStage.name = "decodeDracoPrimitive";
+    dracoStage.input = "synthetic";
+    dracoStage.bytes = compressed->size();
+    dracoStage.vertices = decoded.size() / 11;
+    dracoStage.run = [compressed]()
+        {
+            std::vector<float> interleaved;
+            std::vector<unsigned int> indices;
+            Clock::time_point start = Clock::now();
+            decodeDracoPrimitive(compressed->data(), compressed->size(), interleaved, indices);
+            return elapsedNs(start);
+        };
+    m_Stages.push_back(dracoStage);
+
+    // Same index count at every width, the values only have to be in range
+    for (GLenum indexType : { GL_UNSIGNED_BYTE, GL_UNSIGNED_SHORT, GL_UNSIGNED_INT })
+    {
+        size_t indexSize = getIndexSize(indexType);
+        auto indices = std::make_shared<std::vector<unsigned char>>(grid->indices.size() * indexSize);
+        for (size_t i = 0; i < grid->indices.size(); ++i)
+        {
+            uint32_t index = grid->indices[i] & (indexSize == 4 ? 0xFFFFFFFFu : (1u << (indexSize * 8)) - 1);
+            std::memcpy(indices->data() + i * indexSize, &index, indexSize);
+        }
+        Stage convert;
+        convert.name = "convertIndices";
+        convert.input = "synthetic " + std::to_string(indexSize * 8) + " bit";
+        convert.bytes = indices->size();
+        size_t count = grid->indices.size();
+        convert.run = [indices, count, indexType]()
+            {
+                std::vector<unsigned int> converted;
+                Clock::time_point start = Clock::now();
+                convertIndices(indices->data(), count, indexType, converted);
+                return elapsedNs(start);
+            };
+        m_Stages.push_back(convert);
+    }
+
+    // A BC1 DDS with a full mip chain, the contents don't matter to the reader
+    std::vector<MipmapData> levels;
+    uint32_t seed = 12345;
+    for (uint32_t size = SYNTHETIC_TEXTURE_SIZE * 2; ; size /= 2)
+    {
+        MipmapData level{ size, size, std::vector<uint8_t>(static_cast<size_t>((size + 3) / 4) * ((size + 3) / 4) * 8) };
+        for (uint8_t& byte : level.data)
+        {
+            seed = seed * 1664525u + 1013904223u;
+            byte = static_cast<uint8_t>(seed >> 24);
+        }
+        levels.push_back(std::move(level));
+        if (size == 1)
+        {
+            break;
+        }
+    }
+    std::string ddsPath = (directory / "synthetic.dds").string();
+    try
+    {
+        TextureCooker::writeDDS(ddsPath, COOK_BC1, levels);
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << e.what() << std::endl;
+        return false;
+    }
+
+    // Smooth gradients with some noise, stored without compression by PngWriter
+    std::vector<unsigned char> pixels(static_cast<size_t>(SYNTHETIC_TEXTURE_SIZE) * SYNTHETIC_TEXTURE_SIZE * 4);
+    for (int y = 0; y < SYNTHETIC_TEXTURE_SIZE; ++y)
+    {
+        for (int x = 0; x < SYNTHETIC_TEXTURE_SIZE; ++x)
+        {
+            unsigned char* pixel = &pixels[(static_cast<size_t>(y) * SYNTHETIC_TEXTURE_SIZE + x) * 4];
+            seed = seed * 1664525u + 1013904223u;
+            pixel[0] = static_cast<unsigned char>(x * 255 / SYNTHETIC_TEXTURE_SIZE);
+            pixel[1] = static_cast<unsigned char>(y * 255 / SYNTHETIC_TEXTURE_SIZE);
+            pixel[2] = static_cast<unsigned char>(seed >> 28);
+            pixel[3] = 255;
+        }
+    }
+    std::vector<std::vector<unsigned char>> images;
+    images.push_back(PngWriter::encode(SYNTHETIC_TEXTURE_SIZE, SYNTHETIC_TEXTURE_SIZE, 4, pixels.data()));
+    addImageStages("synthetic", std::move(images), { ddsPath });
+
+    std::string raw(SYNTHETIC_BASE64_BYTES, '\0');
+    for (char& c : raw)
+    {
+        seed = seed * 1664525u + 1013904223u;
+        c = static_cast<char>(seed >> 24);
+    }
+    addBase64Stages("synthetic", { base64_encode(raw) });
+    return true;
+}
+
+bool LoaderBenchmark::addModelStages(const std::string& path)
+{
+    cgltf_options options = {};
+    cgltf_data* parsed = nullptr;
+    if (cgltf_parse_file(&options, path.c_str(), &parsed) != cgltf_result_success)
+    {
+        std::cerr << "Failed to parse GLTF file: " << path << std::endl;
+        return false;
+    }
+    std::shared_ptr<cgltf_data> data(parsed, CgltfDeleter());
+
+    // Payloads are collected before decodeBase64Buffers() fills in the buffers
+    std::vector<std::string> payloads;
+    for (cgltf_size i = 0; i < data->buffers_count; ++i)
+    {
+        std::string payload = getBase64Payload(data->buffers[i].uri);
+        if (!payload.empty())
+        {
+            payloads.push_back(std::move(payload));
+        }
+    }
+    if (decodeBase64Buffers(data.get()) != cgltf_result_success || cgltf_load_buffers(&options, data.get(), path.c_str()) != cgltf_result_success)
+    {
+        std::cerr << "Failed to load buffers for GLTF file: " << path << std::endl;
+        return false;
+    }
+
+    uint64_t fileBytes = 0;
+    uint64_t bufferBytes = 0;
+    uint64_t vertices = 0;
+    std::error_code error;
+    fileBytes = fs::file_size(path, error);
+    for (cgltf_size i = 0; i < data->buffers_count; ++i)
+    {
+        bufferBytes += data->buffers[i].size;
+    }
+
+    auto primitives = std::make_shared<std::vector<PrimitiveInput>>();
+    for (cgltf_size i = 0; i < data->meshes_count; ++i)
+    {
+        for (cgltf_size j = 0; j < data->meshes[i].primitives_count; ++j)
+        {
+            cgltf_primitive& primitive = data->meshes[i].primitives[j];
+            PrimitiveInput input;
+            for (cgltf_size k = 0; k < primitive.attributes_count; ++k)
+            {
+                const cgltf_attribute& attribute = primitive.attributes[k];
+                if (attribute.type == cgltf_attribute_type_position)
+                {
+                    input.positions = getVertexStream(attribute.data);
+                    input.count = attribute.data->count;
+                }
+                else if (attribute.type == cgltf_attribute_type_normal)
+                {
+                    input.normals = getVertexStream(attribute.data);
+                }
+                else if (attribute.type == cgltf_attribute_type_tangent)
+                {
+                    input.tangents = getVertexStream(attribute.data);
+                }
+                else if (attribute.type == cgltf_attribute_type_texcoord && strcmp(attribute.name, "TEXCOORD_0") == 0)
+                {
+                    input.texCoords = getVertexStream(attribute.data);
+                }
+            }
+            if (primitive.has_draco_mesh_compression && primitive.draco_mesh_compression.buffer_view)
+            {
+                const cgltf_buffer_view* view = primitive.draco_mesh_compression.buffer_view;
+                input.draco = static_cast<const char*>(view->buffer->data) + view->offset;
+                input.dracoSize = view->size;
+            }
+            else if (primitive.indices && primitive.indices->buffer_view)
+            {
+                input.indices = cModel::getBufferData(primitive.indices);
+                input.indexCount = primitive.indices->count;
+                input.indexType = getIndexType(primitive.indices->component_type);
+            }
+            vertices += input.count;
+            primitives->push_back(input);
+        }
+    }
+
+    Stage parse;
+    parse.name = "cgltf_parse_file";
+    parse.input = path;
+    parse.bytes = fileBytes;
+    parse.vertices = vertices;
+    parse.run = [path]()
+        {
+            cgltf_options options = {};
+            cgltf_data* data = nullptr;
+            Clock::time_point start = Clock::now();
+            cgltf_parse_file(&options, path.c_str(), &data);
+            uint64_t ns = elapsedNs(start);
+            cgltf_free(data);
+            return ns;
+        };
+    m_Stages.push_back(parse);
+
+    // Parsed again on every run, but only the buffer loading is timed
+    Stage load;
+    load.name = "cgltf_load_buffers";
+    load.input = path;
+    load.bytes = bufferBytes;
+    load.vertices = vertices;
+    load.run = [path]()
+        {
+            cgltf_options options = {};
+            cgltf_data* data = nullptr;
+            if (cgltf_parse_file(&options, path.c_str(), &data) != cgltf_result_success)
+            {
+                return uint64_t(0);
+            }
+            Clock::time_point start = Clock::now();
+            if (decodeBase64Buffers(data) == cgltf_result_success)
+            {
+                cgltf_load_buffers(&options, data, path.c_str());
+            }
+            uint64_t ns = elapsedNs(start);
+            cgltf_free(data);
+            return ns;
+        };
+    m_Stages.push_back(load);
+
+    Stage interleave;
+    interleave.name = "interleaveVertices";
+    interleave.input = path;
+    Stage dracoStage;
+    dracoStage.name = "decodeDracoPrimitive";
+    dracoStage.input = path;
+    Stage convert;
+    convert.name = "convertIndices";
+    convert.input = path;
+    for (const PrimitiveInput& input : *primitives)
+    {
+        if (input.draco)
+        {
+            std::vector<float> decoded;
+            std::vector<unsigned int> indices;
+            if (decodeDracoPrimitive(input.draco, input.dracoSize, decoded, indices))
+            {
+                dracoStage.bytes += input.dracoSize;
+                dracoStage.vertices += decoded.size() / 11;
+            }
+        }
+        else if (input.positions.data && input.normals.data)
+        {
+            interleave.bytes += input.count * sizeof(float) * 6;
+            interleave.bytes += input.tangents.data ? input.count * sizeof(float) * 4 : 0;
+            interleave.bytes += input.texCoords.data ? input.count * sizeof(float) * 2 : 0;
+            interleave.vertices += input.count;
+        }
+        if (input.indices && input.indexType != GL_NONE)
+        {
+            convert.bytes += input.indexCount * getIndexSize(input.indexType);
+        }
+    }
+    interleave.run = [data, primitives]()
+        {
+            uint64_t ns = 0;
+            for (const PrimitiveInput& input : *primitives)
+            {
+                if (!input.draco && input.positions.data && input.normals.data)
+                {
+                    std::vector<float> interleaved;
+                    Clock::time_point start = Clock::now();
+                    interleaveVertices(input.positions, input.normals, input.tangents, input.texCoords, input.count, interleaved);
+                    ns += elapsedNs(start);
+                }
+            }
+            return ns;
+        };
+    dracoStage.run = [data, primitives]()
+        {
+            uint64_t ns = 0;
+            for (const PrimitiveInput& input : *primitives)
+            {
+                if (input.draco)
+                {
+                    std::vector<float> interleaved;
+                    std::vector<unsigned int> indices;
+                    Clock::time_point start = Clock::now();
+                    decodeDracoPrimitive(input.draco, input.dracoSize, interleaved, indices);
+                    ns += elapsedNs(start);
+                }
+            }
+            return ns;
+        };
+    convert.run = [data, primitives]()
+        {
+            uint64_t ns = 0;
+            for (const PrimitiveInput& input : *primitives)
+            {
+                if (input.indices && input.indexType != GL_NONE)
+                {
+                    std::vector<unsigned int> indices;
+                    Clock::time_point start = Clock::now();
+                    convertIndices(input.indices, input.indexCount, input.indexType, indices);
+                    ns += elapsedNs(start);
+                }
+            }
+            return ns;
+        };
+    for (Stage* stage : { &interleave, &dracoStage, &convert })
+    {
+        if (stage->bytes > 0)
+        {
+            m_Stages.push_back(*stage);
+        }
+    }
+
+    // The model's textures: files next to it, images embedded in its buffers and cooked DDS files
+    std::vector<std::vector<unsigned char>> images;
+    std::vector<std::string> ddsPaths;
+    fs::path directory = fs::path(path).parent_path();
+    for (cgltf_size i = 0; i < data->images_count; ++i)
+    {
+        const cgltf_image& image = data->images[i];
+        std::vector<unsigned char> bytes;
+        if (image.buffer_view && image.buffer_view->buffer->data)
+        {
+            const unsigned char* begin = static_cast<const unsigned char*>(image.buffer_view->buffer->data) + image.buffer_view->offset;
+            bytes.assign(begin, begin + image.buffer_view->size);
+        }
+        else if (image.uri && strncmp(image.uri, "data:", 5) == 0)
+        {
+            std::string payload = getBase64Payload(image.uri);
+            bytes.resize(base64DecodedSize(payload));
+            if (payload.empty() || !base64DecodeInto(payload, bytes.data()))
+            {
+                bytes.clear();
+            }
+            else
+            {
+                payloads.push_back(std::move(payload));
+            }
+        }
+        else if (image.uri)
+        {
+            std::string imagePath = (directory / image.uri).string();
+            std::string extension = toLower(fs::path(imagePath).extension().string());
+            std::string cookedPath = TextureCooker::getCookedPath(imagePath);
+            if (extension == ".dds")
+            {
+                cookedPath = imagePath;
+            }
+            if (ddsPaths.size() < MAX_MODEL_IMAGES && fs::exists(cookedPath, error))
+            {
+                ddsPaths.push_back(cookedPath);
+            }
+            if (extension != ".dds")
+            {
+                readFile(imagePath, bytes);
+            }
+        }
+        if (!bytes.empty() && images.size() < MAX_MODEL_IMAGES)
+        {
+            images.push_back(std::move(bytes));
+        }
+    }
+    addImageStages(path, std::move(images), std::move(ddsPaths));
+    addBase64Stages(path, std::move(payloads));
+    return true;
+}
+
+void LoaderBenchmark::addImageStages(const std::string& input, std::vector<std::vector<unsigned char>> images, std::vector<std::string> ddsPaths)
+{
+    if (!images.empty())
+    {
+        auto encoded = std::make_shared<std::vector<std::vector<unsigned char>>>(std::move(images));
+        Stage decode;
+        decode.name = "stbi_load_from_memory";
+        decode.input = input;
+        for (const auto& image : *encoded)
+        {
+            decode.bytes += image.size();
+        }
+        decode.run = [encoded]()
+            {
+                uint64_t ns = 0;
+                for (const auto& image : *encoded)
+                {
+                    int width, height, channels;
+                    Clock::time_point start = Clock::now();
+                    stbi_uc* pixels = stbi_load_from_memory(image.data(), static_cast<int>(image.size()), &width, &height, &channels, STBI_rgb_alpha);
+                    ns += elapsedNs(start);
+                    stbi_image_free(pixels);
+                }
+                return ns;
+            };
+        m_Stages.push_back(decode);
+    }
+
+    if (!ddsPaths.empty())
+    {
+        auto paths = std::make_shared<std::vector<std::string>>(std::move(ddsPaths));
+        Stage read;
+        read.name = "Texture::readDDS";
+        read.input = input;
+        std::error_code error;
+        for (const std::string& ddsPath : *paths)
+        {
+            read.bytes += fs::file_size(ddsPath, error);
+        }
+        read.run = [paths]()
+            {
+                uint64_t ns = 0;
+                Texture texture;
+                for (const std::string& ddsPath : *paths)
+                {
+                    DDSHeader header;
+                    DDSHeaderDX10 headerDX10 = {};
+                    Clock::time_point start = Clock::now();
+                    try
+                    {
+                        texture.readDDS(ddsPath, header, headerDX10);
+                    }
+                    catch (const std::exception&)
+                    {
+                    }
+                    ns += elapsedNs(start);
+                }
+                return ns;
+            };
+        m_Stages.push_back(read);
+    }
+}
+
+void LoaderBenchmark::addBase64Stages(const std::string& input, std::vector<std::string> payloads)
+{
+    if (payloads.empty())
+    {
+        return;
+    }
+    auto encoded = std::make_shared<std::vector<std::string>>(std::move(payloads));
+    Stage decode;
+    decode.name = "base64_decode";
+    decode.input = input;
+    for (const std::string& payload : *encoded)
+    {
+        decode.bytes += payload.size();
+    }
+    decode.run = [encoded]()
+        {
+            uint64_t ns = 0;
+            for (const std::string& payload : *encoded)
+            {
+                Clock::time_point start = Clock::now();
+                std::string decoded = base64_decode(payload);
+                ns += elapsedNs(start);
+            }
+            return ns;
+        };
+    m_Stages.push_back(decode);
+
+    // What decodeBase64Buffers uses instead
+    decode.name = std::string("base64DecodeInto (") + base64PathName(base64BestPath()) + ")";
+    decode.run = [encoded]()
+        {
+            uint64_t ns = 0;
+            for (const std::string& payload : *encoded)
+            {
+                std::vector<unsigned char> decoded(base64DecodedSize(payload));
+                Clock::time_point start = Clock::now();
+                base64DecodeInto(payload, decoded.data());
+                ns += elapsedNs(start);
+            }
+            return ns;
+        };
+    m_Stages.push_back(decode);
+}
+
+LoaderStageResult LoaderBenchmark::measure(const Stage& stage, int threadCount) const
+{
+    int iterations = m_Options.iterations;
+    std::vector<std::vector<uint64_t>> runNs(threadCount, std::vector<uint64_t>(iterations));
+    std::atomic<bool> start{ false };
+    std::vector<std::thread> threads;
+    for (int i = 0; i < threadCount; ++i)
+    {
+        threads.emplace_back([&, i]()
+            {
+                while (!start.load(std::memory_order_acquire))
+                {
+                    std::this_thread::yield();
+                }
+                for (int iteration = 0; iteration < iterations; ++iteration)
+                {
+                    runNs[i][iteration] = stage.run();
+                }
+            });
+    }
+    start.store(true, std::memory_order_release);
+    for (std::thread& thread : threads)
+    {
+        thread.join();
+    }
+
+    LoaderStageResult result;
+    result.stage = stage.name;
+    result.input = stage.input;
+    result.threads = threadCount;
+    result.runs = threadCount * iterations;
+    result.bytes = stage.bytes;
+    result.vertices = stage.vertices;
+
+    std::vector<uint64_t> all;
+    uint64_t busiestNs = 0;
+    for (const auto& thread : runNs)
+    {
+        uint64_t threadNs = 0;
+        for (uint64_t ns : thread)
+        {
+            threadNs += ns;
+        }
+        busiestNs = std::max(busiestNs, threadNs);
+        all.insert(all.end(), thread.begin(), thread.end());
+    }
+    std::sort(all.begin(), all.end());
+    result.minMs = all.front() / 1e6;
+    result.medianMs = all[all.size() / 2] / 1e6;
+    result.wallMs = busiestNs / 1e6;
+
+    double seconds = std::max(busiestNs, uint64_t(1)) / 1e9;
+    result.megabytesPerSecond = static_cast<double>(stage.bytes) * result.runs / (1024.0 * 1024.0) / seconds;
+    result.verticesPerSecond = static_cast<double>(stage.vertices) * result.runs / seconds;
+    return result;
+}
+
+bool LoaderBenchmark::run()
+{
+    if (m_Options.synthetic && !addSyntheticStages())
+    {
+        return false;
+    }
+    bool allRead = true;
+    for (const std::string& input : m_Options.inputs)
+    {
+        std::string extension = toLower(fs::path(input).extension().string());
+        if (extension == ".gltf" || extension == ".glb")
+        {
+            allRead &= addModelStages(input);
+        }
+        else if (extension == ".dds")
+        {
+            addImageStages(input, {}, { input });
+        }
+        else
+        {
+            std::vector<unsigned char> bytes;
+            if (!readFile(input, bytes))
+            {
+                std::cerr << "Failed to read " << input << std::endl;
+                allRead = false;
+                continue;
+            }
+            std::vector<std::vector<unsigned char>> images;
+            images.push_back(std::move(bytes));
+            addImageStages(input, std::move(images), {});
+        }
+    }
+
+    std::cout << "Loader benchmark: " << m_Stages.size() << " stages, " << m_Options.iterations << " runs per thread\n";
+    for (const Stage& stage : m_Stages)
+    {
+        // One untimed run so every thread count starts with warm caches and a primed allocator
+        stage.run();
+        std::cout << "  " << stage.name << " (" << stage.input << "), " << stage.bytes / 1024 << " KB";
+        if (stage.vertices > 0)
+        {
+            std::cout << ", " << stage.vertices << " vertices";
+        }
+        std::cout << "\n";
+
+        double singleThreadRate = 0.0;
+        for (int threadCount : m_Options.threadCounts)
+        {
+            LoaderStageResult result = measure(stage, threadCount);
+            if (threadCount == 1)
+            {
+                singleThreadRate = result.megabytesPerSecond;
+            }
+            result.scaling = singleThreadRate > 0.0 ? result.megabytesPerSecond / singleThreadRate : 0.0;
+            std::cout << "    " << threadCount << " threads: " << result.megabytesPerSecond << " MB/s";
+            if (result.vertices > 0)
+            {
+                std::cout << ", " << result.verticesPerSecond / 1e6 << " M vertices/s";
+            }
+            std::cout << ", median " << result.medianMs << "ms";
+            if (result.scaling > 0.0 && threadCount > 1)
+            {
+                std::cout << ", " << result.scaling << "x";
+            }
+            std::cout << "\n";
+            m_Results.push_back(result);
+        }
+        std::cout << std::flush;
+    }
+    return writeReport() && allRead;
+}
+
+bool LoaderBenchmark::writeReport() const
+{
+    std::string temporaryPath = m_Options.outputPath + ".tmp";
+    {
+        std::ofstream file(temporaryPath);
+        JsonWriter json(file);
+        json.beginObject();
+        json.field("hardwareThreads", std::thread::hardware_concurrency());
+        json.field("iterations", m_Options.iterations);
+        json.field("base64Path", base64PathName(base64BestPath()));
+        json.key("results");
+        json.beginArray();
+        for (const LoaderStageResult& result : m_Results)
+        {
+            json.beginObject();
+            json.field("stage", result.stage);
+            json.field("input", result.input);
+            json.field("threads", result.threads);
+            json.field("runs", result.runs);
+            json.field("bytes", result.bytes);
+            json.field("vertices", result.vertices);
+            json.field("minMs", result.minMs);
+            json.field("medianMs", result.medianMs);
+            json.field("wallMs", result.wallMs);
+            json.field("megabytesPerSecond", result.megabytesPerSecond);
+            json.field("verticesPerSecond", result.verticesPerSecond);
+            if (result.scaling > 0.0)
+            {
+                json.field("scaling", result.scaling);
+            }
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporaryPath, m_Options.outputPath, error);
+    if (error)
+    {
+        std::cerr << "Failed to write " << m_Options.outputPath << ": " << error.message() << std::endl;
+        return false;
+    }
+    std::cout << "Loader benchmark written to " << m_Options.outputPath << std::endl;
+    return true;
+}
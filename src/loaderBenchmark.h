@@ -0,0 +1,74 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <string>
+#include <vector>
+
+struct LoaderBenchmarkOptions
+{
+    std::vector<std::string> inputs;    // .gltf/.glb models, .dds files and .png/.jpg images
+    std::vector<int> threadCounts;      // empty: 1, 2, 4, ... up to the hardware thread count
+    int iterations = 10;                // runs per thread
+    bool synthetic = true;
+    std::string outputPath = "loader_benchmark.json";
+
+    // --bench-loader [inputs...] [--threads 1,2,8] [--iterations n] [--no-synthetic] [--out file.json]
+    static bool parse(int argc, char* argv[], LoaderBenchmarkOptions& options);
+};
+
+struct LoaderStageResult
+{
+    std::string stage;
+    std::string input;
+    int threads = 1;
+    int runs = 0;                   // over all threads
+    uint64_t bytes = 0;             // consumed by one run
+    uint64_t vertices = 0;          // produced by one run, 0 where the stage has none
+    double minMs = 0.0;             // fastest single run
+    double medianMs = 0.0;
+    double wallMs = 0.0;            // busiest thread
+    double megabytesPerSecond = 0.0;
+    double verticesPerSecond = 0.0;
+    double scaling = 0.0;           // throughput relative to one thread
+};
+
+// Times the CPU stages of loading a model on their own: cgltf parsing and buffer loading,
+// vertex interleaving, Draco decoding, index widening, Texture::readDDS, stbi decoding and
+// base64. Each stage runs on synthetic inputs generated on the spot and on the real files
+// given on the command line.
+//
+// Every thread count runs the same work on that many threads at once, so the numbers show
+// how a stage scales when the loader runs it in parallel, including allocator and memory
+// bandwidth contention. A run only times the stage itself, e.g. the cgltf_load_buffers
+// numbers leave out the parse that has to precede every run.
+class LoaderBenchmark
+{
+public:
+    explicit LoaderBenchmark(const LoaderBenchmarkOptions& options);
+
+    // Prints a table and writes the JSON report, false if an input could not be read
+    bool run();
+
+private:
+    struct Stage
+    {
+        std::string name;
+        std::string input;
+        uint64_t bytes = 0;
+        uint64_t vertices = 0;
+        // One run, returns the ns spent in the measured part
+        std::function<uint64_t()> run;
+    };
+
+    bool addSyntheticStages();
+    bool addModelStages(const std::string& path);
+    // stbi decodes images from memory, Texture::readDDS needs the file
+    void addImageStages(const std::string& input, std::vector<std::vector<unsigned char>> images, std::vector<std::string> ddsPaths);
+    void addBase64Stages(const std::string& input, std::vector<std::string> payloads);
+    LoaderStageResult measure(const Stage& stage, int threadCount) const;
+    bool writeReport() const;
+
+    LoaderBenchmarkOptions m_Options;
+    std::vector<Stage> m_Stages;
+    std::vector<LoaderStageResult> m_Results;
+};
@@ -6,7 +6,7 @@
 
 int main(int argc, char* argv[])
 {
-	run();
+	run(argc, argv);
 	return 0;
 }
 
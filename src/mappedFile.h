@@ -0,0 +1,129 @@
+#pragma once
+#include <string>
+#include <cstddef>
+#ifdef _WIN32
+#include <Windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+// Read-only memory mapping of a whole file. The pages are faulted in straight from the
+// page cache, so parsing and uploading from data() needs no intermediate copies.
+class MappedFile
+{
+public:
+    MappedFile() = default;
+    explicit MappedFile(const std::string& path)
+    {
+        open(path);
+    }
+    ~MappedFile()
+    {
+        close();
+    }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::string& path)
+    {
+        close();
+#ifdef _WIN32
+        m_File = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+        if (m_File == INVALID_HANDLE_VALUE)
+        {
+            return false;
+        }
+        LARGE_INTEGER fileSize;
+        if (!GetFileSizeEx(m_File, &fileSize) || fileSize.QuadPart == 0)
+        {
+            close();
+            return false;
+        }
+        m_Mapping = CreateFileMappingA(m_File, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        if (m_Mapping == nullptr)
+        {
+            close();
+            return false;
+        }
+        m_Data = static_cast<const unsigned char*>(MapViewOfFile(m_Mapping, FILE_MAP_READ, 0, 0, 0));
+        m_Size = static_cast<size_t>(fileSize.QuadPart);
+#else
+        m_File = ::open(path.c_str(), O_RDONLY);
+        if (m_File < 0)
+        {
+            return false;
+        }
+        struct stat fileStat;
+        if (fstat(m_File, &fileStat) != 0 || fileStat.st_size == 0)
+        {
+            close();
+            return false;
+        }
+        void* data = mmap(nullptr, fileStat.st_size, PROT_READ, MAP_PRIVATE, m_File, 0);
+        if (data == MAP_FAILED)
+        {
+            close();
+            return false;
+        }
+        madvise(data, fileStat.st_size, MADV_SEQUENTIAL);
+        m_Data = static_cast<const unsigned char*>(data);
+        m_Size = static_cast<size_t>(fileStat.st_size);
+#endif
+        if (m_Data == nullptr)
+        {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close()
+    {
+#ifdef _WIN32
+        if (m_Data)
+        {
+            UnmapViewOfFile(m_Data);
+        }
+        if (m_Mapping)
+        {
+            CloseHandle(m_Mapping);
+        }
+        if (m_File != INVALID_HANDLE_VALUE)
+        {
+            CloseHandle(m_File);
+        }
+        m_Mapping = nullptr;
+        m_File = INVALID_HANDLE_VALUE;
+#else
+        if (m_Data)
+        {
+            munmap(const_cast<unsigned char*>(m_Data), m_Size);
+        }
+        if (m_File >= 0)
+        {
+            ::close(m_File);
+        }
+        m_File = -1;
+#endif
+        m_Data = nullptr;
+        m_Size = 0;
+    }
+
+    bool isOpen() const { return m_Data != nullptr; }
+    const unsigned char* data() const { return m_Data; }
+    size_t size() const { return m_Size; }
+
+private:
+    const unsigned char* m_Data = nullptr;
+    size_t m_Size = 0;
+#ifdef _WIN32
+    HANDLE m_File = INVALID_HANDLE_VALUE;
+    HANDLE m_Mapping = nullptr;
+#else
+    int m_File = -1;
+#endif
+};
@@ -0,0 +1,136 @@
+#include "pch.h"
+#include "pngWriter.h"
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+
+namespace
+{
+    const size_t MAX_STORED_BLOCK = 65535;
+
+    void appendBigEndian(std::vector<unsigned char>& out, uint32_t value)
+    {
+        out.push_back(static_cast<unsigned char>(value >> 24));
+        out.push_back(static_cast<unsigned char>(value >> 16));
+        out.push_back(static_cast<unsigned char>(value >> 8));
+        out.push_back(static_cast<unsigned char>(value));
+    }
+
+    void appendChunk(std::vector<unsigned char>& out, const char* type, const unsigned char* data, size_t size)
+    {
+        appendBigEndian(out, static_cast<uint32_t>(size));
+        size_t typeOffset = out.size();
+        out.insert(out.end(), type, type + 4);
+        if (size > 0)
+        {
+            out.insert(out.end(), data, data + size);
+        }
+        appendBigEndian(out, PngWriter::crc32(out.data() + typeOffset, size + 4));
+    }
+}
+
+uint32_t PngWriter::crc32(const unsigned char* data, size_t size, uint32_t crc)
+{
+    static const auto table = []()
+        {
+            std::vector<uint32_t> entries(256);
+            for (uint32_t i = 0; i < 256; ++i)
+            {
+                uint32_t value = i;
+                for (int bit = 0; bit < 8; ++bit)
+                {
+                    value = (value & 1) ? 0xEDB88320u ^ (value >> 1) : value >> 1;
+                }
+                entries[i] = value;
+            }
+            return entries;
+        }();
+
+    crc = ~crc;
+    for (size_t i = 0; i < size; ++i)
+    {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return ~crc;
+}
+
+std::vector<unsigned char> PngWriter::encode(int width, int height, int channels, const unsigned char* pixels)
+{
+    static const unsigned char colorTypes[] = { 0, 0, 4, 2, 6 };
+    static const unsigned char signature[] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+
+    std::vector<unsigned char> png(signature, signature + sizeof(signature));
+    std::vector<unsigned char> header;
+    appendBigEndian(header, static_cast<uint32_t>(width));
+    appendBigEndian(header, static_cast<uint32_t>(height));
+    header.insert(header.end(), { 8, colorTypes[channels], 0, 0, 0 });
+    appendChunk(png, "IHDR", header.data(), header.size());
+
+    // Filter type 0 in front of every row
+    size_t rowBytes = static_cast<size_t>(width) * channels;
+    std::vector<unsigned char> filtered((rowBytes + 1) * height);
+    for (int y = 0; y < height; ++y)
+    {
+        filtered[y * (rowBytes + 1)] = 0;
+        std::memcpy(&filtered[y * (rowBytes + 1) + 1], pixels + y * rowBytes, rowBytes);
+    }
+
+    // zlib header, stored blocks of at most 64 KB, Adler-32 of the uncompressed data
+    std::vector<unsigned char> zlib = { 0x78, 0x01 };
+    zlib.reserve(filtered.size() + filtered.size() / MAX_STORED_BLOCK * 5 + 16);
+    size_t offset = 0;
+    do
+    {
+        size_t blockSize = std::min(MAX_STORED_BLOCK, filtered.size() - offset);
+        bool last = offset + blockSize == filtered.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(static_cast<unsigned char>(blockSize));
+        zlib.push_back(static_cast<unsigned char>(blockSize >> 8));
+        zlib.push_back(static_cast<unsigned char>(~blockSize));
+        zlib.push_back(static_cast<unsigned char>(~blockSize >> 8));
+        zlib.insert(zlib.end(), filtered.begin() + offset, filtered.begin() + offset + blockSize);
+        offset += blockSize;
+    } while (offset < filtered.size());
+
+    uint32_t a = 1;
+    uint32_t b = 0;
+    for (size_t i = 0; i < filtered.size(); ++i)
+    {
+        a = (a + filtered[i]) % 65521;
+        b = (b + a) % 65521;
+    }
+    appendBigEndian(zlib, (b << 16) | a);
+
+    appendChunk(png, "IDAT", zlib.data(), zlib.size());
+    appendChunk(png, "IEND", nullptr, 0);
+    return png;
+}
+
+bool PngWriter::write(const std::string& path, int width, int height, int channels, const unsigned char* pixels)
+{
+    if (width <= 0 || height <= 0 || channels < 1 || channels > 4)
+    {
+        std::cerr << "Can't write " << path << ": unsupported image layout" << std::endl;
+        return false;
+    }
+    std::vector<unsigned char> png = encode(width, height, channels, pixels);
+
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(png.data()), png.size());
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        std::cerr << "Failed to write " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    return true;
+}
@@ -0,0 +1,17 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+// Writes 8-bit gray, gray+alpha, RGB or RGBA PNGs. The zlib stream holds stored deflate blocks,
+// so nothing is compressed. That keeps the encoder to a few lines and as fast as the copy, which
+// suits golden frames and generated test textures more than small files do.
+class PngWriter
+{
+public:
+    // pixels are tightly packed rows, top row first
+    static std::vector<unsigned char> encode(int width, int height, int channels, const unsigned char* pixels);
+    static bool write(const std::string& path, int width, int height, int channels, const unsigned char* pixels);
+
+    static uint32_t crc32(const unsigned char* data, size_t size, uint32_t crc = 0);
+};
@@ -0,0 +1,479 @@
+#include "pch.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string_view>
+
+namespace
+{
+    const size_t GPU_QUERY_GROWTH = 64;
+    const int CALIBRATION_SCOPES = 256;
+
+    // Scope names are literals, only quotes and backslashes need escaping
+    void writeJsonString(std::ofstream& file, const char* text)
+    {
+        file << '"';
+        for (const char* c = text; *c; ++c)
+        {
+            if (*c == '"' || *c == '\\')
+            {
+                file << '\\';
+            }
+            file << *c;
+        }
+        file << '"';
+    }
+
+    ImU32 getScopeColor(const char* name)
+    {
+        // Same name, same color, across frames
+        size_t hash = std::hash<std::string_view>()(name);
+        float hue = (hash % 360) / 360.0f;
+        float r, g, b;
+        ImGui::ColorConvertHSVtoRGB(hue, 0.5f, 0.8f, r, g, b);
+        return ImGui::ColorConvertFloat4ToU32(ImVec4(r, g, b, 1.0f));
+    }
+}
+
+Profiler& Profiler::get()
+{
+    static Profiler profiler;
+    return profiler;
+}
+
+uint64_t Profiler::now()
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+Profiler::ThreadBuffer& Profiler::getThreadBuffer()
+{
+    static thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer)
+    {
+        std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+        m_Threads.push_back(std::make_unique<ThreadBuffer>());
+        buffer = m_Threads.back().get();
+        buffer->index = static_cast<uint32_t>(m_Threads.size() - 1);
+        buffer->name = "Thread " + std::to_string(buffer->index);
+        buffer->events = std::make_unique<ProfileEvent[]>(RING_CAPACITY);
+    }
+    return *buffer;
+}
+
+void Profiler::setThreadName(const char* name)
+{
+    ThreadBuffer& buffer = getThreadBuffer();
+    std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+    buffer.name = name;
+}
+
+void Profiler::beginCpu(const char* name)
+{
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (buffer.depth < MAX_DEPTH)
+    {
+        buffer.names[buffer.depth] = name;
+        buffer.starts[buffer.depth] = now();
+    }
+    ++buffer.depth;
+}
+
+void Profiler::endCpu()
+{
+    ThreadBuffer& buffer = getThreadBuffer();
+    if (buffer.depth == 0)
+    {
+        return;
+    }
+    uint32_t depth = --buffer.depth;
+    if (depth >= MAX_DEPTH)
+    {
+        return;
+    }
+
+    size_t head = buffer.head.load(std::memory_order_relaxed);
+    if (head - buffer.tail.load(std::memory_order_acquire) >= RING_CAPACITY)
+    {
+        buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+        return;
+    }
+    buffer.events[head & (RING_CAPACITY - 1)] = { buffer.names[depth], buffer.starts[depth], now(), buffer.index, depth };
+    buffer.head.store(head + 1, std::memory_order_release);
+}
+
+GLuint Profiler::allocateQuery(GpuQuerySet& set)
+{
+    if (set.usedQueries == set.queries.size())
+    {
+        set.queries.resize(set.queries.size() + GPU_QUERY_GROWTH);
+        glGenQueries(GPU_QUERY_GROWTH, set.queries.data() + set.usedQueries);
+    }
+    return set.queries[set.usedQueries++];
+}
+
+void Profiler::beginGpu(const char* name)
+{
+    if (!m_GpuSupported)
+    {
+        m_GpuStack.push_back(SIZE_MAX);
+        return;
+    }
+    GpuQuerySet& set = m_GpuSets[m_CurrentGpuSet];
+    GpuScope scope = { name, static_cast<uint32_t>(m_GpuStack.size()), set.usedQueries, 0 };
+    glQueryCounter(allocateQuery(set), GL_TIMESTAMP);
+    m_GpuStack.push_back(set.scopes.size());
+    set.scopes.push_back(scope);
+}
+
+void Profiler::endGpu()
+{
+    if (m_GpuStack.empty())
+    {
+        return;
+    }
+    size_t scope = m_GpuStack.back();
+    m_GpuStack.pop_back();
+    if (scope == SIZE_MAX)
+    {
+        return;
+    }
+    GpuQuerySet& set = m_GpuSets[m_CurrentGpuSet];
+    set.scopes[scope].endQuery = set.usedQueries;
+    glQueryCounter(allocateQuery(set), GL_TIMESTAMP);
+}
+
+void Profiler::calibrate()
+{
+    // Run on the GL thread before it has recorded anything this frame, then take the events back out
+    ThreadBuffer& buffer = getThreadBuffer();
+    size_t head = buffer.head.load(std::memory_order_relaxed);
+    uint64_t start = now();
+    for (int i = 0; i < CALIBRATION_SCOPES; ++i)
+    {
+        beginCpu("Profiler calibration");
+        endCpu();
+    }
+    m_ScopeCostNs = (now() - start) / CALIBRATION_SCOPES;
+    buffer.head.store(head, std::memory_order_release);
+    buffer.dropped.store(0, std::memory_order_relaxed);
+}
+
+void Profiler::beginFrame()
+{
+    uint64_t frameStart = now();
+    if (!m_GpuInitialized)
+    {
+        m_GpuInitialized = true;
+        GLint bits = 0;
+        glGetQueryiv(GL_TIMESTAMP, GL_QUERY_COUNTER_BITS, &bits);
+        m_GpuSupported = bits > 0;
+        calibrate();
+    }
+    if (m_FrameStart != 0)
+    {
+        m_Frames.push_back({ m_FrameStart, frameStart });
+    }
+    m_FrameStart = frameStart;
+
+    // Scopes left open by an early return would nest everything that follows
+    m_GpuStack.clear();
+    m_CurrentGpuSet = (m_CurrentGpuSet + 1) % GPU_QUERY_SETS;
+    GpuQuerySet& set = m_GpuSets[m_CurrentGpuSet];
+    m_FrameEvents = set.scopes.size();
+    resolveGpu(set);
+    if (m_GpuSupported)
+    {
+        glGetInteger64v(GL_TIMESTAMP, &set.gpuReference);
+        set.cpuReference = now();
+    }
+
+    drain();
+    trimHistory();
+    updateStats();
+    m_Stats.overheadMs = ((now() - frameStart) + m_FrameEvents * m_ScopeCostNs) / 1000000.0f;
+}
+
+void Profiler::resolveGpu(GpuQuerySet& set)
+{
+    if (!set.scopes.empty())
+    {
+        // Timestamps complete in order, the last one being ready means all of them are
+        GLuint available = 0;
+        glGetQueryObjectuiv(set.queries[set.usedQueries - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (available)
+        {
+            for (const GpuScope& scope : set.scopes)
+            {
+                GLuint64 begin = 0;
+                GLuint64 end = 0;
+                glGetQueryObjectui64v(set.queries[scope.beginQuery], GL_QUERY_RESULT, &begin);
+                glGetQueryObjectui64v(set.queries[scope.endQuery], GL_QUERY_RESULT, &end);
+                uint64_t start = set.cpuReference + (static_cast<int64_t>(begin) - set.gpuReference);
+                m_Events.push_back({ scope.name, start, start + (end - begin), GPU_THREAD, scope.depth });
+            }
+        }
+        else
+        {
+            m_GpuDropped += set.scopes.size();
+        }
+    }
+    set.scopes.clear();
+    set.usedQueries = 0;
+}
+
+void Profiler::drain()
+{
+    size_t dropped = 0;
+    std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+    for (const auto& buffer : m_Threads)
+    {
+        size_t tail = buffer->tail.load(std::memory_order_relaxed);
+        size_t head = buffer->head.load(std::memory_order_acquire);
+        for (size_t i = tail; i != head; ++i)
+        {
+            m_Events.push_back(buffer->events[i & (RING_CAPACITY - 1)]);
+        }
+        buffer->tail.store(head, std::memory_order_release);
+        m_FrameEvents += head - tail;
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    m_Stats.droppedEvents = dropped;
+    m_Stats.droppedGpuScopes = m_GpuDropped;
+    m_Stats.eventsPerFrame = m_FrameEvents;
+}
+
+void Profiler::trimHistory()
+{
+    while (m_Frames.size() > m_HistoryFrames)
+    {
+        m_Frames.pop_front();
+    }
+    if (m_Frames.empty())
+    {
+        return;
+    }
+    // Events arrive roughly in end order, a long worker scope may hold back a few younger ones
+    uint64_t cutoff = m_Frames.front().start;
+    while (!m_Events.empty() && (m_Events.front().end < cutoff || m_Events.size() > m_HistoryFrames * RING_CAPACITY / 16))
+    {
+        m_Events.pop_front();
+    }
+}
+
+void Profiler::updateStats()
+{
+    if (m_Frames.empty())
+    {
+        return;
+    }
+    std::vector<float> frameMs;
+    frameMs.reserve(m_Frames.size());
+    for (const Frame& frame : m_Frames)
+    {
+        frameMs.push_back((frame.end - frame.start) / 1000000.0f);
+    }
+    m_Stats.frameMs = frameMs.back();
+    auto percentile = [&frameMs](float fraction)
+        {
+            size_t index = std::min(frameMs.size() - 1, static_cast<size_t>(fraction * frameMs.size()));
+            std::nth_element(frameMs.begin(), frameMs.begin() + index, frameMs.end());
+            return frameMs[index];
+        };
+    m_Stats.p50Ms = percentile(0.50f);
+    m_Stats.p95Ms = percentile(0.95f);
+    m_Stats.p99Ms = percentile(0.99f);
+    m_Stats.maxMs = *std::max_element(frameMs.begin(), frameMs.end());
+}
+
+void Profiler::destroy()
+{
+    for (GpuQuerySet& set : m_GpuSets)
+    {
+        if (!set.queries.empty())
+        {
+            glDeleteQueries(static_cast<GLsizei>(set.queries.size()), set.queries.data());
+        }
+        set = GpuQuerySet();
+    }
+    m_GpuStack.clear();
+    m_GpuSupported = false;
+}
+
+void Profiler::drawTimeline(float width, float rowHeight) const
+{
+    if (m_Frames.size() < 2)
+    {
+        ImGui::TextUnformatted("No complete frame yet");
+        return;
+    }
+    // The frame before last, the newest one whose GPU scopes are resolved. Its GPU work runs
+    // behind the CPU, so the window is stretched to cover it.
+    const Frame& frame = m_Frames[m_Frames.size() - 2];
+    uint64_t rangeStart = frame.start;
+    uint64_t rangeEnd = frame.end;
+    std::vector<const ProfileEvent*> visible;
+    for (const ProfileEvent& event : m_Events)
+    {
+        if (event.thread == GPU_THREAD && event.start >= frame.start && event.start < frame.end)
+        {
+            rangeEnd = std::max(rangeEnd, event.end);
+        }
+    }
+    for (const ProfileEvent& event : m_Events)
+    {
+        if (event.end > rangeStart && event.start < rangeEnd)
+        {
+            visible.push_back(&event);
+        }
+    }
+
+    // One row group per thread with events, GPU last
+    std::vector<std::pair<uint32_t, std::string>> groups;
+    {
+        std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+        for (const auto& buffer : m_Threads)
+        {
+            groups.push_back({ buffer->index, buffer->name });
+        }
+    }
+    groups.push_back({ GPU_THREAD, "GPU" });
+    std::vector<uint32_t> rows(groups.size(), 0);
+    for (const ProfileEvent* event : visible)
+    {
+        size_t group = event->thread == GPU_THREAD ? groups.size() - 1 : event->thread;
+        rows[group] = std::max(rows[group], event->depth + 1);
+    }
+
+    const float labelWidth = 90.0f * ImGui::GetIO().FontGlobalScale;
+    float barWidth = std::max(1.0f, width - labelWidth);
+    float scale = barWidth / static_cast<float>(rangeEnd - rangeStart);
+    ImDrawList* drawList = ImGui::GetWindowDrawList();
+    ImVec2 origin = ImGui::GetCursorScreenPos();
+    ImVec2 mouse = ImGui::GetIO().MousePos;
+    const ProfileEvent* hovered = nullptr;
+
+    ImGui::Text("Frame %.3f ms, window %.3f ms", (frame.end - frame.start) / 1000000.0f, (rangeEnd - rangeStart) / 1000000.0f);
+    origin.y += ImGui::GetTextLineHeightWithSpacing();
+    float y = origin.y;
+    for (size_t group = 0; group < groups.size(); ++group)
+    {
+        if (rows[group] == 0)
+        {
+            continue;
+        }
+        uint32_t thread = groups[group].first;
+        drawList->AddText(ImVec2(origin.x, y), ImGui::GetColorU32(ImGuiCol_Text), groups[group].second.c_str());
+        for (const ProfileEvent* event : visible)
+        {
+            if (event->thread != thread)
+            {
+                continue;
+            }
+            uint64_t start = std::max(event->start, rangeStart);
+            uint64_t end = std::min(event->end, rangeEnd);
+            ImVec2 min(origin.x + labelWidth + (start - rangeStart) * scale, y + event->depth * rowHeight);
+            ImVec2 max(std::max(min.x + 1.0f, origin.x + labelWidth + (end - rangeStart) * scale), min.y + rowHeight - 1.0f);
+            drawList->AddRectFilled(min, max, getScopeColor(event->name));
+            if (max.x - min.x > 30.0f)
+            {
+                drawList->PushClipRect(min, max, true);
+                drawList->AddText(ImVec2(min.x + 2.0f, min.y), IM_COL32(0, 0, 0, 255), event->name);
+                drawList->PopClipRect();
+            }
+            if (mouse.x >= min.x && mouse.x < max.x && mouse.y >= min.y && mouse.y < max.y)
+            {
+                hovered = event;
+            }
+        }
+        y += rows[group] * rowHeight + 4.0f;
+    }
+    ImGui::Dummy(ImVec2(width, y - origin.y));
+    if (hovered)
+    {
+        ImGui::SetTooltip("%s: %.3f ms", hovered->name, (hovered->end - hovered->start) / 1000000.0f);
+    }
+}
+
+bool Profiler::exportChromeTrace(const std::string& path) const
+{
+    if (m_Events.empty())
+    {
+        return false;
+    }
+    uint64_t origin = UINT64_MAX;
+    for (const ProfileEvent& event : m_Events)
+    {
+        origin = std::min(origin, event.start);
+    }
+
+    // Written under a temporary name so a viewer never opens a half written trace
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath);
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to open " << temporaryPath << std::endl;
+            return false;
+        }
+        uint32_t gpuThread = 0;
+        file << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+        {
+            std::lock_guard<std::mutex> lock(m_ThreadsMutex);
+            for (const auto& buffer : m_Threads)
+            {
+                file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->index << ",\"args\":{\"name\":";
+                writeJsonString(file, buffer->name.c_str());
+                file << "}},\n";
+            }
+            gpuThread = static_cast<uint32_t>(m_Threads.size());
+        }
+        file << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << gpuThread << ",\"args\":{\"name\":\"GPU\"}}";
+
+        char timing[64];
+        for (const ProfileEvent& event : m_Events)
+        {
+            file << ",\n{\"name\":";
+            writeJsonString(file, event.name);
+            snprintf(timing, sizeof(timing), ",\"ts\":%.3f,\"dur\":%.3f", (event.start - origin) / 1000.0, (event.end - event.start) / 1000.0);
+            file << ",\"cat\":\"" << (event.thread == GPU_THREAD ? "gpu" : "cpu") << "\",\"ph\":\"X\",\"pid\":1,\"tid\":"
+                 << (event.thread == GPU_THREAD ? gpuThread : event.thread) << timing << "}";
+        }
+        for (const Frame& frame : m_Frames)
+        {
+            snprintf(timing, sizeof(timing), ",\"ts\":%.3f", (frame.start - origin) / 1000.0);
+            file << ",\n{\"name\":\"Frame\",\"ph\":\"i\",\"s\":\"g\",\"pid\":1,\"tid\":0" << timing << "}";
+        }
+        file << "\n]}\n";
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, path, error);
+    if (error)
+    {
+        std::cerr << "Failed to write " << path << ": " << error.message() << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << m_Events.size() << " events over " << m_Frames.size() << " frames to " << path << std::endl;
+    return true;
+}
+
+float ProfileTimer::stop()
+{
+    if (m_Ms < 0.0f)
+    {
+        if (m_Active)
+        {
+            Profiler::get().endCpu();
+        }
+        m_Ms = (Profiler::now() - m_Start) / 1000000.0f;
+        std::cout << m_Name << " took: " << m_Ms << "ms" << std::endl;
+    }
+    return m_Ms;
+}
@@ -0,0 +1,222 @@
+#pragma once
+#include <glad/glad.h>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+struct ProfileEvent
+{
+    const char* name;
+    uint64_t start;     // ns on Profiler::now()
+    uint64_t end;
+    uint32_t thread;    // index into the thread list, GPU events use GPU_THREAD
+    uint32_t depth;
+};
+
+struct ProfilerStats
+{
+    float frameMs = 0.0f;
+    float p50Ms = 0.0f;
+    float p95Ms = 0.0f;
+    float p99Ms = 0.0f;
+    float maxMs = 0.0f;
+    float overheadMs = 0.0f;        // bookkeeping plus estimated scope cost, per frame
+    size_t eventsPerFrame = 0;
+    size_t droppedEvents = 0;       // ring buffers were full, total since start
+    size_t droppedGpuScopes = 0;    // results not ready when their queries were reused
+};
+
+// Always compiled frame profiler for nested CPU scopes on any thread and GPU scopes on the GL thread.
+//
+// A CPU scope costs two clock reads and one write into its thread's ring buffer. The ring is
+// single producer, single consumer, so the writer never locks. beginFrame() drains every ring
+// on the main thread into a history of the last m_HistoryFrames frames. A full ring drops the
+// event and counts it instead of blocking.
+//
+// GPU scopes put a glQueryCounter(GL_TIMESTAMP) at both ends. Query sets are double-buffered
+// like GpuQuery, so the results of frame N-2 are read when their set is reused and the CPU
+// never waits. GPU times are moved onto the CPU clock with one GL_TIMESTAMP per frame, so both
+// line up in the timeline and in the trace.
+//
+// Scope names must outlive the profiler, string literals in practice.
+class Profiler
+{
+public:
+    static const uint32_t GPU_THREAD = 0xFFFFFFFF;
+
+    static Profiler& get();
+    static uint64_t now();
+
+    // Call once per frame on the GL thread, the time between two calls is the frame time
+    void beginFrame();
+    void destroy();
+
+    void beginCpu(const char* name);
+    void endCpu();
+    void beginGpu(const char* name);
+    void endGpu();
+    void setThreadName(const char* name);
+
+    bool isEnabled() const { return m_Enabled.load(std::memory_order_relaxed); }
+    void setEnabled(bool enabled) { m_Enabled.store(enabled, std::memory_order_relaxed); }
+
+    const ProfilerStats& getStats() const { return m_Stats; }
+    // Flame view of the last complete frame, one row group per thread
+    void drawTimeline(float width, float rowHeight) const;
+    // Writes the history as Chrome trace JSON (chrome://tracing, Perfetto)
+    bool exportChromeTrace(const std::string& path) const;
+
+    size_t m_HistoryFrames = 300;
+
+private:
+    static const size_t RING_CAPACITY = 1 << 14;
+    static const int GPU_QUERY_SETS = 2;
+    static const int MAX_DEPTH = 64;
+
+    struct ThreadBuffer
+    {
+        std::string name;
+        uint32_t index = 0;
+        std::unique_ptr<ProfileEvent[]> events;
+        std::atomic<size_t> head{ 0 };  // written by the owning thread
+        std::atomic<size_t> tail{ 0 };  // written by beginFrame()
+        std::atomic<size_t> dropped{ 0 };
+        const char* names[MAX_DEPTH];
+        uint64_t starts[MAX_DEPTH];
+        uint32_t depth = 0;
+    };
+
+    struct GpuScope
+    {
+        const char* name;
+        uint32_t depth;
+        size_t beginQuery;
+        size_t endQuery;
+    };
+
+    struct GpuQuerySet
+    {
+        std::vector<GLuint> queries;
+        std::vector<GpuScope> scopes;
+        size_t usedQueries = 0;
+        uint64_t cpuReference = 0;
+        GLint64 gpuReference = 0;
+    };
+
+    struct Frame
+    {
+        uint64_t start;
+        uint64_t end;
+    };
+
+    Profiler() = default;
+    ThreadBuffer& getThreadBuffer();
+    GLuint allocateQuery(GpuQuerySet& set);
+    void drain();
+    void resolveGpu(GpuQuerySet& set);
+    void trimHistory();
+    void updateStats();
+    void calibrate();
+
+    std::atomic<bool> m_Enabled{ true };
+    mutable std::mutex m_ThreadsMutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> m_Threads;
+
+    GpuQuerySet m_GpuSets[GPU_QUERY_SETS];
+    int m_CurrentGpuSet = 0;
+    std::vector<size_t> m_GpuStack;     // open scopes of the current set
+    bool m_GpuSupported = false;
+    bool m_GpuInitialized = false;
+
+    std::deque<ProfileEvent> m_Events;  // drained, sorted by end time per thread only
+    std::deque<Frame> m_Frames;
+    uint64_t m_FrameStart = 0;
+    uint64_t m_ScopeCostNs = 0;         // measured cost of one CPU scope
+    uint64_t m_FrameEvents = 0;
+    size_t m_GpuDropped = 0;
+    ProfilerStats m_Stats;
+};
+
+// Records the enclosing block as a CPU scope of the current thread
+class ProfileScope
+{
+public:
+    explicit ProfileScope(const char* name) : m_Active(Profiler::get().isEnabled())
+    {
+        if (m_Active)
+        {
+            Profiler::get().beginCpu(name);
+        }
+    }
+    ~ProfileScope()
+    {
+        if (m_Active)
+        {
+            Profiler::get().endCpu();
+        }
+    }
+    ProfileScope(const ProfileScope&) = delete;
+    ProfileScope& operator=(const ProfileScope&) = delete;
+
+private:
+    bool m_Active;
+};
+
+// Records the GL commands issued in the enclosing block as a GPU scope, GL thread only
+class GpuProfileScope
+{
+public:
+    explicit GpuProfileScope(const char* name) : m_Active(Profiler::get().isEnabled())
+    {
+        if (m_Active)
+        {
+            Profiler::get().beginGpu(name);
+        }
+    }
+    ~GpuProfileScope()
+    {
+        if (m_Active)
+        {
+            Profiler::get().endGpu();
+        }
+    }
+    GpuProfileScope(const GpuProfileScope&) = delete;
+    GpuProfileScope& operator=(const GpuProfileScope&) = delete;
+
+private:
+    bool m_Active;
+};
+
+// A CPU scope that also prints its duration, for one-off steps like loading
+class ProfileTimer
+{
+public:
+    explicit ProfileTimer(const char* name) : m_Name(name), m_Start(Profiler::now()), m_Active(Profiler::get().isEnabled())
+    {
+        if (m_Active)
+        {
+            Profiler::get().beginCpu(name);
+        }
+    }
+    ~ProfileTimer()
+    {
+        stop();
+    }
+    // Returns the duration in ms, prints it the first time
+    float stop();
+
+private:
+    const char* m_Name;
+    uint64_t m_Start;
+    bool m_Active;
+    float m_Ms = -1.0f;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+#define PROFILE_SCOPE(name) ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(name)
+#define PROFILE_GPU_SCOPE(name) GpuProfileScope PROFILE_CONCAT(gpuProfileScope, __LINE__)(name)
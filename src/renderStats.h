@@ -0,0 +1,23 @@
+#pragma once
+#include <cstdint>
+
+// Draw calls issued since the last reset(), counted at every glDraw* call site. A multi-draw
+// counts once, like it does for the driver's CPU cost.
+class RenderStats
+{
+public:
+    static RenderStats& get()
+    {
+        static RenderStats stats;
+        return stats;
+    }
+
+    void countDraw() { ++m_DrawCalls; }
+    void reset() { m_DrawCalls = 0; }
+    uint32_t getDrawCalls() const { return m_DrawCalls; }
+
+private:
+    RenderStats() = default;
+
+    uint32_t m_DrawCalls = 0;
+};
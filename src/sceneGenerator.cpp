@@ -0,0 +1,830 @@
+#include "pch.h"
+#include "sceneGenerator.h"
+#include "pngWriter.h"
+#include "jsonWriter.h"
+#include "base64.h"
+#include <algorithm>
+#include <cfloat>
+#include <chrono>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // glTF enums, spelled out so this file needs no GL header
+    const int COMPONENT_UNSIGNED_BYTE = 5121;
+    const int COMPONENT_UNSIGNED_SHORT = 5123;
+    const int COMPONENT_UNSIGNED_INT = 5125;
+    const int COMPONENT_FLOAT = 5126;
+    const int TARGET_ARRAY_BUFFER = 34962;
+    const int TARGET_ELEMENT_ARRAY_BUFFER = 34963;
+
+    const uint32_t GLB_MAGIC = 0x46546C67;     // "glTF"
+    const uint32_t GLB_CHUNK_JSON = 0x4E4F534A;
+    const uint32_t GLB_CHUNK_BIN = 0x004E4942;
+
+    const float ROOT_SPACING = 3.0f;
+    const float CHILD_SPREAD = 3.0f;
+    const float PRIMITIVE_SPACING = 2.2f;
+
+    // Every mixed mesh keeps normals, the renderer needs them
+    const uint32_t ATTRIBUTE_MIXES[] = {
+        SYNTHETIC_ALL_ATTRIBUTES,
+        SYNTHETIC_NORMAL | SYNTHETIC_TEXCOORD0,
+        SYNTHETIC_NORMAL | SYNTHETIC_TANGENT | SYNTHETIC_TEXCOORD0,
+        SYNTHETIC_NORMAL | SYNTHETIC_TEXCOORD0 | SYNTHETIC_TEXCOORD1 | SYNTHETIC_COLOR,
+        SYNTHETIC_NORMAL,
+    };
+
+    uint64_t align4(uint64_t size)
+    {
+        return (size + 3) & ~uint64_t(3);
+    }
+
+    void writeUint32(std::ostream& out, uint32_t value)
+    {
+        out.write(reinterpret_cast<const char*>(&value), sizeof(value));
+    }
+
+    bool parseAttributes(const std::string& list, uint32_t& attributes)
+    {
+        attributes = 0;
+        std::stringstream stream(list);
+        std::string name;
+        while (std::getline(stream, name, ','))
+        {
+            if (name == "normal") attributes |= SYNTHETIC_NORMAL;
+            else if (name == "tangent") attributes |= SYNTHETIC_TANGENT;
+            else if (name == "uv0") attributes |= SYNTHETIC_TEXCOORD0;
+            else if (name == "uv1") attributes |= SYNTHETIC_TEXCOORD1;
+            else if (name == "color") attributes |= SYNTHETIC_COLOR;
+            else if (name == "all") attributes |= SYNTHETIC_ALL_ATTRIBUTES;
+            else if (name != "position")
+            {
+                return false;
+            }
+        }
+        return true;
+    }
+}
+
+bool SceneGeneratorOptions::parse(int argc, char* argv[], SceneGeneratorOptions& options)
+{
+    if (argc < 3)
+    {
+        std::cerr << "Usage: --generate-scene <out.glb|out.gltf> [--nodes n] [--depth n] [--mesh-reuse r] [--primitives n] "
+                     "[--grid n] [--materials n] [--textures n] [--texture-size n] [--draco r] [--index-bits n] "
+                     "[--attributes normal,tangent,uv0,uv1,color] [--mix-attributes] [--embed] [--seed n]" << std::endl;
+        return false;
+    }
+    options.outputPath = argv[2];
+    for (int i = 3; i < argc; ++i)
+    {
+        std::string option = argv[i];
+        if (option == "--mix-attributes")
+        {
+            options.mixAttributes = true;
+            continue;
+        }
+        if (option == "--embed")
+        {
+            options.embedBuffers = true;
+            continue;
+        }
+        if (i + 1 >= argc)
+        {
+            std::cerr << option << " needs a value" << std::endl;
+            return false;
+        }
+        const char* value = argv[++i];
+        if (option == "--nodes")
+        {
+            options.nodes = std::max(1, std::atoi(value));
+        }
+        else if (option == "--depth")
+        {
+            options.depth = std::max(1, std::atoi(value));
+        }
+        else if (option == "--mesh-reuse")
+        {
+            options.meshReuse = std::clamp(static_cast<float>(std::atof(value)), 0.0f, 1.0f);
+        }
+        else if (option == "--primitives")
+        {
+            options.primitivesPerMesh = std::max(1, std::atoi(value));
+        }
+        else if (option == "--grid")
+        {
+            options.gridSize = std::max(2, std::atoi(value));
+        }
+        else if (option == "--materials")
+        {
+            options.materials = std::max(0, std::atoi(value));
+        }
+        else if (option == "--textures")
+        {
+            options.textures = std::max(0, std::atoi(value));
+        }
+        else if (option == "--texture-size")
+        {
+            options.textureSize = std::max(1, std::atoi(value));
+        }
+        else if (option == "--draco")
+        {
+            options.dracoRatio = std::clamp(static_cast<float>(std::atof(value)), 0.0f, 1.0f);
+        }
+        else if (option == "--index-bits")
+        {
+            options.indexBits = std::atoi(value);
+        }
+        else if (option == "--attributes")
+        {
+            if (!parseAttributes(value, options.attributes))
+            {
+                std::cerr << "--attributes expects a list of normal, tangent, uv0, uv1 and color, got " << value << std::endl;
+                return false;
+            }
+        }
+        else if (option == "--seed")
+        {
+            options.seed = static_cast<uint32_t>(std::strtoul(value, nullptr, 10));
+        }
+        else
+        {
+            std::cerr << "Unknown scene generator option " << option << std::endl;
+            return false;
+        }
+    }
+    return true;
+}
+
+SceneGenerator::SceneGenerator(const SceneGeneratorOptions& options)
+    : m_Options(options), m_Random(options.seed != 0 ? options.seed : 1)
+{
+}
+
+float SceneGenerator::random()
+{
+    m_Random = m_Random * 1664525u + 1013904223u;
+    return (m_Random >> 8) / 16777216.0f;
+}
+
+bool SceneGenerator::validate() const
+{
+    std::string extension = fs::path(m_Options.outputPath).extension().string();
+    if (extension != ".glb" && extension != ".gltf")
+    {
+        std::cerr << "Scene output must end in .glb or .gltf: " << m_Options.outputPath << std::endl;
+        return false;
+    }
+    int bits = m_Options.indexBits;
+    if (bits != 0 && bits != 8 && bits != 16 && bits != 32)
+    {
+        std::cerr << "--index-bits must be 8, 16, 32 or 0, got " << bits << std::endl;
+        return false;
+    }
+    uint64_t vertices = static_cast<uint64_t>(m_Options.gridSize) * m_Options.gridSize;
+    // The largest index of a component type is the primitive restart value, glTF forbids it
+    if (bits != 0 && bits != 32 && vertices >= (uint64_t(1) << bits))
+    {
+        std::cerr << m_Options.gridSize << "x" << m_Options.gridSize << " grids have " << vertices
+                  << " vertices, too many for " << bits << " bit indices" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+uint32_t SceneGenerator::getAttributes(int meshIndex) const
+{
+    if (!m_Options.mixAttributes)
+    {
+        return m_Options.attributes;
+    }
+    const size_t mixCount = sizeof(ATTRIBUTE_MIXES) / sizeof(ATTRIBUTE_MIXES[0]);
+    return m_Options.attributes & ATTRIBUTE_MIXES[meshIndex % mixCount];
+}
+
+int SceneGenerator::getIndexBits(uint32_t vertexCount) const
+{
+    if (m_Options.indexBits != 0)
+    {
+        return m_Options.indexBits;
+    }
+    // 255 and 65535 are the primitive restart values, glTF doesn't allow them as indices
+    return vertexCount < 256 ? 8 : (vertexCount < 65536 ? 16 : 32);
+}
+
+int SceneGenerator::addView(const void* data, size_t size, int target)
+{
+    m_Buffer.resize(align4(m_Buffer.size()), 0);
+    BufferView view{ m_Buffer.size(), size, target };
+    const unsigned char* bytes = static_cast<const unsigned char*>(data);
+    m_Buffer.insert(m_Buffer.end(), bytes, bytes + size);
+    m_Views.push_back(view);
+    return static_cast<int>(m_Views.size() - 1);
+}
+
+int SceneGenerator::addAccessor(int bufferView, int componentType, uint32_t count, const char* type)
+{
+    Accessor accessor = { bufferView, componentType, count, type, false, {}, {} };
+    m_Accessors.push_back(accessor);
+    return static_cast<int>(m_Accessors.size() - 1);
+}
+
+void SceneGenerator::buildMesh(int meshIndex)
+{
+    uint32_t attributes = getAttributes(meshIndex);
+    // Spreads the compressed meshes evenly instead of putting them all first
+    bool draco = std::floor((meshIndex + 1) * m_Options.dracoRatio) > std::floor(meshIndex * m_Options.dracoRatio);
+
+    std::vector<Primitive> primitives;
+    for (int p = 0; p < m_Options.primitivesPerMesh; ++p)
+    {
+        int index = meshIndex * m_Options.primitivesPerMesh + p;
+        SyntheticGrid grid = createSyntheticGrid(m_Options.gridSize, attributes, 10.0f + index % 40);
+        for (uint32_t i = 0; i < grid.vertexCount; ++i)
+        {
+            grid.positions[i * 3] += p * PRIMITIVE_SPACING;
+        }
+
+        Primitive primitive;
+        primitive.material = m_Options.materials > 0 ? index % m_Options.materials : -1;
+        struct Attribute
+        {
+            const std::vector<float>& values;
+            const char* name;
+            const char* type;
+            int components;
+        };
+        const Attribute sources[] = {
+            { grid.positions, "POSITION", "VEC3", 3 },
+            { grid.normals, "NORMAL", "VEC3", 3 },
+            { grid.tangents, "TANGENT", "VEC4", 4 },
+            { grid.texCoords0, "TEXCOORD_0", "VEC2", 2 },
+            { grid.texCoords1, "TEXCOORD_1", "VEC2", 2 },
+            { grid.colors, "COLOR_0", "VEC4", 4 },
+        };
+
+        DracoPrimitive compressed;
+        bool compressedOk = draco && encodeDracoGrid(grid, compressed);
+        uint32_t vertexCount = compressedOk ? compressed.pointCount : grid.vertexCount;
+        int indexBits = getIndexBits(vertexCount);
+        int indexComponent = indexBits == 8 ? COMPONENT_UNSIGNED_BYTE : (indexBits == 16 ? COMPONENT_UNSIGNED_SHORT : COMPONENT_UNSIGNED_INT);
+        if (compressedOk)
+        {
+            // Accessors without a view, the extension supplies the data
+            primitive.dracoView = addView(compressed.data.data(), compressed.data.size(), 0);
+            primitive.dracoIds = compressed.attributeIds;
+            for (const Attribute& attribute : sources)
+            {
+                if (!attribute.values.empty())
+                {
+                    primitive.attributes.emplace_back(attribute.name, addAccessor(-1, COMPONENT_FLOAT, vertexCount, attribute.type));
+                }
+            }
+            primitive.indices = addAccessor(-1, indexComponent, static_cast<uint32_t>(grid.indices.size()), "SCALAR");
+            m_Stats.dracoPrimitives++;
+        }
+        else
+        {
+            for (const Attribute& attribute : sources)
+            {
+                if (!attribute.values.empty())
+                {
+                    int view = addView(attribute.values.data(), attribute.values.size() * sizeof(float), TARGET_ARRAY_BUFFER);
+                    primitive.attributes.emplace_back(attribute.name, addAccessor(view, COMPONENT_FLOAT, vertexCount, attribute.type));
+                }
+            }
+            std::vector<unsigned char> indices(grid.indices.size() * (indexBits / 8));
+            for (size_t i = 0; i < grid.indices.size(); ++i)
+            {
+                uint32_t value = grid.indices[i];
+                std::memcpy(&indices[i * (indexBits / 8)], &value, indexBits / 8);
+            }
+            int view = addView(indices.data(), indices.size(), TARGET_ELEMENT_ARRAY_BUFFER);
+            primitive.indices = addAccessor(view, indexComponent, static_cast<uint32_t>(grid.indices.size()), "SCALAR");
+        }
+
+        Accessor& position = m_Accessors[primitive.attributes.front().second];
+        position.bounds = true;
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            position.min[axis] = FLT_MAX;
+            position.max[axis] = -FLT_MAX;
+        }
+        for (uint32_t i = 0; i < grid.vertexCount; ++i)
+        {
+            for (int axis = 0; axis < 3; ++axis)
+            {
+                position.min[axis] = std::min(position.min[axis], grid.positions[i * 3 + axis]);
+                position.max[axis] = std::max(position.max[axis], grid.positions[i * 3 + axis]);
+            }
+        }
+
+        primitives.push_back(std::move(primitive));
+        m_Stats.primitives++;
+        m_Stats.vertices += vertexCount;
+        m_Stats.triangles += grid.indices.size() / 3;
+    }
+    m_Meshes.push_back(std::move(primitives));
+}
+
+std::vector<unsigned char> SceneGenerator::createTexture(int index) const
+{
+    // A checkerboard in a color of its own, so textures differ and mismatches are easy to spot
+    int size = m_Options.textureSize;
+    uint32_t hash = static_cast<uint32_t>(index) * 2654435761u + m_Options.seed;
+    unsigned char color[3] = { static_cast<unsigned char>(hash >> 24), static_cast<unsigned char>(hash >> 16), static_cast<unsigned char>(hash >> 8) };
+    int cell = std::max(1, size / 8);
+    std::vector<unsigned char> pixels(static_cast<size_t>(size) * size * 3);
+    for (int y = 0; y < size; ++y)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            bool light = ((x / cell) + (y / cell)) % 2 == 0;
+            unsigned char* pixel = &pixels[(static_cast<size_t>(y) * size + x) * 3];
+            for (int channel = 0; channel < 3; ++channel)
+            {
+                pixel[channel] = light ? color[channel] : static_cast<unsigned char>(color[channel] / 4);
+            }
+        }
+    }
+    return PngWriter::encode(size, size, 3, pixels.data());
+}
+
+void SceneGenerator::writeJson(std::ostream& out, bool glb, const std::string& bufferUri, const std::string& imagePrefix) const
+{
+    JsonWriter json(out);
+    json.beginObject();
+    json.key("asset");
+    json.beginObject();
+    json.field("version", "2.0");
+    json.field("generator", "spaceStation SceneGenerator");
+    json.endObject();
+
+    if (m_Stats.dracoPrimitives > 0)
+    {
+        for (const char* list : { "extensionsUsed", "extensionsRequired" })
+        {
+            json.key(list);
+            json.beginArray();
+            json.value("KHR_draco_mesh_compression");
+            json.endArray();
+        }
+    }
+
+    std::vector<std::vector<int>> children(m_NodeMeshes.size());
+    std::vector<int> roots;
+    for (size_t i = 0; i < m_NodeParents.size(); ++i)
+    {
+        if (m_NodeParents[i] < 0)
+        {
+            roots.push_back(static_cast<int>(i));
+        }
+        else
+        {
+            children[m_NodeParents[i]].push_back(static_cast<int>(i));
+        }
+    }
+
+    json.field("scene", 0);
+    json.key("scenes");
+    json.beginArray();
+    json.beginObject();
+    json.key("nodes");
+    json.beginArray();
+    for (int root : roots)
+    {
+        json.value(root);
+    }
+    json.endArray();
+    json.endObject();
+    json.endArray();
+
+    json.key("nodes");
+    json.beginArray();
+    for (size_t i = 0; i < m_NodeMeshes.size(); ++i)
+    {
+        json.beginObject();
+        json.field("mesh", m_NodeMeshes[i]);
+        json.key("translation");
+        json.beginArray();
+        for (int axis = 0; axis < 3; ++axis)
+        {
+            json.value(m_NodeTranslations[i * 3 + axis]);
+        }
+        json.endArray();
+        if (!children[i].empty())
+        {
+            json.key("children");
+            json.beginArray();
+            for (int child : children[i])
+            {
+                json.value(child);
+            }
+            json.endArray();
+        }
+        json.endObject();
+    }
+    json.endArray();
+
+    json.key("meshes");
+    json.beginArray();
+    for (const auto& mesh : m_Meshes)
+    {
+        json.beginObject();
+        json.key("primitives");
+        json.beginArray();
+        for (const Primitive& primitive : mesh)
+        {
+            json.beginObject();
+            json.key("attributes");
+            json.beginObject();
+            for (const auto& attribute : primitive.attributes)
+            {
+                json.field(attribute.first, attribute.second);
+            }
+            json.endObject();
+            json.field("indices", primitive.indices);
+            if (primitive.material >= 0)
+            {
+                json.field("material", primitive.material);
+            }
+            if (primitive.dracoView >= 0)
+            {
+                json.key("extensions");
+                json.beginObject();
+                json.key("KHR_draco_mesh_compression");
+                json.beginObject();
+                json.field("bufferView", primitive.dracoView);
+                json.key("attributes");
+                json.beginObject();
+                for (const auto& id : primitive.dracoIds)
+                {
+                    json.field(id.first, id.second);
+                }
+                json.endObject();
+                json.endObject();
+                json.endObject();
+            }
+            json.endObject();
+        }
+        json.endArray();
+        json.endObject();
+    }
+    json.endArray();
+
+    if (m_Options.materials > 0)
+    {
+        json.key("materials");
+        json.beginArray();
+        for (int i = 0; i < m_Options.materials; ++i)
+        {
+            json.beginObject();
+            json.field("name", "material_" + std::to_string(i));
+            json.key("pbrMetallicRoughness");
+            json.beginObject();
+            json.key("baseColorFactor");
+            json.beginArray();
+            uint32_t hash = static_cast<uint32_t>(i) * 2246822519u + m_Options.seed;
+            json.value(0.5f + (hash >> 24) / 510.0f);
+            json.value(0.5f + ((hash >> 16) & 0xFF) / 510.0f);
+            json.value(0.5f + ((hash >> 8) & 0xFF) / 510.0f);
+            json.value(1.0f);
+            json.endArray();
+            json.field("metallicFactor", (i % 4) / 3.0f);
+            json.field("roughnessFactor", 0.2f + (i % 5) * 0.2f);
+            if (m_Options.textures > 0)
+            {
+                json.key("baseColorTexture");
+                json.beginObject();
+                json.field("index", i % m_Options.textures);
+                json.endObject();
+            }
+            json.endObject();
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    uint64_t imageStart = align4(m_Buffer.size());
+    uint64_t imageStride = align4(m_ImageSize);
+    if (m_Options.textures > 0)
+    {
+        json.key("samplers");
+        json.beginArray();
+        json.beginObject();
+        json.field("magFilter", 9729);     // LINEAR
+        json.field("minFilter", 9987);     // LINEAR_MIPMAP_LINEAR
+        json.endObject();
+        json.endArray();
+
+        json.key("textures");
+        json.beginArray();
+        for (int i = 0; i < m_Options.textures; ++i)
+        {
+            json.beginObject();
+            json.field("sampler", 0);
+            json.field("source", i);
+            json.endObject();
+        }
+        json.endArray();
+
+        json.key("images");
+        json.beginArray();
+        for (int i = 0; i < m_Options.textures; ++i)
+        {
+            json.beginObject();
+            if (glb)
+            {
+                json.field("bufferView", static_cast<int>(m_Views.size()) + i);
+                json.field("mimeType", "image/png");
+            }
+            else if (m_Options.embedBuffers)
+            {
+                std::vector<unsigned char> png = createTexture(i);
+                json.field("uri", "data:image/png;base64," + base64_encode(png.data(), png.size()));
+            }
+            else
+            {
+                json.field("uri", imagePrefix + "texture_" + std::to_string(i) + ".png");
+            }
+            json.endObject();
+        }
+        json.endArray();
+    }
+
+    json.key("buffers");
+    json.beginArray();
+    json.beginObject();
+    json.field("byteLength", glb ? imageStart + imageStride * m_Options.textures : static_cast<uint64_t>(m_Buffer.size()));
+    if (!glb)
+    {
+        json.field("uri", bufferUri);
+    }
+    json.endObject();
+    json.endArray();
+
+    json.key("bufferViews");
+    json.beginArray();
+    for (const BufferView& view : m_Views)
+    {
+        json.beginObject();
+        json.field("buffer", 0);
+        json.field("byteOffset", view.offset);
+        json.field("byteLength", view.length);
+        if (view.target != 0)
+        {
+            json.field("target", view.target);
+        }
+        json.endObject();
+    }
+    for (int i = 0; glb && i < m_Options.textures; ++i)
+    {
+        json.beginObject();
+        json.field("buffer", 0);
+        json.field("byteOffset", imageStart + imageStride * i);
+        json.field("byteLength", m_ImageSize);
+        json.endObject();
+    }
+    json.endArray();
+
+    json.key("accessors");
+    json.beginArray();
+    for (const Accessor& accessor : m_Accessors)
+    {
+        json.beginObject();
+        if (accessor.bufferView >= 0)
+        {
+            json.field("bufferView", accessor.bufferView);
+        }
+        json.field("componentType", accessor.componentType);
+        json.field("count", accessor.count);
+        json.field("type", accessor.type);
+        if (accessor.bounds)
+        {
+            json.key("min");
+            json.beginArray();
+            json.value(accessor.min[0]); json.value(accessor.min[1]); json.value(accessor.min[2]);
+            json.endArray();
+            json.key("max");
+            json.beginArray();
+            json.value(accessor.max[0]); json.value(accessor.max[1]); json.value(accessor.max[2]);
+            json.endArray();
+        }
+        json.endObject();
+    }
+    json.endArray();
+    json.endObject();
+    out << "\n";
+}
+
+bool SceneGenerator::writeGltf()
+{
+    fs::path path(m_Options.outputPath);
+    fs::path directory = path.parent_path();
+    std::string stem = path.stem().string();
+    std::string bufferUri;
+    std::string imagePrefix = stem + "_textures/";
+    std::error_code error;
+
+    if (m_Options.embedBuffers)
+    {
+        bufferUri = "data:application/octet-stream;base64," + base64_encode(m_Buffer.data(), m_Buffer.size());
+    }
+    else
+    {
+        bufferUri = stem + ".bin";
+        std::ofstream bin(directory / bufferUri, std::ios::binary);
+        bin.write(reinterpret_cast<const char*>(m_Buffer.data()), m_Buffer.size());
+        if (!bin)
+        {
+            std::cerr << "Failed to write " << (directory / bufferUri).string() << std::endl;
+            return false;
+        }
+
+        if (m_Options.textures > 0)
+        {
+            fs::create_directories(directory / imagePrefix, error);
+        }
+        for (int i = 0; i < m_Options.textures; ++i)
+        {
+            std::vector<unsigned char> png = createTexture(i);
+            fs::path imagePath = directory / (imagePrefix + "texture_" + std::to_string(i) + ".png");
+            std::ofstream image(imagePath, std::ios::binary);
+            image.write(reinterpret_cast<const char*>(png.data()), png.size());
+            if (!image)
+            {
+                std::cerr << "Failed to write " << imagePath.string() << std::endl;
+                return false;
+            }
+        }
+    }
+
+    std::string temporaryPath = m_Options.outputPath + ".tmp";
+    {
+        std::ofstream file(temporaryPath);
+        writeJson(file, false, bufferUri, imagePrefix);
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    fs::rename(temporaryPath, m_Options.outputPath, error);
+    return !error;
+}
+
+bool SceneGenerator::writeGlb()
+{
+    std::ostringstream jsonStream;
+    writeJson(jsonStream, true, std::string(), std::string());
+    std::string json = jsonStream.str();
+    json.resize(align4(json.size()), ' ');
+
+    uint64_t imageStart = align4(m_Buffer.size());
+    uint64_t imageStride = align4(m_ImageSize);
+    uint64_t binSize = imageStart + imageStride * m_Options.textures;
+    uint64_t totalSize = 12 + 8 + json.size() + 8 + binSize;
+    if (totalSize > UINT32_MAX)
+    {
+        std::cerr << "Scene is " << totalSize / (1024 * 1024) << " MB, GLB files end at 4 GB. Write .gltf instead" << std::endl;
+        return false;
+    }
+
+    std::string temporaryPath = m_Options.outputPath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        writeUint32(file, GLB_MAGIC);
+        writeUint32(file, 2);
+        writeUint32(file, static_cast<uint32_t>(totalSize));
+        writeUint32(file, static_cast<uint32_t>(json.size()));
+        writeUint32(file, GLB_CHUNK_JSON);
+        file.write(json.data(), json.size());
+        writeUint32(file, static_cast<uint32_t>(binSize));
+        writeUint32(file, GLB_CHUNK_BIN);
+        file.write(reinterpret_cast<const char*>(m_Buffer.data()), m_Buffer.size());
+
+        const char padding[4] = {};
+        file.write(padding, imageStart - m_Buffer.size());
+        for (int i = 0; i < m_Options.textures; ++i)
+        {
+            std::vector<unsigned char> png = createTexture(i);
+            file.write(reinterpret_cast<const char*>(png.data()), png.size());
+            file.write(padding, imageStride - png.size());
+        }
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporaryPath, m_Options.outputPath, error);
+    return !error;
+}
+
+bool SceneGenerator::write()
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    if (!validate())
+    {
+        return false;
+    }
+
+    m_Stats = GeneratedSceneStats();
+    m_Buffer.clear();
+    m_Views.clear();
+    m_Accessors.clear();
+    m_Meshes.clear();
+
+    int nodes = m_Options.nodes;
+    int meshCount = std::clamp(static_cast<int>(std::lround(nodes * (1.0f - m_Options.meshReuse))), 1, nodes);
+    for (int i = 0; i < meshCount; ++i)
+    {
+        buildMesh(i);
+    }
+
+    // A tree with the smallest branching factor that fits every node within depth levels,
+    // 0 leaves every node a root
+    auto getCapacity = [&](int branching)
+        {
+            double capacity = 0.0;
+            double level = 1.0;
+            for (int d = 0; d < m_Options.depth && capacity < nodes; ++d, level *= branching)
+            {
+                capacity += level;
+            }
+            return capacity;
+        };
+    int branching = 0;
+    if (m_Options.depth > 1 && nodes > 1)
+    {
+        for (branching = 1; getCapacity(branching) < nodes; ++branching)
+        {
+        }
+    }
+    m_NodeMeshes.resize(nodes);
+    m_NodeParents.resize(nodes);
+    m_NodeTranslations.resize(static_cast<size_t>(nodes) * 3);
+    int rootCount = branching > 0 ? 1 : nodes;
+    int side = static_cast<int>(std::ceil(std::sqrt(static_cast<double>(rootCount))));
+    for (int i = 0; i < nodes; ++i)
+    {
+        // Nodes take the meshes in turn, so every mesh is used before any is reused
+        m_NodeMeshes[i] = i % meshCount;
+        m_NodeParents[i] = branching > 0 && i > 0 ? (i - 1) / branching : -1;
+        float* translation = &m_NodeTranslations[static_cast<size_t>(i) * 3];
+        if (m_NodeParents[i] < 0)
+        {
+            translation[0] = (i % side) * ROOT_SPACING * m_Options.primitivesPerMesh;
+            translation[1] = 0.0f;
+            translation[2] = (i / side) * ROOT_SPACING;
+        }
+        else
+        {
+            translation[0] = (random() - 0.5f) * 2.0f * CHILD_SPREAD;
+            translation[1] = random();
+            translation[2] = (random() - 0.5f) * 2.0f * CHILD_SPREAD;
+        }
+    }
+
+    // PngWriter stores the pixels uncompressed, so every texture of this size encodes to the same length
+    if (m_Options.textures > 0)
+    {
+        m_ImageSize = createTexture(0).size();
+    }
+    m_Stats.nodes = nodes;
+    m_Stats.meshes = meshCount;
+    m_Stats.materials = m_Options.materials;
+    m_Stats.textures = m_Options.textures;
+    m_Stats.bufferBytes = m_Buffer.size();
+    m_Stats.imageBytes = m_ImageSize * m_Options.textures;
+
+    bool glb = fs::path(m_Options.outputPath).extension() == ".glb";
+    if (glb && m_Options.embedBuffers)
+    {
+        std::cout << "--embed has no effect on .glb output" << std::endl;
+    }
+    bool written = glb ? writeGlb() : writeGltf();
+    std::chrono::duration<float, std::milli> generateTime = std::chrono::high_resolution_clock::now() - start;
+    m_Stats.generateMs = generateTime.count();
+    return written;
+}
+
+void SceneGenerator::printStats() const
+{
+    std::cout << "Scene written to " << m_Options.outputPath << " in " << m_Stats.generateMs << "ms\n"
+              << "  " << m_Stats.nodes << " nodes (depth " << m_Options.depth << "), " << m_Stats.meshes << " meshes, "
+              << m_Stats.primitives << " primitives (" << m_Stats.dracoPrimitives << " Draco)\n"
+              << "  " << m_Stats.vertices << " vertices, " << m_Stats.triangles << " triangles before instancing\n"
+              << "  " << m_Stats.materials << " materials, " << m_Stats.textures << " textures of " << m_Options.textureSize << "x" << m_Options.textureSize << "\n"
+              << "  Geometry " << m_Stats.bufferBytes / 1024 << " KB, images " << m_Stats.imageBytes / 1024 << " KB" << std::endl;
+}
@@ -0,0 +1,117 @@
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <string>
+#include <utility>
+#include <vector>
+#include "syntheticMesh.h"
+
+struct SceneGeneratorOptions
+{
+    std::string outputPath = "stress.glb";  // .glb, or .gltf with a .bin and a texture folder next to it
+    int nodes = 1000;
+    int depth = 4;                  // most levels of the node hierarchy, 1 keeps every node a root
+    float meshReuse = 0.9f;         // share of nodes that instance a mesh another node already uses
+    int primitivesPerMesh = 1;
+    int gridSize = 32;              // vertices per side of each primitive's grid
+    int materials = 100;
+    int textures = 16;              // base color textures, shared round robin by the materials
+    int textureSize = 256;
+    float dracoRatio = 0.0f;        // share of meshes stored with KHR_draco_mesh_compression
+    int indexBits = 0;              // 8, 16 or 32, 0 picks the smallest width that fits
+    uint32_t attributes = SYNTHETIC_NORMAL | SYNTHETIC_TANGENT | SYNTHETIC_TEXCOORD0;
+    bool mixAttributes = false;     // meshes cycle through subsets of attributes
+    bool embedBuffers = false;      // .gltf only, base64 data URIs instead of side files
+    uint32_t seed = 1;
+
+    // --generate-scene <out.glb|out.gltf> [--nodes n] [--depth n] [--mesh-reuse r] [--primitives n]
+    //   [--grid n] [--materials n] [--textures n] [--texture-size n] [--draco r] [--index-bits n]
+    //   [--attributes normal,tangent,uv0,uv1,color] [--mix-attributes] [--embed] [--seed n]
+    static bool parse(int argc, char* argv[], SceneGeneratorOptions& options);
+};
+
+struct GeneratedSceneStats
+{
+    size_t nodes = 0;
+    size_t meshes = 0;
+    size_t primitives = 0;          // unique, before instancing
+    size_t dracoPrimitives = 0;
+    size_t materials = 0;
+    size_t textures = 0;
+    uint64_t vertices = 0;          // unique, before instancing
+    uint64_t triangles = 0;
+    uint64_t bufferBytes = 0;       // geometry, compressed or not
+    uint64_t imageBytes = 0;
+    float generateMs = 0.0f;
+};
+
+// Writes valid glTF 2.0 stress scenes, so load and frame time can be measured along one axis at
+// a time: node count and depth, mesh reuse, material and texture count, texture size, Draco
+// use, index width and attribute sets. Output is deterministic for a seed.
+//
+// Geometry goes into one buffer. Textures are generated one at a time and written straight
+// to their file or the GLB, so thousands of them never sit in memory together.
+class SceneGenerator
+{
+public:
+    explicit SceneGenerator(const SceneGeneratorOptions& options);
+
+    bool write();
+    const GeneratedSceneStats& getStats() const { return m_Stats; }
+    void printStats() const;
+
+private:
+    struct BufferView
+    {
+        uint64_t offset;
+        uint64_t length;
+        int target;                 // 0 for none
+    };
+
+    struct Accessor
+    {
+        int bufferView;             // -1 for Draco attributes, their data lives in the extension's view
+        int componentType;
+        uint32_t count;
+        const char* type;
+        bool bounds;                // POSITION needs min and max
+        float min[3];
+        float max[3];
+    };
+
+    struct Primitive
+    {
+        std::vector<std::pair<std::string, int>> attributes;    // glTF name, accessor
+        int indices = -1;
+        int material = -1;
+        int dracoView = -1;
+        std::vector<std::pair<std::string, int>> dracoIds;
+    };
+
+    bool validate() const;
+    void buildMesh(int meshIndex);
+    int addView(const void* data, size_t size, int target);
+    int addAccessor(int bufferView, int componentType, uint32_t count, const char* type);
+    uint32_t getAttributes(int meshIndex) const;
+    int getIndexBits(uint32_t vertexCount) const;
+    // GLB keeps the images in the buffer after the geometry, .gltf writes imagePrefix + texture_N.png
+    // or, with embedBuffers, data URIs
+    void writeJson(std::ostream& out, bool glb, const std::string& bufferUri, const std::string& imagePrefix) const;
+    bool writeGltf();
+    bool writeGlb();
+    std::vector<unsigned char> createTexture(int index) const;
+    float random();
+
+    SceneGeneratorOptions m_Options;
+    GeneratedSceneStats m_Stats;
+    uint32_t m_Random = 1;
+
+    std::vector<unsigned char> m_Buffer;
+    std::vector<BufferView> m_Views;
+    std::vector<Accessor> m_Accessors;
+    std::vector<std::vector<Primitive>> m_Meshes;
+    std::vector<int> m_NodeMeshes;
+    std::vector<int> m_NodeParents;             // -1 for roots
+    std::vector<float> m_NodeTranslations;      // xyz per node
+    uint64_t m_ImageSize = 0;                   // every generated PNG has the same size
+};
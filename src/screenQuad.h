@@ -0,0 +1,58 @@
+#pragma once
+#include <glad/glad.h>
+#include "renderStats.h"
+
+// Fullscreen quad matching the vertex layout of shaders/postShader.vert
+// (location 0: vec2 position, location 1: vec2 texture coordinates)
+class ScreenQuad
+{
+public:
+    GLuint m_VAO = 0;
+    GLuint m_VBO = 0;
+
+    void create()
+    {
+        if (m_VAO != 0)
+        {
+            return;
+        }
+
+        const float quadVertices[] = {
+            // positions   // texCoords
+            -1.0f,  1.0f,  0.0f, 1.0f,
+            -1.0f, -1.0f,  0.0f, 0.0f,
+             1.0f, -1.0f,  1.0f, 0.0f,
+
+            -1.0f,  1.0f,  0.0f, 1.0f,
+             1.0f, -1.0f,  1.0f, 0.0f,
+             1.0f,  1.0f,  1.0f, 1.0f
+        };
+
+        glGenVertexArrays(1, &m_VAO);
+        glGenBuffers(1, &m_VBO);
+        glBindVertexArray(m_VAO);
+        glBindBuffer(GL_ARRAY_BUFFER, m_VBO);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(quadVertices), quadVertices, GL_STATIC_DRAW);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)0);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(1, 2, GL_FLOAT, GL_FALSE, 4 * sizeof(float), (void*)(2 * sizeof(float)));
+        glEnableVertexAttribArray(1);
+        glBindVertexArray(0);
+    }
+
+    void draw()
+    {
+        glBindVertexArray(m_VAO);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+        RenderStats::get().countDraw();
+        glBindVertexArray(0);
+    }
+
+    void destroy()
+    {
+        glDeleteBuffers(1, &m_VBO);
+        glDeleteVertexArrays(1, &m_VAO);
+        m_VAO = 0;
+        m_VBO = 0;
+    }
+};
@@ -9,6 +9,9 @@
 #include <sstream>
 #include <iostream>
 #include <unordered_map>
+#include <vector>
+#include <algorithm>
+#include "shaderCache.h"
 
 class Shader
 {
@@ -19,89 +22,83 @@ public:
     // ------------------------------------------------------------------------
     Shader(const char* vertexPath, const char* fragmentPath, const char* geometryPath = nullptr)
     {
-        // 1. retrieve the vertex/fragment source code from filePath
-        std::string vertexCode;
-        std::string fragmentCode;
-        std::string geometryCode;
-        std::ifstream vShaderFile;
-        std::ifstream fShaderFile;
-        std::ifstream gShaderFile;
-        // ensure ifstream objects can throw exceptions:
-        vShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        fShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        gShaderFile.exceptions (std::ifstream::failbit | std::ifstream::badbit);
-        try 
-        {
-            // open files
-            vShaderFile.open(vertexPath);
-            fShaderFile.open(fragmentPath);
-            std::stringstream vShaderStream, fShaderStream;
-            // read file's buffer contents into streams
-            vShaderStream << vShaderFile.rdbuf();
-            fShaderStream << fShaderFile.rdbuf();		
-            // close file handlers
-            vShaderFile.close();
-            fShaderFile.close();
-            // convert stream into string
-            vertexCode = vShaderStream.str();
-            fragmentCode = fShaderStream.str();			
-            // if geometry shader path is present, also load a geometry shader
-            if(geometryPath != nullptr)
+        load(vertexPath, fragmentPath, geometryPath, {});
+    }
+    // constructor for a variant compiled with extra preprocessor defines ("NAME" or "NAME VALUE")
+    // ------------------------------------------------------------------------
+    Shader(const char* vertexPath, const char* fragmentPath, const std::vector<std::string>& defines)
+    {
+        load(vertexPath, fragmentPath, nullptr, defines);
+    }
+
+    void load(const char* vertexPath, const char* fragmentPath, const char* geometryPath, const std::vector<std::string>& defines)
+    {
+        m_VertexPath = vertexPath;
+        m_FragmentPath = fragmentPath;
+        m_GeometryPath = geometryPath ? geometryPath : "";
+        m_Defines = defines;
+        ID = beginBuild();
+    }
+    // constructor for a compute-only program
+    // ------------------------------------------------------------------------
+    explicit Shader(const char* computePath)
+    {
+        m_ComputePath = computePath;
+        ID = beginBuild();
+    }
+    // The constructor only starts the compile and link so that programs created back to back
+    // compile in parallel. This waits for it, use() calls it the first time.
+    // ------------------------------------------------------------------------
+    bool finishBuild()
+    {
+        return endBuild(ID);
+    }
+    // recompiles from the same files, keeps the current program if the new one does not link
+    // ------------------------------------------------------------------------
+    bool reload()
+    {
+        finishBuild();
+        GLuint program = beginBuild();
+        bool linked = endBuild(program);
+        if (!linked)
+        {
+            glDeleteProgram(program);
+            m_Linked = true;    // ID is still the old, linked program
+            return false;
+        }
+        glDeleteProgram(ID);
+        ID = program;
+        m_uniformCache.clear();
+        return true;
+    }
+    // source files this program is built from, including the #included ones
+    // ------------------------------------------------------------------------
+    std::vector<std::string> getSourcePaths() const
+    {
+        std::vector<std::string> paths;
+        if (!m_ComputePath.empty())
+        {
+            paths.push_back(m_ComputePath);
+        }
+        else
+        {
+            paths = { m_VertexPath, m_FragmentPath };
+            if (!m_GeometryPath.empty())
             {
-                gShaderFile.open(geometryPath);
-                std::stringstream gShaderStream;
-                gShaderStream << gShaderFile.rdbuf();
-                gShaderFile.close();
-                geometryCode = gShaderStream.str();
+                paths.push_back(m_GeometryPath);
             }
         }
-        catch (std::ifstream::failure& e)
-        {
-            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << e.what() << std::endl;
-        }
-        const char* vShaderCode = vertexCode.c_str();
-        const char * fShaderCode = fragmentCode.c_str();
-        // 2. compile shaders
-        unsigned int vertex, fragment;
-        // vertex shader
-        vertex = glCreateShader(GL_VERTEX_SHADER);
-        glShaderSource(vertex, 1, &vShaderCode, NULL);
-        glCompileShader(vertex);
-        checkCompileErrors(vertex, "VERTEX");
-        // fragment Shader
-        fragment = glCreateShader(GL_FRAGMENT_SHADER);
-        glShaderSource(fragment, 1, &fShaderCode, NULL);
-        glCompileShader(fragment);
-        checkCompileErrors(fragment, "FRAGMENT");
-        // if geometry shader is given, compile geometry shader
-        unsigned int geometry;
-        if(geometryPath != nullptr)
-        {
-            const char * gShaderCode = geometryCode.c_str();
-            geometry = glCreateShader(GL_GEOMETRY_SHADER);
-            glShaderSource(geometry, 1, &gShaderCode, NULL);
-            glCompileShader(geometry);
-            checkCompileErrors(geometry, "GEOMETRY");
-        }
-        // shader Program
-        ID = glCreateProgram();
-        glAttachShader(ID, vertex);
-        glAttachShader(ID, fragment);
-        if(geometryPath != nullptr)
-            glAttachShader(ID, geometry);
-        glLinkProgram(ID);
-        checkCompileErrors(ID, "PROGRAM");
-        // delete the shaders as they're linked into our program now and no longer necessary
-        glDeleteShader(vertex);
-        glDeleteShader(fragment);
-        if(geometryPath != nullptr)
-            glDeleteShader(geometry);
-
+        paths.insert(paths.end(), m_IncludePaths.begin(), m_IncludePaths.end());
+        return paths;
     }
     // activate the shader
     // ------------------------------------------------------------------------
-    void use() 
+    void use()
     { 
+        if (m_Building)
+        {
+            finishBuild();
+        }
         glUseProgram(ID); 
     }
 
@@ -182,10 +179,203 @@ public:
         glUniformMatrix4fv(getUniformlocation(name), 1, GL_FALSE, &mat[0][0]);
     }
 
+    // inserts "#define ..." lines right after the #version directive
+    // ------------------------------------------------------------------------
+    static std::string applyDefines(const std::string& source, const std::vector<std::string>& defines)
+    {
+        if (defines.empty())
+        {
+            return source;
+        }
+        std::string defineBlock;
+        for (const auto& define : defines)
+        {
+            defineBlock += "#define " + define + "\n";
+        }
+        size_t versionPos = source.find("#version");
+        if (versionPos == std::string::npos)
+        {
+            return defineBlock + source;
+        }
+        size_t lineEnd = source.find('\n', versionPos);
+        if (lineEnd == std::string::npos)
+        {
+            return source + "\n" + defineBlock;
+        }
+        return source.substr(0, lineEnd + 1) + defineBlock + source.substr(lineEnd + 1);
+    }
+
 private:
+    std::string m_VertexPath;
+    std::string m_FragmentPath;
+    std::string m_GeometryPath;
+    std::string m_ComputePath;
+    std::vector<std::string> m_Defines;
+    std::vector<std::string> m_IncludePaths;
+
+    struct PendingStage
+    {
+        GLuint shader;
+        const char* type;
+    };
+    std::vector<PendingStage> m_PendingStages;
+    uint64_t m_CacheKey = 0;
+    bool m_Building = false;
+    bool m_Linked = false;
+
+    // reads a source file and splices in every #include "file" line, resolved relative to the
+    // including file. A file is included once per stage, so shared files need no guards
+    // ------------------------------------------------------------------------
+    static std::string readSource(const std::string& path, std::vector<std::string>& included)
+    {
+        std::string text;
+        std::ifstream file;
+        // ensure ifstream objects can throw exceptions:
+        file.exceptions(std::ifstream::failbit | std::ifstream::badbit);
+        try
+        {
+            file.open(path);
+            std::stringstream stream;
+            stream << file.rdbuf();
+            file.close();
+            text = stream.str();
+        }
+        catch (std::ifstream::failure& e)
+        {
+            std::cout << "ERROR::SHADER::FILE_NOT_SUCCESSFULLY_READ: " << path << " " << e.what() << std::endl;
+        }
+
+        std::string directory = path.substr(0, path.find_last_of("/\\") + 1);
+        std::string source;
+        std::istringstream lines(text);
+        std::string line;
+        while (std::getline(lines, line))
+        {
+            size_t start = line.find_first_not_of(" \t");
+            size_t open = start != std::string::npos && line.compare(start, 8, "#include") == 0 ? line.find('"', start) : std::string::npos;
+            size_t close = open != std::string::npos ? line.find('"', open + 1) : std::string::npos;
+            if (close != std::string::npos)
+            {
+                std::string includePath = directory + line.substr(open + 1, close - open - 1);
+                if (std::find(included.begin(), included.end(), includePath) == included.end())
+                {
+                    included.push_back(includePath);
+                    source += readSource(includePath, included);
+                }
+                continue;
+            }
+            source += line;
+            source += '\n';
+        }
+        return source;
+    }
+
+    std::string readStage(const std::string& path)
+    {
+        std::vector<std::string> included;
+        std::string source = readSource(path, included);
+        for (const auto& includePath : included)
+        {
+            if (std::find(m_IncludePaths.begin(), m_IncludePaths.end(), includePath) == m_IncludePaths.end())
+            {
+                m_IncludePaths.push_back(includePath);
+            }
+        }
+        return source;
+    }
+
+    static const char* getStageName(GLenum type)
+    {
+        switch (type)
+        {
+        case GL_VERTEX_SHADER: return "VERTEX";
+        case GL_FRAGMENT_SHADER: return "FRAGMENT";
+        case GL_GEOMETRY_SHADER: return "GEOMETRY";
+        default: return "COMPUTE";
+        }
+    }
+
+    // 1. reads the sources, 2. links the cached binary or issues the compile and link.
+    // Nothing here waits for the driver, endBuild() does
+    // ------------------------------------------------------------------------
+    GLuint beginBuild()
+    {
+        std::vector<std::pair<GLenum, std::string>> stages;
+        m_IncludePaths.clear();
+        if (!m_ComputePath.empty())
+        {
+            stages.push_back({ GL_COMPUTE_SHADER, readStage(m_ComputePath) });
+        }
+        else
+        {
+            stages.push_back({ GL_VERTEX_SHADER, applyDefines(readStage(m_VertexPath), m_Defines) });
+            stages.push_back({ GL_FRAGMENT_SHADER, applyDefines(readStage(m_FragmentPath), m_Defines) });
+            if (!m_GeometryPath.empty())
+            {
+                stages.push_back({ GL_GEOMETRY_SHADER, applyDefines(readStage(m_GeometryPath), m_Defines) });
+            }
+        }
+
+        ShaderCache& cache = ShaderCache::get();
+        m_CacheKey = cache.getKey(stages);
+        GLuint program = glCreateProgram();
+        if (cache.load(m_CacheKey, program))
+        {
+            m_Building = false;
+            m_Linked = true;
+            return program;
+        }
+        // A refused binary leaves the program failed to link, start from a clean one
+        glDeleteProgram(program);
+        program = glCreateProgram();
+        cache.countCompile();
+
+        for (const auto& stage : stages)
+        {
+            const char* code = stage.second.c_str();
+            GLuint shader = glCreateShader(stage.first);
+            glShaderSource(shader, 1, &code, NULL);
+            glCompileShader(shader);
+            glAttachShader(program, shader);
+            m_PendingStages.push_back({ shader, getStageName(stage.first) });
+        }
+        glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+        glLinkProgram(program);
+        m_Building = true;
+        return program;
+    }
+
+    // 3. waits for the link, reports errors and stores the binary; false if anything failed
+    // ------------------------------------------------------------------------
+    bool endBuild(GLuint program)
+    {
+        if (!m_Building)
+        {
+            return m_Linked;
+        }
+        m_Building = false;
+        for (const PendingStage& stage : m_PendingStages)
+        {
+            checkCompileErrors(stage.shader, stage.type);
+        }
+        m_Linked = checkCompileErrors(program, "PROGRAM");
+        // delete the shaders as they're linked into our program now and no longer necessary
+        for (const PendingStage& stage : m_PendingStages)
+        {
+            glDetachShader(program, stage.shader);
+            glDeleteShader(stage.shader);
+        }
+        m_PendingStages.clear();
+        if (m_Linked)
+        {
+            ShaderCache::get().store(m_CacheKey, program);
+        }
+        return m_Linked;
+    }
+
     // utility function for checking shader compilation/linking errors.
     // ------------------------------------------------------------------------
-    void checkCompileErrors(GLuint shader, std::string type)
+    bool checkCompileErrors(GLuint shader, std::string type)
     {
         GLint success;
         GLchar infoLog[1024];
@@ -207,6 +397,7 @@ private:
                 std::cout << "ERROR::PROGRAM_LINKING_ERROR of type: " << type << "\n" << infoLog << "\n -- --------------------------------------------------- -- " << std::endl;
             }
         }
+        return success != 0;
     }
 };
 #endif
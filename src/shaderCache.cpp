@@ -0,0 +1,216 @@
+#include "pch.h"
+#include "shaderCache.h"
+#include "xxhash64.h"
+#include <SDL.h>
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+
+namespace fs = std::filesystem;
+
+namespace
+{
+    // Not in the generated GL headers
+    const GLuint MAX_SHADER_COMPILER_THREADS_ALL = 0xFFFFFFFF;
+    typedef void (APIENTRY* MaxShaderCompilerThreadsProc)(GLuint count);
+
+    struct BinaryHeader
+    {
+        char magic[4];
+        uint32_t version;
+        uint64_t key;
+        uint32_t format;
+        uint32_t length;
+    };
+
+    const uint32_t BINARY_VERSION = 1;
+
+    bool hasExtension(const char* name)
+    {
+        GLint count = 0;
+        glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+        for (GLint i = 0; i < count; ++i)
+        {
+            const char* extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, i));
+            if (extension && std::strcmp(extension, name) == 0)
+            {
+                return true;
+            }
+        }
+        return false;
+    }
+}
+
+ShaderCache& ShaderCache::get()
+{
+    static ShaderCache cache;
+    return cache;
+}
+
+void ShaderCache::init()
+{
+    m_Initialized = true;
+
+    GLint formats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+    m_Supported = formats > 0;
+
+    std::string driver;
+    for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION })
+    {
+        const char* value = reinterpret_cast<const char*>(glGetString(name));
+        driver += value ? value : "";
+        driver += '\n';
+    }
+    m_DriverHash = xxhash64::hash(driver.data(), driver.size());
+
+    // The default thread count is up to the driver, some leave it at 0 until asked
+    void* (*getProcAddress)(const char*) = m_GetProcAddress ? m_GetProcAddress : SDL_GL_GetProcAddress;
+    MaxShaderCompilerThreadsProc maxShaderCompilerThreads = nullptr;
+    if (hasExtension("GL_KHR_parallel_shader_compile"))
+    {
+        maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(getProcAddress("glMaxShaderCompilerThreadsKHR"));
+    }
+    else if (hasExtension("GL_ARB_parallel_shader_compile"))
+    {
+        maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(getProcAddress("glMaxShaderCompilerThreadsARB"));
+    }
+    if (maxShaderCompilerThreads)
+    {
+        maxShaderCompilerThreads(MAX_SHADER_COMPILER_THREADS_ALL);
+        m_Stats.parallelCompile = true;
+    }
+
+    if (m_Enabled && m_Supported)
+    {
+        std::error_code error;
+        fs::create_directories(m_Directory, error);
+        if (error)
+        {
+            std::cerr << "Failed to create shader cache directory " << m_Directory << ": " << error.message() << std::endl;
+            m_Supported = false;
+        }
+    }
+}
+
+uint64_t ShaderCache::getKey(const std::vector<std::pair<GLenum, std::string>>& stages)
+{
+    if (!m_Initialized)
+    {
+        init();
+    }
+    ++m_Stats.programs;
+    uint64_t key = m_DriverHash;
+    for (const auto& stage : stages)
+    {
+        key = xxhash64::hash(&stage.first, sizeof(stage.first), key);
+        key = xxhash64::hash(stage.second.data(), stage.second.size(), key);
+    }
+    return key;
+}
+
+std::string ShaderCache::getPath(uint64_t key) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(key));
+    return m_Directory + "/" + name;
+}
+
+bool ShaderCache::load(uint64_t key, GLuint program)
+{
+    if (!m_Enabled || !m_Supported)
+    {
+        return false;
+    }
+    std::string path = getPath(key);
+    std::ifstream file(path, std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    BinaryHeader header;
+    std::vector<char> binary;
+    file.read(reinterpret_cast<char*>(&header), sizeof(header));
+    bool valid = file && std::memcmp(header.magic, "SPGB", 4) == 0 && header.version == BINARY_VERSION && header.key == key;
+    if (valid)
+    {
+        binary.resize(header.length);
+        file.read(binary.data(), header.length);
+        valid = static_cast<bool>(file);
+    }
+    file.close();
+
+    GLint linked = GL_FALSE;
+    if (valid)
+    {
+        glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+        glGetProgramiv(program, GL_LINK_STATUS, &linked);
+    }
+    if (linked != GL_TRUE)
+    {
+        ++m_Stats.binaryRejected;
+        std::error_code error;
+        fs::remove(path, error);
+        return false;
+    }
+    ++m_Stats.binaryHits;
+    return true;
+}
+
+void ShaderCache::store(uint64_t key, GLuint program)
+{
+    if (!m_Enabled || !m_Supported)
+    {
+        return;
+    }
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0)
+    {
+        return;
+    }
+    std::vector<char> binary(length);
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+
+    BinaryHeader header = {};
+    std::memcpy(header.magic, "SPGB", 4);
+    header.version = BINARY_VERSION;
+    header.key = key;
+    header.format = format;
+    header.length = static_cast<uint32_t>(length);
+
+    // Written under a temporary name so a crash never leaves a truncated binary behind
+    std::string path = getPath(key);
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(binary.data(), length);
+        if (!file)
+        {
+            std::cerr << "Failed to write shader binary " << temporaryPath << std::endl;
+            return;
+        }
+    }
+    std::error_code error;
+    fs::rename(temporaryPath, path, error);
+    if (!error)
+    {
+        ++m_Stats.stored;
+    }
+}
+
+void ShaderCache::printStats(float setupMs) const
+{
+    // Warm: every program came from a binary, cold: at least one had to compile
+    std::cout << "Shader setup (" << (m_Stats.compiled == 0 ? "warm" : "cold") << "): " << setupMs << "ms for " << m_Stats.programs << " programs, "
+              << m_Stats.binaryHits << " from binaries, " << m_Stats.compiled << " compiled"
+              << (m_Stats.parallelCompile ? " in parallel" : "");
+    if (m_Stats.binaryRejected > 0)
+    {
+        std::cout << ", " << m_Stats.binaryRejected << " binaries rejected by the driver";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,58 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+struct ShaderCacheStats
+{
+    size_t programs = 0;
+    size_t binaryHits = 0;
+    size_t binaryRejected = 0;      // stored binaries the driver refused, compiled instead
+    size_t compiled = 0;
+    size_t stored = 0;
+    bool parallelCompile = false;   // GL_KHR/ARB_parallel_shader_compile is in use
+};
+
+// On-disk cache of linked programs, saved with glGetProgramBinary and loaded with glProgramBinary.
+//
+// A binary is keyed by an XXH64 of the preprocessed stage sources and of the GL vendor, renderer
+// and version strings. Editing a shader or updating the driver therefore misses instead of
+// loading a stale binary. The driver can still refuse a binary, for example after a change it
+// does not report in those strings; the file is then deleted and the program compiled from source.
+//
+// Misses compile on the driver's threads when it has GL_KHR_parallel_shader_compile. Shader only
+// issues the compile and link and leaves the status query to finishBuild(), so programs created
+// back to back overlap.
+class ShaderCache
+{
+public:
+    static ShaderCache& get();
+
+    // (stage type, source) pairs as handed to glShaderSource
+    uint64_t getKey(const std::vector<std::pair<GLenum, std::string>>& stages);
+    // Links program from a stored binary, false if there is none or the driver refused it
+    bool load(uint64_t key, GLuint program);
+    // Call with a linked program that was built with GL_PROGRAM_BINARY_RETRIEVABLE_HINT
+    void store(uint64_t key, GLuint program);
+    void countCompile() { ++m_Stats.compiled; }
+
+    const ShaderCacheStats& getStats() const { return m_Stats; }
+    void printStats(float setupMs) const;
+
+    bool m_Enabled = true;
+    std::string m_Directory = ".shadercache";
+    // Extension entry point lookup of the current context, nullptr for SDL_GL_GetProcAddress
+    void* (*m_GetProcAddress)(const char* name) = nullptr;
+
+private:
+    ShaderCache() = default;
+    void init();
+    std::string getPath(uint64_t key) const;
+
+    bool m_Initialized = false;
+    bool m_Supported = false;       // the driver has at least one binary format
+    uint64_t m_DriverHash = 0;
+    ShaderCacheStats m_Stats;
+};
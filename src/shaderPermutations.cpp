@@ -0,0 +1,108 @@
+#include "pch.h"
+#include "shaderPermutations.h"
+#include "cMaterial.h"
+
+ShaderPermutations::ShaderPermutations(const std::string& vertexPath, const std::string& fragmentPath)
+    : m_VertexPath(vertexPath), m_FragmentPath(fragmentPath)
+{
+}
+
+uint32_t ShaderPermutations::getMaterialFeatures(const Material& material)
+{
+    uint32_t features = 0;
+    if (material.hasColorTexture && material.colorTexture)
+    {
+        features |= SHADER_BASE_COLOR_MAP;
+        if (material.colorTexture->m_Virtual)
+        {
+            features |= SHADER_VIRTUAL_TEXTURE;
+        }
+    }
+    if (material.normalTexture)
+    {
+        features |= SHADER_NORMAL_MAP;
+    }
+    if (material.alphaMode == ALPHA_MODE_MASK)
+    {
+        features |= SHADER_ALPHA_MASK;
+    }
+    else if (material.alphaMode == ALPHA_MODE_BLEND)
+    {
+        features |= SHADER_ALPHA_BLEND;
+    }
+    return features;
+}
+
+uint32_t ShaderPermutations::select(uint32_t materialFeatures, uint32_t frameFeatures)
+{
+    uint32_t allowed = ~SHADER_OPTIONAL_FEATURES | (frameFeatures & SHADER_OPTIONAL_FEATURES);
+    return (materialFeatures & allowed & ~SHADER_LIGHT_FEATURES) | (frameFeatures & SHADER_LIGHT_FEATURES);
+}
+
+std::vector<std::string> ShaderPermutations::getDefines(uint32_t features)
+{
+    auto flag = [features](const char* name, uint32_t feature)
+        {
+            return std::string(name) + ((features & feature) ? " 1" : " 0");
+        };
+    std::vector<std::string> defines = {
+        "SHADER_PERMUTATION",
+        flag("HAS_BASE_COLOR_MAP", SHADER_BASE_COLOR_MAP),
+        flag("HAS_NORMAL_MAP", SHADER_NORMAL_MAP),
+        flag("HAS_VIRTUAL_TEXTURE", SHADER_VIRTUAL_TEXTURE),
+        flag("HAS_DIRECTIONAL_LIGHT", SHADER_DIRECTIONAL_LIGHT),
+        flag("HAS_CLUSTERED_LIGHTS", SHADER_CLUSTERED_LIGHTS),
+        flag("HAS_SHADOWS", SHADER_SHADOWS),
+    };
+    if (features & SHADER_ALPHA_MASK)
+    {
+        defines.push_back("ALPHA_MASK");
+    }
+    else if (features & SHADER_ALPHA_BLEND)
+    {
+        defines.push_back("ALPHA_BLEND");
+    }
+    else
+    {
+        defines.push_back("ALPHA_OPAQUE");
+    }
+    return defines;
+}
+
+void ShaderPermutations::beginFrame(const std::function<void(Shader&)>& setup)
+{
+    m_Setup = setup;
+    ++m_Frame;
+}
+
+Shader& ShaderPermutations::use(uint32_t features)
+{
+    Variant& variant = m_Variants[features];
+    if (!variant.shader)
+    {
+        variant.shader = std::make_unique<Shader>(m_VertexPath.c_str(), m_FragmentPath.c_str(), getDefines(features));
+        if (m_OnVariantCreated)
+        {
+            m_OnVariantCreated(*variant.shader);
+        }
+    }
+    variant.shader->use();
+    if (variant.setupFrame != m_Frame)
+    {
+        variant.setupFrame = m_Frame;
+        if (m_Setup)
+        {
+            m_Setup(*variant.shader);
+        }
+    }
+    return *variant.shader;
+}
+
+void ShaderPermutations::destroy()
+{
+    for (auto& pair : m_Variants)
+    {
+        pair.second.shader->deleteShader();
+    }
+    m_Variants.clear();
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "shader.h"
+
+class Material;
+
+// Feature bits of a shader.frag permutation. The material bits are picked per primitive at
+// load time, the light model bits per frame.
+enum ShaderFeature : uint32_t
+{
+    SHADER_BASE_COLOR_MAP = 1 << 0,
+    SHADER_NORMAL_MAP = 1 << 1,
+    SHADER_VIRTUAL_TEXTURE = 1 << 2,
+    SHADER_ALPHA_MASK = 1 << 3,
+    SHADER_ALPHA_BLEND = 1 << 4,
+    SHADER_DIRECTIONAL_LIGHT = 1 << 5,
+    SHADER_CLUSTERED_LIGHTS = 1 << 6,
+    SHADER_SHADOWS = 1 << 7,
+
+    SHADER_LIGHT_FEATURES = SHADER_DIRECTIONAL_LIGHT | SHADER_CLUSTERED_LIGHTS | SHADER_SHADOWS,
+    // Material features the frame can switch off, see select()
+    SHADER_OPTIONAL_FEATURES = SHADER_NORMAL_MAP,
+};
+
+// Specialized variants of one vertex/fragment pair, compiled lazily per feature combination.
+//
+// Every feature becomes a HAS_* define set to 0 or 1 (plus the ALPHA_* mode define), so the
+// compiler drops the texture fetches and light loops a variant does not use instead of
+// branching on uniforms per fragment. Variants go through ShaderCache like any other Shader,
+// so a combination compiled once links from its binary on the next run.
+class ShaderPermutations
+{
+public:
+    ShaderPermutations(const std::string& vertexPath, const std::string& fragmentPath);
+
+    // The material bits a primitive needs, call once virtual textures are assigned
+    static uint32_t getMaterialFeatures(const Material& material);
+    // Variant for a primitive: its material bits where the frame allows them, plus the frame's light model
+    static uint32_t select(uint32_t materialFeatures, uint32_t frameFeatures);
+    static std::vector<std::string> getDefines(uint32_t features);
+
+    // setup runs on each variant the first time use() makes it current in this frame
+    void beginFrame(const std::function<void(Shader&)>& setup);
+    // Makes the variant current, compiling it on first use
+    Shader& use(uint32_t features);
+    void destroy();
+
+    size_t getVariantCount() const { return m_Variants.size(); }
+
+    // Called with every new variant, e.g. to register it for hot reload
+    std::function<void(Shader&)> m_OnVariantCreated;
+
+private:
+    struct Variant
+    {
+        std::unique_ptr<Shader> shader;
+        uint64_t setupFrame = 0;
+    };
+
+    std::string m_VertexPath;
+    std::string m_FragmentPath;
+    std::unordered_map<uint32_t, Variant> m_Variants;
+    std::function<void(Shader&)> m_Setup;
+    uint64_t m_Frame = 0;
+};
@@ -0,0 +1,127 @@
+#include "pch.h"
+#include "syntheticMesh.h"
+#include <cmath>
+#include <memory>
+
+#define DRACO_TRANSCODER_SUPPORTED
+#include <draco/compression/encode.h>
+#include <draco/mesh/triangle_soup_mesh_builder.h>
+
+SyntheticGrid createSyntheticGrid(int size, uint32_t attributes, float frequency)
+{
+    SyntheticGrid grid;
+    grid.vertexCount = static_cast<uint32_t>(size * size);
+    grid.positions.reserve(grid.vertexCount * 3);
+    for (int z = 0; z < size; ++z)
+    {
+        for (int x = 0; x < size; ++x)
+        {
+            float u = static_cast<float>(x) / (size - 1);
+            float v = static_cast<float>(z) / (size - 1);
+            float height = 0.05f * std::sin(u * frequency) * std::cos(v * frequency);
+            grid.positions.insert(grid.positions.end(), { u * 2.0f - 1.0f, height, v * 2.0f - 1.0f });
+            if (attributes & SYNTHETIC_NORMAL)
+            {
+                // Height derivatives over the 2 unit wide grid
+                float slopeX = 0.025f * frequency * std::cos(u * frequency) * std::cos(v * frequency);
+                float slopeZ = -0.025f * frequency * std::sin(u * frequency) * std::sin(v * frequency);
+                float length = std::sqrt(slopeX * slopeX + 1.0f + slopeZ * slopeZ);
+                grid.normals.insert(grid.normals.end(), { -slopeX / length, 1.0f / length, -slopeZ / length });
+            }
+            if (attributes & SYNTHETIC_TANGENT)
+            {
+                grid.tangents.insert(grid.tangents.end(), { 1.0f, 0.0f, 0.0f, 1.0f });
+            }
+            if (attributes & SYNTHETIC_TEXCOORD0)
+            {
+                grid.texCoords0.insert(grid.texCoords0.end(), { u, v });
+            }
+            if (attributes & SYNTHETIC_TEXCOORD1)
+            {
+                grid.texCoords1.insert(grid.texCoords1.end(), { u * 4.0f, v * 4.0f });
+            }
+            if (attributes & SYNTHETIC_COLOR)
+            {
+                grid.colors.insert(grid.colors.end(), { u, v, 1.0f - u, 1.0f });
+            }
+        }
+    }
+    grid.indices.reserve(static_cast<size_t>(size - 1) * (size - 1) * 6);
+    for (int z = 0; z + 1 < size; ++z)
+    {
+        for (int x = 0; x + 1 < size; ++x)
+        {
+            uint32_t corner = static_cast<uint32_t>(z * size + x);
+            grid.indices.insert(grid.indices.end(), { corner, corner + size, corner + 1, corner + 1, corner + size, corner + size + 1 });
+        }
+    }
+    return grid;
+}
+
+bool encodeDracoGrid(const SyntheticGrid& grid, DracoPrimitive& primitive)
+{
+    struct Source
+    {
+        const std::vector<float>& values;
+        draco::GeometryAttribute::Type type;
+        int components;
+        const char* name;
+    };
+    const Source sources[] = {
+        { grid.positions, draco::GeometryAttribute::POSITION, 3, "POSITION" },
+        { grid.normals, draco::GeometryAttribute::NORMAL, 3, "NORMAL" },
+        { grid.tangents, draco::GeometryAttribute::TANGENT, 4, "TANGENT" },
+        { grid.texCoords0, draco::GeometryAttribute::TEX_COORD, 2, "TEXCOORD_0" },
+        { grid.texCoords1, draco::GeometryAttribute::TEX_COORD, 2, "TEXCOORD_1" },
+        { grid.colors, draco::GeometryAttribute::COLOR, 4, "COLOR_0" },
+    };
+
+    int faceCount = static_cast<int>(grid.indices.size() / 3);
+    draco::TriangleSoupMeshBuilder builder;
+    builder.Start(faceCount);
+    std::vector<std::pair<const Source*, int>> attributes;
+    for (const Source& source : sources)
+    {
+        if (!source.values.empty())
+        {
+            attributes.emplace_back(&source, builder.AddAttribute(source.type, static_cast<int8_t>(source.components), draco::DT_FLOAT32));
+        }
+    }
+    for (int face = 0; face < faceCount; ++face)
+    {
+        const uint32_t* corners = &grid.indices[face * 3];
+        for (const auto& attribute : attributes)
+        {
+            const float* values = attribute.first->values.data();
+            int components = attribute.first->components;
+            builder.SetAttributeValuesForFace(attribute.second, draco::FaceIndex(face),
+                values + corners[0] * components, values + corners[1] * components, values + corners[2] * components);
+        }
+    }
+    std::unique_ptr<draco::Mesh> mesh = builder.Finalize();
+    if (!mesh)
+    {
+        return false;
+    }
+
+    draco::Encoder encoder;
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::POSITION, 14);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::NORMAL, 10);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::TANGENT, 10);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::TEX_COORD, 12);
+    encoder.SetAttributeQuantization(draco::GeometryAttribute::COLOR, 8);
+    draco::EncoderBuffer buffer;
+    if (!encoder.EncodeMeshToBuffer(*mesh, &buffer).ok())
+    {
+        return false;
+    }
+
+    primitive.data.assign(buffer.data(), buffer.data() + buffer.size());
+    primitive.pointCount = mesh->num_points();
+    primitive.attributeIds.clear();
+    for (const auto& attribute : attributes)
+    {
+        primitive.attributeIds.emplace_back(attribute.first->name, static_cast<int>(mesh->attribute(attribute.second)->unique_id()));
+    }
+    return true;
+}
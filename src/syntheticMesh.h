@@ -0,0 +1,45 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+// Vertex attributes a synthetic grid can carry, positions always come along
+enum SyntheticAttribute : uint32_t
+{
+    SYNTHETIC_NORMAL = 1 << 0,
+    SYNTHETIC_TANGENT = 1 << 1,
+    SYNTHETIC_TEXCOORD0 = 1 << 2,
+    SYNTHETIC_TEXCOORD1 = 1 << 3,
+    SYNTHETIC_COLOR = 1 << 4,
+
+    SYNTHETIC_ALL_ATTRIBUTES = SYNTHETIC_NORMAL | SYNTHETIC_TANGENT | SYNTHETIC_TEXCOORD0 | SYNTHETIC_TEXCOORD1 | SYNTHETIC_COLOR,
+};
+
+// A wavy grid, every attribute in its own tightly packed array. Tangents and colors are vec4s
+// like glTF stores them, arrays of attributes that were not asked for stay empty.
+struct SyntheticGrid
+{
+    uint32_t vertexCount = 0;
+    std::vector<float> positions;
+    std::vector<float> normals;
+    std::vector<float> tangents;
+    std::vector<float> texCoords0;
+    std::vector<float> texCoords1;
+    std::vector<float> colors;
+    std::vector<uint32_t> indices;
+};
+
+// Draco bytes plus what the KHR_draco_mesh_compression extension needs to point at them
+struct DracoPrimitive
+{
+    std::vector<char> data;
+    uint32_t pointCount = 0;
+    std::vector<std::pair<std::string, int>> attributeIds;     // glTF attribute name, Draco unique id
+};
+
+// Generated geometry shared by the loader benchmark and the stress scene generator, so both
+// measure the same data. size is the vertex count per side.
+SyntheticGrid createSyntheticGrid(int size, uint32_t attributes = SYNTHETIC_ALL_ATTRIBUTES, float frequency = 40.0f);
+// Quantized like gltf-pipeline's defaults, false if the encoder fails
+bool encodeDracoGrid(const SyntheticGrid& grid, DracoPrimitive& primitive);
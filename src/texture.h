@@ -1,10 +1,12 @@
 #pragma once
 #include <glad/glad.h>
+#include <glm/glm.hpp>
 #include <vector>
 #include <string>
 #include <stdexcept>
 #include <cstdint>
 #include "MipmapData.h"
+#include "imageCodec.h"
 #include <fstream>
 #include <thread>
 
@@ -62,6 +64,28 @@ public:
     std::vector<MipmapData> m_ddsData;
     bool m_isDDS;
 
+    // File the texture came from, empty for embedded images. Streamed textures are only
+    // registered at load time, TextureStreamer decodes them on demand and owns m_TextureID
+    std::string m_path;
+    // The PNG/JPG a .cooked.dds in m_path was made from, empty when the texture was not cooked
+    std::string m_SourcePath;
+    // Base color and emissive maps, mips built on the CPU are filtered in linear light
+    bool m_SRGB = false;
+    bool m_Streamed = false;
+    GLuint m_TextureID = 0;
+
+    // DDS and KTX/KTX2 files are uploaded straight from the mapped file by DDSLoader/KTXLoader
+    bool m_isMapped = false;
+
+    // Decoded pixels were handed to TextureUploader, which sets m_TextureID once the copy has landed
+    bool m_AsyncUpload = false;
+
+    // Sampled through VirtualTextureSystem's page cache: the texture's region of the virtual
+    // space in virtual UV (offset, size) and its coarsest page level
+    bool m_Virtual = false;
+    glm::vec4 m_VirtualRegion = glm::vec4(0.0f);
+    float m_VirtualMaxMip = 0.0f;
+
     Texture(const std::string& path, bool isDDS)
     {
 
@@ -88,6 +112,12 @@ public:
             throw std::runtime_error("Failed to open DDS file");
         }
 
+        readDDSHeader(file, filePath, header, headerDX10);
+        return readDDSLevels(file, filePath, header, headerDX10, 0);
+    }
+
+    static void readDDSHeader(std::ifstream& file, const std::string& filePath, DDSHeader& header, DDSHeaderDX10& headerDX10)
+    {
         // Read magic number
         char magic[4];
         file.read(magic, sizeof(magic));
@@ -112,20 +142,33 @@ public:
                 throw std::runtime_error("Failed to read DX10 header: " + filePath);
             }
         }
+    }
 
+    // Reads the mip levels from firstLevel down, seeking over the finer ones
+    static std::vector<MipmapData> readDDSLevels(std::ifstream& file, const std::string& filePath, const DDSHeader& header, const DDSHeaderDX10& headerDX10, uint32_t firstLevel)
+    {
         std::vector<MipmapData> mipmaps;
         uint32_t width = header.width;
         uint32_t height = header.height;
+        uint32_t blockSize = getBlockSize(getDDSFormat(header, headerDX10));
+        uint32_t mipCount = std::max(1U, header.mipMapCount);
 
-        for (uint32_t level = 0; level < header.mipMapCount; ++level)
+        for (uint32_t level = 0; level < mipCount; ++level)
         {
-            size_t dataSize = ((width + 3) / 4) * ((height + 3) / 4) * 16; // BC7 block size is 16 bytes
-            mipmaps.push_back({ width, height, std::vector<uint8_t>(dataSize) });
-
-            file.read(reinterpret_cast<char*>(mipmaps[level].data.data()), dataSize);
-            if (file.gcount() != dataSize)
+            size_t dataSize = ((width + 3) / 4) * ((height + 3) / 4) * blockSize;
+            if (level < firstLevel)
+            {
+                file.seekg(dataSize, std::ios::cur);
+            }
+            else
             {
-                throw std::runtime_error("Failed to read mipmap level data: " + filePath);
+                mipmaps.push_back({ width, height, std::vector<uint8_t>(dataSize) });
+
+                file.read(reinterpret_cast<char*>(mipmaps.back().data.data()), dataSize);
+                if (file.gcount() != static_cast<std::streamsize>(dataSize))
+                {
+                    throw std::runtime_error("Failed to read mipmap level data: " + filePath);
+                }
             }
 
             width = std::max(1U, width / 2);
@@ -142,47 +185,7 @@ public:
             DDSHeader header;
             DDSHeaderDX10 headerDX10 = {};
             m_ddsData = readDDS(path, header, headerDX10);
-
-            GLenum format = 0;
-
-            // Constants
-            const uint32_t FOURCC_DXT1 = 0x31545844; // 'DXT1'
-            const uint32_t FOURCC_DXT3 = 0x33545844; // 'DXT3'
-            const uint32_t FOURCC_DXT5 = 0x35545844; // 'DXT5'
-            const uint32_t FOURCC_DX10 = 0x30315844; // 'DX10'
-            const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
-            const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
-       
-
-            switch (header.pixelFormat.fourCC) {
-            case FOURCC_DXT1:
-                format = GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
-                break;
-            case FOURCC_DXT3:
-                format = GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
-                break;
-            case FOURCC_DXT5:
-                format = GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
-                break;
-            case FOURCC_DX10:
-                if (headerDX10.dxgiFormat == DXGI_FORMAT_BC7_UNORM)
-                {
-                    format = GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
-                }
-                else if (headerDX10.dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB)
-                {
-                    format = GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB;
-                }
-                else
-                {
-                    throw std::runtime_error("Unsupported DXGI format in DX10 header");
-                }
-                break;
-            default:
-                std::cout << "DDS format: " << header.pixelFormat.fourCC << "\n";
-                throw std::runtime_error("Unsupported DDS format");
-            }
-            m_format = format;
+            m_format = getDDSFormat(header, headerDX10);
         }
         catch (const std::exception& e)
         {
@@ -190,52 +193,87 @@ public:
         }
     }
 
-    void loadStandardTexture(const std::string& path)
+    static GLenum getDDSFormat(const DDSHeader& header, const DDSHeaderDX10& headerDX10)
     {
-        
-        int nrChannels;
-        unsigned char* rawData = stbi_load(path.c_str(), &m_width, &m_height, &nrChannels, 0);
-        if (rawData == nullptr) {
-            throw std::runtime_error("Failed to load image: " + path);
+        // Constants
+        const uint32_t FOURCC_DXT1 = 0x31545844; // 'DXT1'
+        const uint32_t FOURCC_DXT3 = 0x33545844; // 'DXT3'
+        const uint32_t FOURCC_DXT5 = 0x35545844; // 'DXT5'
+        const uint32_t FOURCC_DX10 = 0x30315844; // 'DX10'
+        const uint32_t FOURCC_ATI2 = 0x32495441; // 'ATI2'
+        const uint32_t FOURCC_BC5U = 0x55354342; // 'BC5U'
+        const uint32_t DXGI_FORMAT_BC5_UNORM = 83;
+        const uint32_t DXGI_FORMAT_BC7_UNORM = 98;
+        const uint32_t DXGI_FORMAT_BC7_UNORM_SRGB = 99;
+
+        switch (header.pixelFormat.fourCC) {
+        case FOURCC_DXT1:
+            return GL_COMPRESSED_RGBA_S3TC_DXT1_EXT;
+        case FOURCC_DXT3:
+            return GL_COMPRESSED_RGBA_S3TC_DXT3_EXT;
+        case FOURCC_DXT5:
+            return GL_COMPRESSED_RGBA_S3TC_DXT5_EXT;
+        case FOURCC_ATI2:
+        case FOURCC_BC5U:
+            return GL_COMPRESSED_RG_RGTC2;
+        case FOURCC_DX10:
+            if (headerDX10.dxgiFormat == DXGI_FORMAT_BC5_UNORM)
+            {
+                return GL_COMPRESSED_RG_RGTC2;
+            }
+            else if (headerDX10.dxgiFormat == DXGI_FORMAT_BC7_UNORM)
+            {
+                return GL_COMPRESSED_RGBA_BPTC_UNORM_ARB;
+            }
+            else if (headerDX10.dxgiFormat == DXGI_FORMAT_BC7_UNORM_SRGB)
+            {
+                return GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB;
+            }
+            throw std::runtime_error("Unsupported DXGI format in DX10 header");
+        default:
+            std::cout << "DDS format: " << header.pixelFormat.fourCC << "\n";
+            throw std::runtime_error("Unsupported DDS format");
         }
-        // Copy data to vector and free raw data
-       
-        
-        m_data.assign(rawData, rawData + (m_width * m_height * nrChannels));
-        stbi_image_free(rawData);
-        
+    }
 
+    // Bytes per 4x4 block of a compressed format
+    static uint32_t getBlockSize(GLenum format)
+    {
+        return format == GL_COMPRESSED_RGBA_S3TC_DXT1_EXT ? 8 : 16;
+    }
 
-        switch (nrChannels)
+    // Decoded by the fastest codec in ImageCodecs, straight into m_data
+    void loadStandardTexture(const std::string& path)
+    {
+        ImageInfo info;
+        if (!ImageCodecs::get().decodeFile(path, 0, m_data, info))
         {
-        case 1: m_format = GL_RED; break;
-        case 3: m_format = GL_RGB; break;
-        case 4: m_format = GL_RGBA; break;
-        default:
-            std::cerr << "Unsupported number of channels: " << nrChannels << std::endl;
+            throw std::runtime_error("Failed to load image: " + path);
         }
+        setStandardFormat(info);
     }
 
     void loadStandardTextureFromBuffer(unsigned char* imageData, size_t bufferLength)
     {
-        int nrChannels;
-        unsigned char* rawData = stbi_load_from_memory(imageData, bufferLength, &m_width, &m_height, &nrChannels, 0);
-        if (rawData == nullptr) {
+        ImageInfo info;
+        if (!ImageCodecs::get().decode(imageData, bufferLength, 0, m_data, info))
+        {
             throw std::runtime_error("Failed to load image from memory");
         }
+        setStandardFormat(info);
+    }
 
-        // Copy data to vector and free raw data
-        m_data.assign(rawData, rawData + (m_width * m_height * nrChannels));
-        stbi_image_free(rawData);
-
-
-        switch (nrChannels)
+    void setStandardFormat(const ImageInfo& info)
+    {
+        m_width = info.width;
+        m_height = info.height;
+        switch (info.channels)
         {
         case 1: m_format = GL_RED; break;
         case 3: m_format = GL_RGB; break;
         case 4: m_format = GL_RGBA; break;
         default:
-            std::cerr << "Unsupported number of channels: " << nrChannels << std::endl;
+            std::cerr << "Unsupported number of channels: " << info.channels << std::endl;
         }
     }
 
@@ -0,0 +1,333 @@
+#include "pch.h"
+#include "textureCooker.h"
+#include "texture.h"
+#include "imageCodec.h"
+#include "profiler.h"
+#include <STB/stb_dxt.h>
+#include <filesystem>
+#include <fstream>
+#include <algorithm>
+#include <cmath>
+
+TextureCooker::TextureCooker(ThreadPool& threadPool)
+    : m_ThreadPool(threadPool)
+{
+}
+
+std::vector<CookResult> TextureCooker::cookAll(const std::vector<CookJob>& jobs)
+{
+    PROFILE_SCOPE("Cook textures");
+    std::vector<CookResult> results(jobs.size());
+    m_ThreadPool.parallelFor(jobs.size(), [&jobs, &results](size_t begin, size_t end)
+        {
+            for (size_t i = begin; i < end; ++i)
+            {
+                results[i] = cook(jobs[i]);
+            }
+        });
+    return results;
+}
+
+CookResult TextureCooker::cook(const CookJob& job)
+{
+    auto start = std::chrono::high_resolution_clock::now();
+    CookResult result;
+    result.sourcePath = job.sourcePath;
+    result.cookedPath = job.cookedPath;
+
+    std::vector<unsigned char> sourcePixels;
+    std::vector<MipmapData> levels;
+    ImageInfo info;
+    if (!ImageCodecs::get().decodeFile(job.sourcePath, 4, sourcePixels, info))
+    {
+        std::cerr << "Failed to load image for cooking: " << job.sourcePath << std::endl;
+        return result;
+    }
+    int width = info.width;
+    int height = info.height;
+    int channels = info.channels;
+    result.width = width;
+    result.height = height;
+
+    CookFormat format = job.format;
+    if (format == COOK_AUTO)
+    {
+        format = COOK_BC1;
+        if (channels == 2 || channels == 4)
+        {
+            for (size_t i = 3; i < sourcePixels.size(); i += 4)
+            {
+                if (sourcePixels[i] != 255)
+                {
+                    format = COOK_BC3;
+                    break;
+                }
+            }
+        }
+    }
+    result.format = format;
+    bool isNormalMap = format == COOK_BC5;
+
+    int mipCount = static_cast<int>(std::floor(std::log2(std::max(width, height)))) + 1;
+    std::vector<unsigned char> current;
+    const unsigned char* source = sourcePixels.data();
+    for (int level = 0; level < mipCount; ++level)
+    {
+        int levelWidth = std::max(1, width >> level);
+        int levelHeight = std::max(1, height >> level);
+        if (level > 0)
+        {
+            std::vector<unsigned char> next(static_cast<size_t>(levelWidth) * levelHeight * 4);
+            int sourceWidth = std::max(1, width >> (level - 1));
+            int sourceHeight = std::max(1, height >> (level - 1));
+            if (isNormalMap)
+            {
+                stbir_resize_uint8_linear(source, sourceWidth, sourceHeight, 0, next.data(), levelWidth, levelHeight, 0, STBIR_4CHANNEL);
+                // Averaged normals get shorter, renormalize before they are quantized again
+                for (size_t i = 0; i < next.size(); i += 4)
+                {
+                    glm::vec3 normal(next[i] / 127.5f - 1.0f, next[i + 1] / 127.5f - 1.0f, next[i + 2] / 127.5f - 1.0f);
+                    normal = glm::length(normal) > 0.0f ? glm::normalize(normal) : glm::vec3(0.0f, 0.0f, 1.0f);
+                    next[i] = static_cast<unsigned char>(std::round((normal.x + 1.0f) * 127.5f));
+                    next[i + 1] = static_cast<unsigned char>(std::round((normal.y + 1.0f) * 127.5f));
+                    next[i + 2] = static_cast<unsigned char>(std::round((normal.z + 1.0f) * 127.5f));
+                }
+            }
+            else if (job.srgb)
+            {
+                // Filter in linear light, alpha stays linear
+                stbir_resize_uint8_srgb(source, sourceWidth, sourceHeight, 0, next.data(), levelWidth, levelHeight, 0, STBIR_RGBA);
+            }
+            else
+            {
+                stbir_resize_uint8_linear(source, sourceWidth, sourceHeight, 0, next.data(), levelWidth, levelHeight, 0, STBIR_RGBA);
+            }
+            current.swap(next);
+            source = current.data();
+        }
+
+        MipmapData mipmap;
+        encodeLevel(source, levelWidth, levelHeight, format, mipmap);
+        result.uncompressedBytes += static_cast<size_t>(levelWidth) * levelHeight * 4;
+        result.compressedBytes += mipmap.data.size();
+        levels.push_back(std::move(mipmap));
+    }
+
+    try
+    {
+        writeDDS(job.cookedPath, format, levels);
+        result.success = true;
+    }
+    catch (const std::exception& e)
+    {
+        std::cerr << "Error writing cooked texture: " << e.what() << std::endl;
+    }
+
+    std::chrono::duration<float, std::milli> cookTime = std::chrono::high_resolution_clock::now() - start;
+    result.cookMs = cookTime.count();
+    return result;
+}
+
+void TextureCooker::encodeLevel(const unsigned char* rgba, int width, int height, CookFormat format, MipmapData& level)
+{
+    int blocksX = (width + 3) / 4;
+    int blocksY = (height + 3) / 4;
+    size_t blockSize = format == COOK_BC1 ? 8 : 16;
+    level.width = width;
+    level.height = height;
+    level.data.resize(blocksX * blocksY * blockSize);
+
+    unsigned char block[16 * 4];
+    unsigned char blockRG[16 * 2];
+    for (int by = 0; by < blocksY; ++by)
+    {
+        for (int bx = 0; bx < blocksX; ++bx)
+        {
+            // Edge blocks of small levels repeat their last row/column
+            for (int y = 0; y < 4; ++y)
+            {
+                for (int x = 0; x < 4; ++x)
+                {
+                    int sx = std::min(bx * 4 + x, width - 1);
+                    int sy = std::min(by * 4 + y, height - 1);
+                    const unsigned char* pixel = rgba + (static_cast<size_t>(sy) * width + sx) * 4;
+                    std::copy(pixel, pixel + 4, block + (y * 4 + x) * 4);
+                    blockRG[(y * 4 + x) * 2] = pixel[0];
+                    blockRG[(y * 4 + x) * 2 + 1] = pixel[1];
+                }
+            }
+
+            unsigned char* dest = level.data.data() + (static_cast<size_t>(by) * blocksX + bx) * blockSize;
+            switch (format)
+            {
+            case COOK_BC5:
+                stb_compress_bc5_block(dest, blockRG);
+                break;
+            case COOK_BC3:
+                stb_compress_dxt_block(dest, block, 1, STB_DXT_HIGHQUAL);
+                break;
+            default:
+                stb_compress_dxt_block(dest, block, 0, STB_DXT_HIGHQUAL);
+                break;
+            }
+        }
+    }
+}
+
+void TextureCooker::writeDDS(const std::string& path, CookFormat format, const std::vector<MipmapData>& levels)
+{
+    const uint32_t FOURCC_DXT1 = 0x31545844; // 'DXT1'
+    const uint32_t FOURCC_DXT5 = 0x35545844; // 'DXT5'
+    const uint32_t FOURCC_ATI2 = 0x32495441; // 'ATI2'
+
+    DDSHeader header = {};
+    header.size = sizeof(DDSHeader);
+    header.flags = 0x1 | 0x2 | 0x4 | 0x1000 | 0x20000 | 0x80000; // CAPS | HEIGHT | WIDTH | PIXELFORMAT | MIPMAPCOUNT | LINEARSIZE
+    header.height = levels[0].height;
+    header.width = levels[0].width;
+    header.pitchOrLinearSize = static_cast<uint32_t>(levels[0].data.size());
+    header.mipMapCount = static_cast<uint32_t>(levels.size());
+    header.pixelFormat.size = sizeof(header.pixelFormat);
+    header.pixelFormat.flags = 0x4; // FOURCC
+    header.pixelFormat.fourCC = format == COOK_BC5 ? FOURCC_ATI2 : (format == COOK_BC3 ? FOURCC_DXT5 : FOURCC_DXT1);
+    header.caps.caps1 = 0x1000 | 0x400000 | 0x8; // TEXTURE | MIPMAP | COMPLEX
+
+    // Written under a temporary name so an interrupted cook never leaves a truncated file behind
+    std::string temporaryPath = path + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open " + temporaryPath);
+        }
+        file.write("DDS ", 4);
+        file.write(reinterpret_cast<const char*>(&header), sizeof(DDSHeader));
+        for (const auto& level : levels)
+        {
+            file.write(reinterpret_cast<const char*>(level.data.data()), level.data.size());
+        }
+        if (!file)
+        {
+            throw std::runtime_error("Failed to write " + temporaryPath);
+        }
+    }
+    std::filesystem::rename(temporaryPath, path);
+}
+
+CookReport TextureCooker::summarize(const std::vector<CookResult>& results)
+{
+    CookReport report;
+    for (const auto& result : results)
+    {
+        if (result.success)
+        {
+            ++report.textureCount;
+            report.uncompressedBytes += result.uncompressedBytes;
+            report.compressedBytes += result.compressedBytes;
+            report.cookMs += result.cookMs;
+        }
+    }
+    return report;
+}
+
+void TextureCooker::measureUploads(const std::vector<CookResult>& results, CookReport& report)
+{
+    report.uncompressedUploadMs = 0.0f;
+    report.compressedUploadMs = 0.0f;
+    for (const auto& result : results)
+    {
+        if (!result.success)
+        {
+            continue;
+        }
+        std::vector<unsigned char> sourcePixels;
+        ImageInfo info;
+        DDSHeader header;
+        DDSHeaderDX10 headerDX10;
+        Texture cooked;
+        if (!ImageCodecs::get().decodeFile(result.sourcePath, 4, sourcePixels, info))
+        {
+            continue;
+        }
+        std::vector<MipmapData> levels;
+        try
+        {
+            levels = cooked.readDDS(result.cookedPath, header, headerDX10);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error reading cooked texture: " << e.what() << std::endl;
+            continue;
+        }
+
+        GLuint textures[2];
+        glGenTextures(2, textures);
+        glFinish();
+
+        // What GpuTextureCache::createTexture does for PNG/JPG
+        auto start = std::chrono::high_resolution_clock::now();
+        glBindTexture(GL_TEXTURE_2D, textures[0]);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, info.width, info.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, sourcePixels.data());
+        glGenerateMipmap(GL_TEXTURE_2D);
+        glFinish();
+        std::chrono::duration<float, std::milli> uncompressedTime = std::chrono::high_resolution_clock::now() - start;
+
+        GLenum internalFormat = result.format == COOK_BC5 ? GL_COMPRESSED_RG_RGTC2 : (result.format == COOK_BC3 ? GL_COMPRESSED_RGBA_S3TC_DXT5_EXT : GL_COMPRESSED_RGBA_S3TC_DXT1_EXT);
+        start = std::chrono::high_resolution_clock::now();
+        glBindTexture(GL_TEXTURE_2D, textures[1]);
+        for (size_t level = 0; level < levels.size(); ++level)
+        {
+            const MipmapData& mipmap = levels[level];
+            glCompressedTexImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), internalFormat, mipmap.width, mipmap.height, 0, static_cast<GLsizei>(mipmap.data.size()), mipmap.data.data());
+        }
+        glFinish();
+        std::chrono::duration<float, std::milli> compressedTime = std::chrono::high_resolution_clock::now() - start;
+
+        glDeleteTextures(2, textures);
+        report.uncompressedUploadMs += uncompressedTime.count();
+        report.compressedUploadMs += compressedTime.count();
+    }
+    glBindTexture(GL_TEXTURE_2D, 0);
+    report.uploadsMeasured = true;
+}
+
+std::string TextureCooker::getCookedPath(const std::string& sourcePath)
+{
+    size_t dot = sourcePath.find_last_of('.');
+    size_t slash = sourcePath.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return sourcePath + ".cooked.dds";
+    }
+    return sourcePath.substr(0, dot) + ".cooked.dds";
+}
+
+bool TextureCooker::isUpToDate(const std::string& sourcePath, const std::string& cookedPath)
+{
+    std::error_code error;
+    auto cookedTime = std::filesystem::last_write_time(cookedPath, error);
+    if (error)
+    {
+        return false;
+    }
+    auto sourceTime = std::filesystem::last_write_time(sourcePath, error);
+    return !error && cookedTime >= sourceTime;
+}
+
+void TextureCooker::printReport(const CookReport& report)
+{
+    double uncompressedMB = report.uncompressedBytes / (1024.0 * 1024.0);
+    double compressedMB = report.compressedBytes / (1024.0 * 1024.0);
+    std::cout << "Cooked " << report.textureCount << " textures in " << report.cookMs << "ms of worker time\n";
+    std::cout << "  VRAM: " << uncompressedMB << " MB uncompressed -> " << compressedMB << " MB block compressed";
+    if (report.compressedBytes > 0)
+    {
+        std::cout << " (" << (double)report.uncompressedBytes / report.compressedBytes << "x smaller)";
+    }
+    if (report.uploadsMeasured)
+    {
+        std::cout << "\n  Upload: " << report.uncompressedUploadMs << "ms (glTexImage2D + glGenerateMipmap) -> "
+                  << report.compressedUploadMs << "ms (glCompressedTexImage2D, all levels)";
+    }
+    std::cout << std::endl;
+}
@@ -0,0 +1,80 @@
+#pragma once
+#include <glad/glad.h>
+#include <string>
+#include <vector>
+#include "MipmapData.h"
+#include "threadPool.h"
+
+enum CookFormat
+{
+    COOK_AUTO = 0,  // BC1, or BC3 if the image has any non-opaque alpha
+    COOK_BC1,
+    COOK_BC3,
+    COOK_BC5        // normal maps, RG only
+};
+
+struct CookJob
+{
+    std::string sourcePath;
+    std::string cookedPath;
+    CookFormat format = COOK_AUTO;
+    bool srgb = false;      // mips are filtered in linear light, only for base color and emissive maps
+};
+
+// Only sizes are kept, cook() frees the pixels and levels once the DDS is written
+struct CookResult
+{
+    std::string sourcePath;
+    std::string cookedPath;
+    bool success = false;
+    CookFormat format = COOK_AUTO;
+    int width = 0;
+    int height = 0;
+    size_t uncompressedBytes = 0;   // RGBA8 with a full mip chain, what the GL_RGB(A) path allocates
+    size_t compressedBytes = 0;
+    float cookMs = 0.0f;
+};
+
+struct CookReport
+{
+    size_t textureCount = 0;
+    size_t uncompressedBytes = 0;
+    size_t compressedBytes = 0;
+    float cookMs = 0.0f;
+    bool uploadsMeasured = false;
+    float uncompressedUploadMs = 0.0f;
+    float compressedUploadMs = 0.0f;
+};
+
+// Offline block compression of PNG/JPG textures into DDS files next to the source. Opt-in
+// with --cook, since it writes into the asset directories.
+//
+// Mip chains are filtered on the CPU with stb_image_resize2. Base color and emissive maps
+// are averaged in linear light so the result is gamma correct. Normal maps, occlusion and
+// other data textures are averaged as stored. Every level is
+// encoded with stb_dxt. Textures are cooked in parallel on the thread pool, and
+// cModel::loadTexture picks up the .cooked.dds file on later runs as long as it is
+// newer than the source.
+class TextureCooker
+{
+public:
+    explicit TextureCooker(ThreadPool& threadPool);
+
+    std::vector<CookResult> cookAll(const std::vector<CookJob>& jobs);
+    // Sizes and cook times only, nothing is uploaded
+    static CookReport summarize(const std::vector<CookResult>& results);
+    // For --bench-cook: decodes every source and reads every cooked file again, one at a
+    // time, and uploads both on the current context with a glFinish around each
+    static void measureUploads(const std::vector<CookResult>& results, CookReport& report);
+
+    static CookResult cook(const CookJob& job);
+    static std::string getCookedPath(const std::string& sourcePath);
+    static bool isUpToDate(const std::string& sourcePath, const std::string& cookedPath);
+    static void printReport(const CookReport& report);
+    static void writeDDS(const std::string& path, CookFormat format, const std::vector<MipmapData>& levels);
+
+private:
+    static void encodeLevel(const unsigned char* rgba, int width, int height, CookFormat format, MipmapData& level);
+
+    ThreadPool& m_ThreadPool;
+};
@@ -0,0 +1,477 @@
+#include "pch.h"
+#include "textureStreamer.h"
+#include "cModel.h"
+#include "frustum.h"
+#include "imageCodec.h"
+#include "profiler.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+TextureStreamer::TextureStreamer(ThreadPool& threadPool)
+    : m_ThreadPool(threadPool)
+{
+}
+
+void TextureStreamer::registerModel(cModel& model)
+{
+    for (const auto& pair : model.m_TextureCache)
+    {
+        const std::shared_ptr<Texture>& texture = pair.second;
+        if (!texture->m_Streamed || texture->m_Virtual || m_EntryIndex.count(texture.get()))
+        {
+            continue;
+        }
+        Entry entry;
+        entry.texture = texture;
+        m_EntryIndex[texture.get()] = m_Entries.size();
+        m_Entries.push_back(std::move(entry));
+    }
+    m_Stats.textureCount = m_Entries.size();
+}
+
+void TextureStreamer::update(cModel& model, const glm::mat4& view, const glm::mat4& projection, int viewportHeight)
+{
+    PROFILE_SCOPE("Texture streaming");
+    ++m_Frame;
+    m_UploadedThisFrame = 0;
+    collectCompletedLoads();
+
+    Frustum frustum = Frustum::fromMatrix(projection * view);
+    glm::vec3 cameraPosition = glm::vec3(glm::inverse(view)[3]);
+    // Pixels covered by one world unit at distance 1
+    float pixelsPerUnit = projection[1][1] * viewportHeight * 0.5f;
+
+    for (auto& mesh : model.meshes)
+    {
+        float scale = std::max({ glm::length(glm::vec3(mesh.transform[0])), glm::length(glm::vec3(mesh.transform[1])), glm::length(glm::vec3(mesh.transform[2])) });
+        for (auto& primitive : mesh.primitives)
+        {
+            const std::shared_ptr<Texture>& texture = primitive.m_material.colorTexture;
+            if (!primitive.m_material.hasColorTexture || !texture || !texture->m_Streamed)
+            {
+                continue;
+            }
+            auto it = m_EntryIndex.find(texture.get());
+            if (it == m_EntryIndex.end())
+            {
+                continue;
+            }
+
+            glm::vec3 worldMin, worldMax;
+            transformBounds(primitive.m_BoundsMin, primitive.m_BoundsMax, mesh.transform, worldMin, worldMax);
+            if (!frustum.intersectsAabb(worldMin, worldMax))
+            {
+                continue;
+            }
+
+            Entry& entry = m_Entries[it->second];
+            if (entry.lastUsedFrame != m_Frame)
+            {
+                entry.lastUsedFrame = m_Frame;
+                entry.requiredMip = std::max(entry.mipCount - 1, 0);
+            }
+            if (entry.mipCount == 0 || scale <= 0.0f)
+            {
+                // Size is unknown until the tail has been loaded
+                continue;
+            }
+
+            glm::vec3 closest = glm::clamp(cameraPosition, worldMin, worldMax);
+            float distance = std::max(glm::length(cameraPosition - closest), 0.01f);
+            float texelsPerUnit = primitive.m_UVDensity / scale * std::max(entry.width, entry.height);
+            float pixelsAtDistance = pixelsPerUnit / distance;
+            int mip = static_cast<int>(std::floor(std::log2(std::max(texelsPerUnit / pixelsAtDistance, 1.0f)) + m_MipBias));
+            entry.requiredMip = std::min(entry.requiredMip, std::clamp(mip, 0, entry.mipCount - 1));
+        }
+    }
+
+    // Missing tails first, then the textures that are furthest from the detail they need
+    std::vector<size_t> requests;
+    size_t pendingLoads = 0;
+    for (size_t i = 0; i < m_Entries.size(); ++i)
+    {
+        const Entry& entry = m_Entries[i];
+        if (entry.loading)
+        {
+            ++pendingLoads;
+            continue;
+        }
+        if (entry.failed || entry.lastUsedFrame != m_Frame)
+        {
+            continue;
+        }
+        if (entry.residentMip < 0 || entry.requiredMip < entry.residentMip)
+        {
+            requests.push_back(i);
+        }
+    }
+    auto priority = [this](size_t index)
+        {
+            const Entry& entry = m_Entries[index];
+            return entry.residentMip < 0 ? INT_MAX : entry.residentMip - entry.requiredMip;
+        };
+    std::sort(requests.begin(), requests.end(), [&priority](size_t a, size_t b) { return priority(a) > priority(b); });
+
+    for (size_t index : requests)
+    {
+        if (pendingLoads >= m_MaxPendingLoads)
+        {
+            break;
+        }
+        Entry& entry = m_Entries[index];
+        int firstLevel = entry.residentMip < 0 ? -1 : entry.requiredMip;
+        if (firstLevel >= 0 && !makeRoom(getChainBytes(entry, firstLevel) - entry.residentBytes, entry))
+        {
+            continue;
+        }
+
+        std::string path = entry.texture->m_path;
+        bool isDDS = entry.texture->m_isDDS;
+        bool srgb = entry.texture->m_SRGB;
+        entry.pending = m_ThreadPool.submit([path, isDDS, srgb, firstLevel] { return loadMipChain(path, isDDS, srgb, firstLevel); });
+        entry.loading = true;
+        ++pendingLoads;
+    }
+
+    size_t residentTextures = 0;
+    for (const Entry& entry : m_Entries)
+    {
+        residentTextures += entry.residentMip >= 0 ? 1 : 0;
+    }
+    m_Stats.residentTextures = residentTextures;
+    m_Stats.pendingLoads = pendingLoads;
+}
+
+void TextureStreamer::destroy()
+{
+    for (Entry& entry : m_Entries)
+    {
+        if (entry.loading)
+        {
+            entry.pending.wait();
+        }
+        if (entry.texture->m_TextureID)
+        {
+            glDeleteTextures(1, &entry.texture->m_TextureID);
+            entry.texture->m_TextureID = 0;
+        }
+    }
+    m_Entries.clear();
+    m_EntryIndex.clear();
+    m_Stats = TextureStreamingStats();
+}
+
+void TextureStreamer::releaseUnused()
+{
+    std::vector<Entry> entries;
+    entries.reserve(m_Entries.size());
+    m_EntryIndex.clear();
+    for (Entry& entry : m_Entries)
+    {
+        if (entry.texture.use_count() == 1)
+        {
+            if (entry.loading)
+            {
+                entry.pending.wait();
+            }
+            if (entry.texture->m_TextureID)
+            {
+                glDeleteTextures(1, &entry.texture->m_TextureID);
+                entry.texture->m_TextureID = 0;
+            }
+            m_Stats.residentBytes -= entry.residentBytes;
+            continue;
+        }
+        m_EntryIndex[entry.texture.get()] = entries.size();
+        entries.push_back(std::move(entry));
+    }
+    m_Entries = std::move(entries);
+    m_Stats.textureCount = m_Entries.size();
+}
+
+void TextureStreamer::invalidate(const Texture* texture)
+{
+    auto it = m_EntryIndex.find(texture);
+    if (it == m_EntryIndex.end())
+    {
+        return;
+    }
+    Entry& entry = m_Entries[it->second];
+    entry.stale = entry.loading;
+    entry.residentMip = -1;
+    entry.mipCount = 0;
+    entry.failed = false;
+}
+
+void TextureStreamer::collectCompletedLoads()
+{
+    for (Entry& entry : m_Entries)
+    {
+        if (m_UploadedThisFrame >= m_UploadBytesPerFrame)
+        {
+            break;
+        }
+        if (!entry.loading || entry.pending.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            continue;
+        }
+
+        entry.loading = false;
+        try
+        {
+            MipChain chain = entry.pending.get();
+            if (entry.stale)
+            {
+                // Decoded from the file as it was before the change
+                entry.stale = false;
+                continue;
+            }
+            upload(entry, chain);
+        }
+        catch (const std::exception& e)
+        {
+            std::cerr << "Error streaming texture " << entry.texture->m_path << ": " << e.what() << std::endl;
+            entry.failed = true;
+        }
+    }
+}
+
+void TextureStreamer::upload(Entry& entry, MipChain& chain)
+{
+    entry.width = chain.width;
+    entry.height = chain.height;
+    entry.mipCount = chain.mipCount;
+    entry.internalFormat = chain.internalFormat;
+    entry.compressed = chain.compressed;
+
+    if (chain.levels.empty() || (entry.residentMip >= 0 && chain.firstLevel >= entry.residentMip))
+    {
+        return;
+    }
+    size_t bytes = getChainBytes(entry, chain.firstLevel);
+    if (entry.residentMip >= 0 && !makeRoom(bytes - entry.residentBytes, entry))
+    {
+        return;
+    }
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexStorage2D(GL_TEXTURE_2D, static_cast<GLsizei>(chain.levels.size()), chain.internalFormat, chain.levels[0].width, chain.levels[0].height);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (size_t level = 0; level < chain.levels.size(); ++level)
+    {
+        const MipmapData& mipmap = chain.levels[level];
+        if (chain.compressed)
+        {
+            glCompressedTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0, mipmap.width, mipmap.height, chain.internalFormat, static_cast<GLsizei>(mipmap.data.size()), mipmap.data.data());
+        }
+        else
+        {
+            glTexSubImage2D(GL_TEXTURE_2D, static_cast<GLint>(level), 0, 0, mipmap.width, mipmap.height, chain.format, GL_UNSIGNED_BYTE, mipmap.data.data());
+        }
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    setTextureParameters();
+
+    if (entry.texture->m_TextureID)
+    {
+        glDeleteTextures(1, &entry.texture->m_TextureID);
+    }
+    entry.texture->m_TextureID = textureID;
+
+    m_Stats.residentBytes = m_Stats.residentBytes - entry.residentBytes + bytes;
+    m_Stats.uploadedBytes += bytes;
+    m_UploadedThisFrame += bytes;
+    entry.residentBytes = bytes;
+    entry.residentMip = chain.firstLevel;
+}
+
+void TextureStreamer::demote(Entry& entry, int newMip)
+{
+    int levels = entry.mipCount - newMip;
+    GLsizei width = std::max(1, entry.width >> newMip);
+    GLsizei height = std::max(1, entry.height >> newMip);
+
+    GLuint textureID;
+    glGenTextures(1, &textureID);
+    glBindTexture(GL_TEXTURE_2D, textureID);
+    glTexStorage2D(GL_TEXTURE_2D, levels, entry.internalFormat, width, height);
+    setTextureParameters();
+
+    // The coarser levels are already on the GPU, no need to touch the file again
+    for (int level = 0; level < levels; ++level)
+    {
+        glCopyImageSubData(entry.texture->m_TextureID, GL_TEXTURE_2D, newMip + level - entry.residentMip, 0, 0, 0,
+                           textureID, GL_TEXTURE_2D, level, 0, 0, 0,
+                           std::max(1, width >> level), std::max(1, height >> level), 1);
+    }
+    glDeleteTextures(1, &entry.texture->m_TextureID);
+    entry.texture->m_TextureID = textureID;
+
+    size_t bytes = getChainBytes(entry, newMip);
+    m_Stats.residentBytes = m_Stats.residentBytes - entry.residentBytes + bytes;
+    entry.residentBytes = bytes;
+    entry.residentMip = newMip;
+    ++m_Stats.evictions;
+}
+
+bool TextureStreamer::makeRoom(size_t bytes, const Entry& requester)
+{
+    if (m_Stats.residentBytes + bytes <= m_BudgetBytes)
+    {
+        return true;
+    }
+
+    // Textures not seen for the longest time go back to their tail first. Textures
+    // visible this frame only give up detail they don't currently need.
+    std::vector<Entry*> candidates;
+    for (Entry& entry : m_Entries)
+    {
+        if (&entry == &requester || entry.residentMip < 0)
+        {
+            continue;
+        }
+        int target = entry.lastUsedFrame == m_Frame ? entry.requiredMip : getTailLevel(entry.width, entry.height, entry.mipCount);
+        if (target > entry.residentMip)
+        {
+            candidates.push_back(&entry);
+        }
+    }
+    std::sort(candidates.begin(), candidates.end(), [](const Entry* a, const Entry* b) { return a->lastUsedFrame < b->lastUsedFrame; });
+
+    for (Entry* entry : candidates)
+    {
+        int target = entry->lastUsedFrame == m_Frame ? entry->requiredMip : getTailLevel(entry->width, entry->height, entry->mipCount);
+        demote(*entry, target);
+        if (m_Stats.residentBytes + bytes <= m_BudgetBytes)
+        {
+            return true;
+        }
+    }
+    return false;
+}
+
+int TextureStreamer::getTailLevel(int width, int height, int mipCount)
+{
+    int level = 0;
+    while (level < mipCount - 1 && std::max(width >> level, height >> level) > TAIL_SIZE)
+    {
+        ++level;
+    }
+    return level;
+}
+
+size_t TextureStreamer::getLevelBytes(GLenum internalFormat, bool compressed, int width, int height)
+{
+    if (compressed)
+    {
+        return static_cast<size_t>((width + 3) / 4) * ((height + 3) / 4) * Texture::getBlockSize(internalFormat);
+    }
+    return static_cast<size_t>(width) * height * (internalFormat == GL_R8 ? 1 : 4);
+}
+
+size_t TextureStreamer::getChainBytes(const Entry& entry, int firstLevel)
+{
+    size_t bytes = 0;
+    for (int level = firstLevel; level < entry.mipCount; ++level)
+    {
+        bytes += getLevelBytes(entry.internalFormat, entry.compressed, std::max(1, entry.width >> level), std::max(1, entry.height >> level));
+    }
+    return bytes;
+}
+
+void TextureStreamer::setTextureParameters()
+{
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
+}
+
+// Runs on a worker thread, no GL calls in here
+TextureStreamer::MipChain TextureStreamer::loadMipChain(const std::string& path, bool isDDS, bool srgb, int firstLevel)
+{
+    PROFILE_SCOPE("Load mip chain");
+    MipChain chain;
+    if (isDDS)
+    {
+        std::ifstream file(path, std::ios::binary);
+        if (!file.is_open())
+        {
+            throw std::runtime_error("Failed to open DDS file: " + path);
+        }
+        DDSHeader header;
+        DDSHeaderDX10 headerDX10 = {};
+        Texture::readDDSHeader(file, path, header, headerDX10);
+
+        chain.internalFormat = Texture::getDDSFormat(header, headerDX10);
+        chain.format = chain.internalFormat;
+        chain.compressed = true;
+        chain.width = header.width;
+        chain.height = header.height;
+        chain.mipCount = std::max(1U, header.mipMapCount);
+        chain.firstLevel = firstLevel < 0 ? getTailLevel(chain.width, chain.height, chain.mipCount) : std::min(firstLevel, chain.mipCount - 1);
+        chain.levels = Texture::readDDSLevels(file, path, header, headerDX10, chain.firstLevel);
+        return chain;
+    }
+
+    ImageInfo info;
+    if (!ImageCodecs::get().readFileInfo(path, info))
+    {
+        throw std::runtime_error("Failed to read image header: " + path);
+    }
+    chain.width = info.width;
+    chain.height = info.height;
+    // Grey stays single channel, everything else is expanded to RGBA
+    int components = info.channels == 1 ? 1 : 4;
+    chain.format = components == 1 ? GL_RED : GL_RGBA;
+    chain.internalFormat = components == 1 ? GL_R8 : GL_RGBA8;
+    chain.compressed = false;
+    chain.mipCount = static_cast<int>(std::floor(std::log2(std::max(chain.width, chain.height)))) + 1;
+    chain.firstLevel = firstLevel < 0 ? getTailLevel(chain.width, chain.height, chain.mipCount) : std::min(firstLevel, chain.mipCount - 1);
+
+    std::vector<uint8_t> pixels;
+    if (!ImageCodecs::get().decodeFile(path, components, pixels, info))
+    {
+        throw std::runtime_error("Failed to load image: " + path);
+    }
+    int width = info.width;
+    int height = info.height;
+
+    stbir_pixel_layout layout = components == 1 ? STBIR_1CHANNEL : STBIR_RGBA;
+    const unsigned char* source = pixels.data();
+    int sourceWidth = width;
+    int sourceHeight = height;
+    // Each level is filtered from the previous one, so the vector must not reallocate
+    chain.levels.reserve(chain.mipCount - chain.firstLevel);
+    for (int level = chain.firstLevel; level < chain.mipCount; ++level)
+    {
+        uint32_t levelWidth = std::max(1, width >> level);
+        uint32_t levelHeight = std::max(1, height >> level);
+        if (level == 0)
+        {
+            // The decoded image is the base level as is
+            chain.levels.push_back({ levelWidth, levelHeight, std::move(pixels) });
+        }
+        else
+        {
+            chain.levels.push_back({ levelWidth, levelHeight, std::vector<uint8_t>(static_cast<size_t>(levelWidth) * levelHeight * components) });
+            uint8_t* destination = chain.levels.back().data.data();
+            if (srgb)
+            {
+                stbir_resize_uint8_srgb(source, sourceWidth, sourceHeight, 0, destination, levelWidth, levelHeight, 0, layout);
+            }
+            else
+            {
+                stbir_resize_uint8_linear(source, sourceWidth, sourceHeight, 0, destination, levelWidth, levelHeight, 0, layout);
+            }
+        }
+        source = chain.levels.back().data.data();
+        sourceWidth = levelWidth;
+        sourceHeight = levelHeight;
+    }
+    return chain;
+}
@@ -0,0 +1,109 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "texture.h"
+#include "threadPool.h"
+
+class cModel;
+
+struct TextureStreamingStats
+{
+    size_t textureCount = 0;
+    size_t residentTextures = 0;     // textures with at least the coarse tail uploaded
+    size_t residentBytes = 0;
+    size_t pendingLoads = 0;
+    size_t evictions = 0;
+    size_t uploadedBytes = 0;        // total since start
+};
+
+// Streams the color textures of a cModel loaded with streamTextures = true.
+//
+// Nothing is decoded until a primitive using the texture passes the frustum test.
+// The first load only brings in the coarse mip tail. After that, each visible primitive
+// asks for the mip at which one texel covers about one pixel. That mip is estimated
+// from the primitive's UV density, its world scale and its distance to the camera.
+// Finer chains are decoded on the thread pool and replace the GL texture
+// when they are ready. If a load would push residency over m_BudgetBytes, textures that
+// have not been used for the longest time are demoted back to their tail first. The
+// demotion is a GPU-side copy, so it needs no IO.
+class TextureStreamer
+{
+public:
+    static const int TAIL_SIZE = 64;           // largest dimension of the initially loaded mip
+
+    explicit TextureStreamer(ThreadPool& threadPool);
+
+    void registerModel(cModel& model);
+    void update(cModel& model, const glm::mat4& view, const glm::mat4& projection, int viewportHeight);
+    void destroy();
+    // The file changed: drops what is resident and streams it again from the tail, the old
+    // texture stays bound until the new tail is uploaded
+    void invalidate(const Texture* texture);
+    // Drops textures no model references any more, after a reload swapped in a new model
+    void releaseUnused();
+
+    const TextureStreamingStats& getStats() const { return m_Stats; }
+
+    size_t m_BudgetBytes = 512ull * 1024 * 1024;
+    size_t m_UploadBytesPerFrame = 16ull * 1024 * 1024;
+    size_t m_MaxPendingLoads = 8;
+    float m_MipBias = 0.0f;
+
+private:
+    // Mip chain from firstLevel down to 1x1, produced by a worker thread
+    struct MipChain
+    {
+        GLenum format = 0;          // upload format, or the compressed format
+        GLenum internalFormat = 0;
+        bool compressed = false;
+        int width = 0;              // full resolution
+        int height = 0;
+        int mipCount = 0;
+        int firstLevel = 0;
+        std::vector<MipmapData> levels;
+    };
+
+    struct Entry
+    {
+        std::shared_ptr<Texture> texture;
+        int width = 0;
+        int height = 0;
+        int mipCount = 0;           // 0 until the first load told us the size
+        GLenum internalFormat = 0;
+        bool compressed = false;
+
+        int residentMip = -1;       // finest resident level, -1: nothing resident
+        int requiredMip = 0;
+        uint64_t lastUsedFrame = 0;
+        size_t residentBytes = 0;
+
+        std::future<MipChain> pending;
+        bool loading = false;
+        bool failed = false;
+        bool stale = false;         // invalidated while a load was in flight
+    };
+
+    // srgb: decoded levels are filtered in linear light, as TextureCooker does for color maps
+    static MipChain loadMipChain(const std::string& path, bool isDDS, bool srgb, int firstLevel);
+    static int getTailLevel(int width, int height, int mipCount);
+    static size_t getLevelBytes(GLenum internalFormat, bool compressed, int width, int height);
+    static size_t getChainBytes(const Entry& entry, int firstLevel);
+    static void setTextureParameters();
+
+    void collectCompletedLoads();
+    void upload(Entry& entry, MipChain& chain);
+    void demote(Entry& entry, int newMip);
+    bool makeRoom(size_t bytes, const Entry& requester);
+
+    ThreadPool& m_ThreadPool;
+    std::vector<Entry> m_Entries;
+    std::unordered_map<const Texture*, size_t> m_EntryIndex;
+    uint64_t m_Frame = 0;
+    size_t m_UploadedThisFrame = 0;
+    TextureStreamingStats m_Stats;
+};
@@ -0,0 +1,59 @@
+#include "pch.h"
+#include "textureUpload.h"
+#include <algorithm>
+
+GLuint TextureUpload::createStorage(const TextureUploadInfo& info)
+{
+    GLuint texture;
+    glGenTextures(1, &texture);
+    glBindTexture(info.target, texture);
+    if (info.target == GL_TEXTURE_2D || info.target == GL_TEXTURE_CUBE_MAP)
+    {
+        glTexStorage2D(info.target, info.levels, info.internalFormat, info.width, info.height);
+    }
+    else
+    {
+        glTexStorage3D(info.target, info.levels, info.internalFormat, info.width, info.height, info.depth);
+    }
+
+    GLenum wrap = info.target == GL_TEXTURE_CUBE_MAP || info.target == GL_TEXTURE_CUBE_MAP_ARRAY ? GL_CLAMP_TO_EDGE : GL_REPEAT;
+    glTexParameteri(info.target, GL_TEXTURE_WRAP_S, wrap);
+    glTexParameteri(info.target, GL_TEXTURE_WRAP_T, wrap);
+    glTexParameteri(info.target, GL_TEXTURE_WRAP_R, wrap);
+    glTexParameteri(info.target, GL_TEXTURE_MIN_FILTER, info.levels > 1 ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+    glTexParameteri(info.target, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(info.target, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
+    return texture;
+}
+
+void TextureUpload::uploadImage(const TextureUploadInfo& info, GLenum format, GLenum type, GLint level, GLint layer, GLsizei layerCount, const void* data, size_t size)
+{
+    GLsizei width = std::max(1, info.width >> level);
+    GLsizei height = std::max(1, info.height >> level);
+
+    if (info.target == GL_TEXTURE_2D || info.target == GL_TEXTURE_CUBE_MAP)
+    {
+        GLenum target = info.target == GL_TEXTURE_CUBE_MAP ? GL_TEXTURE_CUBE_MAP_POSITIVE_X + layer : GL_TEXTURE_2D;
+        if (info.compressed)
+        {
+            glCompressedTexSubImage2D(target, level, 0, 0, width, height, info.internalFormat, static_cast<GLsizei>(size), data);
+        }
+        else
+        {
+            glTexSubImage2D(target, level, 0, 0, width, height, format, type, data);
+        }
+        return;
+    }
+
+    // 3D textures shrink in depth, array layers don't
+    GLint zOffset = info.target == GL_TEXTURE_3D ? 0 : layer;
+    GLsizei depth = info.target == GL_TEXTURE_3D ? std::max(1, info.depth >> level) : layerCount;
+    if (info.compressed)
+    {
+        glCompressedTexSubImage3D(info.target, level, 0, 0, zOffset, width, height, depth, info.internalFormat, static_cast<GLsizei>(size), data);
+    }
+    else
+    {
+        glTexSubImage3D(info.target, level, 0, 0, zOffset, width, height, depth, format, type, data);
+    }
+}
@@ -0,0 +1,28 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+
+struct TextureUploadInfo
+{
+    GLenum target = 0;
+    GLenum internalFormat = 0;
+    bool compressed = false;
+    GLsizei width = 0;
+    GLsizei height = 0;
+    GLsizei depth = 0;      // 3D depth, array layers, or layers * 6 for cube arrays
+    GLsizei levels = 0;
+    size_t bytes = 0;       // image data uploaded
+};
+
+// Immutable texture storage and sub-image uploads shared by the container loaders
+// (KTXLoader, DDSLoader), which hand image data straight from a file mapping.
+class TextureUpload
+{
+public:
+    // Allocates every level with glTexStorage*D and sets the default sampler state
+    static GLuint createStorage(const TextureUploadInfo& info);
+    // layer is the cubemap face for GL_TEXTURE_CUBE_MAP and the first layer (layer-face for
+    // cube arrays) for array targets, which upload layerCount layers at once. 3D textures
+    // always upload every slice of the level.
+    static void uploadImage(const TextureUploadInfo& info, GLenum format, GLenum type, GLint level, GLint layer, GLsizei layerCount, const void* data, size_t size);
+};
@@ -0,0 +1,177 @@
+#include "pch.h"
+#include "textureUploader.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+
+bool TextureUploader::init(size_t ringBytes)
+{
+    return m_Ring.init(ringBytes);
+}
+
+void TextureUploader::destroy()
+{
+    for (auto& job : m_Queue)
+    {
+        glDeleteTextures(1, &job.textureID);
+    }
+    m_Queue.clear();
+    m_Ring.destroy();
+
+    // The ring waited for every fence, so whatever was still in flight is complete
+    for (auto& upload : m_Issued)
+    {
+        m_InFlight.push_back(upload);
+    }
+    for (auto& upload : m_InFlight)
+    {
+        upload.texture->m_TextureID = upload.textureID;
+    }
+    m_Issued.clear();
+    m_InFlight.clear();
+}
+
+bool TextureUploader::queue(const std::shared_ptr<Texture>& texture)
+{
+    GLenum internalFormat;
+    size_t channels;
+    switch (texture->m_format)
+    {
+    case GL_RED: internalFormat = GL_R8; channels = 1; break;
+    case GL_RGB: internalFormat = GL_RGB8; channels = 3; break;
+    case GL_RGBA: internalFormat = GL_RGBA8; channels = 4; break;
+    default: return false;
+    }
+    if (m_Ring.getCapacity() == 0 || texture->m_isDDS || texture->m_data.empty())
+    {
+        return false;
+    }
+
+    Job job;
+    job.texture = texture;
+    job.format = texture->m_format;
+    job.width = texture->m_width;
+    job.height = texture->m_height;
+    job.rowBytes = static_cast<size_t>(job.width) * channels;
+    job.pixels = std::move(texture->m_data);
+    texture->m_data.clear();
+    texture->m_AsyncUpload = true;
+
+    GLsizei levels = static_cast<GLsizei>(std::floor(std::log2(std::max(job.width, job.height)))) + 1;
+    glGenTextures(1, &job.textureID);
+    glBindTexture(GL_TEXTURE_2D, job.textureID);
+    glTexStorage2D(GL_TEXTURE_2D, levels, internalFormat, job.width, job.height);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameterf(GL_TEXTURE_2D, GL_TEXTURE_MAX_ANISOTROPY_EXT, 16.0f);
+
+    if (m_Stats.queuedTextures == m_Stats.completedTextures && m_InFlight.empty())
+    {
+        m_FirstQueued = std::chrono::high_resolution_clock::now();
+        m_Stats.uploadedBytes = 0;
+    }
+    ++m_Stats.queuedTextures;
+    m_Stats.pendingBytes += job.pixels.size();
+    m_Queue.push_back(std::move(job));
+    return true;
+}
+
+void TextureUploader::update()
+{
+    PROFILE_SCOPE("Texture upload");
+    auto start = std::chrono::high_resolution_clock::now();
+    m_Ring.retire();
+
+    // Publish textures whose copies and mip generation have finished on the GPU
+    uint64_t completedBatch = m_Ring.getCompletedBatch();
+    auto completed = std::partition(m_InFlight.begin(), m_InFlight.end(),
+        [completedBatch](const InFlight& upload) { return upload.batch > completedBatch; });
+    for (auto it = completed; it != m_InFlight.end(); ++it)
+    {
+        it->texture->m_TextureID = it->textureID;
+        m_Stats.uploadedBytes += it->bytes;
+        ++m_Stats.completedTextures;
+    }
+    bool anyCompleted = completed != m_InFlight.end();
+    m_InFlight.erase(completed, m_InFlight.end());
+    if (anyCompleted)
+    {
+        std::chrono::duration<float> elapsed = std::chrono::high_resolution_clock::now() - m_FirstQueued;
+        m_Stats.throughputMBs = static_cast<float>(m_Stats.uploadedBytes / (1024.0 * 1024.0) / std::max(elapsed.count(), 1e-6f));
+        if (isIdle() && m_Issued.empty())
+        {
+            std::cout << "Uploaded " << m_Stats.completedTextures << " textures, " << m_Stats.uploadedBytes / (1024.0 * 1024.0)
+                      << " MB in " << elapsed.count() * 1000.0f << "ms (" << m_Stats.throughputMBs << " MB/s)" << std::endl;
+        }
+    }
+
+    if (!m_Queue.empty())
+    {
+        size_t budget = m_UploadBytesPerFrame;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Ring.getBuffer());
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        while (!m_Queue.empty() && uploadRows(m_Queue.front(), budget))
+        {
+            Job& job = m_Queue.front();
+            glBindTexture(GL_TEXTURE_2D, job.textureID);
+            glGenerateMipmap(GL_TEXTURE_2D);
+
+            InFlight upload;
+            upload.texture = job.texture;
+            upload.textureID = job.textureID;
+            upload.bytes = job.pixels.size();
+            m_Issued.push_back(upload);
+            m_Queue.pop_front();
+        }
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+
+    uint64_t batch = m_Ring.submit();
+    if (batch != 0)
+    {
+        for (auto& upload : m_Issued)
+        {
+            upload.batch = batch;
+            m_InFlight.push_back(upload);
+        }
+        m_Issued.clear();
+    }
+
+    std::chrono::duration<float, std::milli> cpuTime = std::chrono::high_resolution_clock::now() - start;
+    m_Stats.lastFrameCpuMs = cpuTime.count();
+}
+
+// Copies as many rows as the budget and the ring allow, returns true once the image is complete
+bool TextureUploader::uploadRows(Job& job, size_t& budget)
+{
+    while (job.nextRow < job.height)
+    {
+        size_t ringRows = m_Ring.getCapacity() / 2 / job.rowBytes;
+        size_t rows = std::min<size_t>({ static_cast<size_t>(job.height - job.nextRow), budget / job.rowBytes, std::max<size_t>(ringRows, 1) });
+        if (rows == 0)
+        {
+            return false;
+        }
+
+        size_t bytes = rows * job.rowBytes;
+        size_t offset;
+        unsigned char* destination = m_Ring.allocate(bytes, 4, offset);
+        if (destination == nullptr)
+        {
+            return false;
+        }
+        std::memcpy(destination, job.pixels.data() + job.nextRow * job.rowBytes, bytes);
+
+        glBindTexture(GL_TEXTURE_2D, job.textureID);
+        glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job.nextRow, job.width, static_cast<GLsizei>(rows), job.format, GL_UNSIGNED_BYTE, reinterpret_cast<const void*>(offset));
+
+        job.nextRow += static_cast<int>(rows);
+        budget -= bytes;
+        m_Stats.pendingBytes -= bytes;
+    }
+    return true;
+}
@@ -0,0 +1,72 @@
+#pragma once
+#include <glad/glad.h>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "texture.h"
+#include "uploadRing.h"
+
+struct TextureUploadStats
+{
+    size_t queuedTextures = 0;
+    size_t completedTextures = 0;
+    size_t pendingBytes = 0;         // queued but not yet copied into the ring
+    size_t uploadedBytes = 0;        // copies whose fence has signalled
+    float lastFrameCpuMs = 0.0f;
+    float throughputMBs = 0.0f;      // uploadedBytes over the time from the first queue() to the last completion
+};
+
+// Uploads decoded PNG/JPG textures without stalling the frame loop.
+//
+// queue() allocates immutable storage (glTexStorage2D, full mip chain) and takes the pixels.
+// Each frame, update() copies up to m_UploadBytesPerFrame of rows into the UploadRing and
+// issues glTexSubImage2D from the PBO. Large images go in strips across several frames.
+// Once the last strip is issued, the mip chain is generated on the GPU. The texture is only
+// published in Texture::m_TextureID when the fence of its batch has signalled. Until then,
+// primitives draw with their base color, as they do for textures that are still streaming.
+class TextureUploader
+{
+public:
+    bool init(size_t ringBytes = 64ull * 1024 * 1024);
+    void destroy();
+
+    // Returns false for formats the uploader does not handle, those take the synchronous path
+    bool queue(const std::shared_ptr<Texture>& texture);
+    void update();
+
+    bool isIdle() const { return m_Queue.empty() && m_InFlight.empty(); }
+    const TextureUploadStats& getStats() const { return m_Stats; }
+
+    size_t m_UploadBytesPerFrame = 32ull * 1024 * 1024;
+
+private:
+    struct Job
+    {
+        std::shared_ptr<Texture> texture;
+        GLuint textureID = 0;
+        GLenum format = 0;
+        int width = 0;
+        int height = 0;
+        size_t rowBytes = 0;
+        int nextRow = 0;
+        std::vector<unsigned char> pixels;
+    };
+
+    struct InFlight
+    {
+        std::shared_ptr<Texture> texture;
+        GLuint textureID = 0;
+        size_t bytes = 0;
+        uint64_t batch = 0;
+    };
+
+    bool uploadRows(Job& job, size_t& budget);
+
+    UploadRing m_Ring;
+    std::deque<Job> m_Queue;
+    std::vector<InFlight> m_InFlight;
+    std::vector<InFlight> m_Issued;      // finished this frame, waiting for the batch id
+    std::chrono::high_resolution_clock::time_point m_FirstQueued;
+    TextureUploadStats m_Stats;
+};
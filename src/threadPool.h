@@ -0,0 +1,126 @@
+#pragma once
+#include <thread>
+#include <vector>
+#include <queue>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <future>
+#include <memory>
+#include <atomic>
+#include <algorithm>
+
+// Fixed-size worker pool shared by the CPU-side systems (light binning, texture work, ...)
+class ThreadPool
+{
+public:
+    explicit ThreadPool(size_t threadCount = 0)
+    {
+        if (threadCount == 0)
+        {
+            unsigned int hardwareThreads = std::thread::hardware_concurrency();
+            threadCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+        }
+        for (size_t i = 0; i < threadCount; ++i)
+        {
+            m_Workers.emplace_back([this] { workerLoop(); });
+        }
+    }
+
+    ~ThreadPool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Stopping = true;
+        }
+        m_Condition.notify_all();
+        for (auto& worker : m_Workers)
+        {
+            worker.join();
+        }
+    }
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    size_t size() const
+    {
+        return m_Workers.size();
+    }
+
+    template<typename F>
+    auto submit(F&& function) -> std::future<decltype(function())>
+    {
+        using ReturnType = decltype(function());
+        auto task = std::make_shared<std::packaged_task<ReturnType()>>(std::forward<F>(function));
+        std::future<ReturnType> result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(m_Mutex);
+            m_Tasks.emplace([task] { (*task)(); });
+        }
+        m_Condition.notify_one();
+        return result;
+    }
+
+    // Splits [0, count) into chunks, runs them on the workers and the calling thread, and waits
+    void parallelFor(size_t count, const std::function<void(size_t begin, size_t end)>& function, size_t minChunkSize = 1)
+    {
+        if (count == 0)
+        {
+            return;
+        }
+
+        size_t chunkCount = std::min(size() + 1, (count + minChunkSize - 1) / minChunkSize);
+        size_t chunkSize = (count + chunkCount - 1) / chunkCount;
+        if (chunkCount <= 1)
+        {
+            function(0, count);
+            return;
+        }
+
+        std::vector<std::future<void>> futures;
+        futures.reserve(chunkCount - 1);
+        for (size_t chunk = 1; chunk < chunkCount; ++chunk)
+        {
+            size_t begin = chunk * chunkSize;
+            size_t end = std::min(count, begin + chunkSize);
+            if (begin >= end)
+            {
+                break;
+            }
+            futures.push_back(submit([&function, begin, end] { function(begin, end); }));
+        }
+
+        function(0, std::min(count, chunkSize));
+        for (auto& future : futures)
+        {
+            future.get();
+        }
+    }
+
+private:
+    void workerLoop()
+    {
+        while (true)
+        {
+            std::function<void()> task;
+            {
+                std::unique_lock<std::mutex> lock(m_Mutex);
+                m_Condition.wait(lock, [this] { return m_Stopping || !m_Tasks.empty(); });
+                if (m_Stopping && m_Tasks.empty())
+                {
+                    return;
+                }
+                task = std::move(m_Tasks.front());
+                m_Tasks.pop();
+            }
+            task();
+        }
+    }
+
+    std::vector<std::thread> m_Workers;
+    std::queue<std::function<void()>> m_Tasks;
+    std::mutex m_Mutex;
+    std::condition_variable m_Condition;
+    bool m_Stopping = false;
+};
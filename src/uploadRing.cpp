@@ -0,0 +1,104 @@
+#include "pch.h"
+#include "uploadRing.h"
+
+bool UploadRing::init(size_t capacity)
+{
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glGenBuffers(1, &m_Buffer);
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Buffer);
+    glBufferStorage(GL_PIXEL_UNPACK_BUFFER, capacity, nullptr, flags);
+    m_Mapped = static_cast<unsigned char*>(glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, capacity, flags));
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    if (m_Mapped == nullptr)
+    {
+        std::cerr << "Failed to map the upload ring" << std::endl;
+        glDeleteBuffers(1, &m_Buffer);
+        m_Buffer = 0;
+        return false;
+    }
+    m_Capacity = capacity;
+    return true;
+}
+
+void UploadRing::destroy()
+{
+    for (auto& batch : m_Batches)
+    {
+        glClientWaitSync(batch.fence, GL_SYNC_FLUSH_COMMANDS_BIT, UINT64_MAX);
+        glDeleteSync(batch.fence);
+    }
+    m_Batches.clear();
+    if (m_Buffer)
+    {
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_Buffer);
+        glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        glDeleteBuffers(1, &m_Buffer);
+    }
+    m_Buffer = 0;
+    m_Mapped = nullptr;
+    m_Capacity = m_Head = m_Used = m_Unsubmitted = 0;
+}
+
+unsigned char* UploadRing::allocate(size_t size, size_t alignment, size_t& offset)
+{
+    if (m_Mapped == nullptr || size > m_Capacity)
+    {
+        return nullptr;
+    }
+
+    size_t start = (m_Head + alignment - 1) / alignment * alignment;
+    size_t needed;
+    if (start + size > m_Capacity)
+    {
+        // Skip the end of the ring and wrap around to the start
+        start = 0;
+        needed = m_Capacity - m_Head + size;
+    }
+    else
+    {
+        needed = start - m_Head + size;
+    }
+    if (m_Used + needed > m_Capacity)
+    {
+        return nullptr;
+    }
+
+    m_Head = start + size;
+    m_Used += needed;
+    m_Unsubmitted += needed;
+    offset = start;
+    return m_Mapped + start;
+}
+
+uint64_t UploadRing::submit()
+{
+    if (m_Unsubmitted == 0)
+    {
+        return 0;
+    }
+    Batch batch;
+    batch.id = m_NextBatch++;
+    batch.bytes = m_Unsubmitted;
+    batch.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_Batches.push_back(batch);
+    m_Unsubmitted = 0;
+    return batch.id;
+}
+
+void UploadRing::retire()
+{
+    while (!m_Batches.empty())
+    {
+        Batch& batch = m_Batches.front();
+        GLenum status = glClientWaitSync(batch.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            break;
+        }
+        glDeleteSync(batch.fence);
+        m_Used -= batch.bytes;
+        m_CompletedBatch = batch.id;
+        m_Batches.pop_front();
+    }
+}
@@ -0,0 +1,49 @@
+#pragma once
+#include <glad/glad.h>
+#include <cstddef>
+#include <cstdint>
+#include <deque>
+
+// Persistently mapped GL_PIXEL_UNPACK_BUFFER used as a ring for streaming data to the GPU.
+//
+// Callers write into the pointer returned by allocate() and issue the GL copy that reads it
+// (glTexSubImage*D with the buffer bound, or glCopyBufferSubData). submit() then fences
+// everything allocated since the previous submit. Space is reclaimed in order, as retire()
+// sees those fences signal, so the ring never waits on the GPU: when it is full, allocate()
+// fails and the caller tries again next frame.
+class UploadRing
+{
+public:
+    bool init(size_t capacity);
+    void destroy();
+
+    // Returns nullptr when the space is still being read by the GPU
+    unsigned char* allocate(size_t size, size_t alignment, size_t& offset);
+    // Returns the id of the fenced batch, 0 if nothing was allocated since the last submit
+    uint64_t submit();
+    // Non-blocking, frees every batch whose fence has signalled
+    void retire();
+
+    GLuint getBuffer() const { return m_Buffer; }
+    size_t getCapacity() const { return m_Capacity; }
+    size_t getBytesInFlight() const { return m_Used; }
+    uint64_t getCompletedBatch() const { return m_CompletedBatch; }
+
+private:
+    struct Batch
+    {
+        uint64_t id;
+        size_t bytes;           // including the padding skipped for alignment and wrap-around
+        GLsync fence;
+    };
+
+    GLuint m_Buffer = 0;
+    unsigned char* m_Mapped = nullptr;
+    size_t m_Capacity = 0;
+    size_t m_Head = 0;
+    size_t m_Used = 0;          // bytes allocated and not yet retired
+    size_t m_Unsubmitted = 0;
+    uint64_t m_NextBatch = 1;
+    uint64_t m_CompletedBatch = 0;
+    std::deque<Batch> m_Batches;
+};
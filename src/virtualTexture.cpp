@@ -0,0 +1,726 @@
+#include "pch.h"
+#include "virtualTexture.h"
+#include "cModel.h"
+#include "imageCodec.h"
+#include "ktxLoader.h"
+#include "textureCooker.h"
+#include "profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <unordered_set>
+
+namespace
+{
+    const char PAGE_FILE_MAGIC[4] = { 'V', 'T', 'P', '1' };
+    const size_t PAGE_BYTES = static_cast<size_t>(VirtualTextureSystem::TILE_SIZE) * VirtualTextureSystem::TILE_SIZE * 4;
+
+    uint32_t nextPowerOfTwo(uint32_t value)
+    {
+        uint32_t result = 1;
+        while (result < value)
+        {
+            result <<= 1;
+        }
+        return result;
+    }
+
+    uint32_t log2Exact(uint32_t value)
+    {
+        uint32_t result = 0;
+        while ((1u << result) < value)
+        {
+            ++result;
+        }
+        return result;
+    }
+
+    // Every other bit of a Morton index
+    uint32_t compactBits(uint32_t value)
+    {
+        value &= 0x55555555;
+        value = (value | (value >> 1)) & 0x33333333;
+        value = (value | (value >> 2)) & 0x0F0F0F0F;
+        value = (value | (value >> 4)) & 0x00FF00FF;
+        value = (value | (value >> 8)) & 0x0000FFFF;
+        return value;
+    }
+
+    uint32_t packEntry(uint32_t tileX, uint32_t tileY, uint32_t level)
+    {
+        return tileX | (tileY << 8) | (level << 16) | (1u << 24);
+    }
+}
+
+VirtualTextureSystem::VirtualTextureSystem(ThreadPool& threadPool)
+    : m_ThreadPool(threadPool)
+{
+}
+
+std::string VirtualTextureSystem::getPageFilePath(const std::string& sourcePath)
+{
+    size_t dot = sourcePath.find_last_of('.');
+    size_t slash = sourcePath.find_last_of("/\\");
+    if (dot == std::string::npos || (slash != std::string::npos && dot < slash))
+    {
+        return sourcePath + ".vtpages";
+    }
+    return sourcePath.substr(0, dot) + ".vtpages";
+}
+
+void VirtualTextureSystem::registerModel(cModel& model)
+{
+    // Only color textures go through the virtual path, the shaders sample nothing else yet
+    std::vector<std::shared_ptr<Texture>> textures;
+    std::unordered_set<const Texture*> seen;
+    for (const auto& mesh : model.meshes)
+    {
+        for (const auto& primitive : mesh.primitives)
+        {
+            const std::shared_ptr<Texture>& texture = primitive.m_material.colorTexture;
+            if (!primitive.m_material.hasColorTexture || !texture || !texture->m_Streamed || texture->m_isDDS || texture->m_Virtual)
+            {
+                continue;
+            }
+            if (KTXLoader::isKTX(texture->m_path) || !seen.insert(texture.get()).second)
+            {
+                continue;
+            }
+            textures.push_back(texture);
+        }
+    }
+
+    for (const auto& texture : textures)
+    {
+        ImageInfo info;
+        if (!ImageCodecs::get().readFileInfo(texture->m_path, info))
+        {
+            continue;
+        }
+        Image image;
+        image.texture = texture;
+        image.pagePath = getPageFilePath(texture->m_path);
+        image.regionPages = nextPowerOfTwo(static_cast<uint32_t>((std::max(info.width, info.height) + PAGE_SIZE - 1) / PAGE_SIZE));
+        m_Images.push_back(std::move(image));
+    }
+    if (m_Images.empty())
+    {
+        return;
+    }
+
+    // Halve the largest regions until everything fits into the virtual space
+    auto totalPages = [this]()
+        {
+            uint64_t total = 0;
+            for (const Image& image : m_Images)
+            {
+                total += static_cast<uint64_t>(image.regionPages) * image.regionPages;
+            }
+            return total;
+        };
+    while (totalPages() > static_cast<uint64_t>(MAX_VIRTUAL_PAGES) * MAX_VIRTUAL_PAGES)
+    {
+        uint32_t largest = 0;
+        for (const Image& image : m_Images)
+        {
+            largest = std::max(largest, image.regionPages);
+        }
+        for (Image& image : m_Images)
+        {
+            if (image.regionPages == largest)
+            {
+                image.regionPages /= 2;
+            }
+        }
+    }
+    m_VirtualPages = 1;
+    while (static_cast<uint64_t>(m_VirtualPages) * m_VirtualPages < totalPages())
+    {
+        m_VirtualPages *= 2;
+    }
+    m_VirtualLevels = log2Exact(m_VirtualPages) + 1;
+
+    // Largest first in Morton order keeps every region aligned to its size
+    std::sort(m_Images.begin(), m_Images.end(), [](const Image& a, const Image& b) { return a.regionPages > b.regionPages; });
+    m_PageOwner.assign(static_cast<size_t>(m_VirtualPages) * m_VirtualPages, -1);
+    uint32_t mortonIndex = 0;
+    for (size_t i = 0; i < m_Images.size(); ++i)
+    {
+        Image& image = m_Images[i];
+        image.regionX = compactBits(mortonIndex);
+        image.regionY = compactBits(mortonIndex >> 1);
+        image.levels = log2Exact(image.regionPages) + 1;
+        mortonIndex += image.regionPages * image.regionPages;
+        for (uint32_t y = 0; y < image.regionPages; ++y)
+        {
+            for (uint32_t x = 0; x < image.regionPages; ++x)
+            {
+                m_PageOwner[static_cast<size_t>(image.regionY + y) * m_VirtualPages + image.regionX + x] = static_cast<int>(i);
+            }
+        }
+
+        float scale = 1.0f / m_VirtualPages;
+        image.texture->m_Virtual = true;
+        image.texture->m_VirtualRegion = glm::vec4(image.regionX * scale, image.regionY * scale, image.regionPages * scale, image.regionPages * scale);
+        image.texture->m_VirtualMaxMip = static_cast<float>(image.levels - 1);
+
+        std::string sourcePath = image.texture->m_path;
+        std::string pagePath = image.pagePath;
+        uint32_t regionPages = image.regionPages;
+        image.build = m_ThreadPool.submit([sourcePath, pagePath, regionPages] { return buildPageFile(sourcePath, pagePath, regionPages); });
+    }
+
+    glGenTextures(1, &m_PhysicalTexture);
+    glBindTexture(GL_TEXTURE_2D, m_PhysicalTexture);
+    glTexStorage2D(GL_TEXTURE_2D, 1, GL_RGBA8, PHYSICAL_TILES * TILE_SIZE, PHYSICAL_TILES * TILE_SIZE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+
+    glGenTextures(1, &m_PageTableTexture);
+    glBindTexture(GL_TEXTURE_2D, m_PageTableTexture);
+    glTexStorage2D(GL_TEXTURE_2D, m_VirtualLevels, GL_RGBA8UI, m_VirtualPages, m_VirtualPages);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    m_PageTable.resize(m_VirtualLevels);
+    m_Dirty.resize(m_VirtualLevels);
+    for (uint32_t level = 0; level < m_VirtualLevels; ++level)
+    {
+        uint32_t side = m_VirtualPages >> level;
+        m_PageTable[level].assign(static_cast<size_t>(side) * side, 0);
+        m_Dirty[level] = { 0, 0, side - 1, side - 1 };
+    }
+    uploadPageTable();
+
+    m_Slots.assign(PHYSICAL_TILES * PHYSICAL_TILES, Slot());
+    for (Readback& readback : m_Readbacks)
+    {
+        glGenBuffers(1, &readback.buffer);
+    }
+
+    m_Stats.textureCount = m_Images.size();
+    m_Stats.virtualPages = m_VirtualPages;
+    m_Stats.capacityPages = m_Slots.size();
+    std::cout << "Virtual texturing: " << m_Images.size() << " textures in " << m_VirtualPages << "x" << m_VirtualPages << " pages" << std::endl;
+}
+
+bool VirtualTextureSystem::buildPageFile(const std::string& sourcePath, const std::string& pagePath, uint32_t regionPages)
+{
+    PROFILE_SCOPE("Build page file");
+    if (TextureCooker::isUpToDate(sourcePath, pagePath))
+    {
+        MappedFile existing(pagePath);
+        PageFileHeader header;
+        if (existing.isOpen() && existing.size() >= sizeof(PageFileHeader))
+        {
+            std::memcpy(&header, existing.data(), sizeof(PageFileHeader));
+            if (std::memcmp(header.magic, PAGE_FILE_MAGIC, 4) == 0 && header.pageSize == PAGE_SIZE && header.border == BORDER && header.regionPages == regionPages)
+            {
+                return true;
+            }
+        }
+    }
+
+    std::vector<unsigned char> source;
+    ImageInfo info;
+    if (!ImageCodecs::get().decodeFile(sourcePath, 4, source, info))
+    {
+        std::cerr << "Failed to load image for virtual texturing: " << sourcePath << std::endl;
+        return false;
+    }
+
+    // The region is square, the image is stretched over it and the UVs stay as they are
+    int size = static_cast<int>(regionPages) * PAGE_SIZE;
+    std::vector<unsigned char> level(static_cast<size_t>(size) * size * 4);
+    stbir_resize_uint8_srgb(source.data(), info.width, info.height, 0, level.data(), size, size, 0, STBIR_RGBA);
+    source.clear();
+    source.shrink_to_fit();
+
+    PageFileHeader header;
+    std::memcpy(header.magic, PAGE_FILE_MAGIC, 4);
+    header.pageSize = PAGE_SIZE;
+    header.border = BORDER;
+    header.regionPages = regionPages;
+    header.levels = log2Exact(regionPages) + 1;
+
+    // Written under a temporary name like TextureCooker does
+    std::string temporaryPath = pagePath + ".tmp";
+    {
+        std::ofstream file(temporaryPath, std::ios::binary);
+        if (!file.is_open())
+        {
+            std::cerr << "Failed to open " << temporaryPath << std::endl;
+            return false;
+        }
+        file.write(reinterpret_cast<const char*>(&header), sizeof(PageFileHeader));
+
+        std::vector<unsigned char> page(PAGE_BYTES);
+        for (uint32_t mip = 0; mip < header.levels; ++mip)
+        {
+            int levelSize = size >> mip;
+            if (mip > 0)
+            {
+                std::vector<unsigned char> next(static_cast<size_t>(levelSize) * levelSize * 4);
+                stbir_resize_uint8_srgb(level.data(), levelSize * 2, levelSize * 2, 0, next.data(), levelSize, levelSize, 0, STBIR_RGBA);
+                level.swap(next);
+            }
+
+            // Borders wrap around, glTF samplers repeat by default
+            int pages = levelSize / PAGE_SIZE;
+            for (int pageY = 0; pageY < pages; ++pageY)
+            {
+                for (int pageX = 0; pageX < pages; ++pageX)
+                {
+                    for (int y = 0; y < TILE_SIZE; ++y)
+                    {
+                        int sourceY = (pageY * PAGE_SIZE + y - BORDER + levelSize) % levelSize;
+                        for (int x = 0; x < TILE_SIZE; ++x)
+                        {
+                            int sourceX = (pageX * PAGE_SIZE + x - BORDER + levelSize) % levelSize;
+                            std::memcpy(&page[(static_cast<size_t>(y) * TILE_SIZE + x) * 4], &level[(static_cast<size_t>(sourceY) * levelSize + sourceX) * 4], 4);
+                        }
+                    }
+                    file.write(reinterpret_cast<const char*>(page.data()), page.size());
+                }
+            }
+        }
+        if (!file)
+        {
+            std::cerr << "Failed to write " << temporaryPath << std::endl;
+            return false;
+        }
+    }
+    std::error_code error;
+    std::filesystem::rename(temporaryPath, pagePath, error);
+    return !error;
+}
+
+size_t VirtualTextureSystem::getPageOffset(uint32_t regionPages, uint32_t level, uint32_t x, uint32_t y)
+{
+    size_t pageIndex = 0;
+    for (uint32_t mip = 0; mip < level; ++mip)
+    {
+        size_t side = regionPages >> mip;
+        pageIndex += side * side;
+    }
+    pageIndex += static_cast<size_t>(y) * (regionPages >> level) + x;
+    return sizeof(PageFileHeader) + pageIndex * PAGE_BYTES;
+}
+
+void VirtualTextureSystem::update()
+{
+    PROFILE_SCOPE("Virtual texturing");
+    if (m_Images.empty())
+    {
+        return;
+    }
+    ++m_Frame;
+    collectBuilds();
+    collectPages();
+    readFeedback();
+    uploadPageTable();
+    m_Stats.pendingLoads = m_Pending.size();
+    m_Stats.residentPages = m_Resident.size();
+}
+
+void VirtualTextureSystem::collectBuilds()
+{
+    for (Image& image : m_Images)
+    {
+        if (image.ready || image.failed || image.build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            continue;
+        }
+        image.file = std::make_unique<MappedFile>(image.pagePath);
+        if (!image.build.get() || !image.file->isOpen() || image.file->size() < getPageOffset(image.regionPages, image.levels, 0, 0))
+        {
+            std::cerr << "Virtual texture page file unusable: " << image.pagePath << std::endl;
+            image.file.reset();
+            image.failed = true;
+            continue;
+        }
+        image.ready = true;
+        ++m_Stats.readyTextures;
+    }
+}
+
+void VirtualTextureSystem::collectPages()
+{
+    size_t uploads = 0;
+    glBindTexture(GL_TEXTURE_2D, m_PhysicalTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (auto it = m_Pending.begin(); it != m_Pending.end() && uploads < m_MaxUploadsPerFrame;)
+    {
+        if (it->second.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        {
+            ++it;
+            continue;
+        }
+        int slot = allocateSlot();
+        if (slot < 0)
+        {
+            // Everything resident was requested this frame, try again next frame
+            break;
+        }
+
+        uint32_t key = it->first;
+        std::vector<unsigned char> pixels = it->second.get();
+        it = m_Pending.erase(it);
+
+        int tileX = slot % PHYSICAL_TILES;
+        int tileY = slot / PHYSICAL_TILES;
+        glTexSubImage2D(GL_TEXTURE_2D, 0, tileX * TILE_SIZE, tileY * TILE_SIZE, TILE_SIZE, TILE_SIZE, GL_RGBA, GL_UNSIGNED_BYTE, pixels.data());
+        m_Slots[slot].key = key;
+        m_Slots[slot].lastUsedFrame = m_Frame;
+        m_Resident[key] = slot;
+
+        uint32_t level = key >> 24;
+        uint32_t x = key & 0xFFF;
+        uint32_t y = (key >> 12) & 0xFFF;
+        setEntry(level, x, y, packEntry(tileX, tileY, level));
+        ++uploads;
+        ++m_Stats.uploadedPages;
+    }
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+int VirtualTextureSystem::allocateSlot()
+{
+    int oldest = -1;
+    for (size_t i = 0; i < m_Slots.size(); ++i)
+    {
+        const Slot& slot = m_Slots[i];
+        if (slot.key == INVALID_KEY)
+        {
+            return static_cast<int>(i);
+        }
+        if (slot.lastUsedFrame < m_Frame && (oldest < 0 || slot.lastUsedFrame < m_Slots[oldest].lastUsedFrame))
+        {
+            oldest = static_cast<int>(i);
+        }
+    }
+    if (oldest >= 0)
+    {
+        evict(oldest);
+    }
+    return oldest;
+}
+
+void VirtualTextureSystem::evict(int slot)
+{
+    uint32_t key = m_Slots[slot].key;
+    m_Resident.erase(key);
+    m_Slots[slot].key = INVALID_KEY;
+    ++m_Stats.evictions;
+
+    // The page and everything below it that has no page of its own falls back to the parent
+    uint32_t level = key >> 24;
+    uint32_t x = key & 0xFFF;
+    uint32_t y = (key >> 12) & 0xFFF;
+    uint32_t parentEntry = 0;
+    Image* image = findImage(level, x, y);
+    if (image && level + 1 < image->levels)
+    {
+        parentEntry = m_PageTable[level + 1][static_cast<size_t>(y / 2) * (m_VirtualPages >> (level + 1)) + x / 2];
+    }
+    setEntry(level, x, y, parentEntry);
+}
+
+void VirtualTextureSystem::setEntry(uint32_t level, uint32_t x, uint32_t y, uint32_t entry)
+{
+    uint32_t side = m_VirtualPages >> level;
+    m_PageTable[level][static_cast<size_t>(y) * side + x] = entry;
+    DirtyRect& dirty = m_Dirty[level];
+    dirty.minX = std::min(dirty.minX, x);
+    dirty.minY = std::min(dirty.minY, y);
+    dirty.maxX = std::max(dirty.maxX, x);
+    dirty.maxY = std::max(dirty.maxY, y);
+
+    if (level == 0)
+    {
+        return;
+    }
+    for (uint32_t child = 0; child < 4; ++child)
+    {
+        uint32_t childX = x * 2 + (child & 1);
+        uint32_t childY = y * 2 + (child >> 1);
+        if (!isResident(level - 1, childX, childY))
+        {
+            setEntry(level - 1, childX, childY, entry);
+        }
+    }
+}
+
+bool VirtualTextureSystem::isResident(uint32_t level, uint32_t x, uint32_t y) const
+{
+    return m_Resident.count(makeKey(level, x, y)) != 0;
+}
+
+VirtualTextureSystem::Image* VirtualTextureSystem::findImage(uint32_t level, uint32_t x, uint32_t y)
+{
+    if (level >= m_VirtualLevels || x >= (m_VirtualPages >> level) || y >= (m_VirtualPages >> level))
+    {
+        return nullptr;
+    }
+    int owner = m_PageOwner[static_cast<size_t>(y << level) * m_VirtualPages + (x << level)];
+    if (owner < 0 || level >= m_Images[owner].levels)
+    {
+        return nullptr;
+    }
+    return &m_Images[owner];
+}
+
+void VirtualTextureSystem::readFeedback()
+{
+    for (int i = 0; i < READBACK_COUNT; ++i)
+    {
+        Readback& readback = m_Readbacks[(m_NextReadback + i) % READBACK_COUNT];
+        if (readback.fence == nullptr)
+        {
+            continue;
+        }
+        GLenum status = glClientWaitSync(readback.fence, 0, 0);
+        if (status != GL_ALREADY_SIGNALED && status != GL_CONDITION_SATISFIED)
+        {
+            continue;
+        }
+        glDeleteSync(readback.fence);
+        readback.fence = nullptr;
+
+        size_t count = static_cast<size_t>(readback.width) * readback.height;
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+        const uint32_t* pixels = static_cast<const uint32_t*>(glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, count * sizeof(uint32_t), GL_MAP_READ_BIT));
+        if (pixels)
+        {
+            processFeedback(pixels, count);
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER);
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+}
+
+void VirtualTextureSystem::processFeedback(const uint32_t* pixels, size_t count)
+{
+    PROFILE_SCOPE("VT feedback");
+    std::unordered_set<uint32_t> requested;
+    for (size_t i = 0; i < count; ++i)
+    {
+        // Bit 31 marks a written pixel, the rest is the key
+        if (pixels[i] & 0x80000000u)
+        {
+            requested.insert(pixels[i] & 0x7FFFFFFFu);
+        }
+    }
+    m_Stats.requestedPages = requested.size();
+
+    // Every requested page keeps its ancestors alive too, they are the fallback while it loads
+    std::vector<uint32_t> missing;
+    std::unordered_set<uint32_t> visited;
+    for (uint32_t key : requested)
+    {
+        uint32_t level = key >> 24;
+        uint32_t x = key & 0xFFF;
+        uint32_t y = (key >> 12) & 0xFFF;
+        Image* image = findImage(level, x, y);
+        if (image == nullptr)
+        {
+            continue;
+        }
+        for (; level < image->levels; ++level, x /= 2, y /= 2)
+        {
+            uint32_t pageKey = makeKey(level, x, y);
+            if (!visited.insert(pageKey).second)
+            {
+                break;
+            }
+            auto resident = m_Resident.find(pageKey);
+            if (resident != m_Resident.end())
+            {
+                m_Slots[resident->second].lastUsedFrame = m_Frame;
+            }
+            else if (image->ready && !m_Pending.count(pageKey))
+            {
+                missing.push_back(pageKey);
+            }
+        }
+    }
+
+    // Coarse pages first, they cover the most screen while the fine ones load
+    std::sort(missing.begin(), missing.end(), [](uint32_t a, uint32_t b) { return (a >> 24) > (b >> 24); });
+    for (uint32_t key : missing)
+    {
+        if (m_Pending.size() >= m_MaxPendingLoads)
+        {
+            break;
+        }
+        uint32_t level = key >> 24;
+        uint32_t x = key & 0xFFF;
+        uint32_t y = (key >> 12) & 0xFFF;
+        Image* image = findImage(level, x, y);
+        const unsigned char* page = image->file->data() + getPageOffset(image->regionPages, level, x - (image->regionX >> level), y - (image->regionY >> level));
+        m_Pending[key] = m_ThreadPool.submit([page] { return std::vector<unsigned char>(page, page + PAGE_BYTES); });
+    }
+}
+
+void VirtualTextureSystem::uploadPageTable()
+{
+    glBindTexture(GL_TEXTURE_2D, m_PageTableTexture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+    for (uint32_t level = 0; level < m_VirtualLevels; ++level)
+    {
+        DirtyRect& dirty = m_Dirty[level];
+        if (dirty.minX > dirty.maxX)
+        {
+            continue;
+        }
+        uint32_t side = m_VirtualPages >> level;
+        glPixelStorei(GL_UNPACK_ROW_LENGTH, side);
+        const uint32_t* data = m_PageTable[level].data() + static_cast<size_t>(dirty.minY) * side + dirty.minX;
+        glTexSubImage2D(GL_TEXTURE_2D, level, dirty.minX, dirty.minY, dirty.maxX - dirty.minX + 1, dirty.maxY - dirty.minY + 1, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, data);
+        dirty = DirtyRect();
+    }
+    glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void VirtualTextureSystem::renderFeedback(cModel& model, Shader& feedbackShader, const glm::mat4& view, const glm::mat4& projection, int width, int height)
+{
+    PROFILE_SCOPE("VT feedback pass");
+    Readback& readback = m_Readbacks[m_NextReadback];
+    if (m_Images.empty() || readback.fence != nullptr)
+    {
+        // All readbacks still in flight, the GPU is behind
+        return;
+    }
+
+    GLint previousFramebuffer = 0;
+    glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &previousFramebuffer);
+    int feedbackWidth = std::max(1, width / FEEDBACK_DIVISOR);
+    int feedbackHeight = std::max(1, height / FEEDBACK_DIVISOR);
+    if (feedbackWidth != m_FeedbackWidth || feedbackHeight != m_FeedbackHeight)
+    {
+        if (m_FeedbackFbo == 0)
+        {
+            glGenFramebuffers(1, &m_FeedbackFbo);
+        }
+        glDeleteTextures(1, &m_FeedbackTexture);
+        glDeleteRenderbuffers(1, &m_FeedbackDepth);
+        glGenTextures(1, &m_FeedbackTexture);
+        glBindTexture(GL_TEXTURE_2D, m_FeedbackTexture);
+        glTexStorage2D(GL_TEXTURE_2D, 1, GL_R32UI, feedbackWidth, feedbackHeight);
+        glBindTexture(GL_TEXTURE_2D, 0);
+        glGenRenderbuffers(1, &m_FeedbackDepth);
+        glBindRenderbuffer(GL_RENDERBUFFER, m_FeedbackDepth);
+        glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, feedbackWidth, feedbackHeight);
+        glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+        glBindFramebuffer(GL_FRAMEBUFFER, m_FeedbackFbo);
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, m_FeedbackTexture, 0);
+        glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, m_FeedbackDepth);
+        if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+        {
+            std::cerr << "Virtual texture feedback framebuffer is incomplete" << std::endl;
+        }
+        m_FeedbackWidth = feedbackWidth;
+        m_FeedbackHeight = feedbackHeight;
+    }
+
+    GLint viewport[4];
+    glGetIntegerv(GL_VIEWPORT, viewport);
+    glBindFramebuffer(GL_FRAMEBUFFER, m_FeedbackFbo);
+    glViewport(0, 0, m_FeedbackWidth, m_FeedbackHeight);
+    const GLuint clearValue[4] = { 0, 0, 0, 0 };
+    glClearBufferuiv(GL_COLOR, 0, clearValue);
+    glClear(GL_DEPTH_BUFFER_BIT);
+
+    // Derivatives are FEEDBACK_DIVISOR times larger than on screen
+    feedbackShader.use();
+    feedbackShader.setMat4("projection", projection);
+    feedbackShader.setMat4("view", view);
+    feedbackShader.setVec4("uVTParams", glm::vec4(static_cast<float>(m_VirtualPages), PAGE_SIZE, BORDER, PHYSICAL_TILES));
+    feedbackShader.setFloat("uVTMipBias", m_MipBias - std::log2(static_cast<float>(FEEDBACK_DIVISOR)));
+    model.Draw(feedbackShader, false);
+
+    size_t bytes = static_cast<size_t>(m_FeedbackWidth) * m_FeedbackHeight * sizeof(uint32_t);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, readback.buffer);
+    if (readback.width != m_FeedbackWidth || readback.height != m_FeedbackHeight)
+    {
+        glBufferData(GL_PIXEL_PACK_BUFFER, bytes, nullptr, GL_STREAM_READ);
+        readback.width = m_FeedbackWidth;
+        readback.height = m_FeedbackHeight;
+    }
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+    glReadPixels(0, 0, m_FeedbackWidth, m_FeedbackHeight, GL_RED_INTEGER, GL_UNSIGNED_INT, nullptr);
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    readback.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+    m_NextReadback = (m_NextReadback + 1) % READBACK_COUNT;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, previousFramebuffer);
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+}
+
+void VirtualTextureSystem::bind(Shader& shader, bool enabled)
+{
+    // Always set, samplers of different types must not share a unit even when unused
+    shader.setInt("uVTPageTable", PAGE_TABLE_UNIT);
+    shader.setInt("uVTPhysical", PHYSICAL_UNIT);
+    if (!enabled || m_Images.empty())
+    {
+        return;
+    }
+    shader.setVec4("uVTParams", glm::vec4(static_cast<float>(m_VirtualPages), PAGE_SIZE, BORDER, PHYSICAL_TILES));
+    shader.setFloat("uVTMipBias", m_MipBias);
+
+    glActiveTexture(GL_TEXTURE0 + PAGE_TABLE_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_PageTableTexture);
+    glActiveTexture(GL_TEXTURE0 + PHYSICAL_UNIT);
+    glBindTexture(GL_TEXTURE_2D, m_PhysicalTexture);
+    glActiveTexture(GL_TEXTURE0);
+}
+
+void VirtualTextureSystem::destroy()
+{
+    for (Image& image : m_Images)
+    {
+        if (image.build.valid())
+        {
+            image.build.wait();
+        }
+        image.texture->m_Virtual = false;
+    }
+    for (auto& pending : m_Pending)
+    {
+        pending.second.wait();
+    }
+    m_Pending.clear();
+    m_Images.clear();
+
+    for (Readback& readback : m_Readbacks)
+    {
+        if (readback.fence)
+        {
+            glDeleteSync(readback.fence);
+        }
+        glDeleteBuffers(1, &readback.buffer);
+        readback = Readback();
+    }
+    glDeleteTextures(1, &m_PhysicalTexture);
+    glDeleteTextures(1, &m_PageTableTexture);
+    glDeleteTextures(1, &m_FeedbackTexture);
+    glDeleteRenderbuffers(1, &m_FeedbackDepth);
+    glDeleteFramebuffers(1, &m_FeedbackFbo);
+    m_PhysicalTexture = m_PageTableTexture = m_FeedbackTexture = m_FeedbackDepth = m_FeedbackFbo = 0;
+    m_FeedbackWidth = m_FeedbackHeight = 0;
+    m_Resident.clear();
+    m_Slots.clear();
+    m_PageTable.clear();
+    m_Dirty.clear();
+    m_PageOwner.clear();
+    m_Stats = VirtualTextureStats();
+}
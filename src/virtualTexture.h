@@ -0,0 +1,163 @@
+#pragma once
+#include <glad/glad.h>
+#include <glm/glm.hpp>
+#include <future>
+#include <memory>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "texture.h"
+#include "threadPool.h"
+#include "shader.h"
+#include "mappedFile.h"
+
+class cModel;
+
+struct VirtualTextureStats
+{
+    size_t textureCount = 0;
+    size_t readyTextures = 0;       // page file built and mapped
+    uint32_t virtualPages = 0;      // pages per side of the virtual space at mip 0
+    size_t residentPages = 0;
+    size_t capacityPages = 0;
+    size_t requestedPages = 0;      // distinct pages in the last feedback readback
+    size_t pendingLoads = 0;
+    size_t uploadedPages = 0;       // total since start
+    size_t evictions = 0;
+};
+
+// Sparse virtual texturing for the color textures of a cModel loaded with streamTextures = true.
+//
+// Every texture gets a square, power of two region of PAGE_SIZE pages in one virtual
+// space. Regions are handed out largest first in Morton order, so each one is aligned to
+// its own size and stays page aligned at every mip. A worker tiles the source image once
+// into a .vtpages file next to it. The file holds every mip level cut into pages with a
+// BORDER texel apron for bilinear filtering. The image is resampled to the square region
+// on the way in.
+//
+// Pages live in one physical cache texture of PHYSICAL_TILES^2 tiles, so VRAM use does not
+// depend on the texture count. The page table is an RGBA8UI texture with a mip per virtual
+// mip level. Each texel holds the physical tile and mip of the finest resident page that
+// covers it. A low resolution pass renders the page every pixel wants into an R32UI
+// target. It is read back through a PBO ring a couple of frames later without stalling.
+// The missing pages are read from the mapped page files on the thread pool, coarse levels
+// first. The least recently requested tiles are recycled for them.
+class VirtualTextureSystem
+{
+public:
+    static const int PAGE_SIZE = 128;
+    static const int BORDER = 1;
+    static const int TILE_SIZE = PAGE_SIZE + 2 * BORDER;
+    static const int PHYSICAL_TILES = 32;          // per side, 4160^2 RGBA8 = 66 MB
+    static const uint32_t MAX_VIRTUAL_PAGES = 1024; // per side, 128K^2 virtual texels
+    static const int FEEDBACK_DIVISOR = 8;
+    static const GLuint PAGE_TABLE_UNIT = 6;
+    static const GLuint PHYSICAL_UNIT = 7;
+
+    explicit VirtualTextureSystem(ThreadPool& threadPool);
+
+    // Takes over the streamed PNG/JPG color textures, call before TextureStreamer::registerModel
+    void registerModel(cModel& model);
+    // Uploads finished pages, reads back feedback and requests what is missing
+    void update();
+    void renderFeedback(cModel& model, Shader& feedbackShader, const glm::mat4& view, const glm::mat4& projection, int width, int height);
+    // Sets the samplers and page table constants, call for every shader declaring uVTPageTable
+    void bind(Shader& shader, bool enabled);
+    void destroy();
+
+    const VirtualTextureStats& getStats() const { return m_Stats; }
+    static std::string getPageFilePath(const std::string& sourcePath);
+
+    size_t m_MaxUploadsPerFrame = 32;
+    size_t m_MaxPendingLoads = 64;
+    float m_MipBias = 0.0f;
+
+private:
+    struct PageFileHeader
+    {
+        char magic[4];
+        uint32_t pageSize;
+        uint32_t border;
+        uint32_t regionPages;
+        uint32_t levels;
+    };
+
+    struct Image
+    {
+        std::shared_ptr<Texture> texture;
+        std::string pagePath;
+        uint32_t regionX = 0;       // in mip 0 pages
+        uint32_t regionY = 0;
+        uint32_t regionPages = 1;
+        uint32_t levels = 1;
+        std::future<bool> build;
+        std::unique_ptr<MappedFile> file;
+        bool ready = false;
+        bool failed = false;
+    };
+
+    struct Slot
+    {
+        uint32_t key = INVALID_KEY;
+        uint64_t lastUsedFrame = 0;
+    };
+
+    struct DirtyRect
+    {
+        uint32_t minX = UINT32_MAX;
+        uint32_t minY = UINT32_MAX;
+        uint32_t maxX = 0;
+        uint32_t maxY = 0;
+    };
+
+    struct Readback
+    {
+        GLuint buffer = 0;
+        GLsync fence = nullptr;
+        int width = 0;
+        int height = 0;
+    };
+
+    static const uint32_t INVALID_KEY = 0xFFFFFFFF;
+    static const int READBACK_COUNT = 3;
+
+    static uint32_t makeKey(uint32_t level, uint32_t x, uint32_t y) { return (level << 24) | (y << 12) | x; }
+    static bool buildPageFile(const std::string& sourcePath, const std::string& pagePath, uint32_t regionPages);
+    static size_t getPageOffset(uint32_t regionPages, uint32_t level, uint32_t x, uint32_t y);
+
+    void collectBuilds();
+    void collectPages();
+    void readFeedback();
+    void processFeedback(const uint32_t* pixels, size_t count);
+    int allocateSlot();
+    void evict(int slot);
+    void setEntry(uint32_t level, uint32_t x, uint32_t y, uint32_t entry);
+    bool isResident(uint32_t level, uint32_t x, uint32_t y) const;
+    Image* findImage(uint32_t level, uint32_t x, uint32_t y);
+    void uploadPageTable();
+
+    ThreadPool& m_ThreadPool;
+    std::vector<Image> m_Images;
+    std::vector<int> m_PageOwner;   // image index per mip 0 virtual page, -1 for unused space
+    uint32_t m_VirtualPages = 0;
+    uint32_t m_VirtualLevels = 0;
+
+    std::vector<Slot> m_Slots;
+    std::unordered_map<uint32_t, int> m_Resident;   // key -> slot
+    std::unordered_map<uint32_t, std::future<std::vector<unsigned char>>> m_Pending;
+    std::vector<std::vector<uint32_t>> m_PageTable; // CPU copy, one vector per level
+    std::vector<DirtyRect> m_Dirty;
+
+    GLuint m_PhysicalTexture = 0;
+    GLuint m_PageTableTexture = 0;
+    GLuint m_FeedbackFbo = 0;
+    GLuint m_FeedbackTexture = 0;
+    GLuint m_FeedbackDepth = 0;
+    int m_FeedbackWidth = 0;
+    int m_FeedbackHeight = 0;
+    Readback m_Readbacks[READBACK_COUNT];
+    int m_NextReadback = 0;
+
+    uint64_t m_Frame = 0;
+    VirtualTextureStats m_Stats;
+};
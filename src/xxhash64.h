@@ -0,0 +1,106 @@
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <cstring>
+
+// XXH64 (https://github.com/Cyan4973/xxHash), used to key content caches. Non-cryptographic:
+// fast enough to hash every embedded image on load, with collisions unlikely enough to use
+// the 64-bit value as the identity of a byte stream.
+namespace xxhash64
+{
+    const uint64_t PRIME1 = 0x9E3779B185EBCA87ull;
+    const uint64_t PRIME2 = 0xC2B2AE3D27D4EB4Full;
+    const uint64_t PRIME3 = 0x165667B19E3779F9ull;
+    const uint64_t PRIME4 = 0x85EBCA77C2B2AE63ull;
+    const uint64_t PRIME5 = 0x27D4EB2F165667C5ull;
+
+    inline uint64_t rotl(uint64_t value, int bits)
+    {
+        return (value << bits) | (value >> (64 - bits));
+    }
+
+    inline uint64_t read64(const unsigned char* data)
+    {
+        uint64_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint32_t read32(const unsigned char* data)
+    {
+        uint32_t value;
+        std::memcpy(&value, data, sizeof(value));
+        return value;
+    }
+
+    inline uint64_t round(uint64_t accumulator, uint64_t input)
+    {
+        accumulator += input * PRIME2;
+        return rotl(accumulator, 31) * PRIME1;
+    }
+
+    inline uint64_t mergeRound(uint64_t hash, uint64_t value)
+    {
+        hash ^= round(0, value);
+        return hash * PRIME1 + PRIME4;
+    }
+
+    inline uint64_t hash(const void* input, size_t length, uint64_t seed = 0)
+    {
+        const unsigned char* data = static_cast<const unsigned char*>(input);
+        const unsigned char* end = data + length;
+        uint64_t result;
+
+        if (length >= 32)
+        {
+            uint64_t v1 = seed + PRIME1 + PRIME2;
+            uint64_t v2 = seed + PRIME2;
+            uint64_t v3 = seed;
+            uint64_t v4 = seed - PRIME1;
+            const unsigned char* limit = end - 32;
+            do
+            {
+                v1 = round(v1, read64(data));
+                v2 = round(v2, read64(data + 8));
+                v3 = round(v3, read64(data + 16));
+                v4 = round(v4, read64(data + 24));
+                data += 32;
+            } while (data <= limit);
+
+            result = rotl(v1, 1) + rotl(v2, 7) + rotl(v3, 12) + rotl(v4, 18);
+            result = mergeRound(result, v1);
+            result = mergeRound(result, v2);
+            result = mergeRound(result, v3);
+            result = mergeRound(result, v4);
+        }
+        else
+        {
+            result = seed + PRIME5;
+        }
+        result += static_cast<uint64_t>(length);
+
+        for (; data + 8 <= end; data += 8)
+        {
+            result ^= round(0, read64(data));
+            result = rotl(result, 27) * PRIME1 + PRIME4;
+        }
+        if (data + 4 <= end)
+        {
+            result ^= static_cast<uint64_t>(read32(data)) * PRIME1;
+            result = rotl(result, 23) * PRIME2 + PRIME3;
+            data += 4;
+        }
+        for (; data < end; ++data)
+        {
+            result ^= (*data) * PRIME5;
+            result = rotl(result, 11) * PRIME1;
+        }
+
+        result ^= result >> 33;
+        result *= PRIME2;
+        result ^= result >> 29;
+        result *= PRIME3;
+        result ^= result >> 32;
+        return result;
+    }
+}